@@ -11,34 +11,21 @@ IPlugConvoEngine::IPlugConvoEngine(const InstanceInfo& info)
 #if IPLUG_DSP
 void IPlugConvoEngine::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-  sample* inputL = inputs[0];
-  sample* outputL = outputs[0];
+  const int nChans = NOutChansConnected();
+  sample* wet[2] = { mWet.Get(), mWet.Get() + nFrames };
   
-  mEngine.Add(inputs, nFrames, 1);
-
-  int nAvailableSamples = std::min(mEngine.Avail(nFrames), nFrames);
+  // unconnected inputs are silent
+  mEngine.ProcessBlock(inputs, wet, nFrames);
 
   const sample dryGain = GetParam(kParamDry)->Value();
   const sample wetGain = GetParam(kParamWet)->Value();
 
-  // If not enough samples are available yet, then only output the dry signal
-  for (auto i = 0; i < nFrames - nAvailableSamples; ++i)
-  {
-    *outputL++ = dryGain * *inputL++;
-  }
-
-  // Output samples from the convolution engine
-  if (nAvailableSamples > 0)
+  for (int c = 0; c < nChans; c++)
   {
-    // Apply the dry/wet mix
-    WDL_FFT_REAL* pWetSignal = mEngine.Get()[0];
-    for (auto i = 0; i < nAvailableSamples; ++i)
+    for (int i = 0; i < nFrames; i++)
     {
-      *outputL++ = dryGain * *inputL++ + wetGain * *pWetSignal++;
+      outputs[c][i] = dryGain * inputs[c][i] + wetGain * wet[c][i];
     }
-
-    // Remove the sample block from the convolution engine's buffer
-    mEngine.Advance(nAvailableSamples);
   }
 }
 
@@ -66,11 +53,15 @@ void IPlugConvoEngine::OnReset()
       Resample(mIR, irLength, irSampleRate, mImpulse.impulses[0].Get(), len, mSampleRate);
     }
     
-    // Tie the impulse response to the convolution engine.
-    mEngine.SetImpulse(&mImpulse);
+    // Route the impulse response L->L and R->R. A true stereo impulse set would also fill the L->R and R->L routes.
+    const WDL_FFT_REAL* matrix[4] = { mImpulse.impulses[0].Get(), nullptr, nullptr, mImpulse.impulses[0].Get() };
+    mEngine.SetImpulses(2, 2, matrix, len, mConvolverHeadLength);
     
     SetLatency(mEngine.GetLatency());
   }
+  
+  mWet.Resize(GetBlockSize() * 2);
+  mEngine.Reset();
 }
 
 template <class I, class O>
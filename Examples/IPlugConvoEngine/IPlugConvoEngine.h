@@ -10,6 +10,7 @@
 #endif
 
 #include "convoengine.h"
+#include "ZeroLatencyConvolver.h"
 
 #if defined USE_WDL_RESAMPLER
   #include "resample.h"
@@ -49,10 +50,12 @@ private:
   static const float mIR[512];
 
   WDL_ImpulseBuffer mImpulse;
-//  WDL_ConvolutionEngine_Div mEngine; // < low latency version
-  WDL_ConvolutionEngine mEngine;
+  // 2x2 true stereo routing with no latency: the head of the impulse is convolved in the time domain
+  ZeroLatencyConvolver mEngine;
+  WDL_TypedBuf<sample> mWet;
   
   static constexpr int mBlockLength = 64;
+  static constexpr int mConvolverHeadLength = 128;
 
   #if defined USE_WDL_RESAMPLER
   WDL_Resampler mResampler;
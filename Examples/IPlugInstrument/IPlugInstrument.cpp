@@ -1,6 +1,7 @@
 #include "IPlugInstrument.h"
 #include "IPlug_include_in_plug_src.h"
 #include "LFO.h"
+#include "IVVoiceStateControl.h"
 
 IPlugInstrument::IPlugInstrument(const InstanceInfo& info)
 : Plugin(info, MakeConfig(kNumParams, kNumPresets))
@@ -60,6 +61,7 @@ IPlugInstrument::IPlugInstrument(const InstanceInfo& info)
     pGraphics->AttachControl(new IVDisplayControl(lfoPanel.GetGridCell(1, 1, 2, 3).Union(lfoPanel.GetGridCell(1, 2, 2, 3)), "", DEFAULT_STYLE, EDirection::Horizontal, 0.f, 1.f, 0.f, 1024), kCtrlTagLFOVis, "LFO");
     
     pGraphics->AttachControl(new IVGroupControl("LFO", "LFO", 10.f, 20.f, 10.f, 10.f));
+    pGraphics->AttachControl(new IVVoiceStateControl(lfoPanel.GetVShifted(230.f).GetFromTop(90.f), "", DEFAULT_STYLE.WithShowLabel(false).WithColor(kBG, COLOR_BLACK)), kCtrlTagVoiceStates);
     
     pGraphics->AttachControl(new IVButtonControl(keyboardBounds.GetFromTRHC(200, 30).GetTranslated(0, -30), SplashClickActionFunc,
       "Show/Hide Keyboard", DEFAULT_STYLE.WithColor(kFG, COLOR_WHITE).WithLabelText({15.f, EVAlign::Middle})))->SetAnimationEndActionFunction(
@@ -97,6 +99,9 @@ void IPlugInstrument::OnIdle()
 {
   mMeterSender.TransmitData(*this);
   mLFOVisSender.TransmitData(*this);
+
+  if (mDSP.mSynth.ConsumeVoiceStates())
+    SendControlMsgFromDelegate(kCtrlTagVoiceStates, IVVoiceStateControl::kUpdateMessage, sizeof(VoiceStates), &mDSP.mSynth.GetVoiceStates());
 }
 
 void IPlugInstrument::OnReset()
@@ -34,6 +34,7 @@ enum EControlTags
   kCtrlTagRTText,
   kCtrlTagKeyboard,
   kCtrlTagBender,
+  kCtrlTagVoiceStates,
   kNumCtrlTags
 };
 
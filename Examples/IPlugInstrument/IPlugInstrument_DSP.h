@@ -50,6 +50,16 @@ public:
       mAMPEnv.Release();
     }
 
+    void Retire() override
+    {
+      mAMPEnv.Kill(true);
+    }
+
+    int GetEnvelopeStage() const override
+    {
+      return mAMPEnv.GetStage();
+    }
+
     void ProcessSamplesAccumulating(T** inputs, T** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) override
     {
       // inputs to the synthesizer can just fetch a value every block, like this:
@@ -122,9 +132,15 @@ public:
       mSynth.AddVoice(new Voice(), 0);
     }
 
+    // publish the voices' states for the IVVoiceStateControl
+    mSynth.SetVoiceStatesEnabled(true);
+
     // some MidiSynth API examples:
     // mSynth.SetKeyToPitchFn([](int k){return (k - 69.)/24.;}); // quarter-tone scale
+    // mSynth.SetTuning(table, 0.1); // a TuningTable filled by ScalaTuning from .scl/.kbm files, retuning held notes over 100ms
     // mSynth.SetNoteGlideTime(0.5); // portamento
+    // mSynth.SetUnison(7, 25.f, 0.8f); // unison stacks, render the layers with UnisonOscillator
+    // mSynth.SetSilenceCulling(VoiceAllocator::kSilenceCullingRetire); // stop processing release tails once they are below -90dB
   }
 
   void ProcessBlock(T** inputs, T** outputs, int nOutputs, int nFrames, double qnPos = 0., bool transportIsRunning = false, double tempo = 120.)
@@ -22,6 +22,17 @@ IPlugOSCEditor::IPlugOSCEditor(const InstanceInfo& info)
   OSCReceiver::SetLogFunc(logFunc);
   OSCSender::SetLogFunc(logFunc);
 
+  // /param/Gain and /param/0 set the gain parameter
+  mRouter.AddParamRoutes(*this);
+  
+  mRouter.AddRoute("/gain", [&](OscMessageRead& msg) {
+    IGraphics* pGraphics = GetUI();
+    auto* pValue = msg.PopFloatArg(true);
+    
+    if (pValue && pGraphics)
+      pGraphics->GetControlWithTag(kCtrlTagGain)->SetValueFromDelegate(*pValue);
+  });
+
 #if IPLUG_EDITOR // http://bit.ly/2S64BDd
   mMakeGraphicsFunc = [&]() {
     return MakeGraphics(*this, PLUG_WIDTH, PLUG_HEIGHT, PLUG_FPS, GetScaleForScreen(PLUG_WIDTH, PLUG_HEIGHT));
@@ -88,14 +99,7 @@ void IPlugOSCEditor::OnOSCMessage(OscMessageRead& msg)
 
   IGraphics* pGraphics = GetUI();
 
-  if(strcmp(msg.GetMessage(), "/gain") == 0)
-  {
-    auto* pValue = msg.PopFloatArg(true);
-    if (pValue) {
-      if(pGraphics)
-        pGraphics->GetControlWithTag(kCtrlTagGain)->SetValueFromDelegate(*pValue);
-    }
-  }
+  mRouter.Dispatch(msg);
 
   WDL_String oscStr;
 
@@ -143,3 +147,14 @@ void IPlugOSCEditor::OnOSCMessage(OscMessageRead& msg)
     }
   }
 }
+
+void IPlugOSCEditor::OnParamChangeUI(int paramIdx, EParamSource source)
+{
+  mRouter.MarkParamChanged(paramIdx);
+}
+
+void IPlugOSCEditor::OnIdle()
+{
+  // send the parameters that changed, once each
+  mRouter.SendChangedParams([&](OscMessageWrite& msg) { SendOSCMessage(msg); });
+}
@@ -2,6 +2,7 @@
 
 #include "IPlug_include_in_plug_hdr.h"
 #include "IPlugOSC.h"
+#include "IPlugOSCRouter.h"
 
 const int kNumPresets = 1;
 
@@ -31,4 +32,9 @@ public:
   void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override;
   
   void OnOSCMessage(OscMessageRead& msg) override;
+  void OnParamChangeUI(int paramIdx, EParamSource source) override;
+  void OnIdle() override;
+
+private:
+  OSCRouter mRouter;
 };
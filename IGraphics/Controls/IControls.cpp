@@ -1683,7 +1683,7 @@ void IBMeterControl::OnMsgFromDelegate(int msgTag, int dataSize, const void* pDa
       for (auto c = d.chanOffset; c < (d.chanOffset + d.nChans); c++)
       {
         auto avg = d.vals[c].second;
-        auto ampValue = AmpToDB(avg);
+        auto ampValue = FastMath::AmpToDB<EMathAccuracy::Fast>(static_cast<double>(avg));
         auto linearPos = (ampValue + lowPointAbs)/rangeDB;
         SetValue(Clip(linearPos, 0., 1.), c);
       }
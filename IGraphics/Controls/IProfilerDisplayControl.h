@@ -0,0 +1,130 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @ingroup SpecialControls
+ * @copydoc IProfilerDisplayControl
+ */
+
+#include "IControl.h"
+#include "IGraphicsProfiler.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** Overlay showing the statistics collected by IGraphicsProfiler: a frame time graph, p50/p99 times of each frame stage,
+ * and the control types with the highest p99 draw times.
+ * This is a special control that lives outside the main IGraphics control stack.
+ * @ingroup SpecialControls */
+class IProfilerDisplayControl : public IControl
+                              , public IVectorBase
+{
+private:
+  static constexpr int MAXBUF = 100;
+  static constexpr int kMaxControlTypesShown = 8;
+  static constexpr float kRowHeight = 14.f;
+public:
+  IProfilerDisplayControl(const IRECT& bounds, const char* label = "Draw Profiler")
+  : IControl(bounds)
+  , IVectorBase(DEFAULT_STYLE)
+  {
+    AttachIControl(this, label);
+
+    SetColor(kBG, COLOR_WHITE.WithOpacity(0.9f));
+    mText = IText(12, GetColor(kFR), DEFAULT_FONT, EAlign::Near, EVAlign::Middle);
+  }
+
+  bool IsDirty() override
+  {
+    return true;
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    const IGraphicsProfiler* pProfiler = g.GetProfiler();
+
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    if (!pProfiler)
+      return;
+
+    IRECT padded = mRECT.GetPadded(-4);
+
+    // frame time graph, 0-20 ms
+    mReadPos = (mReadPos + 1) % MAXBUF;
+    mBuffer[mReadPos] = static_cast<float>(Clip(pProfiler->GetFrameTime().GetPercentile(50.) * 50., 0., 1.));
+
+    for (int i = 0; i < MAXBUF; i++)
+      mOrderedBuffer[i] = mBuffer[(mReadPos + 1 + i) % MAXBUF];
+
+    IRECT graphBounds = padded.ReduceFromTop(40.f);
+    g.DrawData(GetColor(kFG), graphBounds, mOrderedBuffer, MAXBUF, nullptr, nullptr, 1.f);
+    g.DrawText(mText.WithVAlign(EVAlign::Top), mLabelStr.Get(), graphBounds);
+
+    WDL_String str;
+    double slowestTime;
+    const char* slowest = pProfiler->GetLastSlowestControlType(slowestTime);
+    str.SetFormatted(256, "Slowest: %s %.1f us", slowest ? slowest : "-", slowestTime * 1e6);
+    g.DrawText(mText, str.Get(), padded.ReduceFromTop(kRowHeight));
+
+    auto drawRow = [&](const char* name, const IGraphicsProfiler::Histogram& h) {
+      IRECT row = padded.ReduceFromTop(kRowHeight);
+      str.SetFormatted(256, "%.1f / %.1f", h.GetPercentile(50.) * 1e6, h.GetPercentile(99.) * 1e6);
+      g.DrawText(mText, name, row);
+      g.DrawText(mText.WithAlign(EAlign::Far), str.Get(), row);
+    };
+
+    IRECT header = padded.ReduceFromTop(kRowHeight);
+    g.DrawText(mText.WithAlign(EAlign::Far), "p50 / p99 (us)", header);
+    drawRow("Frame", pProfiler->GetFrameTime());
+
+    for (int s = 0; s < IGraphicsProfiler::kNumStages; s++)
+    {
+      const auto stage = static_cast<IGraphicsProfiler::EStage>(s);
+      drawRow(IGraphicsProfiler::GetStageName(stage), pProfiler->GetStageTime(stage));
+    }
+
+    // the control types with the highest p99 times
+    const IGraphicsProfiler::ControlTypeStats* shown[kMaxControlTypesShown] = {};
+    int nShown = 0;
+
+    pProfiler->ForEachControlType([&](const IGraphicsProfiler::ControlTypeStats& stats) {
+      const double p99 = stats.drawTime.GetPercentile(99.);
+      int pos = nShown;
+
+      while (pos > 0 && shown[pos - 1]->drawTime.GetPercentile(99.) < p99)
+        pos--;
+
+      if (pos < kMaxControlTypesShown)
+      {
+        for (int i = std::min(nShown, kMaxControlTypesShown - 1); i > pos; i--)
+          shown[i] = shown[i - 1];
+
+        shown[pos] = &stats;
+        nShown = std::min(nShown + 1, kMaxControlTypesShown);
+      }
+    });
+
+    for (int i = 0; i < nShown; i++)
+      drawRow(shown[i]->name.Get(), shown[i]->drawTime);
+  }
+
+private:
+  float mBuffer[MAXBUF] = {};
+  float mOrderedBuffer[MAXBUF] = {};
+  int mReadPos = 0;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
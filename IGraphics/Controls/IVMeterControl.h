@@ -19,6 +19,7 @@
 #include "IControl.h"
 #include "ISender.h"
 #include "IPlugStructs.h"
+#include "FastMath.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
@@ -114,9 +115,11 @@ public:
       {
         auto lowPointAbs = std::fabs(mLowRangeDB);
         auto rangeDB = std::fabs(mHighRangeDB - mLowRangeDB);
+        std::array<float, MAXNC> dBValues;
+        FastMath::AmpToDB<EMathAccuracy::Fast>(d.vals.data() + d.chanOffset, dBValues.data() + d.chanOffset, d.nChans);
         for (auto c = d.chanOffset; c < (d.chanOffset + d.nChans); c++)
         {
-          auto ampValue = AmpToDB(static_cast<double>(d.vals[c]));
+          auto ampValue = static_cast<double>(dBValues[c]);
           auto linearPos = (ampValue + lowPointAbs)/rangeDB;
           SetValue(Clip(linearPos, 0., 1.), c);
         }
@@ -203,10 +206,19 @@ public:
       double lowPointAbs = std::fabs(lowRangeDB);
       double rangeDB = std::fabs(highRangeDB - lowRangeDB);
       
+      // peaks then averages, converted in one block
+      std::array<float, MAXNC * 2> dBValues;
+      for (auto i = 0; i < d.nChans; i++)
+      {
+        dBValues[i] = std::get<0>(d.vals[d.chanOffset + i]);
+        dBValues[d.nChans + i] = std::get<1>(d.vals[d.chanOffset + i]);
+      }
+      FastMath::AmpToDB<EMathAccuracy::Fast>(dBValues.data(), dBValues.data(), d.nChans * 2);
+
       for (auto c = d.chanOffset; c < (d.chanOffset + d.nChans); c++)
       {
-        double peakValue = AmpToDB(static_cast<double>(std::get<0>(d.vals[c])));
-        double avgValue = AmpToDB(static_cast<double>(std::get<1>(d.vals[c])));
+        double peakValue = dBValues[c - d.chanOffset];
+        double avgValue = dBValues[d.nChans + c - d.chanOffset];
         double linearPeakPos = (peakValue + lowPointAbs)/rangeDB;
         double linearAvgPos = (avgValue + lowPointAbs)/rangeDB;
 
@@ -15,20 +15,35 @@
  * @copydoc IVMultiSliderControl
  */
 
+#include <atomic>
+
 #include "IControl.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
 /** A vectorial multi-slider control
+ * For high track counts (wavetable editors, spectral masks etc) enable batched drawing with SetDrawBatched(), receive changes
+ * as ranges via SetOnNewValueRangeFunc() or SetValueRangeMsgTag(), and/or let the DSP read values directly with SetSharedValueStorage()
  * @ingroup IControls */
 template <int MAXNC = 1>
 class IVMultiSliderControl : public IVTrackControlBase
 {
 public:
   using OnNewValueFunc = std::function<void(int trackIdx, double val)>;
+  using OnNewValueRangeFunc = std::function<void(int startIdx, int nVals)>;
 
   static constexpr int kMsgTagSetHighlight = 0;
+  static constexpr int kMsgTagSetValueRange = 1;
+
+  /** Header for a message containing a contiguous range of track values. The header is followed by nVals doubles.
+   * This is the layout of messages sent from the control when SetValueRangeMsgTag() is used,
+   * and of kMsgTagSetValueRange messages sent to the control from the delegate */
+  struct ValueRangeMsgHeader
+  {
+    int startIdx;
+    int nVals;
+  };
   
   /** Constructs a vector multi slider control that is not linked to parameters
    * @param bounds The control's bounds
@@ -81,6 +96,84 @@ public:
       g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
   }
 
+  void DrawWidget(IGraphics& g) override
+  {
+    if(!mDrawBatched)
+    {
+      IVTrackControlBase::DrawWidget(g);
+      return;
+    }
+
+    // Batched drawing: rather than a fill per track, all the handles and all the peaks are added to one path each, which is filled once.
+    // Overrides of DrawTrack(), DrawTrackHandle() and DrawPeak() are bypassed
+    const int nVals = NVals();
+    const bool stepped = GetStepped();
+    const IRECT* pTrackBounds = mTrackBounds.Get();
+    IRECT* pHandleBounds = mHandleBounds.ResizeOK(nVals, false);
+
+    // as in DrawTrack(), a stepped track at zero has no handle unless zero has its own step
+    auto hasHandle = [&](int ch) { return !stepped || mZeroValueStepHasBounds || GetValue(ch) > 0.; };
+
+    if(mHighlightedTrack > kNoValIdx && mHighlightedTrack < nVals)
+      g.FillRect(GetColor(kHL), pTrackBounds[mHighlightedTrack]);
+
+    if(HasTrackNames())
+    {
+      for (int ch = 0; ch < nVals; ch++)
+        DrawTrackName(g, pTrackBounds[ch], ch);
+    }
+
+    g.PathClear();
+
+    for (int ch = 0; ch < nVals; ch++)
+    {
+      pHandleBounds[ch] = GetTrackHandleRect(pTrackBounds[ch], ch);
+
+      if(ch == mHighlightedTrack || !hasHandle(ch))
+        continue;
+
+      g.PathRect(pHandleBounds[ch]);
+    }
+
+    g.PathFill(GetColor(kFG), IFillOptions(), &mBlend);
+
+    if(!stepped && mPeakSize > 0.f)
+    {
+      for (int ch = 0; ch < nVals; ch++)
+        g.PathRect(GetTrackPeakRect(pHandleBounds[ch], ch));
+
+      g.PathFill(GetColor(kFR), IFillOptions(), &mBlend);
+    }
+
+    if(mHighlightedTrack > kNoValIdx && mHighlightedTrack < nVals && hasHandle(mHighlightedTrack))
+      g.FillRect(GetColor(kX1), pHandleBounds[mHighlightedTrack], &mBlend);
+
+    if(mMouseOverTrack > kNoValIdx && mMouseOverTrack < nVals && hasHandle(mMouseOverTrack))
+      g.FillRect(GetColor(kHL), pHandleBounds[mMouseOverTrack], &mBlend);
+
+    if(mStyle.drawFrame && mDrawTrackFrame)
+    {
+      for (int ch = 0; ch < nVals; ch++)
+        g.PathRect(pTrackBounds[ch]);
+
+      g.PathStroke(GetColor(kFR), mStyle.frameThickness, IStrokeOptions(), &mBlend);
+    }
+  }
+
+  int GetValIdxForPos(float x, float y) const override
+  {
+    const int candidate = GetNearestTrackIdx(x, y);
+
+    // tracks are evenly spaced, so only the nearest track and its neighbours need testing
+    for (int v = std::max(candidate - 1, 0); v <= std::min(candidate + 1, NVals() - 1); v++)
+    {
+      if (mTrackBounds.Get()[v].Contains(x, y))
+        return v;
+    }
+
+    return kNoValIdx;
+  }
+
   void SnapToMouse(float x, float y, EDirection direction, const IRECT& bounds, int valIdx = -1 /* TODO:: not used*/, double minClip = 0., double maxClip = 1.) override
   {
     bounds.Constrain(x, y);
@@ -107,7 +200,9 @@ public:
         value = 1.f - (y-bounds.T) / bounds.H();
       }
       
-      for(auto i = 0; i < nVals; i++)
+      const int candidate = GetNearestTrackIdx(x, y);
+      
+      for(auto i = std::max(candidate - 1, 0); i <= std::min(candidate + 1, nVals - 1); i++)
       {
         if(mTrackBounds.Get()[i].ContainsEdge(x, mTrackBounds.Get()[i].MH()))
         {
@@ -131,7 +226,9 @@ public:
       {
         value = (x-bounds.L) / bounds.W();
       }
-      for(auto i = 0; i < nVals; i++)
+      const int candidate = GetNearestTrackIdx(x, y);
+      
+      for(auto i = std::max(candidate - 1, 0); i <= std::min(candidate + 1, nVals - 1); i++)
       {
         if(mTrackBounds.Get()[i].ContainsEdge(mTrackBounds.Get()[i].MW(), y))
         {
@@ -147,7 +244,9 @@ public:
     if (sliderTest > -1)
     {
       SetValue(Clip(value, 0., 1.), sliderTest);
-      OnNewValue(sliderTest, GetValue(sliderTest));
+      
+      int changedLo = sliderTest;
+      int changedHi = sliderTest;
 
       mSliderHit = sliderTest;
       mMouseOverTrack = mSliderHit;
@@ -169,22 +268,29 @@ public:
             highBounds = mPrevSliderHit;
           }
 
-          for (auto i = lowBounds; i < highBounds; i++)
+          const double lowValue = GetValue(lowBounds);
+          const double highValue = GetValue(highBounds);
+
+          for (auto i = lowBounds + 1; i < highBounds; i++)
           {
             double frac = (double)(i - lowBounds) / double(highBounds-lowBounds);
-            SetValue(iplug::Lerp(GetValue(lowBounds), GetValue(highBounds), frac), i);
-            OnNewValue(i, GetValue(i));
+            SetValue(iplug::Lerp(lowValue, highValue, frac), i);
           }
+          
+          changedLo = lowBounds;
+          changedHi = highBounds;
         }
       }
       mPrevSliderHit = mSliderHit;
+
+      NotifyValueRange(changedLo, changedHi - changedLo + 1);
     }
     else
     {
       mSliderHit = -1;
     }
 
-    SetDirty(true); // will send all param vals to delegate
+    SetDirty(false);
   }
 
   void OnMouseDown(float x, float y, const IMouseMod& mod) override
@@ -206,8 +312,8 @@ public:
           if(GetValue(ch) == valueAtStep)
           {
             SetValue(0., ch);
-            OnNewValue(ch, 0.);
-            SetDirty(true);
+            NotifyValueRange(ch, 1);
+            SetDirty(false);
             return;
           }
         }
@@ -231,6 +337,65 @@ public:
     {
       SetHighlightedTrack(*reinterpret_cast<const int*>(pData));
     }
+    else if (msgTag == kMsgTagSetValueRange)
+    {
+      int startIdx, nVals;
+      const double* pValues;
+      
+      if (GetValueRangeFromMsg(dataSize, pData, startIdx, nVals, pValues))
+      {
+        for (int i = 0; i < nVals && startIdx + i < NVals(); i++)
+        {
+          SetValue(Clip(pValues[i], 0., 1.), startIdx + i);
+          
+          if (mSharedValues && startIdx + i < mNSharedValues)
+            mSharedValues[startIdx + i].store(static_cast<float>(GetValue(startIdx + i)), std::memory_order_relaxed);
+        }
+        
+        SetDirty(false);
+      }
+    }
+  }
+
+  /** Decode a message containing a contiguous range of track values, e.g. in IPluginBase::OnMessage()
+   * @param dataSize The size of the message data in bytes
+   * @param pData Pointer to the message data, starting with a ValueRangeMsgHeader
+   * @param startIdx The index of the first track in the range
+   * @param nVals The number of values in the range
+   * @param pValues Set to point at the first value in the message data
+   * @return \c true if the message was valid */
+  static bool GetValueRangeFromMsg(int dataSize, const void* pData, int& startIdx, int& nVals, const double*& pValues)
+  {
+    if (dataSize < static_cast<int>(sizeof(ValueRangeMsgHeader)))
+      return false;
+    
+    const ValueRangeMsgHeader* pHeader = reinterpret_cast<const ValueRangeMsgHeader*>(pData);
+    
+    if (pHeader->startIdx < 0 || pHeader->nVals < 0 || dataSize != static_cast<int>(sizeof(ValueRangeMsgHeader) + pHeader->nVals * sizeof(double)))
+      return false;
+    
+    startIdx = pHeader->startIdx;
+    nVals = pHeader->nVals;
+    pValues = reinterpret_cast<const double*>(pHeader + 1);
+    return true;
+  }
+
+  /** Set a contiguous range of track values, notifying once for the whole range as if they had been edited with the mouse
+   * @param startIdx The index of the first track to set
+   * @param nVals The number of values to set
+   * @param pValues Pointer to an array of nVals normalized values */
+  void SetValueRange(int startIdx, int nVals, const double* pValues)
+  {
+    nVals = std::min(nVals, NVals() - startIdx);
+    
+    if (startIdx < 0 || nVals <= 0)
+      return;
+    
+    for (int i = 0; i < nVals; i++)
+      SetValue(Clip(pValues[i], 0., 1.), startIdx + i);
+    
+    NotifyValueRange(startIdx, nVals);
+    SetDirty(false);
   }
 
   /** override to do something when an individual slider is dragged */
@@ -240,10 +405,64 @@ public:
       mOnNewValueFunc(trackIdx, val);
   }
   
+  /** Called once for each contiguous range of sliders changed by a single edit. If no OnNewValueRangeFunc is set, OnNewValue() is called for each slider in the range
+   * @param startIdx The index of the first changed slider
+   * @param nVals The number of changed sliders */
+  virtual void OnNewValueRange(int startIdx, int nVals)
+  {
+    if(mOnNewValueRangeFunc)
+      mOnNewValueRangeFunc(startIdx, nVals);
+    else
+    {
+      for (int i = startIdx; i < startIdx + nVals; i++)
+        OnNewValue(i, GetValue(i));
+    }
+  }
+  
   void SetOnNewValueFunc(OnNewValueFunc func)
   {
     mOnNewValueFunc = func;
   }
+
+  void SetOnNewValueRangeFunc(OnNewValueRangeFunc func)
+  {
+    mOnNewValueRangeFunc = func;
+  }
+  
+  /** Send each edit to the delegate as a single arbitrary message (a ValueRangeMsgHeader followed by the changed values), rather than relying on the action function
+   * @param msgTag The message tag to use with SendArbitraryMsgFromUI(), or kNoTag to disable */
+  void SetValueRangeMsgTag(int msgTag)
+  {
+    mValueRangeMsgTag = msgTag;
+  }
+  
+  /** Share the slider values with the DSP via lock-free storage, owned by the caller (usually the plug-in class), that the audio thread can read directly.
+   * The control takes its initial values from the storage, and writes edited values to it. Only suitable where the UI and DSP share an address space
+   * @param pValues Pointer to an array of nValues atomics, or nullptr to disable
+   * @param nValues The number of elements in pValues */
+  void SetSharedValueStorage(std::atomic<float>* pValues, int nValues)
+  {
+    mSharedValues = pValues;
+    mNSharedValues = nValues;
+    
+    if (mSharedValues)
+    {
+      const int n = std::min(NVals(), mNSharedValues);
+      
+      for (int i = 0; i < n; i++)
+        SetValue(mSharedValues[i].load(std::memory_order_relaxed), i);
+      
+      SetDirty(false);
+    }
+  }
+  
+  /** Draw all the tracks' handles and peaks with one path fill each, rather than individual fills per track. Recommended for high track counts.
+   * Note that overrides of DrawTrack(), DrawTrackHandle() and DrawPeak() will not be called */
+  void SetDrawBatched(bool batched)
+  {
+    mDrawBatched = batched;
+    SetDirty(false);
+  }
   
   int GetLastSliderHit() const
   {
@@ -251,10 +470,65 @@ public:
   }
   
 protected:
+  /** Get the index of the track nearest to a point, without testing each track's bounds */
+  int GetNearestTrackIdx(float x, float y) const
+  {
+    const int nVals = NVals();
+    const float frac = (mDirection == EDirection::Vertical) ? (x - mWidgetBounds.L) / mWidgetBounds.W()
+                                                            : (y - mWidgetBounds.T) / mWidgetBounds.H();
+    
+    return Clip(static_cast<int>(frac * nVals), 0, nVals - 1);
+  }
+  
+  /** Notify the listeners, linked parameters, shared storage and the delegate once for a range of changed values */
+  void NotifyValueRange(int startIdx, int nVals)
+  {
+    OnNewValueRange(startIdx, nVals);
+    
+    for (int i = startIdx; i < startIdx + nVals; i++)
+    {
+      if (GetParamIdx(i) > kNoParameter)
+      {
+        GetDelegate()->SendParameterValueFromUI(GetParamIdx(i), GetValue(i));
+        GetUI()->UpdatePeers(this, i);
+      }
+      
+      if (mSharedValues && i < mNSharedValues)
+        mSharedValues[i].store(static_cast<float>(GetValue(i)), std::memory_order_relaxed);
+    }
+    
+    if (mValueRangeMsgTag > kNoTag)
+    {
+      const int dataSize = static_cast<int>(sizeof(ValueRangeMsgHeader) + nVals * sizeof(double));
+      uint8_t* pData = mValueRangeMsgData.ResizeOK(dataSize, false);
+      
+      ValueRangeMsgHeader* pHeader = reinterpret_cast<ValueRangeMsgHeader*>(pData);
+      pHeader->startIdx = startIdx;
+      pHeader->nVals = nVals;
+      
+      double* pValues = reinterpret_cast<double*>(pHeader + 1);
+      
+      for (int i = 0; i < nVals; i++)
+        pValues[i] = GetValue(startIdx + i);
+      
+      GetDelegate()->SendArbitraryMsgFromUI(mValueRangeMsgTag, GetTag(), dataSize, pData);
+    }
+    
+    if (GetActionFunction())
+      GetActionFunction()(this);
+  }
+  
   OnNewValueFunc mOnNewValueFunc = nullptr;
+  OnNewValueRangeFunc mOnNewValueRangeFunc = nullptr;
   int mPrevSliderHit = -1;
   int mSliderHit = -1;
   double mGrain = 0.001;
+  bool mDrawBatched = false;
+  int mValueRangeMsgTag = kNoTag;
+  std::atomic<float>* mSharedValues = nullptr;
+  int mNSharedValues = 0;
+  WDL_TypedBuf<IRECT> mHandleBounds;
+  WDL_TypedBuf<uint8_t> mValueRangeMsgData;
 };
 
 /** A vectorial multi-toggle control, could be used for a trigger in a step sequencer or tarnce gate
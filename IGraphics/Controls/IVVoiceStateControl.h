@@ -0,0 +1,132 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @ingroup Controls
+ * @copydoc IVVoiceStateControl
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "IControl.h"
+#include "VoiceState.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** Vectorial control that shows the active voices of a MidiSynth and their expression, to help with debugging MPE and poly aftertouch.
+ * Each voice is drawn at its pitch including pitch bend, across the same note range as an IVKeyboardControl, so it can sit above one.
+ * A bar shows the voice's pressure, a dot at the height of its timbre is sized by its level, and the envelope stage is written at the top.
+ * Released voices are drawn in the shadow color. Send it the snapshots from MidiSynth::GetVoiceStates(), see MidiSynth::SetVoiceStatesEnabled()
+ * @ingroup IControls */
+class IVVoiceStateControl : public IControl
+                          , public IVectorBase
+{
+public:
+  static constexpr int kUpdateMessage = 0;
+
+  /** Constructs an IVVoiceStateControl
+   * @param bounds The rectangular area that the control occupies
+   * @param label A CString to label the control
+   * @param style, /see IVStyle
+   * @param minNote The lowest note shown
+   * @param maxNote The highest note shown */
+  IVVoiceStateControl(const IRECT& bounds, const char* label = "", const IVStyle& style = DEFAULT_STYLE, int minNote = 48, int maxNote = 72)
+  : IControl(bounds)
+  , IVectorBase(style)
+  , mMinNote(minNote)
+  , mMaxNote(maxNote)
+  {
+    assert(maxNote > minNote);
+    AttachIControl(this, label);
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    DrawBackground(g, mRECT);
+    DrawWidget(g);
+    DrawLabel(g);
+
+    if (mStyle.drawFrame)
+      g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
+  }
+
+  void DrawWidget(IGraphics& g) override
+  {
+    const IRECT r = mWidgetBounds.GetPadded(-mPadding);
+    const float nNotes = static_cast<float>(mMaxNote - mMinNote + 1);
+    const float colW = r.W() / nNotes;
+    const float stageH = mStyle.valueText.mSize;
+
+    for (int v = 0; v < mStates.mNVoices; v++)
+    {
+      const VoiceState& state = mStates.mVoices[v];
+
+      if (!state.mActive)
+        continue;
+
+      const float note = 69.f + 12.f * (state.mPitch + state.mPitchBend);
+      const float x = r.L + (note - mMinNote + 0.5f) * colW;
+
+      if (x < r.L || x > r.R)
+        continue;
+
+      const IColor& color = GetColor(state.mReleased ? kSH : kFG);
+      const float barH = Clip(state.mPressure, 0.f, 1.f) * (r.H() - stageH);
+      g.FillRect(GetColor(kPR), IRECT(x - colW * 0.3f, r.B - barH, x + colW * 0.3f, r.B), &mBlend);
+
+      const float y = r.B - Clip(state.mTimbre, 0.f, 1.f) * (r.H() - stageH);
+      const float radius = colW * (0.15f + 0.35f * Clip(state.mLevel, 0.f, 1.f));
+      g.FillCircle(color, x, y, radius, &mBlend);
+
+      if (state.mStage != VoiceState::kNoStage)
+      {
+        char str[8];
+        snprintf(str, sizeof(str), "%i", state.mStage);
+        g.DrawText(mStyle.valueText, str, IRECT(x - colW * 0.5f, r.T, x + colW * 0.5f, r.T + stageH), &mBlend);
+      }
+    }
+  }
+
+  void OnResize() override
+  {
+    SetTargetRECT(MakeRects(mRECT));
+    SetDirty(false);
+  }
+
+  /** Receives a VoiceStates snapshot. The message can leave out the unused voices at the end of the snapshot */
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    constexpr int headerSize = static_cast<int>(offsetof(VoiceStates, mVoices));
+
+    if (!IsDisabled() && msgTag == kUpdateMessage && dataSize >= headerSize && dataSize <= static_cast<int>(sizeof(VoiceStates)))
+    {
+      memcpy(&mStates, pData, dataSize);
+      mStates.mNVoices = Clip(mStates.mNVoices, 0, (dataSize - headerSize) / static_cast<int>(sizeof(VoiceState)));
+      SetDirty(false);
+    }
+  }
+
+  const VoiceStates& GetVoiceStates() const { return mStates; }
+
+private:
+  VoiceStates mStates;
+  int mMinNote;
+  int mMaxNote;
+  float mPadding = 2.f;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
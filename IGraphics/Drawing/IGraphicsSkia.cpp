@@ -346,7 +346,21 @@ void IGraphicsSkia::OnViewInitialized(void* pContext)
 
 void IGraphicsSkia::OnViewDestroyed()
 {
-  RemoveAllControls();
+  if (GetKeepControlsWhenClosed())
+  {
+    KeepControlsOnViewDestroyed();
+    
+#ifndef IGRAPHICS_CPU
+    // the kept layers may hold GPU surfaces, which must not touch the backend context when they are eventually freed
+    if (mGrContext)
+      mGrContext->abandonContext();
+    
+    mSurface = nullptr;
+    mGrContext = nullptr;
+#endif
+  }
+  else
+    RemoveAllControls();
 
 #if defined IGRAPHICS_GL
   mSurface = nullptr;
@@ -1642,6 +1642,30 @@ protected:
       DrawTrackName(g, r, chIdx);
     
     const float trackPos = static_cast<float>(GetValue(chIdx));
+    const IRECT fillRect = GetTrackHandleRect(r, chIdx);
+
+    if(GetStepped())
+    {
+      if(mZeroValueStepHasBounds || GetValue(chIdx) > 0.)
+        DrawTrackHandle(g, fillRect, chIdx, trackPos > mBaseValue);
+    }
+    else
+    {
+      DrawTrackHandle(g, fillRect, chIdx, trackPos > mBaseValue);
+      DrawPeak(g, GetTrackPeakRect(fillRect, chIdx), chIdx, trackPos > mBaseValue);
+    }
+
+    if(mStyle.drawFrame && mDrawTrackFrame)
+      g.DrawRect(GetColor(kFR), r, &mBlend, mStyle.frameThickness);
+  }
+
+  /** Calculate the bounds of the main body of a track, taking into account mBaseValue and any cross-axis steps
+   * @param r The bounds of the track
+   * @param chIdx channel index
+   * @return The bounds of the track handle */
+  IRECT GetTrackHandleRect(const IRECT& r, int chIdx) const
+  {
+    const float trackPos = static_cast<float>(GetValue(chIdx));
     
     const bool stepped = GetStepped();
     
@@ -1693,36 +1717,33 @@ protected:
           fillRect.B = mStepBounds.Get()[step].B;
         }
       }
-      
-      if(mZeroValueStepHasBounds || GetValue(chIdx) > 0.)
-        DrawTrackHandle(g, fillRect, chIdx, trackPos > mBaseValue);
+    }
+    
+    return fillRect;
+  }
+
+  /** Calculate the bounds of the peak marker of a (non-stepped) track
+   * @param fillRect The bounds of the track handle, as returned by GetTrackHandleRect()
+   * @param chIdx channel index
+   * @return The bounds of the peak marker */
+  IRECT GetTrackPeakRect(const IRECT& fillRect, int chIdx) const
+  {
+    const float trackPos = static_cast<float>(GetValue(chIdx));
+
+    if(mDirection == EDirection::Vertical)
+    {
+      return IRECT(fillRect.L,
+                   trackPos < mBaseValue ? fillRect.B : fillRect.T,
+                   fillRect.R,
+                   trackPos < mBaseValue ? fillRect.B - mPeakSize: fillRect.T + mPeakSize);
     }
     else
     {
-      DrawTrackHandle(g, fillRect, chIdx, trackPos > mBaseValue);
-      
-      IRECT peakRect;
-      
-      if(mDirection == EDirection::Vertical)
-      {
-        peakRect = IRECT(fillRect.L,
-                         trackPos < mBaseValue ? fillRect.B : fillRect.T,
-                         fillRect.R,
-                         trackPos < mBaseValue ? fillRect.B - mPeakSize: fillRect.T + mPeakSize);
-      }
-      else
-      {
-        peakRect = IRECT(trackPos < mBaseValue ? fillRect.L + mPeakSize : fillRect.R - mPeakSize,
-                         fillRect.T,
-                         trackPos < mBaseValue ? fillRect.L : fillRect.R,
-                         fillRect.B);
-      }
-      
-      DrawPeak(g, peakRect, chIdx, trackPos > mBaseValue);
+      return IRECT(trackPos < mBaseValue ? fillRect.L + mPeakSize : fillRect.R - mPeakSize,
+                   fillRect.T,
+                   trackPos < mBaseValue ? fillRect.L : fillRect.R,
+                   fillRect.B);
     }
-
-    if(mStyle.drawFrame && mDrawTrackFrame)
-      g.DrawRect(GetColor(kFR), r, &mBlend, mStyle.frameThickness);
   }
 
   virtual void DrawTrackBackground(IGraphics& g, const IRECT& r, int chIdx)
@@ -32,6 +32,8 @@ using VST3_API_BASE = iplug::IPlugVST3Controller;
 #include "IControls.h"
 #include "IGraphicsLiveEdit.h"
 #include "IFPSDisplayControl.h"
+#include "IProfilerDisplayControl.h"
+#include "IGraphicsProfiler.h"
 #include "ICornerResizerControl.h"
 #include "IPopupMenuControl.h"
 #include "ITextEntryControl.h"
@@ -198,6 +200,7 @@ void IGraphics::RemoveAllControls()
   mTextEntryControl = nullptr;
   mCornerResizer = nullptr;
   mPerfDisplay = nullptr;
+  mProfilerDisplay = nullptr;
     
 #ifndef NDEBUG
   mLiveEdit = nullptr;
@@ -209,6 +212,27 @@ void IGraphics::RemoveAllControls()
   mControls.Empty(true);
 }
 
+void IGraphics::KeepControlsOnViewDestroyed()
+{
+  ReleaseMouseCapture();
+  ClearMouseOver();
+
+  mControlsKept = true;
+  mViewGeneration++;
+}
+
+void IGraphics::LayoutUIOnOpen()
+{
+  if (mControlsKept)
+  {
+    mControlsKept = false;
+    ForAllControls(&IControl::OnResize);
+    SetAllControlsDirty();
+  }
+  else
+    GetDelegate()->LayoutUI(this);
+}
+
 void IGraphics::SetControlPosition(IControl* pControl, float x, float y)
 {
   pControl->SetPosition(x, y);
@@ -443,6 +467,40 @@ void IGraphics::ShowFPSDisplay(bool enable)
   SetAllControlsDirty();
 }
 
+void IGraphics::EnableProfiler(bool enable)
+{
+  if (enable)
+  {
+    if (!mProfiler)
+      mProfiler = std::make_unique<IGraphicsProfiler>();
+  }
+  else
+  {
+    ShowProfilerDisplay(false);
+    mProfiler = nullptr;
+  }
+}
+
+void IGraphics::ShowProfilerDisplay(bool enable)
+{
+  if (enable)
+  {
+    EnableProfiler(true);
+    
+    if (!mProfilerDisplay)
+    {
+      mProfilerDisplay = std::make_unique<IProfilerDisplayControl>(GetBounds().GetPadded(-10).GetFromTRHC(280, 240));
+      mProfilerDisplay->SetDelegate(*GetDelegate());
+    }
+  }
+  else
+  {
+    mProfilerDisplay = nullptr;
+  }
+
+  SetAllControlsDirty();
+}
+
 IControl* IGraphics::GetControlWithTag(int ctrlTag) const
 {
   const auto it = mCtrlTags.find(ctrlTag);
@@ -525,6 +583,9 @@ void IGraphics::ForAllControlsFunc(std::function<void(IControl* pControl)> func)
   if (mPerfDisplay)
     func(mPerfDisplay.get());
   
+  if (mProfilerDisplay)
+    func(mProfilerDisplay.get());
+  
 #ifndef NDEBUG
   if (mLiveEdit)
     func(mLiveEdit.get());
@@ -808,6 +869,9 @@ bool IGraphics::IsDirty(IRECTList& rects)
   if (mDisplayTickFunc)
     mDisplayTickFunc();
 
+  // after the tick function, which can be the one reading the profiler, so that it isn't counted as part of the scan
+  double timestamp = mProfiler ? GetTimestamp() : 0.;
+
   ForAllControlsFunc([](IControl* pControl) { pControl->Animate(); } );
 
   bool dirty = false;
@@ -830,6 +894,12 @@ bool IGraphics::IsDirty(IRECTList& rects)
     
   ForAllControlsFunc(func);
 
+  if (mProfiler && dirty)
+  {
+    mProfiler->BeginFrame();
+    mProfiler->AddStageTimeSince(IGraphicsProfiler::kDirtyScan, timestamp);
+  }
+
 #ifdef USE_IDLE_CALLS
   if (dirty)
   {
@@ -883,7 +953,15 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
     }
     
     PrepareRegion(clipBounds);
-    pControl->Draw(*this);
+    
+    if (mProfiler && pControl != mProfilerDisplay.get())
+    {
+      const double timestamp = GetTimestamp();
+      pControl->Draw(*this);
+      mProfiler->AddControlTime(*pControl, GetTimestamp() - timestamp);
+    }
+    else
+      pControl->Draw(*this);
 #ifdef AAX_API
     pControl->DrawPTHighlight(*this);
 #endif
@@ -922,25 +1000,46 @@ void IGraphics::Draw(IRECTList& rects)
     return;
   
   float scale = GetBackingPixelScale();
+  
+  double timestamp = mProfiler ? GetTimestamp() : 0.;
     
   BeginFrame();
+  
+  const double beginFrameTime = mProfiler ? GetTimestamp() - timestamp : 0.;
+  timestamp += beginFrameTime;
     
   if (mStrict)
   {
     IRECT r = rects.Bounds();
     r.PixelAlign(scale);
+    
+    if (mProfiler)
+      mProfiler->AddStageTimeSince(IGraphicsProfiler::kRegionLayout, timestamp);
+    
     Draw(r, scale);
   }
   else
   {
     rects.PixelAlign(scale);
     rects.Optimize();
+    
+    if (mProfiler)
+      mProfiler->AddStageTimeSince(IGraphicsProfiler::kRegionLayout, timestamp);
 
     for (auto i = 0; i < rects.Size(); i++)
       Draw(rects.Get(i), scale);
   }
   
+  if (mProfiler)
+    mProfiler->AddStageTimeSince(IGraphicsProfiler::kDraw, timestamp);
+  
   EndFrame();
+  
+  if (mProfiler)
+  {
+    mProfiler->AddStageTime(IGraphicsProfiler::kBackendFlush, beginFrameTime + GetTimestamp() - timestamp);
+    mProfiler->EndFrame();
+  }
 }
 
 void IGraphics::SetStrictDrawing(bool strict)
@@ -1929,7 +2028,9 @@ void IGraphics::StartLayer(IControl* pControl, const IRECT& r, bool cacheable)
   const int w = static_cast<int>(std::ceil(pixelBackingScale * std::ceil(alignedBounds.W())));
   const int h = static_cast<int>(std::ceil(pixelBackingScale * std::ceil(alignedBounds.H())));
 
-  PushLayer(new ILayer(CreateAPIBitmap(w, h, GetScreenScale(), GetDrawScale(), cacheable), alignedBounds, pControl, pControl ? pControl->GetRECT() : IRECT()));
+  ILayer* pLayer = new ILayer(CreateAPIBitmap(w, h, GetScreenScale(), GetDrawScale(), cacheable), alignedBounds, pControl, pControl ? pControl->GetRECT() : IRECT());
+  pLayer->mViewGeneration = mViewGeneration;
+  PushLayer(pLayer);
 }
 
 void IGraphics::ResumeLayer(ILayerPtr& layer)
@@ -1987,7 +2088,7 @@ bool IGraphics::CheckLayer(const ILayerPtr& layer)
     layer->Invalidate();
   }
 
-  return pBitmap && !layer->mInvalid && pBitmap->GetDrawScale() == GetDrawScale() && pBitmap->GetScale() == GetScreenScale();
+  return pBitmap && !layer->mInvalid && layer->mViewGeneration == mViewGeneration && pBitmap->GetDrawScale() == GetDrawScale() && pBitmap->GetScale() == GetScreenScale();
 }
 
 void IGraphics::DrawLayer(const ILayerPtr& layer, const IBlend* pBlend)
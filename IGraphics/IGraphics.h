@@ -76,6 +76,8 @@ class IPopupMenuControl;
 class ITextEntryControl;
 class ICornerResizerControl;
 class IFPSDisplayControl;
+class IProfilerDisplayControl;
+class IGraphicsProfiler;
 class IBubbleControl;
 
 /**  The lowest level base class of an IGraphics context */
@@ -1048,6 +1050,18 @@ public:
   /* Enables layout on resize. This means IGEditorDelegate:LayoutUI() will be called when the GUI is resized */
   void SetLayoutOnResize(bool layoutOnResize);
 
+  /** Keep the controls, loaded resources and layout when the window is closed, so that reopening it only recreates the platform view and drawing context.
+   * Only has an effect if the drawing backend supports it, see CanKeepControlsWhenClosed(). Usually set via IGEditorDelegate::SetKeepUIWhenClosed()
+   * Controls that attach platform views (e.g. web views) are not recreated, so don't use this with them.
+   * @param keep \c true to keep the controls when the window is closed */
+  void SetKeepControlsWhenClosed(bool keep) { mKeepControlsWhenClosed = keep; }
+
+  /** @return \c true if the controls will be kept when the window is closed */
+  bool GetKeepControlsWhenClosed() const { return mKeepControlsWhenClosed && CanKeepControlsWhenClosed(); }
+
+  /** @return \c true if the drawing backend can keep its loaded resources when its context is destroyed */
+  virtual bool CanKeepControlsWhenClosed() const { return false; }
+
   /** Gets the width of the graphics context
    * @return A whole number representing the width of the graphics context in pixels on a 1:1 screen */
   int Width() const { return mWidth; }
@@ -1307,6 +1321,21 @@ public:
   
   /** @return \c true if performance display is shown */
   bool ShowingFPSDisplay() { return mPerfDisplay != nullptr; }
+
+  /** Enable collection of per-control and per-frame draw timings. This adds a couple of timestamps per control drawn
+   * @param enable \c true to enable
+   * @see IGraphicsProfiler */
+  void EnableProfiler(bool enable);
+
+  /** @return The profiler, which can be used to get a report of the timings, or nullptr if the profiler is not enabled */
+  IGraphicsProfiler* GetProfiler() { return mProfiler.get(); }
+
+  /** Shows an overlay with the statistics collected by the profiler, enabling the profiler if needed
+   * @param enable \c true to show */
+  void ShowProfilerDisplay(bool enable);
+
+  /** @return \c true if the profiler display is shown */
+  bool ShowingProfilerDisplay() { return mProfilerDisplay != nullptr; }
   
   /** Attach an IControl to the graphics context and add it to the top of the control stack. The control is owned by the graphics context and will be deleted when the context is deleted.
    * @param pControl A pointer to an IControl to attach.
@@ -1668,6 +1697,13 @@ protected:
    * @return APIBitmap* Drawing API bitmap abstraction */
   virtual APIBitmap* LoadAPIBitmap(const char* name, const void* pData, int dataSize, int scale) = 0;
 
+  /** Called by the drawing backend in OnViewDestroyed(), instead of RemoveAllControls() if GetKeepControlsWhenClosed() is \c true.
+   * Layers are redrawn when the window is reopened, since their contents belong to the old drawing context */
+  void KeepControlsOnViewDestroyed();
+
+  /** Called by the platform when the window is opened, after OnViewInitialized(). Calls IGEditorDelegate::LayoutUI(), unless the controls were kept when the window was closed */
+  void LayoutUIOnOpen();
+
   /** Creates a new API bitmap, either in memory or as a GPU texture
    * @param width The desired width
    * @param height The desired height
@@ -1757,6 +1793,8 @@ private:
   WDL_PtrList<IBubbleControl> mBubbleControls;
   std::unique_ptr<IPopupMenuControl> mPopupControl;
   std::unique_ptr<IFPSDisplayControl> mPerfDisplay;
+  std::unique_ptr<IProfilerDisplayControl> mProfilerDisplay;
+  std::unique_ptr<IGraphicsProfiler> mProfiler;
   std::unique_ptr<ITextEntryControl> mTextEntryControl;
   std::unique_ptr<IControl> mLiveEdit;
   
@@ -1797,6 +1835,9 @@ private:
   bool mShowAreaDrawn = false;
   bool mResizingInProcess = false;
   bool mLayoutOnResize = false;
+  bool mKeepControlsWhenClosed = false;
+  bool mControlsKept = false;
+  int mViewGeneration = 0; // incremented when controls are kept, invalidating the layers of the old drawing context
   bool mEnableMultiTouch = false;
   EUIResizerMode mGUISizeMode = EUIResizerMode::Scale;
   double mPrevTimestamp = 0.;
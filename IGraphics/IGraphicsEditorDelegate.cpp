@@ -12,6 +12,8 @@
 #include "IGraphics.h"
 #include "IControl.h"
 
+#include <limits>
+
 using namespace iplug;
 using namespace igraphics;
 
@@ -31,10 +33,21 @@ void* IGEditorDelegate::OpenWindow(void* pParent)
     mGraphics = std::unique_ptr<IGraphics>(CreateGraphics());
     if (mLastWidth && mLastHeight && mLastScale)
       GetUI()->Resize(mLastWidth, mLastHeight, mLastScale);
+    if (mGraphics)
+      mGraphics->SetKeepControlsWhenClosed(mKeepUIWhenClosed);
   }
   
   if(mGraphics)
-    return mGraphics->OpenWindow(pParent);
+  {
+    void* pView = mGraphics->OpenWindow(pParent);
+    
+    // in case OnUIOpen() was overridden without sending the parameter values
+    for (int i = 0; i < static_cast<int>(mClosedParamValues.size()); i++)
+      SendParameterValueFromDelegate(i, GetParam(i)->GetNormalized(), true);
+    
+    mClosedParamValues.clear();
+    return pView;
+  }
   else
     return nullptr;
 }
@@ -51,8 +64,21 @@ void IGEditorDelegate::CloseWindow()
       mLastWidth = mGraphics->Width();
       mLastHeight = mGraphics->Height();
       mLastScale = mGraphics->GetDrawScale();
-      mGraphics->CloseWindow();
-      mGraphics = nullptr;
+      
+      if (mGraphics->GetKeepControlsWhenClosed())
+      {
+        mClosedParamValues.resize(NParams());
+        
+        for (int i = 0; i < NParams(); i++)
+          mClosedParamValues[i] = GetParam(i)->GetNormalized();
+        
+        mGraphics->CloseWindow();
+      }
+      else
+      {
+        mGraphics->CloseWindow();
+        mGraphics = nullptr;
+      }
     }
     
     mClosing = false;
@@ -102,6 +128,21 @@ void IGEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value
     if (!normalized)
       value = GetParam(paramIdx)->ToNormalized(value);
 
+    // the UI was kept when the window closed. While it is closed, just note the change, the controls and OnParamChangeUI() get it when
+    // the window reopens. Then skip the parameters that didn't change
+    if (!mClosedParamValues.empty())
+    {
+      if (!mGraphics->WindowIsOpen())
+      {
+        mClosedParamValues[paramIdx] = std::numeric_limits<double>::quiet_NaN();
+        return;
+      }
+      else if (value == mClosedParamValues[paramIdx])
+        return;
+      
+      mClosedParamValues[paramIdx] = value;
+    }
+
     for (int c = 0; c < mGraphics->NControls(); c++)
     {
       IControl* pControl = mGraphics->GetControl(c);
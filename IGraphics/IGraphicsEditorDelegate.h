@@ -11,6 +11,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "IPlugEditorDelegate.h"
 
@@ -71,6 +72,12 @@ public:
       mLayoutFunc(pGraphics);
   }
   
+  /** Keep the IGraphics context with its controls and loaded resources when the editor window is closed, so that it reopens without calling CreateGraphics() or LayoutUI() again.
+   * Only the platform view and drawing context are recreated. Parameter changes made while the window is closed reach the controls and OnParamChangeUI() when it reopens, and only for the parameters that changed.
+   * Has no effect if the drawing backend can't keep its resources, see IGraphics::CanKeepControlsWhenClosed(). Call it in the plug-in constructor
+   * @param keep \c true to keep the UI when the window is closed */
+  void SetKeepUIWhenClosed(bool keep) { mKeepUIWhenClosed = keep; }
+
   /** Get a pointer to the IGraphics context */
   IGraphics* GetUI() { return mGraphics.get(); };
 
@@ -96,6 +103,8 @@ private:
   int mLastWidth = 0;
   int mLastHeight = 0;
   float mLastScale = 0.f;
+  bool mKeepUIWhenClosed = false;
+  std::vector<double> mClosedParamValues; // normalized values when the UI was kept, NaN if a parameter changed while the window was closed
   bool mClosing = false; // used to prevent re-entrancy on closing
 };
 
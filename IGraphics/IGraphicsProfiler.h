@@ -0,0 +1,331 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IGraphicsProfiler
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#endif
+
+#include "wdlstring.h"
+
+#include "IGraphicsUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+class IControl;
+
+/** Collects per-control and per-frame draw timings for an IGraphics context, aggregated into rolling histograms.
+ * Enable it with IGraphics::EnableProfiler(), show the overlay with IGraphics::ShowProfilerDisplay() and get a text report with GetReport() */
+class IGraphicsProfiler
+{
+public:
+  /** The per-frame stages that are timed, in addition to the individual controls */
+  enum EStage
+  {
+    kDirtyScan = 0, // IGraphics::IsDirty(), including control animations
+    kRegionLayout,  // pixel aligning and optimizing the dirty region list
+    kDraw,          // drawing the controls in all the dirty regions
+    kBackendFlush,  // IGraphics::BeginFrame() and EndFrame(), i.e. the drawing backend preparing and submitting the frame
+    kNumStages
+  };
+
+  /** A histogram of durations with quarter-octave bins from kMinTime. It keeps two half windows of samples,
+   * so that percentiles always cover between kWindowFrames/2 and kWindowFrames frames */
+  class Histogram
+  {
+  public:
+    static constexpr int kNumBins = 80;
+    static constexpr double kMinTime = 1e-7; // 0.1 us, the upper bin is ~100 ms
+    static constexpr double kBinsPerOctave = 4.;
+
+    void AddSample(double seconds)
+    {
+      int bin = 0;
+
+      if (seconds > kMinTime)
+        bin = std::min(static_cast<int>(kBinsPerOctave * std::log2(seconds / kMinTime)), kNumBins - 1);
+
+      mCurrent[bin]++;
+      mTotal += seconds;
+      mNSamples++;
+    }
+
+    /** Start a new half window, discarding the oldest one */
+    void Roll()
+    {
+      for (int i = 0; i < kNumBins; i++)
+      {
+        mPrevious[i] = mCurrent[i];
+        mCurrent[i] = 0;
+      }
+    }
+
+    void Reset()
+    {
+      for (int i = 0; i < kNumBins; i++)
+        mPrevious[i] = mCurrent[i] = 0;
+
+      mTotal = 0.;
+      mNSamples = 0;
+    }
+
+    /** @param pct The percentile to get, 0-100
+     * @return The approximate duration in seconds at the percentile, within the window */
+    double GetPercentile(double pct) const
+    {
+      const int n = GetNumSamplesInWindow();
+
+      if (!n)
+        return 0.;
+
+      const int target = std::max(1, static_cast<int>(std::ceil(pct / 100. * n)));
+      int count = 0;
+
+      for (int i = 0; i < kNumBins; i++)
+      {
+        count += mPrevious[i] + mCurrent[i];
+
+        if (count >= target)
+          return kMinTime * std::pow(2., (i + 0.5) / kBinsPerOctave); // geometric centre of bin
+      }
+
+      return kMinTime * std::pow(2., kNumBins / kBinsPerOctave);
+    }
+
+    int GetNumSamplesInWindow() const
+    {
+      int n = 0;
+
+      for (int i = 0; i < kNumBins; i++)
+        n += mPrevious[i] + mCurrent[i];
+
+      return n;
+    }
+
+    /** @return The mean duration in seconds of all the samples since the last Reset() */
+    double GetMean() const { return mNSamples ? mTotal / mNSamples : 0.; }
+
+  private:
+    int mCurrent[kNumBins] = {};
+    int mPrevious[kNumBins] = {};
+    double mTotal = 0.;
+    int64_t mNSamples = 0;
+  };
+
+  /** Statistics for all the controls of one C++ type */
+  struct ControlTypeStats
+  {
+    WDL_String name;
+    Histogram drawTime; // time to draw one control of this type
+  };
+
+  static constexpr int kWindowFrames = 240;
+
+  IGraphicsProfiler()
+  {
+    mControlTypes.reserve(64);
+  }
+
+  IGraphicsProfiler(const IGraphicsProfiler&) = delete;
+  IGraphicsProfiler& operator=(const IGraphicsProfiler&) = delete;
+
+  /** Called by IGraphics at the start of a frame that will be drawn */
+  void BeginFrame()
+  {
+    mFrameCost = 0.;
+    mSlowestControlTime = 0.;
+    mSlowestControlType = -1;
+  }
+
+  /** Called by IGraphics when a frame has been submitted. The frame cost is the sum of the stage times */
+  void EndFrame()
+  {
+    mFrameTime.AddSample(mFrameCost);
+    mFrameCost = 0.;
+    mLastSlowestControlTime = mSlowestControlTime;
+    mLastSlowestControlType = mSlowestControlType;
+
+    if (++mFramesInHalfWindow >= kWindowFrames / 2)
+    {
+      mFramesInHalfWindow = 0;
+      mFrameTime.Roll();
+
+      for (auto& stage : mStages)
+        stage.Roll();
+
+      for (auto& type : mControlTypes)
+        type.drawTime.Roll();
+    }
+
+    mNFrames++;
+  }
+
+  void AddStageTime(EStage stage, double seconds)
+  {
+    mStages[stage].AddSample(seconds);
+    mFrameCost += seconds;
+  }
+
+  /** Add the time elapsed since a timestamp to a stage, and update the timestamp so that consecutive stages can be timed
+   * @param stage The stage to add the time to
+   * @param timestamp A timestamp from GetTimestamp(), set to the current time on return */
+  void AddStageTimeSince(EStage stage, double& timestamp)
+  {
+    const double now = GetTimestamp();
+    AddStageTime(stage, now - timestamp);
+    timestamp = now;
+  }
+
+  /** Called by IGraphics::DrawControl() with the time taken by IControl::Draw()
+   * @param control The control that was drawn
+   * @param seconds The time it took to draw */
+  void AddControlTime(const IControl& control, double seconds)
+  {
+    const std::type_index type(typeid(control));
+    auto itr = mTypeIndices.find(type);
+    int idx;
+
+    if (itr == mTypeIndices.end())
+    {
+      // first time we've seen this control type
+      idx = static_cast<int>(mControlTypes.size());
+      mControlTypes.emplace_back();
+      mControlTypes.back().name.Set(Demangle(type.name()).Get());
+      mTypeIndices[type] = idx;
+    }
+    else
+      idx = itr->second;
+
+    mControlTypes[idx].drawTime.AddSample(seconds);
+
+    if (seconds > mSlowestControlTime)
+    {
+      mSlowestControlTime = seconds;
+      mSlowestControlType = idx;
+    }
+  }
+
+  /** Clear all statistics, e.g. between benchmark runs */
+  void Reset()
+  {
+    mFrameTime.Reset();
+
+    for (auto& stage : mStages)
+      stage.Reset();
+
+    mControlTypes.clear();
+    mTypeIndices.clear();
+    mFramesInHalfWindow = 0;
+    mNFrames = 0;
+    mLastSlowestControlType = mSlowestControlType = -1;
+  }
+
+  const Histogram& GetFrameTime() const { return mFrameTime; }
+
+  const Histogram& GetStageTime(EStage stage) const { return mStages[stage]; }
+
+  int GetNFrames() const { return mNFrames; }
+
+  /** Call a function for each control type that has been drawn, in the order they were first drawn */
+  void ForEachControlType(std::function<void(const ControlTypeStats& stats)> func) const
+  {
+    for (auto& type : mControlTypes)
+      func(type);
+  }
+
+  /** @return The name of the control type that took the longest to draw in the last frame, or nullptr */
+  const char* GetLastSlowestControlType(double& seconds) const
+  {
+    seconds = mLastSlowestControlTime;
+    return mLastSlowestControlType > -1 ? mControlTypes[mLastSlowestControlType].name.Get() : nullptr;
+  }
+
+  static const char* GetStageName(EStage stage)
+  {
+    static const char* names[kNumStages] = { "Dirty scan", "Region layout", "Draw", "Backend flush" };
+    return names[stage];
+  }
+
+  /** Write a text report of the p50/p99 costs per frame stage and per control type, sorted by p99 cost
+   * @param str The string to write the report into */
+  void GetReport(WDL_String& str) const
+  {
+    auto appendLine = [&str](const char* name, const Histogram& h) {
+      str.AppendFormatted(256, "%-40s %10.1f %10.1f %10.1f %8i\n", name, h.GetPercentile(50.) * 1e6, h.GetPercentile(99.) * 1e6, h.GetMean() * 1e6, h.GetNumSamplesInWindow());
+    };
+
+    str.SetFormatted(256, "IGraphicsProfiler: %i frames, times in us\n", mNFrames);
+    str.AppendFormatted(256, "%-40s %10s %10s %10s %8s\n", "", "p50", "p99", "mean", "n");
+    appendLine("Frame", mFrameTime);
+
+    for (int s = 0; s < kNumStages; s++)
+      appendLine(GetStageName(static_cast<EStage>(s)), mStages[s]);
+
+    std::vector<const ControlTypeStats*> sorted;
+
+    for (auto& type : mControlTypes)
+      sorted.push_back(&type);
+
+    std::sort(sorted.begin(), sorted.end(), [](const ControlTypeStats* a, const ControlTypeStats* b) {
+      return a->drawTime.GetPercentile(99.) > b->drawTime.GetPercentile(99.);
+    });
+
+    for (auto pType : sorted)
+      appendLine(pType->name.Get(), pType->drawTime);
+  }
+
+private:
+  static WDL_String Demangle(const char* name)
+  {
+    WDL_String str(name);
+#if defined(__GNUC__) || defined(__clang__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+
+    if (demangled && status == 0)
+      str.Set(demangled);
+
+    free(demangled);
+#endif
+    return str;
+  }
+
+  Histogram mFrameTime;
+  Histogram mStages[kNumStages];
+  std::vector<ControlTypeStats> mControlTypes;
+  std::unordered_map<std::type_index, int> mTypeIndices;
+  double mFrameCost = 0.;
+  double mSlowestControlTime = 0.;
+  double mLastSlowestControlTime = 0.;
+  int mSlowestControlType = -1;
+  int mLastSlowestControlType = -1;
+  int mFramesInHalfWindow = 0;
+  int mNFrames = 0;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
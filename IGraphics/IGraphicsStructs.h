@@ -2359,6 +2359,7 @@ private:
   IRECT mControlRECT;
   IRECT mRECT;
   bool mInvalid;
+  int mViewGeneration = 0;
 };
 
 /** ILayerPtr is a managed pointer for transferring the ownership of layers */
@@ -106,7 +106,7 @@ void* IGraphicsIOS::OpenWindow(void* pParent)
   
   SetScreenScale([UIScreen mainScreen].scale);
   
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
   GetDelegate()->OnUIOpen();
   
   [view setMultipleTouchEnabled:MultiTouchEnabled()];
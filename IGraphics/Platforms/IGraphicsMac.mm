@@ -99,7 +99,7 @@ void* IGraphicsMac::OpenWindow(void* pParent)
     
   OnViewInitialized([pView layer]);
   SetScreenScale([[NSScreen mainScreen] backingScaleFactor]);
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
   UpdateTooltips();
   GetDelegate()->OnUIOpen();
   
@@ -644,7 +644,7 @@ void* IGraphicsWeb::OpenWindow(void* pHandle)
 
   SetScreenScale(std::ceil(std::max(emscripten_get_device_pixel_ratio(), 1.)));
 
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
   GetDelegate()->OnUIOpen();
   
   return nullptr;
@@ -9,6 +9,7 @@
 */
 
 #include "IPlugAPP_host.h"
+#include "IPlugAPP_realtime.h"
 
 #ifdef OS_WIN
 #include <sys/stat.h>
@@ -58,6 +59,11 @@ bool IPlugAPPHost::Init()
     
   if (!InitState())
     return false;
+
+#if APP_LOCK_MEMORY && defined OS_LINUX
+  mMemoryLocked = LockProcessMemory(); // before any audio buffers exist, so that they are allocated locked
+  DBGMSG("memory %s\n", mMemoryLocked ? "locked" : "not locked, falling back to locking the audio buffers only");
+#endif
   
   TryToChangeAudioDriverType(); // will init RTAudio with an API type based on gState->mAudioDriverType
   ProbeAudioIO(); // find out what audio IO devs are available and put their IDs in the global variables gAudioInputDevs / gAudioOutputDevs
@@ -381,6 +387,11 @@ bool IPlugAPPHost::TryToChangeAudioDriverType()
     mDAC = std::make_unique<RtAudio>(RtAudio::MACOSX_CORE);
   //else
   //mDAC = std::make_unique<RtAudio>(RtAudio::UNIX_JACK);
+#elif defined OS_LINUX
+  if(mState.mAudioDriverType == kDeviceJack)
+    mDAC = std::make_unique<RtAudio>(RtAudio::UNIX_JACK);
+  else
+    mDAC = std::make_unique<RtAudio>(RtAudio::LINUX_ALSA);
 #else
   #error NOT IMPLEMENTED
 #endif
@@ -401,7 +412,7 @@ bool IPlugAPPHost::TryToChangeAudio()
     inputID = GetAudioDeviceIdx(mState.mAudioOutDev.Get());
   else
     inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
-#elif defined OS_MAC
+#elif defined OS_MAC || defined OS_LINUX
   inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
 #else
   #error NOT IMPLEMENTED
@@ -570,6 +581,8 @@ void IPlugAPPHost::CloseAudio()
     }
     
     mDAC->closeStream();
+
+    DBGMSG("audio stream closed, callback thread ran as %s, %u xruns\n", GetAudioThreadScheduling(), GetXRunCount());
   }
 }
 
@@ -592,7 +605,8 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
          sr, mBufferSize, inId, GetAudioDeviceName(inId).c_str(), outId, GetAudioDeviceName(outId).c_str(), iParams.nChannels, oParams.nChannels);
 
   RtAudio::StreamOptions options;
-  options.flags = RTAUDIO_NONINTERLEAVED;
+  options.flags = RTAUDIO_NONINTERLEAVED | RTAUDIO_SCHEDULE_REALTIME; // SCHED_RR for the ALSA callback thread, if permitted
+  options.priority = APP_REALTIME_PRIORITY;
   // options.streamName = BUNDLE_NAME; // JACK stream name, not used on other streams
 
   mBufIndex = 0;
@@ -601,6 +615,8 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
   mVecWait = 0;
   mAudioEnding = false;
   mAudioDone = false;
+  mAudioThreadConfigured = false;
+  mXRunCount = 0;
   
   mIPlug->SetBlockSize(APP_SIGNAL_VECTOR_SIZE);
   mIPlug->SetSampleRate(mSampleRate);
@@ -620,6 +636,7 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
       mOutputBufPtrs.Add(nullptr); //will be set in callback
     }
     
+    PrefaultAudioBuffers();
     mDAC->startStream();
 
     mActiveState = mState;
@@ -663,6 +680,56 @@ bool IPlugAPPHost::InitMidi()
   return true;
 }
 
+bool IPlugAPPHost::PrefaultAudioBuffers()
+{
+#if defined OS_LINUX
+  // with the process locked this only maps the pages, otherwise lock what the callback touches
+  const bool lock = !mMemoryLocked;
+#else
+  const bool lock = false;
+#endif
+  bool locked = true;
+
+  for (int d = 0; d < 2; d++)
+  {
+    const ERoute direction = static_cast<ERoute>(d);
+
+    for (int c = 0; c < mIPlug->MaxNChannels(direction); c++)
+    {
+      WDL_TypedBuf<PLUG_SAMPLE_DST>& buf = mIPlug->GetScratchBuf(direction, c);
+      locked &= PrefaultMemory(buf.Get(), buf.GetSize() * sizeof(PLUG_SAMPLE_DST), lock);
+    }
+  }
+
+  locked &= PrefaultMemory(mInputBufPtrs.GetList(), mInputBufPtrs.GetSize() * sizeof(double*), lock);
+  locked &= PrefaultMemory(mOutputBufPtrs.GetList(), mOutputBufPtrs.GetSize() * sizeof(double*), lock);
+
+#if defined OS_LINUX
+  if (lock && !locked)
+    DBGMSG("couldn't lock the audio buffers, raise the memlock limit to avoid page faults on the audio thread\n");
+#endif
+
+  return locked;
+}
+
+void IPlugAPPHost::ConfigureAudioThread()
+{
+  // RtAudio's ALSA backend applies RTAUDIO_SCHEDULE_REALTIME itself, this covers backends and builds that don't
+  if (!IsThreadRealtime())
+    PromoteThreadToRealtime(APP_REALTIME_PRIORITY);
+
+  PrefaultStack();
+  DescribeThreadScheduling(mAudioThreadScheduling, sizeof(mAudioThreadScheduling));
+  mAudioThreadConfigured.store(true, std::memory_order_release);
+}
+
+//static
+bool IPlugAPPHost::ConfigureWorkerThread(int workerIdx)
+{
+  SetThreadAffinity(workerIdx + 1);
+  return PromoteThreadToRealtime(APP_REALTIME_PRIORITY - 1);
+}
+
 void ApplyFades(double *pBuffer, int nChans, int nFrames, bool down)
 {
   for (int i = 0; i < nChans; i++)
@@ -687,6 +754,12 @@ int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_
 {
   IPlugAPPHost* _this = (IPlugAPPHost*) pUserData;
 
+  if (!_this->mAudioThreadConfigured.load(std::memory_order_relaxed))
+    _this->ConfigureAudioThread();
+
+  if (status & (RTAUDIO_INPUT_OVERFLOW | RTAUDIO_OUTPUT_UNDERFLOW))
+    _this->mXRunCount.fetch_add(1, std::memory_order_relaxed);
+
   int nins = _this->GetPlug()->MaxNChannels(ERoute::kInput);
   int nouts = _this->GetPlug()->MaxNChannels(ERoute::kOutput);
   
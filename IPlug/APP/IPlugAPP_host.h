@@ -28,6 +28,7 @@
  
  */
 
+#include <atomic>
 #include <cstdlib>
 #include <string>
 #include <vector>
@@ -57,6 +58,19 @@
   #define DEFAULT_OUTPUT_DEV "Built-in Output"
 #elif defined(OS_LINUX)
   #include "IPlugSWELL.h"
+  #define DEFAULT_INPUT_DEV "default"
+  #define DEFAULT_OUTPUT_DEV "default"
+#endif
+
+/** SCHED_FIFO priority requested for the audio callback thread on Linux. JACK clients get the priority jackd was started with */
+#ifndef APP_REALTIME_PRIORITY
+  #define APP_REALTIME_PRIORITY 70
+#endif
+
+/** Set to 0 to never mlockall() on Linux. Even when enabled the whole process is only locked if the memlock limit is unlimited or the app
+ * has CAP_IPC_LOCK, otherwise just the audio buffers are locked */
+#ifndef APP_LOCK_MEMORY
+  #define APP_LOCK_MEMORY 1
 #endif
 
 #include "RtAudio.h"
@@ -206,6 +220,21 @@ public:
   bool TryToChangeAudioDriverType();
   bool TryToChangeAudio();
   bool SelectMIDIDevice(ERoute direction, const char* portName);
+
+  /** @return The number of input overflows and output underflows the driver has reported since the stream was opened */
+  uint32_t GetXRunCount() const { return mXRunCount.load(std::memory_order_relaxed); }
+
+  /** @return The scheduling class the audio callback thread runs with, e.g. "SCHED_FIFO 70", or an empty string before the first callback */
+  const char* GetAudioThreadScheduling() const { return mAudioThreadConfigured.load(std::memory_order_acquire) ? mAudioThreadScheduling : ""; }
+
+  /** @return \c true if the whole process is locked into RAM, see APP_LOCK_MEMORY */
+  bool IsMemoryLocked() const { return mMemoryLocked; }
+
+  /** Set up a DSP worker thread the plug-in creates: pins it to CPU \c workerIdx + 1, leaving CPU 0 to the UI and the driver, and
+   * promotes it to one below the audio thread's priority. Call from the worker thread itself
+   * @param workerIdx Zero based index of the worker
+   * @return \c true if the thread is now realtime */
+  static bool ConfigureWorkerThread(int workerIdx);
   
   static int AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData);
   static void MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, void* pUserData);
@@ -216,6 +245,12 @@ public:
 
   IPlugAPP* GetPlug() { return mIPlug.get(); }
 private:
+  /** Prefault the buffers the audio callback touches, and on Linux lock them if the whole process isn't locked
+   * @return \c false if locking them failed */
+  bool PrefaultAudioBuffers();
+  /** Called on the first callback of a stream: promotes the thread if the driver didn't, prefaults its stack and records its scheduling */
+  void ConfigureAudioThread();
+
   std::unique_ptr<IPlugAPP> mIPlug = nullptr;
   std::unique_ptr<RtAudio> mDAC = nullptr;
   std::unique_ptr<RtMidiIn> mMidiIn = nullptr;
@@ -243,6 +278,13 @@ private:
   int32_t mDefaultInputDev = -1;
   /** The index of the operating systems default output device, -1 if not detected */
   int32_t mDefaultOutputDev = -1;
+
+  /** Set by the first callback of a stream, once the thread has been promoted and its stack prefaulted */
+  std::atomic<bool> mAudioThreadConfigured {false};
+  /** Written once by the audio thread before mAudioThreadConfigured is set */
+  char mAudioThreadScheduling[64] = {};
+  std::atomic<uint32_t> mXRunCount {0};
+  bool mMemoryLocked = false;
     
   WDL_String mINIPath;
   
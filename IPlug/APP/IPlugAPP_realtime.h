@@ -0,0 +1,219 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Realtime thread and memory setup for the standalone app's audio path
+ *
+ * On Linux the audio callback thread belongs to RtAudio (ALSA) or to the JACK client library. Unless it is given a realtime
+ * scheduling class, and unless the memory it touches is resident, it competes with every other process and page faults on its first
+ * pass through each buffer, which is where most xruns under load come from.
+ *
+ * These helpers are no-ops returning \c false on other platforms, where CoreAudio, ASIO and DirectSound already run their callbacks
+ * on time-constrained threads. Promotion needs CAP_SYS_NICE or an rtprio limit (e.g. membership of the "audio" group via
+ * /etc/security/limits.d), locking needs a memlock limit, and locking the whole process needs an unlimited one or CAP_IPC_LOCK.
+ * Failures are reported, never fatal.
+ */
+
+#include <cstddef>
+#include <cstdio>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_LINUX
+  #include <cstdlib>
+  #include <cstring>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/mman.h>
+  #include <sys/resource.h>
+  #include <unistd.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The number of bytes of stack PrefaultStack() touches. The audio callback should never need more than this */
+static constexpr size_t kRealtimeStackPrefaultBytes = 128 * 1024;
+
+/** Promote the calling thread to SCHED_FIFO
+ * @param priority The requested realtime priority, clamped to the range the OS allows (1-99 on Linux)
+ * @return \c true if the thread now runs with a realtime policy */
+static inline bool PromoteThreadToRealtime(int priority)
+{
+#if defined OS_LINUX
+  const int minPriority = sched_get_priority_min(SCHED_FIFO);
+  const int maxPriority = sched_get_priority_max(SCHED_FIFO);
+  sched_param param {};
+  param.sched_priority = priority < minPriority ? minPriority : priority > maxPriority ? maxPriority : priority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+  return false;
+#endif
+}
+
+/** @return \c true if the calling thread runs with SCHED_FIFO or SCHED_RR */
+static inline bool IsThreadRealtime()
+{
+#if defined OS_LINUX
+  int policy = 0;
+  sched_param param {};
+
+  if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+    return false;
+
+  return policy == SCHED_FIFO || policy == SCHED_RR;
+#else
+  return false;
+#endif
+}
+
+/** Describe the scheduling class of the calling thread, e.g. "SCHED_FIFO 70". Does not allocate, so it may be called on the audio thread
+ * @param str Destination
+ * @param maxLen Size of \c str in bytes */
+static inline void DescribeThreadScheduling(char* str, size_t maxLen)
+{
+#if defined OS_LINUX
+  int policy = 0;
+  sched_param param {};
+
+  if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+  {
+    snprintf(str, maxLen, "unknown");
+    return;
+  }
+
+  switch (policy)
+  {
+    case SCHED_FIFO: snprintf(str, maxLen, "SCHED_FIFO %i", param.sched_priority); break;
+    case SCHED_RR: snprintf(str, maxLen, "SCHED_RR %i", param.sched_priority); break;
+    default: snprintf(str, maxLen, "SCHED_OTHER"); break;
+  }
+#else
+  snprintf(str, maxLen, "driver default");
+#endif
+}
+
+/** Pin the calling thread to a single CPU. Intended for DSP worker threads, so that they don't migrate between cores mid-block
+ * @param cpu The CPU index, wrapped to the number of online CPUs
+ * @return \c true on success */
+static inline bool SetThreadAffinity(int cpu)
+{
+#if defined OS_LINUX
+  const long nCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (nCPUs < 1 || cpu < 0)
+    return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(static_cast<int>(cpu % nCPUs), &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+/** @return \c true if the process may lock any amount of memory, i.e. its memlock limit is unlimited or it has CAP_IPC_LOCK */
+static inline bool CanLockUnlimitedMemory()
+{
+#if defined OS_LINUX
+  rlimit limit {};
+
+  if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY)
+    return true;
+
+  FILE* pFile = fopen("/proc/self/status", "r");
+
+  if (!pFile)
+    return false;
+
+  static constexpr int kCapIPCLock = 14; // from linux/capability.h
+  char line[256];
+  bool hasCap = false;
+
+  while (fgets(line, sizeof(line), pFile))
+  {
+    if (!strncmp(line, "CapEff:", 7))
+    {
+      hasCap = (strtoull(line + 7, nullptr, 16) >> kCapIPCLock) & 1;
+      break;
+    }
+  }
+
+  fclose(pFile);
+  return hasCap;
+#else
+  return false;
+#endif
+}
+
+/** Lock all current and future pages of the process into RAM, so that the audio thread never waits on a page fault.
+ * With MCL_FUTURE every later allocation counts against the memlock limit and fails once it is reached, so this is only attempted
+ * when CanLockUnlimitedMemory(). Otherwise nothing is locked and the caller should lock just the buffers the audio thread touches
+ * @return \c true if the process is now locked */
+static inline bool LockProcessMemory()
+{
+#if defined OS_LINUX
+  return CanLockUnlimitedMemory() && mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#else
+  return false;
+#endif
+}
+
+/** Touch every page of a buffer so it is mapped before the audio thread uses it, and optionally lock it. The contents are preserved
+ * @param pData Start of the buffer
+ * @param nBytes Size of the buffer
+ * @param lock Also mlock() the range
+ * @return \c false if locking was requested and failed */
+static inline bool PrefaultMemory(void* pData, size_t nBytes, bool lock)
+{
+  if (!pData || !nBytes)
+    return true;
+
+#if defined OS_LINUX
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+  const size_t pageSize = 4096;
+#endif
+
+  volatile char* pBytes = static_cast<volatile char*>(pData);
+
+  for (size_t i = 0; i < nBytes; i += pageSize)
+    pBytes[i] = pBytes[i];
+
+  pBytes[nBytes - 1] = pBytes[nBytes - 1];
+
+#if defined OS_LINUX
+  if (lock)
+    return mlock(pData, nBytes) == 0;
+#endif
+
+  return !lock;
+}
+
+/** Touch kRealtimeStackPrefaultBytes of stack below the caller, so that the audio thread's stack is mapped (and locked, after
+ * LockProcessMemory()) before it is needed. Call once from the thread itself */
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+static inline void PrefaultStack()
+{
+  char stack[kRealtimeStackPrefaultBytes];
+  volatile char* pStack = stack; // volatile so the stores aren't optimised away
+
+  for (size_t i = 0; i < kRealtimeStackPrefaultBytes; i += 1024)
+    pStack[i] = 0;
+}
+
+END_IPLUG_NAMESPACE
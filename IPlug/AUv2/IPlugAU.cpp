@@ -1757,6 +1757,11 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
     }
   }
 
+  if (_this->GetOutputIsSilent())
+  {
+    *pFlags |= kAudioUnitRenderAction_OutputIsSilence;
+  }
+
   if (nRenderNotify)
   {
     for (int i = 0; i < nRenderNotify; ++i)
@@ -628,6 +628,11 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
 
       pPlug->ProcessWithEvents(timestamp, frameCount, realtimeEventListHead, timeInfo);
     }
+
+    if (pPlug->GetOutputIsSilent())
+    {
+      *actionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+    }
     
     return noErr;
   };
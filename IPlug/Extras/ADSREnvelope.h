@@ -107,6 +107,12 @@ public:
     return mStage != kIdle;
   }
 
+  /** @return The current stage, see EStage */
+  int GetStage() const
+  {
+    return mStage;
+  }
+
   /** @return /c true if the envelope is released */
   bool GetReleased() const
   {
@@ -0,0 +1,467 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Biquad coefficient designs and a multi-channel cascaded biquad engine.
+ * Designs are based on:
+ * - Robert Bristow-Johnson's Audio EQ Cookbook
+ * - Martin Vicanek, "Matched Second Order Digital Filters" (2016), which matches the analog magnitude response up to Nyquist
+ */
+
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+#define BIQUADTYPES_VALIST "LowPass", "HighPass", "BandPass", "Notch", "AllPass", "Bell", "LowShelf", "HighShelf"
+
+/** Normalized (a0 = 1) biquad coefficients, for H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2) */
+struct BiquadCoeffs
+{
+  double b0 = 1.;
+  double b1 = 0.;
+  double b2 = 0.;
+  double a1 = 0.;
+  double a2 = 0.;
+
+  bool operator==(const BiquadCoeffs& other) const
+  {
+    return b0 == other.b0 && b1 == other.b1 && b2 == other.b2 && a1 == other.a1 && a2 == other.a2;
+  }
+
+  bool operator!=(const BiquadCoeffs& other) const { return !(*this == other); }
+
+  /** @return The magnitude (linear) of the filter's frequency response at freqCPS */
+  double GetMagnitude(double freqCPS, double sampleRate) const
+  {
+    const double w = 2. * PI * freqCPS / sampleRate;
+    const double c1 = std::cos(w), s1 = std::sin(w);
+    const double c2 = std::cos(2. * w), s2 = std::sin(2. * w);
+
+    const double nr = b0 + b1 * c1 + b2 * c2;
+    const double ni = -(b1 * s1 + b2 * s2);
+    const double dr = 1. + a1 * c1 + a2 * c2;
+    const double di = -(a1 * s1 + a2 * s2);
+
+    return std::sqrt((nr * nr + ni * ni) / (dr * dr + di * di));
+  }
+};
+
+/** Static functions to calculate biquad coefficients */
+class BiquadDesign
+{
+public:
+  enum EType
+  {
+    kLowPass = 0,
+    kHighPass,
+    kBandPass,
+    kNotch,
+    kAllPass,
+    kBell,
+    kLowShelf,
+    kHighShelf,
+    kNumTypes
+  };
+
+  enum EDesign
+  {
+    kRBJ = 0, // bilinear transform with frequency prewarping, cramps near Nyquist
+    kMatched  // Vicanek's matched magnitude designs where available (LowPass, HighPass, BandPass, Bell), otherwise RBJ
+  };
+
+  /** Calculate the coefficients for a filter
+   * @param type The filter response
+   * @param design The design method
+   * @param freqCPS The cutoff or centre frequency in Hz
+   * @param Q The quality factor
+   * @param gainDB The gain in dB, for Bell and shelf types
+   * @param sampleRate The sample rate in Hz */
+  static BiquadCoeffs Calculate(EType type, EDesign design, double freqCPS, double Q, double gainDB, double sampleRate)
+  {
+    freqCPS = Clip(freqCPS, 1., sampleRate * 0.4999);
+    Q = std::max(Q, 0.01);
+
+    if (design == kMatched)
+    {
+      switch (type)
+      {
+        case kLowPass: return MatchedLowPass(freqCPS, Q, sampleRate);
+        case kHighPass: return MatchedHighPass(freqCPS, Q, sampleRate);
+        case kBandPass: return MatchedBandPass(freqCPS, Q, sampleRate);
+        case kBell: return MatchedBell(freqCPS, Q, gainDB, sampleRate);
+        default: break;
+      }
+    }
+
+    return RBJ(type, freqCPS, Q, gainDB, sampleRate);
+  }
+
+  /** Audio EQ Cookbook designs. BandPass has 0 dB peak gain */
+  static BiquadCoeffs RBJ(EType type, double freqCPS, double Q, double gainDB, double sampleRate)
+  {
+    const double w0 = 2. * PI * freqCPS / sampleRate;
+    const double cosw = std::cos(w0);
+    const double alpha = std::sin(w0) / (2. * Q);
+    const double A = std::pow(10., gainDB / 40.);
+    const double sqrtA2alpha = 2. * std::sqrt(A) * alpha;
+
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type)
+    {
+      case kLowPass:
+        b0 = (1. - cosw) * 0.5; b1 = 1. - cosw; b2 = b0;
+        a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+        break;
+      case kHighPass:
+        b0 = (1. + cosw) * 0.5; b1 = -(1. + cosw); b2 = b0;
+        a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+        break;
+      case kBandPass:
+        b0 = alpha; b1 = 0.; b2 = -alpha;
+        a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+        break;
+      case kNotch:
+        b0 = 1.; b1 = -2. * cosw; b2 = 1.;
+        a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+        break;
+      case kAllPass:
+        b0 = 1. - alpha; b1 = -2. * cosw; b2 = 1. + alpha;
+        a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+        break;
+      case kBell:
+        b0 = 1. + alpha * A; b1 = -2. * cosw; b2 = 1. - alpha * A;
+        a0 = 1. + alpha / A; a1 = -2. * cosw; a2 = 1. - alpha / A;
+        break;
+      case kLowShelf:
+        b0 = A * ((A + 1.) - (A - 1.) * cosw + sqrtA2alpha);
+        b1 = 2. * A * ((A - 1.) - (A + 1.) * cosw);
+        b2 = A * ((A + 1.) - (A - 1.) * cosw - sqrtA2alpha);
+        a0 = (A + 1.) + (A - 1.) * cosw + sqrtA2alpha;
+        a1 = -2. * ((A - 1.) + (A + 1.) * cosw);
+        a2 = (A + 1.) + (A - 1.) * cosw - sqrtA2alpha;
+        break;
+      case kHighShelf:
+        b0 = A * ((A + 1.) + (A - 1.) * cosw + sqrtA2alpha);
+        b1 = -2. * A * ((A - 1.) + (A + 1.) * cosw);
+        b2 = A * ((A + 1.) + (A - 1.) * cosw - sqrtA2alpha);
+        a0 = (A + 1.) - (A - 1.) * cosw + sqrtA2alpha;
+        a1 = 2. * ((A - 1.) - (A + 1.) * cosw);
+        a2 = (A + 1.) - (A - 1.) * cosw - sqrtA2alpha;
+        break;
+      default:
+        return BiquadCoeffs();
+    }
+
+    BiquadCoeffs c;
+    c.b0 = b0 / a0;
+    c.b1 = b1 / a0;
+    c.b2 = b2 / a0;
+    c.a1 = a1 / a0;
+    c.a2 = a2 / a0;
+    return c;
+  }
+
+  static BiquadCoeffs MatchedLowPass(double freqCPS, double Q, double sampleRate)
+  {
+    MatchedTerms t(freqCPS, Q, sampleRate);
+
+    const double R1 = (t.A0 * t.phi0 + t.A1 * t.phi1 + t.A2 * t.phi2) * Q * Q;
+    const double B0 = t.A0;
+    const double B1 = (R1 - B0 * t.phi0) / t.phi1;
+
+    BiquadCoeffs c;
+    c.b0 = 0.5 * (std::sqrt(B0) + std::sqrt(std::max(B1, 0.)));
+    c.b1 = std::sqrt(B0) - c.b0;
+    c.b2 = 0.;
+    c.a1 = t.a1;
+    c.a2 = t.a2;
+    return c;
+  }
+
+  static BiquadCoeffs MatchedHighPass(double freqCPS, double Q, double sampleRate)
+  {
+    MatchedTerms t(freqCPS, Q, sampleRate);
+
+    BiquadCoeffs c;
+    c.b0 = Q * std::sqrt(t.A0 * t.phi0 + t.A1 * t.phi1 + t.A2 * t.phi2) / (4. * t.phi1);
+    c.b1 = -2. * c.b0;
+    c.b2 = c.b0;
+    c.a1 = t.a1;
+    c.a2 = t.a2;
+    return c;
+  }
+
+  static BiquadCoeffs MatchedBandPass(double freqCPS, double Q, double sampleRate)
+  {
+    MatchedTerms t(freqCPS, Q, sampleRate);
+
+    const double R1 = t.A0 * t.phi0 + t.A1 * t.phi1 + t.A2 * t.phi2;
+    const double R2 = -t.A0 + t.A1 + 4. * (t.phi0 - t.phi1) * t.A2;
+    const double B2 = (R1 - R2 * t.phi1) / (4. * t.phi1 * t.phi1);
+    const double B1 = R2 + 4. * (t.phi1 - t.phi0) * B2;
+
+    BiquadCoeffs c;
+    c.b1 = -0.5 * std::sqrt(std::max(B1, 0.));
+    c.b0 = 0.5 * (std::sqrt(std::max(B2 + c.b1 * c.b1, 0.)) - c.b1);
+    c.b2 = -c.b0 - c.b1;
+    c.a1 = t.a1;
+    c.a2 = t.a2;
+    return c;
+  }
+
+  static BiquadCoeffs MatchedBell(double freqCPS, double Q, double gainDB, double sampleRate)
+  {
+    const double G = std::pow(10., gainDB / 20.);
+    // the poles of the analog prototype have a quality factor of Q * sqrt(G)
+    MatchedTerms t(freqCPS, Q * std::sqrt(G), sampleRate);
+
+    const double G2 = G * G;
+    const double R1 = (t.A0 * t.phi0 + t.A1 * t.phi1 + t.A2 * t.phi2) * G2;
+    const double R2 = (-t.A0 + t.A1 + 4. * (t.phi0 - t.phi1) * t.A2) * G2;
+    const double B0 = t.A0;
+    const double B2 = (R1 - R2 * t.phi1 - B0) / (4. * t.phi1 * t.phi1);
+    const double B1 = R2 + B0 + 4. * (t.phi1 - t.phi0) * B2;
+    const double W = 0.5 * (std::sqrt(B0) + std::sqrt(std::max(B1, 0.)));
+
+    BiquadCoeffs c;
+    c.b0 = 0.5 * (W + std::sqrt(std::max(W * W + B2, 0.)));
+    c.b1 = 0.5 * (std::sqrt(B0) - std::sqrt(std::max(B1, 0.)));
+    c.b2 = -B2 / (4. * c.b0);
+    c.a1 = t.a1;
+    c.a2 = t.a2;
+    return c;
+  }
+
+private:
+  // impulse invariant poles and the terms shared by the matched designs
+  struct MatchedTerms
+  {
+    double a1, a2, A0, A1, A2, phi0, phi1, phi2;
+
+    MatchedTerms(double freqCPS, double Q, double sampleRate)
+    {
+      const double w0 = 2. * PI * freqCPS / sampleRate;
+      const double q = 1. / (2. * Q);
+      const double expqw = std::exp(-q * w0);
+
+      if (q <= 1.)
+        a1 = -2. * expqw * std::cos(std::sqrt(1. - q * q) * w0);
+      else
+        a1 = -2. * expqw * std::cosh(std::sqrt(q * q - 1.) * w0);
+
+      a2 = expqw * expqw;
+
+      const double s = std::sin(w0 * 0.5);
+      phi1 = s * s;
+      phi0 = 1. - phi1;
+      phi2 = 4. * phi0 * phi1;
+
+      A0 = (1. + a1 + a2) * (1. + a1 + a2);
+      A1 = (1. - a1 + a2) * (1. - a1 + a2);
+      A2 = -4. * a2;
+    }
+  };
+};
+
+/** A cascade of up to MAXBANDS biquads applied in series to up to MAXCHANS channels.
+ * Channels are packed into groups of NLANES, and each group is processed as a structure of arrays in transposed direct form II,
+ * so that the inner loops over lanes are vectorised by the compiler (SSE/AVX/NEON).
+ * New coefficients are linearly interpolated per sample over the next ProcessBlock() call, so they can be changed every block without zipper noise.
+ * All bands share coefficients across channels */
+template<typename T = double, int MAXCHANS = 2, int MAXBANDS = 8, int NLANES = 4>
+class BiquadCascade
+{
+public:
+  static constexpr int kNGroups = (MAXCHANS + NLANES - 1) / NLANES;
+  static constexpr int kChunkSize = 64; // samples processed per band before moving to the next band
+
+  BiquadCascade()
+  {
+    Reset();
+  }
+
+  /** Set the number of biquads in use, from the first */
+  void SetNBands(int nBands)
+  {
+    mNBands = Clip(nBands, 0, MAXBANDS);
+  }
+
+  int GetNBands() const { return mNBands; }
+
+  /** Set the coefficients for a band, to be reached by the end of the next ProcessBlock()
+   * @param band The band index
+   * @param coeffs The target coefficients
+   * @param immediate If \c true, jump to the coefficients without interpolating, e.g. when starting up */
+  void SetCoefficients(int band, const BiquadCoeffs& coeffs, bool immediate = false)
+  {
+    assert(band >= 0 && band < MAXBANDS);
+
+    mTarget[band] = coeffs;
+
+    if (immediate)
+      mCurrent[band] = coeffs;
+  }
+
+  const BiquadCoeffs& GetCoefficients(int band) const { return mTarget[band]; }
+
+  /** Clear the filter states */
+  void Reset()
+  {
+    memset(mS1, 0, sizeof(mS1));
+    memset(mS2, 0, sizeof(mS2));
+  }
+
+  /** @return The magnitude (linear) of the cascade's response at freqCPS, using the target coefficients. Suitable for UI curve drawing */
+  double GetMagnitude(double freqCPS, double sampleRate) const
+  {
+    double mag = 1.;
+
+    for (int b = 0; b < mNBands; b++)
+      mag *= mTarget[b].GetMagnitude(freqCPS, sampleRate);
+
+    return mag;
+  }
+
+  /** Process a block, in place processing is allowed
+   * @param inputs Pointer to nChans input channel arrays
+   * @param outputs Pointer to nChans output channel arrays
+   * @param nChans The number of channels, up to MAXCHANS
+   * @param nFrames The number of sample frames */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames)
+  {
+    assert(nChans <= MAXCHANS);
+
+    if (nFrames <= 0)
+      return;
+
+    // per sample coefficient increments to reach the targets at the end of the block
+    const double invFrames = 1. / nFrames;
+
+    for (int b = 0; b < mNBands; b++)
+    {
+      const BiquadCoeffs& from = mCurrent[b];
+      const BiquadCoeffs& to = mTarget[b];
+      mInterpolating[b] = from != to;
+      mIncr[b].b0 = (to.b0 - from.b0) * invFrames;
+      mIncr[b].b1 = (to.b1 - from.b1) * invFrames;
+      mIncr[b].b2 = (to.b2 - from.b2) * invFrames;
+      mIncr[b].a1 = (to.a1 - from.a1) * invFrames;
+      mIncr[b].a2 = (to.a2 - from.a2) * invFrames;
+    }
+
+    for (int g = 0; g < kNGroups && g * NLANES < nChans; g++)
+    {
+      const int chanOffset = g * NLANES;
+      const int nLanesUsed = std::min(NLANES, nChans - chanOffset);
+
+      for (int start = 0; start < nFrames; start += kChunkSize)
+      {
+        const int n = std::min(kChunkSize, nFrames - start);
+
+        // transpose the input into lanes
+        for (int s = 0; s < n; s++)
+        {
+          for (int l = 0; l < NLANES; l++)
+            mBuffer[s][l] = l < nLanesUsed ? inputs[chanOffset + l][start + s] : T(0);
+        }
+
+        for (int b = 0; b < mNBands; b++)
+          ProcessBand(g, b, start, n);
+
+        for (int l = 0; l < nLanesUsed; l++)
+        {
+          T* pOut = outputs[chanOffset + l] + start;
+
+          for (int s = 0; s < n; s++)
+            pOut[s] = mBuffer[s][l];
+        }
+      }
+    }
+
+    for (int b = 0; b < mNBands; b++)
+      mCurrent[b] = mTarget[b];
+  }
+
+private:
+  void ProcessBand(int group, int band, int blockPos, int nFrames)
+  {
+    T* s1 = mS1[group][band];
+    T* s2 = mS2[group][band];
+
+    const BiquadCoeffs& c = mCurrent[band];
+
+    if (!mInterpolating[band])
+    {
+      const T b0 = T(c.b0), b1 = T(c.b1), b2 = T(c.b2), a1 = T(c.a1), a2 = T(c.a2);
+
+      for (int s = 0; s < nFrames; s++)
+      {
+        T* x = mBuffer[s];
+
+        for (int l = 0; l < NLANES; l++)
+        {
+          const T y = b0 * x[l] + s1[l];
+          s1[l] = b1 * x[l] - a1 * y + s2[l];
+          s2[l] = b2 * x[l] - a2 * y;
+          x[l] = y;
+        }
+      }
+    }
+    else
+    {
+      const BiquadCoeffs& d = mIncr[band];
+
+      for (int s = 0; s < nFrames; s++)
+      {
+        const double t = blockPos + s + 1;
+        const T b0 = T(c.b0 + d.b0 * t), b1 = T(c.b1 + d.b1 * t), b2 = T(c.b2 + d.b2 * t);
+        const T a1 = T(c.a1 + d.a1 * t), a2 = T(c.a2 + d.a2 * t);
+        T* x = mBuffer[s];
+
+        for (int l = 0; l < NLANES; l++)
+        {
+          const T y = b0 * x[l] + s1[l];
+          s1[l] = b1 * x[l] - a1 * y + s2[l];
+          s2[l] = b2 * x[l] - a2 * y;
+          x[l] = y;
+        }
+      }
+    }
+
+    // flush denormals in the states
+    for (int l = 0; l < NLANES; l++)
+    {
+      if (std::abs(s1[l]) < T(1e-30)) s1[l] = T(0);
+      if (std::abs(s2[l]) < T(1e-30)) s2[l] = T(0);
+    }
+  }
+
+  alignas(32) T mBuffer[kChunkSize][NLANES];
+  alignas(32) T mS1[kNGroups][MAXBANDS][NLANES];
+  alignas(32) T mS2[kNGroups][MAXBANDS][NLANES];
+  BiquadCoeffs mCurrent[MAXBANDS];
+  BiquadCoeffs mTarget[MAXBANDS];
+  BiquadCoeffs mIncr[MAXBANDS];
+  bool mInterpolating[MAXBANDS] = {};
+  int mNBands = 0;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,548 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Vectorised approximations of exp2/log2, dB/amplitude conversion, tanh, sin/cos and pow, with accuracy tiers.
+ * The block functions process float or double arrays four lanes at a time with SSE2 or NEON, and fall back to scalar
+ * code elsewhere (or when IPLUG_FASTMATH_NO_SIMD is defined). Double arrays are computed in single precision.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+
+#if !defined(IPLUG_FASTMATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define IPLUG_FASTMATH_SSE2
+  #include <emmintrin.h>
+#elif !defined(IPLUG_FASTMATH_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+  #define IPLUG_FASTMATH_NEON
+  #include <arm_neon.h>
+#endif
+
+/** The tier used when none is specified: Exact, Precise or Fast */
+#ifndef IPLUG_FASTMATH_DEFAULT_ACCURACY
+#define IPLUG_FASTMATH_DEFAULT_ACCURACY Precise
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Accuracy tiers for FastMath. The bounds are the maximum error against libm in double precision:
+ * relative error for Exp2, DBToAmp and Pow, and error relative to max(1, |result|) for Log2, AmpToDB, Tanh, Sin and Cos */
+enum class EMathAccuracy
+{
+  Exact,   ///< libm in double precision, one value at a time. DBToAmp and AmpToDB are the IPlugUtilities functions
+  Precise, ///< Error <= 1e-6, a few float ulps
+  Fast     ///< Error <= 1e-3, lower order polynomials
+};
+
+/** Block and scalar approximations of common DSP and UI conversions.
+ * Block functions take the tier as a template argument, or as the first argument to choose it at runtime.
+ * Input and output may be the same array.
+ * Out of range inputs are clamped rather than producing inf/NaN: Exp2 clamps to [-126, 127],
+ * Log2/AmpToDB treat inputs below FLT_MIN (including 0 and negative values) as FLT_MIN (-126 octaves, about -758.5dB),
+ * Pow expects a positive base. Sin and Cos reduce the argument in single precision, |x| should be below about 1e5
+ * @code
+ * FastMath::AmpToDB<EMathAccuracy::Fast>(peaks, peaksDB, nChans);
+ * FastMath::Tanh(mAccuracy, pBuffer, pBuffer, nFrames);
+ * const float y = FastMath::Tanh(x);
+ * @endcode */
+class FastMath
+{
+public:
+  static constexpr EMathAccuracy kDefaultAccuracy = EMathAccuracy::IPLUG_FASTMATH_DEFAULT_ACCURACY;
+
+#pragma mark - Block functions, accuracy chosen at compile time
+
+  /** \f$ 2^x \f$ */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Exp2(const T* pIn, T* pOut, int n) { Process(OpExp2<A>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  /** \f$ log_2(x) \f$ */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Log2(const T* pIn, T* pOut, int n) { Process(OpLog2<A>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  /** Gain from dB, see iplug::DBToAmp() */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void DBToAmp(const T* pIn, T* pOut, int n) { Process(OpDBToAmp<A>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  /** dB from gain, see iplug::AmpToDB() */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void AmpToDB(const T* pIn, T* pOut, int n) { Process(OpAmpToDB<A>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Tanh(const T* pIn, T* pOut, int n) { Process(OpTanh<A>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Sin(const T* pIn, T* pOut, int n) { Process(OpSin<A, 0>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Cos(const T* pIn, T* pOut, int n) { Process(OpSin<A, 1>(), pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  /** \f$ x^y \f$ for a positive base array and a constant exponent. The relative error grows with |y * log2(x)|
+   * (about 1e-7 per unit for Precise), the tier bounds hold while it is below about 8 */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Pow(const T* pBase, T exponent, T* pOut, int n) { Process(OpPow<A>(static_cast<float>(exponent)), pBase, static_cast<const T*>(nullptr), pOut, n); }
+
+  /** \f$ x^y \f$ element-wise, for a positive base array and an array of exponents */
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static void Pow(const T* pBase, const T* pExponent, T* pOut, int n) { Process(OpPow<A>(), pBase, pExponent, pOut, n); }
+
+#pragma mark - Block functions, accuracy chosen at runtime
+
+  template <typename T>
+  static void Exp2(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpExp2>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void Log2(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpLog2>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void DBToAmp(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpDBToAmp>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void AmpToDB(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpAmpToDB>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void Tanh(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpTanh>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void Sin(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpSine>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void Cos(EMathAccuracy accuracy, const T* pIn, T* pOut, int n) { Dispatch<OpCosine>(accuracy, pIn, static_cast<const T*>(nullptr), pOut, n); }
+
+  template <typename T>
+  static void Pow(EMathAccuracy accuracy, const T* pBase, T exponent, T* pOut, int n)
+  {
+    switch (accuracy)
+    {
+      case EMathAccuracy::Exact: Pow<EMathAccuracy::Exact>(pBase, exponent, pOut, n); break;
+      case EMathAccuracy::Precise: Pow<EMathAccuracy::Precise>(pBase, exponent, pOut, n); break;
+      case EMathAccuracy::Fast: Pow<EMathAccuracy::Fast>(pBase, exponent, pOut, n); break;
+    }
+  }
+
+  template <typename T>
+  static void Pow(EMathAccuracy accuracy, const T* pBase, const T* pExponent, T* pOut, int n) { Dispatch<OpPow>(accuracy, pBase, pExponent, pOut, n); }
+
+#pragma mark - Scalar functions
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Exp2(T x) { return ProcessOne(OpExp2<A>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Log2(T x) { return ProcessOne(OpLog2<A>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T DBToAmp(T x) { return ProcessOne(OpDBToAmp<A>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T AmpToDB(T x) { return ProcessOne(OpAmpToDB<A>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Tanh(T x) { return ProcessOne(OpTanh<A>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Sin(T x) { return ProcessOne(OpSin<A, 0>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Cos(T x) { return ProcessOne(OpSin<A, 1>(), x); }
+
+  template <EMathAccuracy A = kDefaultAccuracy, typename T>
+  static T Pow(T x, T y) { return ProcessOne(OpPow<A>(static_cast<float>(y)), x); }
+
+private:
+#pragma mark - Lanes
+
+#if defined IPLUG_FASTMATH_SSE2
+  static constexpr int kLanes = 4;
+
+  struct VI
+  {
+    __m128i v;
+    VI operator+(VI b) const { return {_mm_add_epi32(v, b.v)}; }
+    VI operator-(VI b) const { return {_mm_sub_epi32(v, b.v)}; }
+    VI operator&(VI b) const { return {_mm_and_si128(v, b.v)}; }
+  };
+
+  struct VF
+  {
+    __m128 v;
+    VF operator+(VF b) const { return {_mm_add_ps(v, b.v)}; }
+    VF operator-(VF b) const { return {_mm_sub_ps(v, b.v)}; }
+    VF operator*(VF b) const { return {_mm_mul_ps(v, b.v)}; }
+    VF operator/(VF b) const { return {_mm_div_ps(v, b.v)}; }
+  };
+
+  static inline VF Load(const float* p) { return {_mm_loadu_ps(p)}; }
+  static inline void Store(float* p, VF a) { _mm_storeu_ps(p, a.v); }
+  static inline VF Splat(float x) { return {_mm_set1_ps(x)}; }
+  static inline VI SplatI(int32_t x) { return {_mm_set1_epi32(x)}; }
+  static inline VF Min(VF a, VF b) { return {_mm_min_ps(a.v, b.v)}; }
+  static inline VF Max(VF a, VF b) { return {_mm_max_ps(a.v, b.v)}; }
+  static inline VI RoundToInt(VF a) { return {_mm_cvtps_epi32(a.v)}; } // round to nearest, the default MXCSR mode
+  static inline VF ToFloat(VI a) { return {_mm_cvtepi32_ps(a.v)}; }
+  static inline VI AsInt(VF a) { return {_mm_castps_si128(a.v)}; }
+  static inline VF AsFloat(VI a) { return {_mm_castsi128_ps(a.v)}; }
+  template <int N> static inline VI ShiftLeft(VI a) { return {_mm_slli_epi32(a.v, N)}; }
+  template <int N> static inline VI ShiftRight(VI a) { return {_mm_srli_epi32(a.v, N)}; }
+  static inline VI Greater(VF a, VF b) { return {_mm_castps_si128(_mm_cmpgt_ps(a.v, b.v))}; }
+  static inline VF Select(VI mask, VF a, VF b) { const __m128 m = _mm_castsi128_ps(mask.v); return {_mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v))}; }
+#elif defined IPLUG_FASTMATH_NEON
+  static constexpr int kLanes = 4;
+
+  struct VI
+  {
+    int32x4_t v;
+    VI operator+(VI b) const { return {vaddq_s32(v, b.v)}; }
+    VI operator-(VI b) const { return {vsubq_s32(v, b.v)}; }
+    VI operator&(VI b) const { return {vandq_s32(v, b.v)}; }
+  };
+
+  struct VF
+  {
+    float32x4_t v;
+    VF operator+(VF b) const { return {vaddq_f32(v, b.v)}; }
+    VF operator-(VF b) const { return {vsubq_f32(v, b.v)}; }
+    VF operator*(VF b) const { return {vmulq_f32(v, b.v)}; }
+#if defined(__aarch64__) || defined(_M_ARM64)
+    VF operator/(VF b) const { return {vdivq_f32(v, b.v)}; }
+#else
+    VF operator/(VF b) const
+    {
+      float32x4_t r = vrecpeq_f32(b.v);
+      r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+      r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+      return {vmulq_f32(v, r)};
+    }
+#endif
+  };
+
+  static inline VF Load(const float* p) { return {vld1q_f32(p)}; }
+  static inline void Store(float* p, VF a) { vst1q_f32(p, a.v); }
+  static inline VF Splat(float x) { return {vdupq_n_f32(x)}; }
+  static inline VI SplatI(int32_t x) { return {vdupq_n_s32(x)}; }
+  static inline VF Min(VF a, VF b) { return {vminq_f32(a.v, b.v)}; }
+  static inline VF Max(VF a, VF b) { return {vmaxq_f32(a.v, b.v)}; }
+#if defined(__aarch64__) || defined(_M_ARM64)
+  static inline VI RoundToInt(VF a) { return {vcvtnq_s32_f32(a.v)}; }
+#else
+  static inline VI RoundToInt(VF a) { return {vcvtq_s32_f32(vaddq_f32(a.v, vbslq_f32(vcltq_f32(a.v, vdupq_n_f32(0.f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))))}; }
+#endif
+  static inline VF ToFloat(VI a) { return {vcvtq_f32_s32(a.v)}; }
+  static inline VI AsInt(VF a) { return {vreinterpretq_s32_f32(a.v)}; }
+  static inline VF AsFloat(VI a) { return {vreinterpretq_f32_s32(a.v)}; }
+  template <int N> static inline VI ShiftLeft(VI a) { return {vshlq_n_s32(a.v, N)}; }
+  template <int N> static inline VI ShiftRight(VI a) { return {vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a.v), N))}; }
+  static inline VI Greater(VF a, VF b) { return {vreinterpretq_s32_u32(vcgtq_f32(a.v, b.v))}; }
+  static inline VF Select(VI mask, VF a, VF b) { return {vbslq_f32(vreinterpretq_u32_s32(mask.v), a.v, b.v)}; }
+#else
+  static constexpr int kLanes = 1;
+
+  struct VI
+  {
+    int32_t v;
+    VI operator+(VI b) const { return {static_cast<int32_t>(static_cast<uint32_t>(v) + static_cast<uint32_t>(b.v))}; }
+    VI operator-(VI b) const { return {static_cast<int32_t>(static_cast<uint32_t>(v) - static_cast<uint32_t>(b.v))}; }
+    VI operator&(VI b) const { return {v & b.v}; }
+  };
+
+  struct VF
+  {
+    float v;
+    VF operator+(VF b) const { return {v + b.v}; }
+    VF operator-(VF b) const { return {v - b.v}; }
+    VF operator*(VF b) const { return {v * b.v}; }
+    VF operator/(VF b) const { return {v / b.v}; }
+  };
+
+  static inline VF Load(const float* p) { return {*p}; }
+  static inline void Store(float* p, VF a) { *p = a.v; }
+  static inline VF Splat(float x) { return {x}; }
+  static inline VI SplatI(int32_t x) { return {x}; }
+  static inline VF Min(VF a, VF b) { return {b.v < a.v ? b.v : a.v}; }
+  static inline VF Max(VF a, VF b) { return {b.v > a.v ? b.v : a.v}; }
+  static inline VI RoundToInt(VF a) { return {static_cast<int32_t>(std::lrint(a.v))}; }
+  static inline VF ToFloat(VI a) { return {static_cast<float>(a.v)}; }
+  static inline VI AsInt(VF a) { VI r; memcpy(&r.v, &a.v, sizeof(float)); return r; }
+  static inline VF AsFloat(VI a) { VF r; memcpy(&r.v, &a.v, sizeof(float)); return r; }
+  template <int N> static inline VI ShiftLeft(VI a) { return {static_cast<int32_t>(static_cast<uint32_t>(a.v) << N)}; }
+  template <int N> static inline VI ShiftRight(VI a) { return {static_cast<int32_t>(static_cast<uint32_t>(a.v) >> N)}; }
+  static inline VI Greater(VF a, VF b) { return {a.v > b.v ? -1 : 0}; }
+  static inline VF Select(VI mask, VF a, VF b) { return mask.v ? a : b; }
+#endif
+
+  static inline VF Abs(VF a) { return AsFloat(AsInt(a) & SplatI(0x7fffffff)); }
+  static inline VF FlipSign(VF a, VI signBit) { return AsFloat(AsInt(a) + signBit); } // signBit is 0 or 0x80000000
+
+#pragma mark - Kernels
+
+  /** 2^f for f in [-0.5, 0.5], minimax polynomials */
+  template <EMathAccuracy A>
+  static inline VF Exp2Poly(VF f)
+  {
+    if (A == EMathAccuracy::Fast) // 7.5e-5
+      return ((Splat(0.0551716691f) * f + Splat(0.242611122f)) * f + Splat(0.693260985f)) * f + Splat(0.999928074f);
+    else // 7.5e-8
+      return ((((Splat(0.00132764722f) * f + Splat(0.00967554133f)) * f + Splat(0.0555071327f)) * f + Splat(0.240221197f)) * f + Splat(0.693146967f)) * f + Splat(1.00000007f);
+  }
+
+  /** 2^(k + f) */
+  static inline VF Scale2(VF p, VI k) { return p * AsFloat(ShiftLeft<23>(k + SplatI(127))); }
+
+  template <EMathAccuracy A>
+  static inline VF Exp2V(VF x)
+  {
+    x = Min(Max(x, Splat(-126.f)), Splat(127.f));
+    const VI k = RoundToInt(x);
+    return Scale2(Exp2Poly<A>(x - ToFloat(k)), k);
+  }
+
+  /** 2^(x * c) where c = cHi + cLo and cHi has 12 significant bits. The Precise tier splits the product so that rounding
+   * it doesn't cost accuracy for large x */
+  template <EMathAccuracy A>
+  static inline VF Exp2ScaledV(VF x, float cHi, float cLo, float limit)
+  {
+    x = Min(Max(x, Splat(-limit)), Splat(limit));
+
+    if (A == EMathAccuracy::Fast)
+      return Exp2V<A>(x * Splat(cHi + cLo));
+
+    const VF xHi = AsFloat(AsInt(x) & SplatI(static_cast<int32_t>(0xfffff000u)));
+    const VF xLo = x - xHi;
+    const VF yHi = xHi * Splat(cHi); // exact
+    const VI k = RoundToInt(x * Splat(cHi + cLo));
+    const VF f = (yHi - ToFloat(k)) + (xLo * Splat(cHi) + x * Splat(cLo));
+    return Scale2(Exp2Poly<A>(f), k);
+  }
+
+  template <EMathAccuracy A>
+  static inline VF Log2V(VF x)
+  {
+    const VI bits = AsInt(Max(x, Splat(1.17549435e-38f)));
+    VI e = ShiftRight<23>(bits) - SplatI(127);
+    VF m = AsFloat((bits & SplatI(0x007fffff)) + SplatI(0x3f800000)); // [1, 2)
+    const VI big = Greater(m, Splat(1.41421356f));
+    m = Select(big, m * Splat(0.5f), m); // [sqrt(0.5), sqrt(2))
+    e = e - big;
+
+    // log2(m) = t * P(t^2) with t = (m - 1) / (m + 1), a minimax fit of 2 atanh(t) / (t ln(2))
+    const VF t = (m - Splat(1.f)) / (m + Splat(1.f));
+    const VF u = t * t;
+    VF p;
+    if (A == EMathAccuracy::Fast) // 1.1e-5
+      p = Splat(0.979149856f) * u + Splat(2.88532555f);
+    else // 5.9e-8
+      p = (Splat(0.595796515f) * u + Splat(0.961587861f)) * u + Splat(2.88539043f);
+
+    return ToFloat(e) + t * p;
+  }
+
+  template <EMathAccuracy A>
+  static inline VF TanhV(VF x)
+  {
+    // 2 / ln(2), beyond |x| = 9 tanh(x) rounds to +-1 in single precision
+    const VF e = Exp2ScaledV<A>(x, 2.8857421875f, -3.52105708e-4f, 9.f);
+    return (e - Splat(1.f)) / (e + Splat(1.f));
+  }
+
+  /** sin(x + quadrant * pi/2) */
+  template <EMathAccuracy A, int quadrant>
+  static inline VF SinV(VF x)
+  {
+    const VI q = RoundToInt(x * Splat(0.636619772f));
+    const VF qf = ToFloat(q);
+    // x - q * pi/2 in three parts (Cody-Waite), the first two are exact for |q| < 2^16
+    const VF r = ((x - qf * Splat(1.5703125f)) - qf * Splat(4.83751296997e-4f)) - qf * Splat(7.54978995489e-8f);
+    const VF u = r * r;
+
+    VF s, c;
+    if (A == EMathAccuracy::Fast) // 1.1e-6, 1e-5
+    {
+      s = r * ((Splat(0.00815163558f) * u + Splat(-0.166624802f)) * u + Splat(0.999998569f));
+      c = (Splat(0.0403985360f) * u + Splat(-0.499708140f)) * u + Splat(0.999990035f);
+    }
+    else // 2.4e-9, 2.8e-8
+    {
+      s = r * (((Splat(-1.95040220e-4f) * u + Splat(0.00833203688f)) * u + Splat(-0.166666507f)) * u + Splat(0.999999997f));
+      c = ((Splat(-0.00135859085f) * u + Splat(0.0416550269f)) * u + Splat(-0.499998567f)) * u + Splat(0.999999972f);
+    }
+
+    // odd quadrants use cos(r), quadrants 2 and 3 are negated
+    const VI qq = q + SplatI(quadrant);
+    const VI odd = SplatI(0) - (qq & SplatI(1));
+    return FlipSign(Select(odd, c, s), ShiftLeft<30>(qq & SplatI(2)));
+  }
+
+#pragma mark - Ops
+
+  template <EMathAccuracy A>
+  struct OpExp2
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    VF operator()(VF x, VF) const { return Exp2V<A>(x); }
+    double operator()(double x, double) const { return std::exp2(x); }
+  };
+
+  template <EMathAccuracy A>
+  struct OpLog2
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    VF operator()(VF x, VF) const { return Log2V<A>(x); }
+    double operator()(double x, double) const { return std::log2(x); }
+  };
+
+  template <EMathAccuracy A>
+  struct OpDBToAmp
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    // log2(10) / 20, clamped to the Exp2 range
+    VF operator()(VF x, VF) const { return Exp2ScaledV<A>(x, 0.16607666015625f, 1.97445879e-5f, 758.f); }
+    double operator()(double x, double) const { return iplug::DBToAmp(x); }
+  };
+
+  template <EMathAccuracy A>
+  struct OpAmpToDB
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    // 20 * log10(2)
+    VF operator()(VF x, VF) const { return Log2V<A>(Abs(x)) * Splat(6.02059991f); }
+    double operator()(double x, double) const { return iplug::AmpToDB(x); }
+  };
+
+  template <EMathAccuracy A>
+  struct OpTanh
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    VF operator()(VF x, VF) const { return TanhV<A>(x); }
+    double operator()(double x, double) const { return std::tanh(x); }
+  };
+
+  template <EMathAccuracy A, int quadrant>
+  struct OpSin
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    VF operator()(VF x, VF) const { return SinV<A, quadrant>(x); }
+    double operator()(double x, double) const { return quadrant ? std::cos(x) : std::sin(x); }
+  };
+
+  template <EMathAccuracy A> using OpSine = OpSin<A, 0>;
+  template <EMathAccuracy A> using OpCosine = OpSin<A, 1>;
+
+  /** With a constant exponent, or the second input array when there is one */
+  template <EMathAccuracy A>
+  struct OpPow
+  {
+    static constexpr EMathAccuracy kAccuracy = A;
+    OpPow(float exponent = 1.f) : mExponent(exponent) {}
+    VF operator()(VF x, VF y) const { return Exp2V<A>(y * Log2V<A>(x)); }
+    double operator()(double x, double y) const { return std::pow(x, y); }
+    float mExponent;
+  };
+
+  template <typename Op> static float GetY(const Op&) { return 0.f; }
+  template <EMathAccuracy A> static float GetY(const OpPow<A>& op) { return op.mExponent; }
+
+#pragma mark - Loops
+
+  static constexpr int kBlockSize = 64;
+
+  template <typename Op>
+  static void ProcessFloat(const Op& op, const float* pX, const float* pY, float* pOut, int n)
+  {
+    const VF yConst = Splat(GetY(op));
+    int i = 0;
+
+    for (; i + kLanes <= n; i += kLanes)
+      Store(pOut + i, op(Load(pX + i), pY ? Load(pY + i) : yConst));
+
+    if (i < n)
+    {
+      float x[kLanes] = {}, y[kLanes] = {};
+      std::copy(pX + i, pX + n, x);
+      if (pY)
+        std::copy(pY + i, pY + n, y);
+      Store(x, op(Load(x), pY ? Load(y) : yConst));
+      std::copy(x, x + (n - i), pOut + i);
+    }
+  }
+
+  template <typename Op, typename T>
+  static void Process(const Op& op, const T* pX, const T* pY, T* pOut, int n)
+  {
+    if (Op::kAccuracy == EMathAccuracy::Exact)
+    {
+      const double y = GetY(op);
+      for (int i = 0; i < n; i++)
+        pOut[i] = static_cast<T>(op(static_cast<double>(pX[i]), pY ? static_cast<double>(pY[i]) : y));
+    }
+    else
+      ProcessConverted(op, pX, pY, pOut, n);
+  }
+
+  template <typename Op>
+  static void ProcessConverted(const Op& op, const float* pX, const float* pY, float* pOut, int n)
+  {
+    ProcessFloat(op, pX, pY, pOut, n);
+  }
+
+  /** Other sample types go through a float buffer */
+  template <typename Op, typename T>
+  static void ProcessConverted(const Op& op, const T* pX, const T* pY, T* pOut, int n)
+  {
+    float x[kBlockSize], y[kBlockSize];
+
+    for (int start = 0; start < n; start += kBlockSize)
+    {
+      const int count = std::min(kBlockSize, n - start);
+      for (int i = 0; i < count; i++)
+        x[i] = static_cast<float>(pX[start + i]);
+      if (pY)
+      {
+        for (int i = 0; i < count; i++)
+          y[i] = static_cast<float>(pY[start + i]);
+      }
+      ProcessFloat(op, x, pY ? y : nullptr, x, count);
+      for (int i = 0; i < count; i++)
+        pOut[start + i] = static_cast<T>(x[i]);
+    }
+  }
+
+  template <typename Op, typename T>
+  static T ProcessOne(const Op& op, T x)
+  {
+    if (Op::kAccuracy == EMathAccuracy::Exact)
+      return static_cast<T>(op(static_cast<double>(x), static_cast<double>(GetY(op))));
+
+    float result[kLanes];
+    Store(result, op(Splat(static_cast<float>(x)), Splat(GetY(op))));
+    return static_cast<T>(result[0]);
+  }
+
+  template <template <EMathAccuracy> class Op, typename T>
+  static void Dispatch(EMathAccuracy accuracy, const T* pX, const T* pY, T* pOut, int n)
+  {
+    switch (accuracy)
+    {
+      case EMathAccuracy::Exact: Process(Op<EMathAccuracy::Exact>(), pX, pY, pOut, n); break;
+      case EMathAccuracy::Precise: Process(Op<EMathAccuracy::Precise>(), pX, pY, pOut, n); break;
+      case EMathAccuracy::Fast: Process(Op<EMathAccuracy::Fast>(), pX, pY, pOut, n); break;
+    }
+  }
+};
+
+END_IPLUG_NAMESPACE
@@ -16,6 +16,7 @@
  */
 
 #include "Oscillator.h"
+#include "TransportTracker.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -142,6 +143,27 @@ public:
     IOscillator<T>::mPhase = phase;
   }
   
+  /* Block process function using the sample accurate positions of a TransportTracker, so that the phase follows tempo ramps and loop wraps within the block */
+  void ProcessBlock(T* pOutput, int nFrames, const TransportTracker& transport)
+  {
+    if (mRateMode == ERateMode::kBPM && transport.IsRunning())
+    {
+      T oneOverQNScalar = 1./mQNScalar;
+      const double* pQNPos = transport.GetPPQBuffer();
+      T phase = IOscillator<T>::mPhase;
+
+      for (int s=0; s<nFrames; s++)
+      {
+        phase = std::fmod(pQNPos[s], oneOverQNScalar) / oneOverQNScalar;
+        pOutput[s] = DoProcess(phase);
+      }
+
+      IOscillator<T>::mPhase = phase;
+    }
+    else
+      ProcessBlock(pOutput, nFrames, 0., false, transport.GetTempo(0));
+  }
+  
   void SetShape(int lfoShape)
   {
     mShape = (EShape) Clip(lfoShape, 0, kNumShapes-1);
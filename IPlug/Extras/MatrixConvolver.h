@@ -0,0 +1,303 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc MatrixConvolver
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "fft.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Uniformly partitioned convolution of nIns inputs with an nIns x nOuts matrix of impulse responses, e.g. true stereo (2x2) or
+ * ambisonic (NxM) reverbs.
+ *
+ * WDL_ConvolutionEngine convolves channel i with impulse i only, so a matrix needs one engine per input and every engine transforms the
+ * same input again. Here each input block is transformed once into a frequency domain delay line and multiply-accumulated against the
+ * spectra of every impulse it is routed to, followed by one inverse FFT per output. Spectra are kept as separate real/imaginary arrays so
+ * that the multiply-accumulate loop vectorises. Partitions where the impulse or the input is silent are skipped.
+ *
+ * The latency is one block. SetImpulses() allocates, ProcessBlock() is realtime safe and takes any number of frames.
+ * Uses WDL_real_fft(), so WDL/fft.c must be compiled into the project. */
+class MatrixConvolver
+{
+public:
+  MatrixConvolver()
+  {
+    WDL_fft_init();
+  }
+
+  MatrixConvolver(const MatrixConvolver&) = delete;
+  MatrixConvolver& operator=(const MatrixConvolver&) = delete;
+
+  /** Set the routing matrix. Call off the audio thread
+   * @param nIns Number of inputs
+   * @param nOuts Number of outputs
+   * @param pImpulses nIns * nOuts pointers, the impulse from input \c i to output \c o at [i * nOuts + o]. nullptr means no route
+   * @param length Length of each impulse (in samples)
+   * @param blockSize Partition size and latency, a power of two of at least 16. Smaller blocks lower latency and raise CPU use
+   * @param irOffset Number of samples to skip at the start of each impulse, e.g. when the head is convolved elsewhere
+   * @return \c false if the arguments are invalid */
+  bool SetImpulses(int nIns, int nOuts, const WDL_FFT_REAL* const* pImpulses, int length, int blockSize, int irOffset = 0)
+  {
+    if (nIns < 1 || nOuts < 1 || blockSize < 16 || (blockSize & (blockSize - 1)) || irOffset < 0)
+      return false;
+
+    mNIns = nIns;
+    mNOuts = nOuts;
+    mBlockSize = blockSize;
+
+    const int fftSize = blockSize * 2;
+    const int tailLength = std::max(length - irOffset, 0);
+    mNPartitions = std::max((tailLength + blockSize - 1) / blockSize, 1);
+
+    mImpulseRe.assign(static_cast<size_t>(nIns) * nOuts * mNPartitions * blockSize, 0.);
+    mImpulseIm.assign(mImpulseRe.size(), 0.);
+    mImpulseActive.assign(static_cast<size_t>(nIns) * nOuts * mNPartitions, 0);
+    mScratch.resize(fftSize);
+
+    // WDL_real_fft() scales by 2 going forwards and by fftSize round trip, so a product of two spectra comes back 4 * fftSize too
+    // loud. Fold the correction into the impulse spectra
+    const WDL_FFT_REAL scale = static_cast<WDL_FFT_REAL>(0.25 / fftSize);
+
+    for (int i = 0; i < nIns; i++)
+    {
+      for (int o = 0; o < nOuts; o++)
+      {
+        const WDL_FFT_REAL* pIR = pImpulses ? pImpulses[i * nOuts + o] : nullptr;
+
+        if (!pIR)
+          continue;
+
+        for (int p = 0; p < mNPartitions; p++)
+        {
+          const int start = irOffset + p * blockSize;
+          const int n = std::max(std::min(blockSize, length - start), 0);
+          bool active = false;
+
+          std::fill(mScratch.begin(), mScratch.end(), 0.);
+
+          for (int s = 0; s < n; s++)
+          {
+            mScratch[s] = pIR[start + s] * scale;
+            active |= pIR[start + s] != 0.;
+          }
+
+          if (!active)
+            continue;
+
+          const size_t idx = RouteIdx(i, o, p);
+          mImpulseActive[idx] = 1;
+          WDL_real_fft(mScratch.data(), fftSize, 0);
+          Deinterleave(mScratch.data(), &mImpulseRe[idx * blockSize], &mImpulseIm[idx * blockSize]);
+        }
+      }
+    }
+
+    mInput.assign(static_cast<size_t>(nIns) * fftSize, 0.);
+    mSpectrumRe.assign(static_cast<size_t>(nIns) * mNPartitions * blockSize, 0.);
+    mSpectrumIm.assign(mSpectrumRe.size(), 0.);
+    mSpectrumActive.assign(static_cast<size_t>(nIns) * mNPartitions, 0);
+    mInputWasActive.assign(nIns, 0);
+    mAccRe.resize(blockSize);
+    mAccIm.resize(blockSize);
+    mOutput.assign(static_cast<size_t>(nOuts) * blockSize, 0.);
+    Reset();
+    return true;
+  }
+
+  /** Clear all history, e.g. from OnReset() */
+  void Reset()
+  {
+    std::fill(mInput.begin(), mInput.end(), 0.);
+    std::fill(mSpectrumActive.begin(), mSpectrumActive.end(), 0);
+    std::fill(mInputWasActive.begin(), mInputWasActive.end(), 0);
+    std::fill(mOutput.begin(), mOutput.end(), 0.);
+    mPos = 0;
+    mSpectrumPos = 0;
+  }
+
+  /** Convolve \c nFrames of NIns() inputs into NOuts() outputs, delayed by GetLatency(). In-place processing is supported */
+  void ProcessBlock(WDL_FFT_REAL** inputs, WDL_FFT_REAL** outputs, int nFrames)
+  {
+    if (!mBlockSize)
+      return;
+
+    int done = 0;
+
+    while (done < nFrames)
+    {
+      const int n = std::min(nFrames - done, mBlockSize - mPos);
+
+      for (int i = 0; i < mNIns; i++)
+        memcpy(&mInput[(i * 2 + 1) * mBlockSize + mPos], inputs[i] + done, n * sizeof(WDL_FFT_REAL));
+
+      for (int o = 0; o < mNOuts; o++)
+        memcpy(outputs[o] + done, &mOutput[o * mBlockSize + mPos], n * sizeof(WDL_FFT_REAL));
+
+      mPos += n;
+      done += n;
+
+      if (mPos == mBlockSize)
+      {
+        ProcessPartition();
+        mPos = 0;
+      }
+    }
+  }
+
+  int GetLatency() const { return mBlockSize; }
+  int GetBlockSize() const { return mBlockSize; }
+  int NIns() const { return mNIns; }
+  int NOuts() const { return mNOuts; }
+
+private:
+  size_t RouteIdx(int in, int out, int partition) const { return (static_cast<size_t>(in) * mNOuts + out) * mNPartitions + partition; }
+
+  /** WDL_real_fft() output is packed: element 0 holds DC and Nyquist as its real and imaginary parts */
+  void Deinterleave(const WDL_FFT_REAL* pSrc, WDL_FFT_REAL* pRe, WDL_FFT_REAL* pIm) const
+  {
+    for (int k = 0; k < mBlockSize; k++)
+    {
+      pRe[k] = pSrc[k * 2];
+      pIm[k] = pSrc[k * 2 + 1];
+    }
+  }
+
+  /** acc += x * h for packed spectra. The pointers never alias, saying so lets compilers vectorise this without runtime checks */
+  static void ComplexMultiplyAdd(WDL_FFT_REAL* __restrict pAccRe, WDL_FFT_REAL* __restrict pAccIm,
+                                 const WDL_FFT_REAL* __restrict pXRe, const WDL_FFT_REAL* __restrict pXIm,
+                                 const WDL_FFT_REAL* __restrict pHRe, const WDL_FFT_REAL* __restrict pHIm, int n)
+  {
+    // DC and Nyquist are both real
+    const WDL_FFT_REAL dc = pAccRe[0] + pXRe[0] * pHRe[0];
+    const WDL_FFT_REAL nyquist = pAccIm[0] + pXIm[0] * pHIm[0];
+
+    for (int k = 0; k < n; k++)
+    {
+      pAccRe[k] += pXRe[k] * pHRe[k] - pXIm[k] * pHIm[k];
+      pAccIm[k] += pXRe[k] * pHIm[k] + pXIm[k] * pHRe[k];
+    }
+
+    pAccRe[0] = dc;
+    pAccIm[0] = nyquist;
+  }
+
+  void ProcessPartition()
+  {
+    const int B = mBlockSize;
+    const int fftSize = B * 2;
+
+    // one forward transform per input, into the frequency domain delay line
+    mSpectrumPos = mSpectrumPos ? mSpectrumPos - 1 : mNPartitions - 1;
+
+    for (int i = 0; i < mNIns; i++)
+    {
+      WDL_FFT_REAL* pIn = &mInput[i * fftSize];
+      bool active = false;
+
+      for (int s = B; s < fftSize; s++)
+        active |= pIn[s] != 0.;
+
+      const size_t slot = static_cast<size_t>(i) * mNPartitions + mSpectrumPos;
+      mSpectrumActive[slot] = active || mInputWasActive[i];
+      mInputWasActive[i] = active;
+
+      if (mSpectrumActive[slot])
+      {
+        memcpy(mScratch.data(), pIn, fftSize * sizeof(WDL_FFT_REAL));
+        WDL_real_fft(mScratch.data(), fftSize, 0);
+        Deinterleave(mScratch.data(), &mSpectrumRe[slot * B], &mSpectrumIm[slot * B]);
+      }
+
+      memcpy(pIn, pIn + B, B * sizeof(WDL_FFT_REAL));
+    }
+
+    // multiply-accumulate every route, one inverse transform per output
+    for (int o = 0; o < mNOuts; o++)
+    {
+      WDL_FFT_REAL* pAccRe = mAccRe.data();
+      WDL_FFT_REAL* pAccIm = mAccIm.data();
+      bool any = false;
+
+      for (int i = 0; i < mNIns; i++)
+      {
+        for (int p = 0; p < mNPartitions; p++)
+        {
+          const size_t route = RouteIdx(i, o, p);
+          const size_t slot = static_cast<size_t>(i) * mNPartitions + (mSpectrumPos + p) % mNPartitions;
+
+          if (!mImpulseActive[route] || !mSpectrumActive[slot])
+            continue;
+
+          const WDL_FFT_REAL* pXRe = &mSpectrumRe[slot * B];
+          const WDL_FFT_REAL* pXIm = &mSpectrumIm[slot * B];
+          const WDL_FFT_REAL* pHRe = &mImpulseRe[route * B];
+          const WDL_FFT_REAL* pHIm = &mImpulseIm[route * B];
+
+          if (!any)
+          {
+            std::fill(pAccRe, pAccRe + B, 0.);
+            std::fill(pAccIm, pAccIm + B, 0.);
+            any = true;
+          }
+
+          ComplexMultiplyAdd(pAccRe, pAccIm, pXRe, pXIm, pHRe, pHIm, B);
+        }
+      }
+
+      WDL_FFT_REAL* pOut = &mOutput[o * B];
+
+      if (!any)
+      {
+        std::fill(pOut, pOut + B, 0.);
+        continue;
+      }
+
+      for (int k = 0; k < B; k++)
+      {
+        mScratch[k * 2] = pAccRe[k];
+        mScratch[k * 2 + 1] = pAccIm[k];
+      }
+
+      WDL_real_fft(mScratch.data(), fftSize, 1);
+
+      // overlap-save: the second half is the valid part of the circular convolution
+      memcpy(pOut, mScratch.data() + B, B * sizeof(WDL_FFT_REAL));
+    }
+  }
+
+  int mNIns = 0;
+  int mNOuts = 0;
+  int mBlockSize = 0;
+  int mNPartitions = 0;
+  int mPos = 0;
+  int mSpectrumPos = 0;
+
+  std::vector<WDL_FFT_REAL> mImpulseRe, mImpulseIm; // [in][out][partition][bin]
+  std::vector<char> mImpulseActive;
+  std::vector<WDL_FFT_REAL> mInput; // [in][2 * block], the previous block and the one being filled
+  std::vector<WDL_FFT_REAL> mSpectrumRe, mSpectrumIm; // [in][partition][bin], a ring indexed from mSpectrumPos
+  std::vector<char> mSpectrumActive;
+  std::vector<char> mInputWasActive;
+  std::vector<WDL_FFT_REAL> mAccRe, mAccIm;
+  std::vector<WDL_FFT_REAL> mScratch;
+  std::vector<WDL_FFT_REAL> mOutput; // [out][block], the output being played out
+};
+
+END_IPLUG_NAMESPACE
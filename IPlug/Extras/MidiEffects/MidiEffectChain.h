@@ -0,0 +1,186 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc MidiEffectChain
+ */
+
+#include <memory>
+#include <vector>
+
+#include "MidiScheduler.h"
+#include "TransportTracker.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Everything a MidiStage needs to know about the block being processed */
+struct MidiBlockInfo
+{
+  int64_t mStartTime; // absolute sample time of the first sample in the block
+  int mNFrames;
+  double mSampleRate;
+  const TransportTracker& mTransport;
+
+  int64_t GetEndTime() const { return mStartTime + mNFrames; }
+
+  /** @return The number of samples per quarter note at the start of the block */
+  double GetSamplesPerQN() const { return mSampleRate * 60. / mTransport.GetTempo(0); }
+
+  /** @return The PPQ position at an absolute time within the block */
+  double GetPPQ(int64_t time) const { return mTransport.GetPPQ(static_cast<int>(time - mStartTime)); }
+};
+
+/** Returns true for note offs, including note ons with zero velocity */
+inline bool IsNoteOff(const IMidiMsg& msg)
+{
+  return msg.StatusMsg() == IMidiMsg::kNoteOff || (msg.StatusMsg() == IMidiMsg::kNoteOn && msg.Velocity() == 0);
+}
+
+inline bool IsNoteOn(const IMidiMsg& msg)
+{
+  return msg.StatusMsg() == IMidiMsg::kNoteOn && msg.Velocity() > 0;
+}
+
+/** Base class for a stage in a MidiEffectChain. A stage consumes the timestamped events from its input scheduler for the current block,
+ * and schedules its output events in the next stage's scheduler, at the same time or any time in the future.
+ * The default implementation passes each input event to OnMidi(), override ProcessBlock() for stages that also generate events on a clock */
+class MidiStage
+{
+public:
+  virtual ~MidiStage() {}
+
+  /** Called when the sample rate changes or the chain is reset. Clear any held note state here */
+  virtual void OnReset(double sampleRate) {}
+
+  /** Called for each input event, in time order
+   * @param msg The message
+   * @param time The absolute sample time of the message
+   * @param out The scheduler for the output events
+   * @param info The current block */
+  virtual void OnMidi(const IMidiMsg& msg, int64_t time, MidiScheduler& out, const MidiBlockInfo& info)
+  {
+    out.Push(time, msg);
+  }
+
+  /** Process the input events up to the end of the block */
+  virtual void ProcessBlock(MidiScheduler& in, MidiScheduler& out, const MidiBlockInfo& info)
+  {
+    int64_t time;
+    IMidiMsg msg;
+
+    while (in.Pop(info.GetEndTime(), time, msg))
+      OnMidi(msg, time, out, info);
+  }
+};
+
+/** A chain of MidiStage objects processed in series, for building MIDI effects that are sample accurate across block boundaries.
+ * Each stage writes into a preallocated MidiScheduler that feeds the next, and the output of the last stage can be sent to the host.
+ * @code
+ * void MyPlug::OnReset() { mTransport.Reset(GetSampleRate(), GetBlockSize()); mChain.Reset(GetSampleRate()); }
+ * void MyPlug::ProcessMidiMsg(const IMidiMsg& msg) { mChain.AddInput(msg); }
+ * void MyPlug::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+ * {
+ *   mTransport.ProcessBlock(GetTimeInfo(), nFrames);
+ *   mChain.ProcessBlock(mTransport, nFrames);
+ *   IMidiMsg msg;
+ *   while (mChain.PopOutput(msg))
+ *     SendMidiMsg(msg);
+ * }
+ * @endcode */
+class MidiEffectChain
+{
+public:
+  /** @param queueCapacity The maximum number of pending events between each stage */
+  MidiEffectChain(int queueCapacity = 4096)
+  : mQueueCapacity(queueCapacity)
+  {
+    mQueues.emplace_back(new MidiScheduler(queueCapacity));
+  }
+
+  MidiEffectChain(const MidiEffectChain&) = delete;
+  MidiEffectChain& operator=(const MidiEffectChain&) = delete;
+
+  /** Add a stage to the end of the chain. Allocates, so call when setting up the plug-in. The chain takes ownership of the stage
+   * @return The stage */
+  template <class T>
+  T* AddStage(T* pStage)
+  {
+    mStages.emplace_back(pStage);
+    mQueues.emplace_back(new MidiScheduler(mQueueCapacity));
+    pStage->OnReset(mSampleRate);
+    return pStage;
+  }
+
+  MidiStage* GetStage(int idx) const { return mStages[idx].get(); }
+
+  int NStages() const { return static_cast<int>(mStages.size()); }
+
+  /** Clear all pending events and note state, call from OnReset() */
+  void Reset(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    mBlockStart = mBlockEnd = 0;
+
+    for (auto& pQueue : mQueues)
+      pQueue->Clear();
+
+    for (auto& pStage : mStages)
+      pStage->OnReset(sampleRate);
+  }
+
+  /** Add an input event for the next block, call from ProcessMidiMsg()
+   * @return \c false if the input queue is full */
+  bool AddInput(const IMidiMsg& msg)
+  {
+    return mQueues.front()->Push(mBlockEnd + msg.mOffset, msg);
+  }
+
+  /** Run all stages for a block
+   * @param transport The transport, after TransportTracker::ProcessBlock() has been called for this block */
+  void ProcessBlock(const TransportTracker& transport, int nFrames)
+  {
+    mBlockStart = mBlockEnd;
+    mBlockEnd = mBlockStart + nFrames;
+
+    const MidiBlockInfo info { mBlockStart, nFrames, mSampleRate, transport };
+
+    for (int i = 0; i < NStages(); i++)
+      mStages[i]->ProcessBlock(*mQueues[i], *mQueues[i + 1], info);
+  }
+
+  /** Get the next output event of the current block, with mOffset set relative to the block
+   * @return \c true if there was an event */
+  bool PopOutput(IMidiMsg& msg)
+  {
+    int64_t time;
+
+    if (!mQueues.back()->Pop(mBlockEnd, time, msg))
+      return false;
+
+    msg.mOffset = static_cast<int>(time - mBlockStart);
+    return true;
+  }
+
+  /** @return The absolute sample time of the start of the current block */
+  int64_t GetBlockStartTime() const { return mBlockStart; }
+
+private:
+  std::vector<std::unique_ptr<MidiStage>> mStages;
+  std::vector<std::unique_ptr<MidiScheduler>> mQueues;
+  double mSampleRate = 44100.;
+  int64_t mBlockStart = 0;
+  int64_t mBlockEnd = 0;
+  int mQueueCapacity;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,284 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc MidiScheduler
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+#include "IPlugPlatform.h"
+#include "IPlugMidi.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A preallocated calendar queue of MIDI messages keyed by absolute sample time.
+ * Events can be scheduled any distance into the future, e.g. note offs several blocks ahead, and are popped in time order.
+ * Events with equal times are popped in the order they were pushed.
+ * Time is divided into "days" of kBucketWidth samples, and each day maps onto one of nBuckets sorted lists, so that
+ * pushes and pops cost O(1) when the events are spread over less than a "year" (nBuckets * kBucketWidth samples).
+ * Nothing is allocated after construction: Push() fails if the queue is full. */
+class MidiScheduler
+{
+public:
+  static constexpr int kBucketWidthShift = 6; // 64 samples per bucket
+  static constexpr int64_t kBucketWidth = 1 << kBucketWidthShift;
+
+  /** @param capacity The maximum number of pending events
+   * @param nBuckets The number of buckets, rounded up to a power of two. The default spans ~3 seconds at 44.1kHz */
+  MidiScheduler(int capacity = 4096, int nBuckets = 2048)
+  {
+    int n = 1;
+
+    while (n < nBuckets)
+      n <<= 1;
+
+    mBucketMask = n - 1;
+    mBuckets.resize(n);
+    mNodes.resize(capacity);
+    Clear();
+  }
+
+  /** Remove all events, and restart from time 0 */
+  void Clear()
+  {
+    for (auto& bucket : mBuckets)
+      bucket = { kNone, kNone };
+
+    for (int i = 0; i < static_cast<int>(mNodes.size()); i++)
+      mNodes[i].next = i + 1 < static_cast<int>(mNodes.size()) ? i + 1 : kNone;
+
+    mFreeList = mNodes.empty() ? kNone : 0;
+    mSize = 0;
+    mNow = 0;
+  }
+
+  /** Schedule a message
+   * @param time The absolute sample time of the event. Times before the last pop time are moved to that time
+   * @param msg The message. Its mOffset is ignored and will be set relative to the block when popped
+   * @return \c false if the queue is full and the event was dropped */
+  bool Push(int64_t time, const IMidiMsg& msg)
+  {
+    if (mFreeList == kNone)
+      return false;
+
+    if (time < mNow)
+      time = mNow;
+
+    const int idx = mFreeList;
+    Node& node = mNodes[idx];
+    mFreeList = node.next;
+    node.time = time;
+    node.msg = msg;
+    node.next = kNone;
+
+    Bucket& bucket = mBuckets[GetBucketIdx(time)];
+
+    if (bucket.tail == kNone)
+    {
+      bucket.head = bucket.tail = idx;
+    }
+    else if (mNodes[bucket.tail].time <= time)
+    {
+      // the common case, events scheduled in time order
+      mNodes[bucket.tail].next = idx;
+      bucket.tail = idx;
+    }
+    else
+    {
+      int* pPrev = &bucket.head;
+
+      while (*pPrev != kNone && mNodes[*pPrev].time <= time)
+        pPrev = &mNodes[*pPrev].next;
+
+      node.next = *pPrev;
+      *pPrev = idx;
+    }
+
+    mSize++;
+    return true;
+  }
+
+  /** Get the time of the earliest event, if it is before endTime
+   * @return \c true if there is an event before endTime */
+  bool Peek(int64_t endTime, int64_t& time)
+  {
+    const int bucketIdx = FindNext(endTime);
+
+    if (bucketIdx == kNone)
+      return false;
+
+    time = mNodes[mBuckets[bucketIdx].head].time;
+    return true;
+  }
+
+  /** Remove the earliest event, if it is before endTime
+   * @param endTime The time (exclusive) up to which to pop events, usually the end of the current block
+   * @param time Set to the event's absolute sample time
+   * @param msg Set to the message
+   * @return \c true if an event was popped */
+  bool Pop(int64_t endTime, int64_t& time, IMidiMsg& msg)
+  {
+    const int bucketIdx = FindNext(endTime);
+
+    if (bucketIdx == kNone)
+      return false;
+
+    Bucket& bucket = mBuckets[bucketIdx];
+    const int idx = bucket.head;
+    Node& node = mNodes[idx];
+
+    time = node.time;
+    msg = node.msg;
+
+    bucket.head = node.next;
+
+    if (bucket.head == kNone)
+      bucket.tail = kNone;
+
+    node.next = mFreeList;
+    mFreeList = idx;
+    mSize--;
+    mNow = time;
+    return true;
+  }
+
+  /** Remove pending events matching a predicate, e.g. to cancel scheduled notes. This is O(capacity)
+   * @param pred bool(int64_t time, const IMidiMsg& msg), return true to remove the event */
+  template <typename Pred>
+  void RemoveIf(Pred pred)
+  {
+    for (auto& bucket : mBuckets)
+    {
+      int* pPrev = &bucket.head;
+      int last = kNone;
+
+      while (*pPrev != kNone)
+      {
+        const int idx = *pPrev;
+        Node& node = mNodes[idx];
+
+        if (pred(node.time, node.msg))
+        {
+          *pPrev = node.next;
+          node.next = mFreeList;
+          mFreeList = idx;
+          mSize--;
+        }
+        else
+        {
+          last = idx;
+          pPrev = &node.next;
+        }
+      }
+
+      bucket.tail = last;
+    }
+  }
+
+  int GetSize() const { return mSize; }
+
+  int GetCapacity() const { return static_cast<int>(mNodes.size()); }
+
+  bool Empty() const { return mSize == 0; }
+
+private:
+  static constexpr int kNone = -1;
+
+  struct Node
+  {
+    int64_t time;
+    IMidiMsg msg;
+    int next;
+  };
+
+  struct Bucket
+  {
+    int head;
+    int tail;
+  };
+
+  int GetBucketIdx(int64_t time) const
+  {
+    return static_cast<int>((time >> kBucketWidthShift) & mBucketMask);
+  }
+
+  /** Find the bucket holding the earliest event before endTime, advancing the current time to the start of its day
+   * @return The bucket index, or kNone */
+  int FindNext(int64_t endTime)
+  {
+    if (!mSize || mNow >= endTime)
+      return kNone;
+
+    const int64_t yearLength = static_cast<int64_t>(mBucketMask + 1) << kBucketWidthShift;
+
+    if (endTime - mNow > yearLength)
+    {
+      // the range covers a whole year, so the earliest event is one of the bucket heads
+      int best = kNone;
+
+      for (int b = 0; b <= mBucketMask; b++)
+      {
+        const int head = mBuckets[b].head;
+
+        if (head != kNone && (best == kNone || mNodes[head].time < mNodes[mBuckets[best].head].time))
+          best = b;
+      }
+
+      if (best == kNone || mNodes[mBuckets[best].head].time >= endTime)
+        return kNone;
+
+      mNow = mNodes[mBuckets[best].head].time;
+      return best;
+    }
+
+    // walk the days from now, only taking events from the current year
+    int64_t dayStart = (mNow >> kBucketWidthShift) << kBucketWidthShift;
+
+    while (dayStart < endTime)
+    {
+      const int b = GetBucketIdx(dayStart);
+      const int head = mBuckets[b].head;
+
+      if (head != kNone)
+      {
+        const int64_t t = mNodes[head].time;
+
+        if (t < dayStart + kBucketWidth)
+        {
+          if (t >= endTime)
+            return kNone;
+
+          return b;
+        }
+      }
+
+      dayStart += kBucketWidth;
+      mNow = dayStart;
+    }
+
+    mNow = endTime;
+    return kNone;
+  }
+
+  std::vector<Node> mNodes;
+  std::vector<Bucket> mBuckets;
+  int mBucketMask = 0;
+  int mFreeList = kNone;
+  int mSize = 0;
+  int64_t mNow = 0; // no events are pending before this time
+};
+
+END_IPLUG_NAMESPACE
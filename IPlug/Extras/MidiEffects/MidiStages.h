@@ -0,0 +1,505 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Reusable MidiStage implementations: arpeggiator, note repeat, chord, humaniser and quantiser
+ */
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "MidiEffectChain.h"
+#include "IPlugUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+#define ARP_MODES_VALIST "Up", "Down", "Up/Down", "As Played", "Random"
+
+/** The keys currently held, sorted by pitch, with the order they were pressed */
+class MidiHeldNotes
+{
+public:
+  static constexpr int kMaxNotes = 32;
+
+  struct Note
+  {
+    uint8_t key;
+    uint8_t channel;
+    uint8_t velocity;
+    uint32_t order;
+  };
+
+  void Add(int key, int channel, int velocity)
+  {
+    Remove(key, channel);
+
+    if (mNNotes == kMaxNotes)
+      return;
+
+    int pos = mNNotes;
+
+    while (pos > 0 && mNotes[pos - 1].key > key)
+    {
+      mNotes[pos] = mNotes[pos - 1];
+      pos--;
+    }
+
+    mNotes[pos] = { static_cast<uint8_t>(key), static_cast<uint8_t>(channel), static_cast<uint8_t>(velocity), mOrder++ };
+    mNNotes++;
+  }
+
+  void Remove(int key, int channel)
+  {
+    for (int i = 0; i < mNNotes; i++)
+    {
+      if (mNotes[i].key == key && mNotes[i].channel == channel)
+      {
+        memmove(&mNotes[i], &mNotes[i + 1], (mNNotes - i - 1) * sizeof(Note));
+        mNNotes--;
+        return;
+      }
+    }
+  }
+
+  void Clear() { mNNotes = 0; }
+
+  int GetNNotes() const { return mNNotes; }
+
+  /** @return The note at idx in pitch order */
+  const Note& Get(int idx) const { return mNotes[idx]; }
+
+  /** @return The note at idx in the order the notes were pressed, O(N) */
+  const Note& GetInPlayedOrder(int idx) const
+  {
+    // count the notes pressed before each candidate
+    for (int i = 0; i < mNNotes; i++)
+    {
+      int nEarlier = 0;
+
+      for (int j = 0; j < mNNotes; j++)
+        nEarlier += mNotes[j].order < mNotes[i].order;
+
+      if (nEarlier == idx)
+        return mNotes[i];
+    }
+
+    return mNotes[0];
+  }
+
+private:
+  Note mNotes[kMaxNotes];
+  int mNNotes = 0;
+  uint32_t mOrder = 0;
+};
+
+/** A small, allocation free random number generator for MIDI stages */
+class MidiRandom
+{
+public:
+  /** @return A random number in the range 0-1 */
+  double Next()
+  {
+    // xorshift32
+    mState ^= mState << 13;
+    mState ^= mState >> 17;
+    mState ^= mState << 5;
+    return mState / 4294967296.;
+  }
+
+  void Seed(uint32_t seed) { mState = seed ? seed : 1; }
+
+private:
+  uint32_t mState = 2463534242u;
+};
+
+/** Base class for stages that generate events on a clock, e.g. arpeggiators and sequencers.
+ * When the transport is running the clock is locked to a grid of quarter notes. When it is stopped the clock free runs at the
+ * host tempo, starting when the first key is pressed. Input events and clock ticks are interleaved in time order */
+class ClockedMidiStage : public MidiStage
+{
+public:
+  /** @param rateQN The clock period in quarter notes, e.g. 0.25 for 16ths */
+  void SetRate(double rateQN) { mRateQN = std::max(rateQN, 1. / 64.); }
+
+  /** @param gate The length of the generated notes as a fraction of the clock period */
+  void SetGate(double gate) { mGate = Clip(gate, 0.01, 4.); }
+
+  void OnReset(double sampleRate) override
+  {
+    mHeldNotes.Clear();
+    mNextFreeStep = 0;
+  }
+
+  void ProcessBlock(MidiScheduler& in, MidiScheduler& out, const MidiBlockInfo& info) override
+  {
+    const int64_t endTime = info.GetEndTime();
+    const bool synced = info.mTransport.IsRunning();
+    const int64_t stepLength = std::max(static_cast<int64_t>(mRateQN * info.GetSamplesPerQN()), int64_t(1));
+    TransportTracker::GridEventIterator itr(info.mTransport, mRateQN);
+    TransportTracker::GridEvent gridEvent {};
+
+    bool haveGridStep = synced && itr.Next(gridEvent);
+
+    while (true)
+    {
+      int64_t inTime;
+      const bool haveInput = in.Peek(endTime, inTime);
+
+      int64_t stepTime = endTime;
+      bool haveStep = false;
+
+      if (synced)
+      {
+        haveStep = haveGridStep;
+
+        if (haveGridStep)
+          stepTime = info.mStartTime + gridEvent.sampleOffset;
+      }
+      else if (mHeldNotes.GetNNotes() && mNextFreeStep < endTime)
+      {
+        haveStep = true;
+        stepTime = std::max(mNextFreeStep, info.mStartTime);
+      }
+
+      if (!haveInput && !haveStep)
+        break;
+
+      if (haveInput && (!haveStep || inTime <= stepTime))
+      {
+        IMidiMsg msg;
+        in.Pop(endTime, inTime, msg);
+
+        if (IsNoteOn(msg))
+        {
+          if (!mHeldNotes.GetNNotes())
+          {
+            OnFirstNote();
+
+            if (!synced)
+              mNextFreeStep = inTime;
+          }
+
+          mHeldNotes.Add(msg.NoteNumber(), msg.Channel(), msg.Velocity());
+        }
+        else if (IsNoteOff(msg))
+          mHeldNotes.Remove(msg.NoteNumber(), msg.Channel());
+        else
+          out.Push(inTime, msg);
+      }
+      else
+      {
+        if (mHeldNotes.GetNNotes())
+          OnStep(stepTime, std::max(static_cast<int64_t>(mGate * stepLength), int64_t(1)), out);
+
+        if (synced)
+          haveGridStep = itr.Next(gridEvent);
+        else
+          mNextFreeStep = stepTime + stepLength;
+      }
+    }
+  }
+
+protected:
+  /** Called on each clock tick while keys are held
+   * @param time The absolute sample time of the tick
+   * @param noteLength The length of notes to generate, in samples
+   * @param out The scheduler for the output events */
+  virtual void OnStep(int64_t time, int64_t noteLength, MidiScheduler& out) = 0;
+
+  /** Called when a key is pressed and no others are held */
+  virtual void OnFirstNote() {}
+
+  void PlayNote(int64_t time, int64_t noteLength, int key, int channel, int velocity, MidiScheduler& out)
+  {
+    IMidiMsg msg;
+    msg.MakeNoteOnMsg(key, velocity, 0, channel);
+    out.Push(time, msg);
+    msg.MakeNoteOffMsg(key, 0, channel);
+    out.Push(time + noteLength, msg);
+  }
+
+  MidiHeldNotes mHeldNotes;
+  double mRateQN = 0.25;
+  double mGate = 0.5;
+  int64_t mNextFreeStep = 0;
+};
+
+/** An arpeggiator, playing the held keys one at a time across a number of octaves */
+class MidiArpeggiator : public ClockedMidiStage
+{
+public:
+  enum EMode
+  {
+    kUp = 0,
+    kDown,
+    kUpDown,
+    kAsPlayed,
+    kRandom,
+    kNumModes
+  };
+
+  void SetMode(EMode mode) { mMode = mode; }
+
+  void SetOctaves(int octaves) { mOctaves = Clip(octaves, 1, 4); }
+
+protected:
+  void OnFirstNote() override
+  {
+    mStepIdx = 0;
+  }
+
+  void OnStep(int64_t time, int64_t noteLength, MidiScheduler& out) override
+  {
+    const int nNotes = mHeldNotes.GetNNotes();
+    const int seqLength = nNotes * mOctaves;
+    int idx;
+
+    switch (mMode)
+    {
+      case kDown: idx = seqLength - 1 - (mStepIdx % seqLength); break;
+      case kUpDown:
+      {
+        const int period = std::max(2 * seqLength - 2, 1);
+        idx = mStepIdx % period;
+
+        if (idx >= seqLength)
+          idx = period - idx;
+        break;
+      }
+      case kRandom: idx = std::min(static_cast<int>(mRandom.Next() * seqLength), seqLength - 1); break;
+      default: idx = mStepIdx % seqLength; break;
+    }
+
+    const int octave = idx / nNotes;
+    const MidiHeldNotes::Note& note = mMode == kAsPlayed ? mHeldNotes.GetInPlayedOrder(idx % nNotes) : mHeldNotes.Get(idx % nNotes);
+    const int key = note.key + octave * 12;
+
+    if (key < 128)
+      PlayNote(time, noteLength, key, note.channel, note.velocity, out);
+
+    mStepIdx++;
+  }
+
+private:
+  EMode mMode = kUp;
+  int mOctaves = 1;
+  int mStepIdx = 0;
+  MidiRandom mRandom;
+};
+
+/** Retriggers all of the held keys on every clock tick */
+class MidiNoteRepeat : public ClockedMidiStage
+{
+protected:
+  void OnStep(int64_t time, int64_t noteLength, MidiScheduler& out) override
+  {
+    for (int i = 0; i < mHeldNotes.GetNNotes(); i++)
+    {
+      const MidiHeldNotes::Note& note = mHeldNotes.Get(i);
+      PlayNote(time, noteLength, note.key, note.channel, note.velocity, out);
+    }
+  }
+};
+
+/** Plays a chord for every note, made of intervals in semitones from the played key.
+ * The chord is remembered for each held key, so changing it doesn't leave hanging notes, and notes shared by overlapping chords are reference counted */
+class MidiChord : public MidiStage
+{
+public:
+  static constexpr int kMaxIntervals = 8;
+
+  /** Set the chord, e.g. {0, 4, 7} for a major triad */
+  void SetIntervals(const int* intervals, int nIntervals)
+  {
+    mNIntervals = std::min(nIntervals, kMaxIntervals);
+
+    for (int i = 0; i < mNIntervals; i++)
+      mIntervals[i] = static_cast<int8_t>(Clip(intervals[i], -48, 48));
+  }
+
+  void OnReset(double sampleRate) override
+  {
+    memset(mHeldNIntervals, 0, sizeof(mHeldNIntervals));
+    memset(mOutputRefs, 0, sizeof(mOutputRefs));
+  }
+
+  void OnMidi(const IMidiMsg& msg, int64_t time, MidiScheduler& out, const MidiBlockInfo& info) override
+  {
+    const int channel = msg.Channel();
+    const int key = msg.NoteNumber();
+
+    if (IsNoteOn(msg))
+    {
+      ReleaseChord(channel, key, time, out); // in case of a repeated note on
+
+      for (int i = 0; i < mNIntervals; i++)
+      {
+        const int outKey = key + mIntervals[i];
+
+        if (outKey < 0 || outKey > 127)
+          continue;
+
+        IMidiMsg noteOn;
+        noteOn.MakeNoteOnMsg(outKey, msg.Velocity(), 0, channel);
+        out.Push(time, noteOn);
+        mOutputRefs[channel][outKey]++;
+        mHeldIntervals[channel][key][i] = mIntervals[i];
+      }
+
+      mHeldNIntervals[channel][key] = static_cast<uint8_t>(mNIntervals);
+    }
+    else if (IsNoteOff(msg))
+      ReleaseChord(channel, key, time, out);
+    else
+      out.Push(time, msg);
+  }
+
+private:
+  void ReleaseChord(int channel, int key, int64_t time, MidiScheduler& out)
+  {
+    for (int i = 0; i < mHeldNIntervals[channel][key]; i++)
+    {
+      const int outKey = key + mHeldIntervals[channel][key][i];
+
+      if (outKey < 0 || outKey > 127 || !mOutputRefs[channel][outKey])
+        continue;
+
+      if (--mOutputRefs[channel][outKey] == 0)
+      {
+        IMidiMsg noteOff;
+        noteOff.MakeNoteOffMsg(outKey, 0, channel);
+        out.Push(time, noteOff);
+      }
+    }
+
+    mHeldNIntervals[channel][key] = 0;
+  }
+
+  int8_t mIntervals[kMaxIntervals] = { 0, 4, 7 };
+  int mNIntervals = 3;
+  int8_t mHeldIntervals[16][128][kMaxIntervals] = {};
+  uint8_t mHeldNIntervals[16][128] = {};
+  uint8_t mOutputRefs[16][128] = {};
+};
+
+/** Base class for stages that delay notes. A note off is delayed by the same amount as its note on, so note lengths are kept,
+ * and a note on is never moved before the previous note off of the same key */
+class MidiNoteDelayStage : public MidiStage
+{
+public:
+  void OnReset(double sampleRate) override
+  {
+    mSampleRate = sampleRate;
+    memset(mDelays, 0, sizeof(mDelays));
+    memset(mLastNoteOffTimes, 0, sizeof(mLastNoteOffTimes));
+  }
+
+  void OnMidi(const IMidiMsg& msg, int64_t time, MidiScheduler& out, const MidiBlockInfo& info) override
+  {
+    const int channel = msg.Channel();
+    const int key = msg.NoteNumber();
+
+    if (IsNoteOn(msg))
+    {
+      IMidiMsg noteOn = msg;
+      const int64_t delay = GetNoteOnDelay(noteOn, time, info);
+      const int64_t onTime = std::max(time + delay, mLastNoteOffTimes[channel][key]);
+      mDelays[channel][key] = onTime - time;
+      out.Push(onTime, noteOn);
+    }
+    else if (IsNoteOff(msg))
+    {
+      const int64_t offTime = time + mDelays[channel][key];
+      mLastNoteOffTimes[channel][key] = offTime;
+      out.Push(offTime, msg);
+    }
+    else
+      out.Push(time, msg);
+  }
+
+protected:
+  /** @param msg The note on, which can be modified
+   * @param time The absolute sample time of the note on
+   * @return The delay to apply in samples */
+  virtual int64_t GetNoteOnDelay(IMidiMsg& msg, int64_t time, const MidiBlockInfo& info) = 0;
+
+  double mSampleRate = 44100.;
+
+private:
+  int64_t mDelays[16][128] = {};
+  int64_t mLastNoteOffTimes[16][128] = {};
+};
+
+/** Adds random timing delays and velocity variations to notes */
+class MidiHumaniser : public MidiNoteDelayStage
+{
+public:
+  /** @param maxDelayMs The maximum delay of a note on, in milliseconds */
+  void SetMaxDelay(double maxDelayMs) { mMaxDelayMs = std::max(maxDelayMs, 0.); }
+
+  /** @param maxVelocityChange The maximum change in velocity, up or down */
+  void SetMaxVelocityChange(int maxVelocityChange) { mMaxVelocityChange = Clip(maxVelocityChange, 0, 127); }
+
+  void SetSeed(uint32_t seed) { mRandom.Seed(seed); }
+
+protected:
+  int64_t GetNoteOnDelay(IMidiMsg& msg, int64_t time, const MidiBlockInfo& info) override
+  {
+    const int velocityChange = static_cast<int>(std::round((mRandom.Next() * 2. - 1.) * mMaxVelocityChange));
+    msg.MakeNoteOnMsg(msg.NoteNumber(), Clip(msg.Velocity() + velocityChange, 1, 127), 0, msg.Channel());
+    return static_cast<int64_t>(mRandom.Next() * mMaxDelayMs * 0.001 * mSampleRate);
+  }
+
+private:
+  MidiRandom mRandom;
+  double mMaxDelayMs = 10.;
+  int mMaxVelocityChange = 8;
+};
+
+/** Moves note ons forward onto a grid while the transport is running. Notes can only be delayed, so notes played just after a grid line
+ * (within the late window) are left where they are */
+class MidiQuantiser : public MidiNoteDelayStage
+{
+public:
+  /** @param gridQN The grid in quarter notes */
+  void SetGrid(double gridQN) { mGridQN = std::max(gridQN, 1. / 64.); }
+
+  /** @param strength How far to move the notes towards the grid, 0-1 */
+  void SetStrength(double strength) { mStrength = Clip(strength, 0., 1.); }
+
+  /** @param window The fraction of the grid after a grid line in which notes are left alone */
+  void SetLateWindow(double window) { mLateWindow = Clip(window, 0., 1.); }
+
+protected:
+  int64_t GetNoteOnDelay(IMidiMsg& msg, int64_t time, const MidiBlockInfo& info) override
+  {
+    if (!info.mTransport.IsRunning())
+      return 0;
+
+    const double pos = info.GetPPQ(time) / mGridQN;
+    const double fraction = pos - std::floor(pos);
+
+    if (fraction <= mLateWindow)
+      return 0;
+
+    return static_cast<int64_t>(std::round((1. - fraction) * mGridQN * mStrength * info.GetSamplesPerQN()));
+  }
+
+private:
+  double mGridQN = 0.25;
+  double mStrength = 1.;
+  double mLateWindow = 0.125;
+};
+
+END_IPLUG_NAMESPACE
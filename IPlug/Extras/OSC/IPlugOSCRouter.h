@@ -0,0 +1,518 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc OSCRouter
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugEditorDelegate.h"
+#include "IPlugOSC_msg.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Dispatches incoming OSC messages to the handlers registered for their addresses, so that OSCReceiver::OnOSCMessage() doesn't need to compare the address with every address it handles.
+ * Registered addresses are stored in a tree with a node for each part of the address. A message address without pattern characters is looked up in a hash map.
+ * Addresses containing OSC 1.0 patterns (`*`, `?`, `[]`, `{}`) are matched against the tree once, and the matching routes are cached until a route is added.
+ * AddParamRoutes() registers `/param/<name>` and `/param/<idx>` for each parameter of a plug-in, and parameter changes can be sent back with SendChangedParams(), once per parameter however often it changed.
+ * Use it on the main thread.
+ * @code
+ * MyPlug::MyPlug(const InstanceInfo& info)
+ * : Plugin(info, MakeConfig(kNumParams, kNumPresets)), OSCReceiver(8000), OSCSender("127.0.0.1", 8001)
+ * {
+ *   // ... init params
+ *   mRouter.AddParamRoutes(*this);
+ *   mRouter.AddRoute("/preset", [&](OscMessageRead& msg) { if (auto* pIdx = msg.PopIntArg(true)) RestorePreset(*pIdx); });
+ * }
+ *
+ * void MyPlug::OnOSCMessage(OscMessageRead& msg) { mRouter.Dispatch(msg); }
+ * void MyPlug::OnParamChangeUI(int paramIdx, EParamSource source) { mRouter.MarkParamChanged(paramIdx); }
+ * void MyPlug::OnIdle() { mRouter.SendChangedParams([&](OscMessageWrite& msg) { SendOSCMessage(msg); }); }
+ * @endcode */
+class OSCRouter
+{
+public:
+  /** Called with a message sent to a registered address. Several routes can match a message with a pattern address, so use peek when getting the arguments */
+  using HandlerFunc = std::function<void(OscMessageRead& msg)>;
+  using SendFunc = std::function<void(OscMessageWrite& msg)>;
+
+  static constexpr int kMaxCachedPatterns = 256;
+
+  OSCRouter()
+  {
+    mNodes.emplace_back();
+  }
+
+  OSCRouter(const OSCRouter&) = delete;
+  OSCRouter& operator=(const OSCRouter&) = delete;
+
+  /** Register a handler for an address. More than one handler can be registered for the same address.
+   * When called from a handler, the route is added once the message has been dispatched
+   * @param address The address, starting with '/'. It can't contain pattern characters
+   * @param func The handler
+   * @return \c false if the address is not valid */
+  bool AddRoute(const char* address, HandlerFunc func)
+  {
+    if (!address || address[0] != '/' || IsPattern(address))
+      return false;
+
+    if (mDispatchDepth)
+    {
+      mPendingRoutes.emplace_back(address, std::move(func));
+      return true;
+    }
+
+    int nodeIdx = 0;
+    const char* pPart = address + 1;
+
+    while (*pPart)
+    {
+      const char* pEnd = strchr(pPart, '/');
+      const std::string part = pEnd ? std::string(pPart, pEnd - pPart) : std::string(pPart);
+      auto it = mNodes[nodeIdx].mChildren.find(part);
+
+      if (it != mNodes[nodeIdx].mChildren.end())
+        nodeIdx = it->second;
+      else
+      {
+        const int childIdx = static_cast<int>(mNodes.size());
+        mNodes.emplace_back();
+        mNodes[nodeIdx].mChildren[part] = childIdx;
+        nodeIdx = childIdx;
+      }
+
+      if (!pEnd)
+        break;
+
+      pPart = pEnd + 1;
+    }
+
+    mNodes[nodeIdx].mRoutes.push_back(static_cast<int>(mHandlers.size()));
+    mHandlers.push_back(func);
+    mAddresses[address] = nodeIdx;
+    mPatternCache.clear();
+    return true;
+  }
+
+  /** Remove all the routes, including the parameter routes. When called from a handler, the routes are removed once the message has been dispatched */
+  void RemoveAllRoutes()
+  {
+    if (mDispatchDepth)
+    {
+      mPendingRoutes.clear();
+      mPendingRemoveAll = true;
+      return;
+    }
+
+    mNodes.clear();
+    mNodes.emplace_back();
+    mHandlers.clear();
+    mAddresses.clear();
+    mPatternCache.clear();
+    mParamAddresses.clear();
+    mParamChanged.clear();
+    mChangedParams.clear();
+    mDelegate = nullptr;
+  }
+
+  /** Call the handlers registered for the message's address, or for all the addresses that match it if it is a pattern
+   * @param msg The incoming message
+   * @return \c true if at least one handler was called */
+  bool Dispatch(OscMessageRead& msg)
+  {
+    const char* address = msg.GetMessage();
+
+    if (address[0] != '/')
+      return false;
+
+    mLookup.assign(address);
+
+    // collect the routes before calling any handler. A handler can dispatch another message, which appends its routes after these
+    const size_t start = mDispatchRoutes.size();
+
+    if (!IsPattern(address))
+    {
+      auto it = mAddresses.find(mLookup);
+
+      if (it != mAddresses.end())
+        AppendRoutes(it->second);
+    }
+    else
+    {
+      auto it = mPatternCache.find(mLookup);
+
+      if (it == mPatternCache.end())
+      {
+        if (mPatternCache.size() >= kMaxCachedPatterns)
+          mPatternCache.clear();
+
+        std::vector<std::string> parts;
+        SplitAddress(address, parts);
+        std::vector<int> nodes;
+        MatchNodes(0, parts, 0, nodes);
+        it = mPatternCache.emplace(mLookup, std::move(nodes)).first;
+      }
+
+      for (int nodeIdx : it->second)
+        AppendRoutes(nodeIdx);
+    }
+
+    const size_t end = mDispatchRoutes.size();
+
+    // routes added or removed by the handlers are applied afterwards, so mHandlers, mNodes and mPatternCache don't change meanwhile
+    mDispatchDepth++;
+
+    for (size_t i = start; i < end; i++)
+      mHandlers[mDispatchRoutes[i]](msg);
+
+    mDispatchDepth--;
+    mDispatchRoutes.resize(start);
+
+    if (!mDispatchDepth)
+      ApplyPendingRoutes();
+
+    return end > start;
+  }
+
+  /** Register `<prefix>/<name>` and `<prefix>/<idx>` for every parameter. Characters in the name that aren't allowed in an OSC address are replaced with '_'
+   * A float argument sets the normalized value (or the real value if normalized is \c false), an int argument sets the real value, and a string is parsed like text entry.
+   * A message without arguments queries the parameter, which is sent by the next call to SendChangedParams()
+   * @param delegate The plug-in, or its editor delegate
+   * @param normalized \c true if float arguments and feedback are normalized values
+   * @param prefix The start of the addresses */
+  void AddParamRoutes(IEditorDelegate& delegate, bool normalized = true, const char* prefix = "/param")
+  {
+    const int nParams = delegate.NParams();
+    mDelegate = &delegate;
+    mParamsNormalized = normalized;
+    mParamAddresses.resize(nParams);
+    mParamChanged.assign(nParams, 0);
+    mChangedParams.clear();
+
+    for (int i = 0; i < nParams; i++)
+    {
+      auto handler = [this, i](OscMessageRead& msg) { OnParamMessage(i, msg); };
+      const std::string idxAddress = std::string(prefix) + "/" + std::to_string(i);
+      const std::string name = MakeAddressPart(delegate.GetParam(i)->GetName());
+      AddRoute(idxAddress.c_str(), handler);
+
+      if (name.empty())
+        mParamAddresses[i] = idxAddress;
+      else
+      {
+        mParamAddresses[i] = std::string(prefix) + "/" + name;
+        AddRoute(mParamAddresses[i].c_str(), handler);
+      }
+    }
+  }
+
+  /** Queue a parameter to be sent by the next call to SendChangedParams(), e.g. from OnParamChangeUI()
+   * @param paramIdx The parameter index */
+  void MarkParamChanged(int paramIdx)
+  {
+    if (paramIdx >= 0 && paramIdx < static_cast<int>(mParamChanged.size()) && !mParamChanged[paramIdx])
+    {
+      mParamChanged[paramIdx] = 1;
+      mChangedParams.push_back(paramIdx);
+    }
+  }
+
+  /** Send the current value of each parameter queued with MarkParamChanged(), to its `<prefix>/<name>` address. Call it periodically, e.g. from OnIdle()
+   * @param sendFunc Sends a message, e.g. OSCSender::SendOSCMessage() which bundles the messages into as few packets as possible */
+  void SendChangedParams(const SendFunc& sendFunc)
+  {
+    if (!mDelegate)
+      return;
+
+    for (int paramIdx : mChangedParams)
+    {
+      const IParam* pParam = mDelegate->GetParam(paramIdx);
+      OscMessageWrite msg;
+      msg.PushWord(mParamAddresses[paramIdx].c_str());
+      msg.PushFloatArg(static_cast<float>(mParamsNormalized ? pParam->GetNormalized() : pParam->Value()));
+      sendFunc(msg);
+      mParamChanged[paramIdx] = 0;
+    }
+
+    mChangedParams.clear();
+  }
+
+  /** @return The address used for a parameter's feedback, or an empty string if AddParamRoutes() hasn't been called */
+  const char* GetParamAddress(int paramIdx) const
+  {
+    return (paramIdx >= 0 && paramIdx < static_cast<int>(mParamAddresses.size())) ? mParamAddresses[paramIdx].c_str() : "";
+  }
+
+  /** @return \c true if the address contains OSC pattern characters */
+  static bool IsPattern(const char* address)
+  {
+    return strpbrk(address, "*?[]{}") != nullptr;
+  }
+
+  /** Match one part of an address (no '/') against an OSC 1.0 pattern
+   * @param pattern The pattern, which can contain `?`, `*`, `[abc]`, `[a-z]`, `[!a-z]` and `{foo,bar}`
+   * @param str The part of the address
+   * @return \c true if the pattern matches the whole of str */
+  static bool MatchPattern(const char* pattern, const char* str)
+  {
+    while (*pattern)
+    {
+      switch (*pattern)
+      {
+        case '?':
+          if (!*str)
+            return false;
+          pattern++;
+          str++;
+          break;
+        case '*':
+        {
+          while (*pattern == '*')
+            pattern++;
+
+          if (!*pattern)
+            return true;
+
+          do
+          {
+            if (MatchPattern(pattern, str))
+              return true;
+          } while (*str++);
+
+          return false;
+        }
+        case '[':
+        {
+          if (!*str)
+            return false;
+
+          pattern++;
+          const bool negate = *pattern == '!';
+          bool matched = false;
+
+          if (negate)
+            pattern++;
+
+          while (*pattern && *pattern != ']')
+          {
+            if (pattern[1] == '-' && pattern[2] && pattern[2] != ']')
+            {
+              const char lo = std::min(pattern[0], pattern[2]);
+              const char hi = std::max(pattern[0], pattern[2]);
+              matched |= (*str >= lo && *str <= hi);
+              pattern += 3;
+            }
+            else
+              matched |= (*pattern++ == *str);
+          }
+
+          if (*pattern != ']' || matched == negate)
+            return false;
+
+          pattern++;
+          str++;
+          break;
+        }
+        case '{':
+        {
+          const char* pEnd = strchr(pattern, '}');
+
+          if (!pEnd)
+            return false;
+
+          for (const char* pAlt = pattern + 1; pAlt <= pEnd; )
+          {
+            const char* pAltEnd = pAlt;
+
+            while (pAltEnd < pEnd && *pAltEnd != ',')
+              pAltEnd++;
+
+            const size_t len = pAltEnd - pAlt;
+
+            if (!strncmp(pAlt, str, len) && MatchPattern(pEnd + 1, str + len))
+              return true;
+
+            pAlt = pAltEnd + 1;
+          }
+
+          return false;
+        }
+        default:
+          if (*pattern++ != *str++)
+            return false;
+          break;
+      }
+    }
+
+    return !*str;
+  }
+
+  /** @return A parameter name with the characters that aren't allowed in an OSC address replaced by '_' */
+  static std::string MakeAddressPart(const char* name)
+  {
+    std::string part(name ? name : "");
+
+    for (char& c : part)
+    {
+      if (static_cast<unsigned char>(c) <= ' ' || strchr("#*,/?[]{}", c))
+        c = '_';
+    }
+
+    return part;
+  }
+
+private:
+  struct Node
+  {
+    std::unordered_map<std::string, int> mChildren;
+    std::vector<int> mRoutes; // indexes into mHandlers
+  };
+
+  void AppendRoutes(int nodeIdx)
+  {
+    const std::vector<int>& routes = mNodes[nodeIdx].mRoutes;
+    mDispatchRoutes.insert(mDispatchRoutes.end(), routes.begin(), routes.end());
+  }
+
+  void ApplyPendingRoutes()
+  {
+    if (mPendingRemoveAll)
+    {
+      mPendingRemoveAll = false;
+      RemoveAllRoutes();
+    }
+
+    if (mPendingRoutes.empty())
+      return;
+
+    std::vector<std::pair<std::string, HandlerFunc>> pending;
+    pending.swap(mPendingRoutes);
+
+    for (auto& route : pending)
+      AddRoute(route.first.c_str(), std::move(route.second));
+  }
+
+  static void SplitAddress(const char* address, std::vector<std::string>& parts)
+  {
+    const char* pPart = address + 1;
+
+    while (true)
+    {
+      const char* pEnd = strchr(pPart, '/');
+      parts.emplace_back(pPart, pEnd ? pEnd - pPart : strlen(pPart));
+
+      if (!pEnd)
+        break;
+
+      pPart = pEnd + 1;
+    }
+  }
+
+  void MatchNodes(int nodeIdx, const std::vector<std::string>& parts, size_t depth, std::vector<int>& result) const
+  {
+    const Node& node = mNodes[nodeIdx];
+
+    if (depth == parts.size())
+    {
+      if (!node.mRoutes.empty())
+        result.push_back(nodeIdx);
+
+      return;
+    }
+
+    const std::string& part = parts[depth];
+
+    if (!IsPattern(part.c_str()))
+    {
+      auto it = node.mChildren.find(part);
+
+      if (it != node.mChildren.end())
+        MatchNodes(it->second, parts, depth + 1, result);
+    }
+    else
+    {
+      for (const auto& child : node.mChildren)
+      {
+        if (MatchPattern(part.c_str(), child.first.c_str()))
+          MatchNodes(child.second, parts, depth + 1, result);
+      }
+    }
+  }
+
+  void OnParamMessage(int paramIdx, OscMessageRead& msg)
+  {
+    if (!mDelegate)
+      return;
+
+    const IParam* pParam = mDelegate->GetParam(paramIdx);
+    char type = 0;
+
+    if (!msg.GetIndexedArg(0, &type))
+    {
+      MarkParamChanged(paramIdx);
+      return;
+    }
+
+    double value = 0.;
+
+    switch (type)
+    {
+      case 'f':
+      {
+        const double arg = *msg.PopFloatArg(true);
+        value = mParamsNormalized ? Clip(arg, 0., 1.) : pParam->ToNormalized(pParam->Constrain(arg));
+        break;
+      }
+      case 'i':
+        value = pParam->ToNormalized(pParam->Constrain(*msg.PopIntArg(true)));
+        break;
+      case 's':
+        value = pParam->ToNormalized(pParam->StringToValue(msg.PopStringArg(true)));
+        break;
+      default:
+        return;
+    }
+
+    mDelegate->BeginInformHostOfParamChangeFromUI(paramIdx);
+    mDelegate->SendParameterValueFromUI(paramIdx, value);
+    mDelegate->EndInformHostOfParamChangeFromUI(paramIdx);
+    mDelegate->SendParameterValueFromDelegate(paramIdx, value, true);
+  }
+
+  std::vector<Node> mNodes; // mNodes[0] is the root
+  std::vector<HandlerFunc> mHandlers;
+  std::unordered_map<std::string, int> mAddresses; // address to node, for addresses without patterns
+  std::unordered_map<std::string, std::vector<int>> mPatternCache; // pattern to matching nodes
+  std::string mLookup; // reused so that looking up an address doesn't allocate
+  std::vector<int> mDispatchRoutes; // the routes matched by the messages being dispatched, reused so that dispatching doesn't allocate
+  int mDispatchDepth = 0;
+  std::vector<std::pair<std::string, HandlerFunc>> mPendingRoutes; // added by handlers during dispatch
+  bool mPendingRemoveAll = false;
+
+  IEditorDelegate* mDelegate = nullptr;
+  bool mParamsNormalized = true;
+  std::vector<std::string> mParamAddresses;
+  std::vector<uint8_t> mParamChanged;
+  std::vector<int> mChangedParams;
+};
+
+END_IPLUG_NAMESPACE
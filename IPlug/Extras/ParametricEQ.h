@@ -0,0 +1,155 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ParametricEQ
+ */
+
+#include "Biquad.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A multi-channel parametric EQ with up to MAXBANDS bands, processed by a BiquadCascade.
+ * Band settings can be changed at any time on the audio thread, the coefficients are recalculated at the start of the next
+ * ProcessBlock() and interpolated across it. Disabled bands fade to unity rather than switching out */
+template<typename T = double, int MAXCHANS = 2, int MAXBANDS = 8>
+class ParametricEQ
+{
+public:
+  struct Band
+  {
+    BiquadDesign::EType type = BiquadDesign::kBell;
+    double freqCPS = 1000.;
+    double Q = 0.707;
+    double gainDB = 0.;
+    bool enabled = true;
+  };
+
+  ParametricEQ(int nBands = MAXBANDS, BiquadDesign::EDesign design = BiquadDesign::kMatched)
+  : mDesign(design)
+  {
+    SetNBands(nBands);
+  }
+
+  void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    UpdateCoefficients(true);
+    mCascade.Reset();
+  }
+
+  void SetNBands(int nBands)
+  {
+    mNBands = Clip(nBands, 0, MAXBANDS);
+    mCascade.SetNBands(mNBands);
+    mDirty = true;
+  }
+
+  int GetNBands() const { return mNBands; }
+
+  void SetDesign(BiquadDesign::EDesign design)
+  {
+    mDesign = design;
+    mDirty = true;
+  }
+
+  void SetBand(int idx, const Band& band)
+  {
+    assert(idx >= 0 && idx < MAXBANDS);
+    mBands[idx] = band;
+    mDirty = true;
+  }
+
+  void SetBandType(int idx, BiquadDesign::EType type) { mBands[idx].type = type; mDirty = true; }
+  void SetBandFreq(int idx, double freqCPS) { mBands[idx].freqCPS = freqCPS; mDirty = true; }
+  void SetBandQ(int idx, double Q) { mBands[idx].Q = Q; mDirty = true; }
+  void SetBandGain(int idx, double gainDB) { mBands[idx].gainDB = gainDB; mDirty = true; }
+  void SetBandEnabled(int idx, bool enabled) { mBands[idx].enabled = enabled; mDirty = true; }
+
+  const Band& GetBand(int idx) const { return mBands[idx]; }
+
+  void Reset()
+  {
+    mCascade.Reset();
+  }
+
+  /** Process a block, in place processing is allowed */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames)
+  {
+    if (mDirty)
+      UpdateCoefficients(false);
+
+    mCascade.ProcessBlock(inputs, outputs, nChans, nFrames);
+  }
+
+  /** Calculate the magnitude response of the current band settings, e.g. for drawing an EQ curve.
+   * This designs the coefficients itself, so it can be called from the UI thread with a copy of the bands
+   * @param bands The band settings
+   * @param nBands The number of bands
+   * @param design The design method
+   * @param sampleRate The sample rate
+   * @param freqsCPS Array of nPoints frequencies to evaluate
+   * @param magsDB Array of nPoints to receive the magnitudes in dB
+   * @param nPoints The number of points */
+  static void GetMagnitudeResponseDB(const Band* bands, int nBands, BiquadDesign::EDesign design, double sampleRate, const double* freqsCPS, double* magsDB, int nPoints)
+  {
+    for (int i = 0; i < nPoints; i++)
+      magsDB[i] = 0.;
+
+    for (int b = 0; b < nBands; b++)
+    {
+      if (!bands[b].enabled)
+        continue;
+
+      const BiquadCoeffs c = Design(bands[b], design, sampleRate);
+
+      for (int i = 0; i < nPoints; i++)
+        magsDB[i] += 20. * std::log10(std::max(c.GetMagnitude(freqsCPS[i], sampleRate), 1e-12));
+    }
+  }
+
+  /** @return The magnitude response in dB at a normalized x position on a log frequency axis, like SVF::PlotResponse() */
+  double PlotResponseDB(double x, double minHz = 20., double maxHz = 20000.) const
+  {
+    const double freq = minHz * std::pow(maxHz / minHz, Clip(x, 0., 1.));
+    double magDB;
+    GetMagnitudeResponseDB(mBands, mNBands, mDesign, mSampleRate, &freq, &magDB, 1);
+    return magDB;
+  }
+
+private:
+  static BiquadCoeffs Design(const Band& band, BiquadDesign::EDesign design, double sampleRate)
+  {
+    return BiquadDesign::Calculate(band.type, design, band.freqCPS, band.Q, band.gainDB, sampleRate);
+  }
+
+  void UpdateCoefficients(bool immediate)
+  {
+    for (int b = 0; b < mNBands; b++)
+    {
+      const BiquadCoeffs c = mBands[b].enabled ? Design(mBands[b], mDesign, mSampleRate) : BiquadCoeffs();
+      mCascade.SetCoefficients(b, c, immediate);
+    }
+
+    mDirty = false;
+  }
+
+  BiquadCascade<T, MAXCHANS, MAXBANDS> mCascade;
+  Band mBands[MAXBANDS];
+  BiquadDesign::EDesign mDesign;
+  double mSampleRate = 44100.;
+  int mNBands = 0;
+  bool mDirty = true;
+};
+
+END_IPLUG_NAMESPACE
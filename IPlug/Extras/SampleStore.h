@@ -0,0 +1,525 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Compressed in-memory sample storage, with realtime block decoding and a per-voice decoded block cache
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Compact storage for sample content (e.g. the samples of a sample based instrument).
+ *
+ * Each channel is split into blocks of kBlockSize frames that can be decoded independently, so playback can start anywhere.
+ * Encodings:
+ * - kFloat: uncompressed 32 bit float
+ * - kLossless: samples quantized to 16 or 24 bits, then a fixed polynomial predictor (order 0-2, chosen per block) and zigzag residuals
+ *   bit-packed with a width chosen per group of 32. Exact for 16/24 bit source material, and usually half the size of 16 bit PCM or less
+ * - kADPCM: 4 bit IMA ADPCM (the step tables used by WDL's adpcm_decode.h), 1/8 the size of float, lossy (around 35 dB SNR on typical material, 47 dB on a sine)
+ *
+ * Encode() allocates and should be called off the audio thread, DecodeBlock() is realtime safe. Voices normally read through a
+ * SampleStoreCache rather than calling DecodeBlock() directly.
+ * Decoding runs as separate passes over a block (unpack, integrate, convert) with the unpacking and int to float conversion written to
+ * vectorise. The predictor integration and the ADPCM recurrence are inherently serial. */
+class SampleStore
+{
+public:
+  enum EEncoding
+  {
+    kFloat = 0,
+    kLossless,
+    kADPCM
+  };
+
+  static constexpr int kBlockSize = 1024;
+
+  SampleStore() = default;
+
+  /** Compress planar sample data, replacing any previous content
+   * @param inputs nChans pointers to nFrames samples in the range -1 to 1
+   * @param bitDepth For kLossless, the resolution the samples are quantized to: 16 or 24 */
+  template <typename T>
+  void Encode(const T* const* inputs, int nChans, int nFrames, EEncoding encoding, int bitDepth = 16)
+  {
+    mEncoding = encoding;
+    mNChans = nChans;
+    mNFrames = nFrames;
+    mNBlocks = (nFrames + kBlockSize - 1) / kBlockSize;
+    mScale = encoding == kLossless && bitDepth > 16 ? 8388608.f : 32768.f;
+    mData.clear();
+    mOffsets.assign(1, 0);
+
+    int32_t ints[kBlockSize + kGroupSize];
+
+    for (int c = 0; c < nChans; c++)
+    {
+      int adpcmIdx = 0;
+
+      for (int b = 0; b < mNBlocks; b++)
+      {
+        const T* pSrc = inputs[c] + b * kBlockSize;
+        const int n = std::min(kBlockSize, nFrames - b * kBlockSize);
+
+        switch (encoding)
+        {
+          case kFloat:
+          {
+            const size_t pos = mData.size();
+            mData.resize(pos + n * sizeof(float));
+
+            for (int i = 0; i < n; i++)
+            {
+              const float f = static_cast<float>(pSrc[i]);
+              memcpy(mData.data() + pos + i * sizeof(float), &f, sizeof(float));
+            }
+            break;
+          }
+          case kLossless:
+            Quantize(pSrc, n, mScale, ints);
+            EncodeLossless(ints, n);
+            break;
+          case kADPCM:
+            Quantize(pSrc, n, 32768.f, ints);
+            EncodeADPCM(ints, n, adpcmIdx);
+            break;
+        }
+
+        mOffsets.push_back(static_cast<uint32_t>(mData.size()));
+      }
+    }
+
+    // slack for the 64 bit reads in Unpack()
+    mData.resize(mData.size() + 8, 0);
+  }
+
+  /** Decode one block of one channel. Realtime safe
+   * @param pDst At least kBlockSize floats. Frames past the end of the sample are zeroed
+   * @return The number of valid frames in the block, 0 if the block doesn't exist */
+  int DecodeBlock(int chan, int block, float* pDst) const
+  {
+    if (chan < 0 || chan >= mNChans || block < 0 || block >= mNBlocks)
+      return 0;
+
+    const int n = std::min(kBlockSize, mNFrames - block * kBlockSize);
+    const uint8_t* pSrc = mData.data() + mOffsets[chan * mNBlocks + block];
+
+    int32_t ints[kBlockSize + kGroupSize];
+
+    switch (mEncoding)
+    {
+      case kFloat:
+        memcpy(pDst, pSrc, n * sizeof(float));
+        break;
+      case kLossless:
+        DecodeLossless(pSrc, n, ints);
+        IntToFloat(ints, n, 1.f / mScale, pDst);
+        break;
+      case kADPCM:
+        DecodeADPCM(pSrc, n, ints);
+        IntToFloat(ints, n, 1.f / 32768.f, pDst);
+        break;
+    }
+
+    std::fill(pDst + n, pDst + kBlockSize, 0.f);
+    return n;
+  }
+
+  int NChans() const { return mNChans; }
+  int NFrames() const { return mNFrames; }
+  int NBlocks() const { return mNBlocks; }
+  EEncoding GetEncoding() const { return mEncoding; }
+
+  /** @return The memory used by the encoded data and block index, in bytes */
+  size_t GetMemoryBytes() const { return mData.size() + mOffsets.size() * sizeof(uint32_t); }
+
+  /** @return The memory the same content would use as 32 bit float, in bytes */
+  size_t GetFloatBytes() const { return static_cast<size_t>(mNChans) * mNFrames * sizeof(float); }
+
+private:
+  static constexpr int kGroupSize = 32;
+
+  template <typename T>
+  static void Quantize(const T* pSrc, int n, float scale, int32_t* pDst)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      const double v = std::round(static_cast<double>(pSrc[i]) * scale);
+      pDst[i] = static_cast<int32_t>(std::max(-static_cast<double>(scale), std::min(static_cast<double>(scale) - 1., v)));
+    }
+  }
+
+  static void IntToFloat(const int32_t* pSrc, int n, float scale, float* pDst)
+  {
+    for (int i = 0; i < n; i++)
+      pDst[i] = static_cast<float>(pSrc[i]) * scale;
+  }
+
+#pragma mark - Lossless
+
+  static uint32_t Residual(const int32_t* x, int i, int order)
+  {
+    const int32_t x1 = i > 0 ? x[i - 1] : 0;
+    const int32_t x2 = i > 1 ? x[i - 2] : 0;
+    int32_t r = x[i];
+
+    if (order == 1)
+      r -= x1;
+    else if (order == 2)
+      r -= 2 * x1 - x2;
+
+    return (static_cast<uint32_t>(r) << 1) ^ static_cast<uint32_t>(r >> 31); // zigzag
+  }
+
+  void EncodeLossless(const int32_t* x, int n)
+  {
+    // pick the predictor order with the smallest residuals
+    int order = 0;
+    uint64_t best = ~uint64_t(0);
+
+    for (int o = 0; o < 3; o++)
+    {
+      uint64_t sum = 0;
+
+      for (int i = 0; i < n; i++)
+        sum += Residual(x, i, o);
+
+      if (sum < best)
+      {
+        best = sum;
+        order = o;
+      }
+    }
+
+    mData.push_back(static_cast<uint8_t>(order));
+
+    uint32_t u[kGroupSize];
+
+    for (int g = 0; g < n; g += kGroupSize)
+    {
+      uint32_t all = 0;
+
+      for (int i = 0; i < kGroupSize; i++)
+      {
+        u[i] = g + i < n ? Residual(x, g + i, order) : 0;
+        all |= u[i];
+      }
+
+      int width = 0;
+      while (width < 32 && (all >> width))
+        width++;
+
+      mData.push_back(static_cast<uint8_t>(width));
+
+      // kGroupSize * width bits is always a whole number of bytes
+      const size_t pos = mData.size();
+      mData.resize(pos + width * kGroupSize / 8 + 8, 0);
+
+      for (int i = 0; i < kGroupSize; i++)
+      {
+        const int bit = i * width;
+        uint64_t v;
+        memcpy(&v, mData.data() + pos + (bit >> 3), 8);
+        v |= static_cast<uint64_t>(u[i]) << (bit & 7);
+        memcpy(mData.data() + pos + (bit >> 3), &v, 8);
+      }
+
+      mData.resize(pos + width * kGroupSize / 8);
+    }
+  }
+
+  /** Unpack kGroupSize values of \c width bits. Little endian, like every platform iPlug targets */
+  static void Unpack(const uint8_t* pSrc, int width, uint32_t* pDst)
+  {
+    const uint32_t mask = width >= 32 ? ~0u : (1u << width) - 1u;
+
+    for (int i = 0; i < kGroupSize; i++)
+    {
+      const int bit = i * width;
+      uint64_t v;
+      memcpy(&v, pSrc + (bit >> 3), 8);
+      pDst[i] = static_cast<uint32_t>(v >> (bit & 7)) & mask;
+    }
+  }
+
+  static void DecodeLossless(const uint8_t* pSrc, int n, int32_t* pDst)
+  {
+    const int order = *pSrc++;
+
+    for (int g = 0; g < n; g += kGroupSize)
+    {
+      const int width = *pSrc++;
+      uint32_t* pU = reinterpret_cast<uint32_t*>(pDst + g);
+
+      Unpack(pSrc, width, pU);
+      pSrc += width * kGroupSize / 8;
+
+      for (int i = 0; i < kGroupSize; i++)
+        pDst[g + i] = static_cast<int32_t>(pU[i] >> 1) ^ -static_cast<int32_t>(pU[i] & 1);
+    }
+
+    if (order == 1)
+    {
+      for (int i = 1; i < n; i++)
+        pDst[i] += pDst[i - 1];
+    }
+    else if (order == 2)
+    {
+      int32_t x2 = 0, x1 = 0;
+
+      for (int i = 0; i < n; i++)
+      {
+        const int32_t x = pDst[i] + 2 * x1 - x2;
+        pDst[i] = x;
+        x2 = x1;
+        x1 = x;
+      }
+    }
+  }
+
+#pragma mark - ADPCM
+
+  static int ADPCMStep(int idx)
+  {
+    static const int16_t kStepTable[89] = {
+      7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+      19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+      50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+      130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+      337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+      876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+      2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+      5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+      15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+
+    return kStepTable[idx];
+  }
+
+  /** Applies one nibble to the predictor state, shared by the encoder and decoder so that they can't drift */
+  static void ADPCMUpdate(int nib, int& pred, int& idx)
+  {
+    static const int8_t kIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+    const int step = ADPCMStep(idx);
+    int diff = step >> 3;
+    if (nib & 4) diff += step;
+    if (nib & 2) diff += step >> 1;
+    if (nib & 1) diff += step >> 2;
+
+    pred = std::max(-32768, std::min(32767, (nib & 8) ? pred - diff : pred + diff));
+    idx = std::max(0, std::min(88, idx + kIndexTable[nib & 7]));
+  }
+
+  /** The block header holds the predictor state at the start of the block, so every block decodes on its own. Since the encoder is free
+   * to choose that state, it starts from the first sample and tries a few step sizes around the running one, which helps at attacks */
+  void EncodeADPCM(const int32_t* x, int n, int& idx)
+  {
+    uint8_t nibbles[kBlockSize];
+    int bestIdx = idx;
+    int64_t bestErr = -1;
+
+    for (int d = -16; d <= 16; d += 4)
+    {
+      const int startIdx = std::max(0, std::min(88, idx + d));
+      int pred = x[0], endIdx = startIdx;
+      const int64_t err = EncodeADPCMNibbles(x, n, pred, endIdx, nibbles);
+
+      if (bestErr < 0 || err < bestErr)
+      {
+        bestErr = err;
+        bestIdx = startIdx;
+      }
+    }
+
+    int pred = x[0];
+    idx = bestIdx;
+
+    const int16_t pred16 = static_cast<int16_t>(pred);
+    uint8_t header[4];
+    memcpy(header, &pred16, 2);
+    header[2] = static_cast<uint8_t>(idx);
+    header[3] = 0;
+    mData.insert(mData.end(), header, header + 4);
+
+    EncodeADPCMNibbles(x, n, pred, idx, nibbles);
+
+    for (int i = 0; i < n; i += 2)
+      mData.push_back(static_cast<uint8_t>(nibbles[i] | (i + 1 < n ? nibbles[i + 1] << 4 : 0)));
+  }
+
+  /** @return The squared error of the decoded block */
+  static int64_t EncodeADPCMNibbles(const int32_t* x, int n, int& pred, int& idx, uint8_t* pNibbles)
+  {
+    int64_t err = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+      int diff = x[i] - pred;
+      int nib = 0;
+
+      if (diff < 0)
+      {
+        nib = 8;
+        diff = -diff;
+      }
+
+      int step = ADPCMStep(idx);
+      if (diff >= step) { nib |= 4; diff -= step; }
+      step >>= 1;
+      if (diff >= step) { nib |= 2; diff -= step; }
+      step >>= 1;
+      if (diff >= step) { nib |= 1; }
+
+      ADPCMUpdate(nib, pred, idx);
+      pNibbles[i] = static_cast<uint8_t>(nib);
+
+      const int64_t e = x[i] - pred;
+      err += e * e;
+    }
+
+    return err;
+  }
+
+  static void DecodeADPCM(const uint8_t* pSrc, int n, int32_t* pDst)
+  {
+    int16_t pred16;
+    memcpy(&pred16, pSrc, 2);
+    int pred = pred16;
+    int idx = std::min<int>(pSrc[2], 88);
+    pSrc += 4;
+
+    for (int i = 0; i < n; i++)
+    {
+      const int nib = (i & 1) ? (pSrc[i >> 1] >> 4) : (pSrc[i >> 1] & 15);
+      ADPCMUpdate(nib, pred, idx);
+      pDst[i] = pred;
+    }
+  }
+
+  EEncoding mEncoding = kFloat;
+  int mNChans = 0;
+  int mNFrames = 0;
+  int mNBlocks = 0;
+  float mScale = 32768.f;
+  std::vector<uint8_t> mData;
+  std::vector<uint32_t> mOffsets;
+};
+
+/** A small per-voice cache of decoded blocks. A voice reading forwards through a sample decodes each block once, and reads that cross a
+ * block boundary or loop back hit the cache. All methods except the constructor are realtime safe. */
+class SampleStoreCache
+{
+public:
+  /** @param nSlots The number of decoded blocks kept, 2 per channel covers playback across block boundaries */
+  SampleStoreCache(int nSlots = 4)
+  : mSlots(std::max(nSlots, 1))
+  , mBuffer(mSlots.size() * SampleStore::kBlockSize)
+  {
+  }
+
+  /** Forget all cached blocks, e.g. when the store is re-encoded */
+  void Reset()
+  {
+    for (auto& slot : mSlots)
+      slot.pStore = nullptr;
+  }
+
+  /** @param nFrames Set to the number of valid frames in the block
+   * @return The decoded block, or nullptr if it doesn't exist. Valid until the next call */
+  const float* GetBlock(const SampleStore& store, int chan, int block, int& nFrames)
+  {
+    mClock++;
+    Slot* pOldest = &mSlots[0];
+
+    for (auto& slot : mSlots)
+    {
+      if (slot.pStore == &store && slot.chan == chan && slot.block == block)
+      {
+        slot.lastUse = mClock;
+        nFrames = slot.nFrames;
+        return BlockData(slot);
+      }
+
+      if (slot.lastUse < pOldest->lastUse)
+        pOldest = &slot;
+    }
+
+    nFrames = store.DecodeBlock(chan, block, BlockData(*pOldest));
+
+    if (!nFrames)
+    {
+      pOldest->pStore = nullptr;
+      return nullptr;
+    }
+
+    *pOldest = { &store, chan, block, nFrames, mClock };
+    return BlockData(*pOldest);
+  }
+
+  /** Copy frames of one channel into \c pDst, zero filling before the start and past the end of the sample
+   * @return The number of frames that were inside the sample */
+  template <typename T>
+  int Read(const SampleStore& store, int chan, int startFrame, T* pDst, int nFrames)
+  {
+    const int lead = startFrame < 0 ? static_cast<int>(std::min<int64_t>(-static_cast<int64_t>(startFrame), nFrames)) : 0;
+    std::fill(pDst, pDst + lead, T(0));
+    int done = lead;
+
+    while (done < nFrames)
+    {
+      const int frame = startFrame + done;
+      const int block = frame / SampleStore::kBlockSize;
+      const int offset = frame - block * SampleStore::kBlockSize;
+      int blockFrames = 0;
+      const float* pBlock = GetBlock(store, chan, block, blockFrames);
+
+      if (!pBlock || offset >= blockFrames)
+        break;
+
+      const int n = std::min(nFrames - done, blockFrames - offset);
+
+      for (int i = 0; i < n; i++)
+        pDst[done + i] = static_cast<T>(pBlock[offset + i]);
+
+      done += n;
+    }
+
+    std::fill(pDst + done, pDst + nFrames, T(0));
+    return done - lead;
+  }
+
+private:
+  struct Slot
+  {
+    const SampleStore* pStore = nullptr;
+    int chan = 0;
+    int block = 0;
+    int nFrames = 0;
+    uint32_t lastUse = 0;
+  };
+
+  float* BlockData(const Slot& slot) { return mBuffer.data() + (&slot - mSlots.data()) * SampleStore::kBlockSize; }
+
+  std::vector<Slot> mSlots;
+  std::vector<float> mBuffer;
+  uint32_t mClock = 0;
+};
+
+END_IPLUG_NAMESPACE
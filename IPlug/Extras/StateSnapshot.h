@@ -0,0 +1,193 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc StateSnapshot
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Immutable, reference counted versions of a large plug-in state (sample content, sequences, tables...) shared between the audio
+ * thread, the host's serialization calls and whichever thread edits or restores the state.
+ *
+ * A new version is built off the audio thread and handed to Publish(), which swaps it in atomically. The audio thread reads the current
+ * version through an AudioScope: it never locks, waits or frees memory, and a version it is using is not destroyed until the scope ends.
+ * SerializeState() takes a reference with Get() and writes that version while processing continues, so the saved state can't tear.
+ * Retired versions are freed on the publishing thread by Publish() or Collect().
+ *
+ * @code
+ * bool SerializeState(IByteChunk& chunk) const override
+ * {
+ *   auto pState = mState.Get();
+ *   chunk.Reserve(chunk.Size() + pState->GetSerializedSize());
+ *   pState->Serialize(chunk);
+ *   return SerializeParams(chunk);
+ * }
+ *
+ * int UnserializeState(const IByteChunk& chunk, int startPos) override
+ * {
+ *   auto pState = std::make_shared<MyState>();
+ *   startPos = pState->Unserialize(chunk, startPos);
+ *   mState.Publish(std::move(pState));
+ *   return UnserializeParams(chunk, startPos);
+ * }
+ *
+ * void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+ * {
+ *   StateSnapshot<MyState>::AudioScope state(mState);
+ *   // use state-> for the whole block
+ * }
+ * @endcode
+ *
+ * Only one audio thread may hold an AudioScope at a time. The non-audio side uses a short mutex around pointer copies only, never
+ * around serialization or around the audio thread. */
+template <class T>
+class StateSnapshot
+{
+public:
+  using Ptr = std::shared_ptr<const T>;
+
+  /** RAII access to the current version from the audio thread */
+  class AudioScope
+  {
+  public:
+    AudioScope(StateSnapshot& snapshot)
+    : mSnapshot(snapshot)
+    , mpState(snapshot.AcquireAudio())
+    {
+    }
+
+    ~AudioScope() { mSnapshot.ReleaseAudio(); }
+
+    AudioScope(const AudioScope&) = delete;
+    AudioScope& operator=(const AudioScope&) = delete;
+
+    const T& operator*() const { return *mpState; }
+    const T* operator->() const { return mpState; }
+    const T* Get() const { return mpState; }
+
+  private:
+    StateSnapshot& mSnapshot;
+    const T* mpState;
+  };
+
+  /** @param pInitial The initial version. Must not be null */
+  StateSnapshot(Ptr pInitial = std::make_shared<const T>())
+  : mCurrent(std::move(pInitial))
+  {
+    mCurrentRaw.store(mCurrent.get());
+  }
+
+  StateSnapshot(const StateSnapshot&) = delete;
+  StateSnapshot& operator=(const StateSnapshot&) = delete;
+
+  /** NON-AUDIO: Make \c pState the current version. Versions retired earlier are freed once nothing uses them
+   * @param pState The new version, fully built. Must not be null */
+  void Publish(Ptr pState)
+  {
+    std::vector<Ptr> toFree;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mCurrentRaw.store(pState.get());
+      mRetired.push_back(std::move(mCurrent));
+      mCurrent = std::move(pState);
+      CollectLocked(toFree);
+    }
+  }
+
+  /** NON-AUDIO: Construct a new version in place and publish it */
+  template <typename... Args>
+  void Emplace(Args&&... args)
+  {
+    Publish(std::make_shared<const T>(std::forward<Args>(args)...));
+  }
+
+  /** NON-AUDIO: @return The current version. It stays valid and unchanged for as long as the caller holds the pointer */
+  Ptr Get() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCurrent;
+  }
+
+  /** NON-AUDIO: Free retired versions that are no longer used. Publish() does this too, call it from a timer if publishing is rare */
+  void Collect()
+  {
+    std::vector<Ptr> toFree;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      CollectLocked(toFree);
+    }
+  }
+
+  /** AUDIO: Lock free, wait free if no version is published concurrently. Prefer AudioScope
+   * @return The current version, valid until ReleaseAudio() */
+  const T* AcquireAudio()
+  {
+    const T* pState = mCurrentRaw.load();
+
+    // publish the hazard, then check the version is still current, so that CollectLocked() either sees it or it was never retired
+    while (true)
+    {
+      mAudioHazard.store(pState);
+      const T* pCurrent = mCurrentRaw.load();
+
+      if (pCurrent == pState)
+        return pState;
+
+      pState = pCurrent;
+    }
+  }
+
+  /** AUDIO: Stop using the version returned by AcquireAudio() */
+  void ReleaseAudio()
+  {
+    mAudioHazard.store(nullptr, std::memory_order_release);
+  }
+
+private:
+  /** Moves unused retired versions into \c toFree, so that they are destroyed after the lock is released */
+  void CollectLocked(std::vector<Ptr>& toFree)
+  {
+    const T* pHazard = mAudioHazard.load();
+
+    for (auto it = mRetired.begin(); it != mRetired.end();)
+    {
+      // use_count() can't grow for a retired version: Get() only hands out mCurrent
+      if (it->get() != pHazard && it->use_count() == 1)
+      {
+        toFree.push_back(std::move(*it));
+        it = mRetired.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+
+  mutable std::mutex mMutex;
+  Ptr mCurrent;
+  std::vector<Ptr> mRetired;
+  std::atomic<const T*> mCurrentRaw {nullptr};
+  std::atomic<const T*> mAudioHazard {nullptr};
+};
+
+END_IPLUG_NAMESPACE
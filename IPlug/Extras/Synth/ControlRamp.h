@@ -15,31 +15,62 @@
  * @copydoc ControlRamp
  */
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <utility>
+#include <vector>
 
 BEGIN_IPLUG_NAMESPACE
 
-/** A ControlRamp describes one value changing over time. It can
+/** The curve of a transition between two values */
+enum ERampShape
+{
+  kRampLinear = 0,
+  kRampExponential, // a constant ratio per sample, e.g. for a frequency in Hz. Linear if the values don't have the same sign
+  kRampSCurve, // smoothstep, starting and finishing slowly
+  kNumRampShapes
+};
+
+/** A ControlRamp describes one value changing over a block. It can
  * be easily converted into a signal for more processing,
  * or if sample accuracy is not needed, just the end value can be used.
- * It describes a piecewise function in three pieces:
- * from [0, startValue] to [transitionStart, startValue]
- * from [transitionStart, startValue] to [transitionEnd, endValue]
- * from [transitionEnd, endValue] to [blockSize, endValue] */
+ * Within the block the value holds, then follows up to kMaxSegments curved segments, holding between and after them.
+ * A ramp that doesn't change during the block IsConstant(), and can be used without writing it to a buffer.
+ * A ramp that has no segments but different start and end values is a single linear transition
+ * from [transitionStart, startValue] to [transitionEnd, endValue], as set by hand. */
 struct ControlRamp
 {
-  double startValue;
-  double endValue;
-  int transitionStart;
-  int transitionEnd;
+  static constexpr int kMaxSegments = 4;
+
+  /** Part of a glide within the block. The glide's curve runs from "from" at progress 0 to "to" at progress 1,
+   * and the sample at index i in [start, end) has progress progressStart + (i - start + 1) * progressIncr */
+  struct Segment
+  {
+    int start;
+    int end;
+    double from;
+    double to;
+    double progressStart;
+    double progressIncr;
+    double endValue; // the value at the last sample, which holds after the segment
+    ERampShape shape;
+  };
+
+  double startValue = 0.;
+  double endValue = 0.;
+  int transitionStart = 0; // the start of the first segment
+  int transitionEnd = 0; // the end of the last segment
+  int nSegments = 0;
+  std::array<Segment, kMaxSegments> segments;
 
   void Clear()
   {
     startValue = endValue = 0.;
     transitionStart = transitionEnd = 0;
+    nSegments = 0;
   }
 
   bool IsNonzero() const
@@ -47,32 +78,267 @@ struct ControlRamp
     return (startValue != 0.) || (endValue != 0.);
   }
 
+  /** @return \c true if the value is endValue for the whole block */
+  bool IsConstant() const
+  {
+    return !nSegments && startValue == endValue;
+  }
+
+  /** @return The value of a glide's curve
+   * @param from The value at progress 0
+   * @param to The value at progress 1
+   * @param progress [0, 1]
+   * @param shape The curve */
+  static double GetCurveValue(double from, double to, double progress, ERampShape shape)
+  {
+    switch (shape)
+    {
+      case kRampExponential:
+        if (SameSign(from, to))
+          return from * std::exp2(std::log2(to / from) * progress);
+        return from + (to - from) * progress;
+      case kRampSCurve:
+        return from + (to - from) * progress * progress * (3. - 2. * progress);
+      case kRampLinear:
+      default:
+        return from + (to - from) * progress;
+    }
+  }
+
   /** Writes the ramp signal to an output buffer.
+   * The segments are written by loops without dependencies between samples, which the compiler vectorises.
    * @param buffer Pointer to the start of an output buffer.
    * @param startIdx Sample index of the start of the desired write within the buffer.
    * @param nFrames The number of samples to be written. */
-  void Write(float* buffer, int startIdx, int nFrames)
+  void Write(float* buffer, int startIdx, int nFrames) const
   {
-    float val = static_cast<float>(startValue);
-    float dv = static_cast<float>((endValue - startValue)/(transitionEnd - transitionStart));
+    float* pOut = buffer + startIdx;
 
-    for(int i=startIdx; i<startIdx + transitionStart; ++i)
+    if (IsConstant())
     {
-      buffer[i] = val;
+      std::fill(pOut, pOut + nFrames, static_cast<float>(endValue));
+      return;
     }
-    for(int i=startIdx + transitionStart; i<startIdx + transitionEnd; ++i)
-    {
-      val += dv;
-      buffer[i] = val;
-    }
-    for(int i=startIdx + transitionEnd; i<startIdx + nFrames; ++i)
+
+    if (!nSegments)
     {
-      buffer[i] = val;
+      const int length = std::max(transitionEnd - transitionStart, 1);
+      const Segment linear {transitionStart, transitionEnd, startValue, endValue, 0., 1. / length, endValue, kRampLinear};
+      WriteSegments(pOut, nFrames, &linear, 1);
+      return;
     }
+
+    WriteSegments(pOut, nFrames, segments.data(), nSegments);
   }
-    
+
   template<size_t N>
   using RampArray = std::array<ControlRamp, N>;
+
+private:
+  static bool SameSign(double a, double b)
+  {
+    return (a > 0. && b > 0.) || (a < 0. && b < 0.);
+  }
+
+  void WriteSegments(float* pOut, int nFrames, const Segment* pSegments, int n) const
+  {
+    double hold = startValue;
+    int pos = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+      const Segment& seg = pSegments[i];
+      const int start = std::min(seg.start, nFrames);
+      const int end = std::min(seg.end, nFrames);
+      std::fill(pOut + pos, pOut + start, static_cast<float>(hold));
+      WriteSegment(pOut + start, end - start, seg);
+      hold = seg.endValue;
+      pos = end;
+    }
+
+    std::fill(pOut + pos, pOut + nFrames, static_cast<float>(hold));
+  }
+
+  static void WriteSegment(float* pOut, int n, const Segment& seg)
+  {
+    const float from = static_cast<float>(seg.from);
+    const float range = static_cast<float>(seg.to - seg.from);
+    const float p0 = static_cast<float>(seg.progressStart);
+    const float dp = static_cast<float>(seg.progressIncr);
+
+    if (seg.shape == kRampExponential && SameSign(seg.from, seg.to))
+    {
+      // each group of 8 samples is a base value times the same 8 powers of the ratio per sample
+      const double logRatio = std::log2(seg.to / seg.from);
+      const double ratio = std::exp2(logRatio * seg.progressIncr);
+      double base = seg.from * std::exp2(logRatio * seg.progressStart);
+      float powers[8];
+      double power = 1.;
+
+      for (int k = 0; k < 8; k++)
+      {
+        power *= ratio;
+        powers[k] = static_cast<float>(power);
+      }
+
+      int i = 0;
+
+      for (; i + 8 <= n; i += 8)
+      {
+        const float b = static_cast<float>(base);
+
+        for (int k = 0; k < 8; k++)
+          pOut[i + k] = b * powers[k];
+
+        base *= power;
+      }
+
+      for (int k = 0; i < n; i++, k++)
+        pOut[i] = static_cast<float>(base) * powers[k];
+    }
+    else if (seg.shape == kRampSCurve)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        const float p = p0 + (i + 1) * dp;
+        pOut[i] = from + range * p * p * (3.f - 2.f * p);
+      }
+    }
+    else
+    {
+      for (int i = 0; i < n; i++)
+        pOut[i] = from + range * (p0 + (i + 1) * dp);
+    }
+  }
+};
+
+/** The state of one glide, which writes a ControlRamp for each block. A glide is a queue of segments, each moving to a target
+ * over a number of samples with a shape. Used by ControlRampProcessor for a single ramp, and by ControlRampBank for many */
+class ControlRampGlide
+{
+public:
+  static constexpr int kMaxQueuedSegments = 4;
+
+  /** Start a new glide, replacing any in progress
+   * @param currentValue The value the glide starts from, the ramp's endValue
+   * @param targetValue The target
+   * @param startOffset The sample at which the glide starts, counted from the start of the next block. It can be in a later block
+   * @param glideSamples The length of the glide
+   * @param shape The curve */
+  void SetTarget(double currentValue, double targetValue, int startOffset, int glideSamples, ERampShape shape)
+  {
+    mQueueSize = 0;
+    mQueueHead = 0;
+    Begin(currentValue, targetValue, glideSamples, shape);
+    mStartOffset = startOffset;
+  }
+
+  /** Queue a segment to follow the glide in progress, or to start at the next block if there isn't one.
+   * @return \c false if the queue is full, in which case the segment is dropped */
+  bool AddSegment(double targetValue, int glideSamples, ERampShape shape)
+  {
+    if (mQueueSize == kMaxQueuedSegments)
+      return false;
+
+    mQueue[(mQueueHead + mQueueSize++) % kMaxQueuedSegments] = {targetValue, glideSamples, shape};
+    return true;
+  }
+
+  bool IsGliding() const
+  {
+    return mGliding || mQueueSize;
+  }
+
+  /** Write the ramp for the next block
+   * @param output The ramp, which continues from its endValue
+   * @param blockSize The block size
+   * @return \c true if the glide continues into the next block */
+  bool Process(ControlRamp& output, int blockSize)
+  {
+    // always connect with previous block
+    output.startValue = output.endValue;
+    output.nSegments = 0;
+
+    // a glide that starts in a later block leaves this one constant
+    if (mStartOffset >= blockSize && mGliding)
+    {
+      mStartOffset -= blockSize;
+      output.transitionStart = output.transitionEnd = 0;
+      return true;
+    }
+
+    int pos = mStartOffset;
+    mStartOffset = 0;
+
+    // if more segments finish within the block than the ramp can hold, the rest are delayed to the next block
+    while (pos < blockSize && IsGliding() && output.nSegments < ControlRamp::kMaxSegments)
+    {
+      if (!mGliding)
+      {
+        const Queued& next = mQueue[mQueueHead];
+        Begin(output.endValue, next.mTarget, next.mSamples, next.mShape);
+        mQueueHead = (mQueueHead + 1) % kMaxQueuedSegments;
+        mQueueSize--;
+      }
+
+      const int n = std::min(mGlideSamples - mElapsed, blockSize - pos);
+      const double progressIncr = 1. / mGlideSamples;
+      ControlRamp::Segment& seg = output.segments[output.nSegments++];
+      seg.start = pos;
+      seg.end = pos + n;
+      seg.from = mFrom;
+      seg.to = mTarget;
+      seg.progressStart = mElapsed * progressIncr;
+      seg.progressIncr = progressIncr;
+      seg.shape = mShape;
+
+      mElapsed += n;
+      pos += n;
+
+      if (mElapsed == mGlideSamples)
+      {
+        seg.endValue = mTarget;
+        mGliding = false;
+      }
+      else
+        seg.endValue = ControlRamp::GetCurveValue(mFrom, mTarget, mElapsed * progressIncr, mShape);
+
+      output.endValue = seg.endValue;
+    }
+
+    output.transitionStart = output.nSegments ? output.segments[0].start : 0;
+    output.transitionEnd = output.nSegments ? output.segments[output.nSegments - 1].end : 0;
+    return IsGliding();
+  }
+
+private:
+  struct Queued
+  {
+    double mTarget;
+    int mSamples;
+    ERampShape mShape;
+  };
+
+  void Begin(double from, double target, int glideSamples, ERampShape shape)
+  {
+    mFrom = from;
+    mTarget = target;
+    mGlideSamples = std::max(glideSamples, 1);
+    mElapsed = 0;
+    mShape = shape;
+    mGliding = true;
+  }
+
+  double mFrom {0.};
+  double mTarget {0.};
+  int mGlideSamples {1};
+  int mElapsed {0};
+  int mStartOffset {0};
+  ERampShape mShape {kRampLinear};
+  bool mGliding {false};
+  std::array<Queued, kMaxQueuedSegments> mQueue {};
+  int mQueueHead {0};
+  int mQueueSize {0};
 };
 
 class ControlRampProcessor
@@ -81,7 +347,7 @@ public:
 
   template<size_t N>
   using RampArray = ControlRamp::RampArray<N>;
-    
+
   template<size_t N>
   using ProcessorArray = std::array<ControlRampProcessor, N>;
 
@@ -90,87 +356,126 @@ public:
   ControlRampProcessor& operator=(const ControlRampProcessor&) = delete;
   ControlRampProcessor(ControlRampProcessor&&) = default;
   ControlRampProcessor& operator=(ControlRampProcessor&&) = delete;
-    
+
   // process the glide and write changes to the output ramp.
   void Process(int blockSize)
   {
-    // always connect with previous block
-    mpOutput.startValue = mpOutput.endValue;
-
-    if(mSamplesRemaining)
-    {
-      if(mSamplesRemaining == mGlideSamples)
-      {
-        // start glide
-        if(mSamplesRemaining > blockSize)
-        {
-          // start with ramp to block end
-          int glideStartSamples = blockSize - mStartOffset;
-          mpOutput.endValue = mpOutput.startValue + glideStartSamples*mChangePerSample;
-          mpOutput.transitionStart = mStartOffset;
-          mpOutput.transitionEnd = blockSize;
-          mSamplesRemaining -= glideStartSamples;
-        }
-        else
-        {
-          // glide starts and finishes within block
-          mpOutput.endValue = mTargetValue;
-          mpOutput.transitionStart = mStartOffset;
-          mpOutput.transitionEnd = mStartOffset + mGlideSamples;
-          mSamplesRemaining = 0;
-        }
-      }
-      else if(mSamplesRemaining > blockSize)
-      {
-        // continue glide
-        mpOutput.endValue = mpOutput.startValue + mChangePerSample*blockSize;
-        mpOutput.transitionStart = 0;
-        mpOutput.transitionEnd = blockSize;
-        mSamplesRemaining -= blockSize;
-      }
-      else
-      {
-        // finish glide
-        mpOutput.endValue = mTargetValue;
-        mpOutput.transitionStart = 0;
-        mpOutput.transitionEnd = mSamplesRemaining;
-        mSamplesRemaining = 0;
-      }
-    }
+    mGlide.Process(mpOutput, blockSize);
   }
 
   // set the next target for the glide without writing directly to the ramp.
-  void SetTarget(double targetValue, int startOffset, int glideSamples, int blockSize)
+  void SetTarget(double targetValue, int startOffset, int glideSamples, ERampShape shape = kRampLinear)
   {
-    mTargetValue = targetValue;
-    if(glideSamples < 1) glideSamples = 1;
-    mGlideSamples = glideSamples;
-    mSamplesRemaining = glideSamples;
-    mChangePerSample = (targetValue - mpOutput.endValue)/glideSamples;
-    mStartOffset = startOffset;
+    mGlide.SetTarget(mpOutput.endValue, targetValue, startOffset, glideSamples, shape);
   }
-    
+
+  // queue a segment after the glide in progress, for multi-segment glides
+  bool AddSegment(double targetValue, int glideSamples, ERampShape shape = kRampLinear)
+  {
+    return mGlide.AddSegment(targetValue, glideSamples, shape);
+  }
+
   // create an array of processors for an array of ramps
   template<size_t N>
   static ProcessorArray<N>* Create(RampArray<N>& inputs)
   {
     return CreateImpl<N>(inputs, std::make_index_sequence<N>());
   }
-    
+
 private:
-    
+
   template<size_t N, size_t ...Is>
   static ProcessorArray<N>* CreateImpl(RampArray<N>& inputs, std::index_sequence<Is...>)
   {
     return new ProcessorArray<N>{std::ref(inputs[Is]).get()...};
   }
-    
+
   ControlRamp& mpOutput;
-  double mTargetValue {0.};
-  double mChangePerSample {0.};
-  int mGlideSamples {0};
-  int mSamplesRemaining {0};
-  int mStartOffset {0};
+  ControlRampGlide mGlide;
+};
+
+/** Glides for many ramps, e.g. every control of every voice, advanced together in one pass per block.
+ * The glides, their outputs and the list of active ramps are kept in separate contiguous arrays. Only ramps that are gliding,
+ * or that glided in the previous block and need to be made constant again, are visited, so idle ramps cost nothing.
+ * Add all the ramps before processing, Add() allocates */
+class ControlRampBank
+{
+public:
+  /** Add a ramp to the bank. The ramp must outlive the bank
+   * @return The index of the ramp in the bank */
+  int Add(ControlRamp& output)
+  {
+    mOutputs.push_back(&output);
+    mGlides.emplace_back();
+    mIsActive.push_back(false);
+    mActive.push_back(0);
+    return static_cast<int>(mOutputs.size()) - 1;
+  }
+
+  int GetNRamps() const { return static_cast<int>(mOutputs.size()); }
+
+  /** @return The number of ramps visited by the next Process() */
+  int GetNActive() const { return mNActive; }
+
+  /** Start a new glide on a ramp, see ControlRampGlide::SetTarget() */
+  void SetTarget(int rampIdx, double targetValue, int startOffset, int glideSamples, ERampShape shape = kRampLinear)
+  {
+    mGlides[rampIdx].SetTarget(mOutputs[rampIdx]->endValue, targetValue, startOffset, glideSamples, shape);
+    Activate(rampIdx);
+  }
+
+  /** Queue a segment on a ramp, see ControlRampGlide::AddSegment() */
+  bool AddSegment(int rampIdx, double targetValue, int glideSamples, ERampShape shape = kRampLinear)
+  {
+    Activate(rampIdx);
+    return mGlides[rampIdx].AddSegment(targetValue, glideSamples, shape);
+  }
+
+  /** Stop a ramp's glide and set it to a constant value immediately, e.g. to clear it */
+  void Reset(int rampIdx, double value = 0.)
+  {
+    mGlides[rampIdx] = ControlRampGlide();
+    ControlRamp& output = *mOutputs[rampIdx];
+    output.Clear();
+    output.startValue = output.endValue = value;
+  }
+
+  /** Write the ramps for the next block */
+  void Process(int blockSize)
+  {
+    int nKept = 0;
+
+    for (int i = 0; i < mNActive; i++)
+    {
+      const int rampIdx = mActive[i];
+      ControlRamp& output = *mOutputs[rampIdx];
+      const bool gliding = mGlides[rampIdx].Process(output, blockSize);
+
+      // a ramp that changed in this block stays active for one more, to make it constant again
+      if (gliding || output.nSegments)
+        mActive[nKept++] = rampIdx;
+      else
+        mIsActive[rampIdx] = false;
+    }
+
+    mNActive = nKept;
+  }
+
+private:
+  void Activate(int rampIdx)
+  {
+    if (!mIsActive[rampIdx])
+    {
+      mIsActive[rampIdx] = true;
+      mActive[mNActive++] = rampIdx;
+    }
+  }
+
+  std::vector<ControlRamp*> mOutputs;
+  std::vector<ControlRampGlide> mGlides;
+  std::vector<bool> mIsActive;
+  std::vector<int> mActive; // the indexes of the active ramps, sized to hold every ramp
+  int mNActive = 0;
 };
 
 END_IPLUG_NAMESPACE
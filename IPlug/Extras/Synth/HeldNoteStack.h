@@ -0,0 +1,200 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc HeldNoteStack
+ */
+
+#include <cstdint>
+#include <cassert>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A fixed capacity set of MIDI keys that remembers the order they were pressed in, for mono note priority and sustain handling.
+ * Push, Remove and finding the last, lowest or highest key are all O(1), and nothing is allocated. */
+class HeldNoteStack
+{
+public:
+  static constexpr int kNumKeys = 128;
+  static constexpr int kNoKey = -1;
+
+  HeldNoteStack() { Clear(); }
+
+  void Clear()
+  {
+    for (int i = 0; i < kNumKeys; i++)
+    {
+      mPrev[i] = mNext[i] = kNoKey;
+      mVelocities[i] = 0.f;
+    }
+
+    mBits[0] = mBits[1] = 0;
+    mHead = mTail = kNoKey;
+    mSize = 0;
+  }
+
+  /** Add a key as the most recent, or move it to the top if it is already held
+   * @param key The key, 0-127. Other values are ignored
+   * @param velocity The velocity, stored to return to this key later */
+  void Push(int key, float velocity)
+  {
+    if (key < 0 || key >= kNumKeys)
+      return;
+
+    Remove(key);
+
+    mPrev[key] = mTail;
+    mNext[key] = kNoKey;
+
+    if (mTail != kNoKey)
+      mNext[mTail] = key;
+    else
+      mHead = key;
+
+    mTail = key;
+    mVelocities[key] = velocity;
+    mBits[key >> 6] |= Bit(key);
+    mSize++;
+  }
+
+  /** @return \c true if the key was held */
+  bool Remove(int key)
+  {
+    if (!Contains(key))
+      return false;
+
+    if (mPrev[key] != kNoKey)
+      mNext[mPrev[key]] = mNext[key];
+    else
+      mHead = mNext[key];
+
+    if (mNext[key] != kNoKey)
+      mPrev[mNext[key]] = mPrev[key];
+    else
+      mTail = mPrev[key];
+
+    mPrev[key] = mNext[key] = kNoKey;
+    mBits[key >> 6] &= ~Bit(key);
+    mSize--;
+    return true;
+  }
+
+  bool Contains(int key) const
+  {
+    return key >= 0 && key < kNumKeys && (mBits[key >> 6] & Bit(key));
+  }
+
+  bool Empty() const { return mSize == 0; }
+
+  int GetSize() const { return mSize; }
+
+  /** @return The most recently pushed key, or kNoKey */
+  int GetLast() const { return mTail; }
+
+  /** @return The lowest key, or kNoKey */
+  int GetLowest() const
+  {
+    if (mBits[0])
+      return CountTrailingZeros(mBits[0]);
+
+    if (mBits[1])
+      return 64 + CountTrailingZeros(mBits[1]);
+
+    return kNoKey;
+  }
+
+  /** @return The highest key, or kNoKey */
+  int GetHighest() const
+  {
+    if (mBits[1])
+      return 127 - CountLeadingZeros(mBits[1]);
+
+    if (mBits[0])
+      return 63 - CountLeadingZeros(mBits[0]);
+
+    return kNoKey;
+  }
+
+  /** @return The velocity the key was pushed with */
+  float GetVelocity(int key) const
+  {
+    assert(key >= 0 && key < kNumKeys);
+    return mVelocities[key];
+  }
+
+  /** Call func(key) for each key, from the oldest to the most recent. func must not modify the stack */
+  template <typename F>
+  void ForEach(F func) const
+  {
+    for (int key = mHead; key != kNoKey; key = mNext[key])
+      func(key);
+  }
+
+private:
+  static uint64_t Bit(int key) { return uint64_t(1) << (key & 63); }
+
+  // x must not be zero
+  static int CountTrailingZeros(uint64_t x)
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<int>(idx);
+#elif defined(_MSC_VER) // 32 bit targets have no 64 bit scan
+    unsigned long idx;
+
+    if (_BitScanForward(&idx, static_cast<unsigned long>(x)))
+      return static_cast<int>(idx);
+
+    _BitScanForward(&idx, static_cast<unsigned long>(x >> 32));
+    return 32 + static_cast<int>(idx);
+#else
+    return __builtin_ctzll(x);
+#endif
+  }
+
+  static int CountLeadingZeros(uint64_t x)
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long idx;
+    _BitScanReverse64(&idx, x);
+    return 63 - static_cast<int>(idx);
+#elif defined(_MSC_VER)
+    unsigned long idx;
+
+    if (_BitScanReverse(&idx, static_cast<unsigned long>(x >> 32)))
+      return 31 - static_cast<int>(idx);
+
+    _BitScanReverse(&idx, static_cast<unsigned long>(x));
+    return 63 - static_cast<int>(idx);
+#else
+    return __builtin_clzll(x);
+#endif
+  }
+
+  int8_t mPrev[kNumKeys];
+  int8_t mNext[kNumKeys];
+  float mVelocities[kNumKeys];
+  uint64_t mBits[2];
+  int mHead;
+  int mTail;
+  int mSize;
+};
+
+END_IPLUG_NAMESPACE
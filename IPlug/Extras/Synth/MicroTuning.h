@@ -0,0 +1,286 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ScalaTuning
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "scalafile.h"
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The pitch of every key on every MIDI channel, in octaves relative to 440Hz ("1v / octave") as used by VoiceAllocator.
+ * Keys that are not mapped are NaN, and don't sound. The default is 12-TET with A4 (key 69) at 440Hz on all channels */
+struct TuningTable
+{
+  static constexpr int kNumChannels = 16;
+  static constexpr int kNumKeys = 128;
+
+  TuningTable()
+  {
+    for (int c = 0; c < kNumChannels; c++)
+    {
+      for (int k = 0; k < kNumKeys; k++)
+        mPitches[c][k] = (k - 69.f) / 12.f;
+    }
+  }
+
+  float GetPitch(int channel, int key) const { return mPitches[channel][key]; }
+
+  float mPitches[kNumChannels][kNumKeys];
+};
+
+/** A tuning defined by a Scala scale (.scl) and keyboard mapping (.kbm), see http://www.huygens-fokker.org/scala/
+ * Use it on the main thread to fill a TuningTable, which can then be sent to MidiSynth::SetTuning().
+ * @code
+ * ScalaTuning tuning;
+ * if (tuning.LoadSCL(sclPath) && tuning.LoadKBM(kbmPath))
+ * {
+ *   TuningTable table;
+ *   tuning.Fill(table);
+ *   mSynth.SetTuning(table, 0.1); // held notes glide to the new tuning over 100ms
+ * }
+ * @endcode */
+class ScalaTuning
+{
+public:
+  static constexpr int kUnmapped = -1;
+
+  /** A Scala keyboard mapping. The default maps the scale linearly with degree 0 on key 60, and key 69 at 440Hz */
+  struct KeyboardMapping
+  {
+    int mFirstKey = 0; // keys outside [mFirstKey, mLastKey] are not mapped
+    int mLastKey = 127;
+    int mMiddleKey = 60; // the key that plays degree 0
+    int mReferenceKey = 69;
+    double mReferenceFreq = 440.;
+    int mOctaveDegree = 0; // the degree that repeats the mapping, 0 = the scale's period
+    std::vector<int> mMap; // the degree played by each key from mMiddleKey, or kUnmapped. Empty maps every key to the next degree
+  };
+
+  ScalaTuning()
+  {
+    Reset();
+  }
+
+  /** Set 12-TET and the default keyboard mapping */
+  void Reset()
+  {
+    mCents.clear();
+
+    for (int i = 1; i <= 12; i++)
+      mCents.push_back(i * 100.);
+
+    mDescription = "12-TET";
+    mMapping = KeyboardMapping();
+  }
+
+  /** Load a Scala .scl file
+   * @return \c false if the file could not be read, in which case the scale is unchanged */
+  bool LoadSCL(const char* path)
+  {
+    ScalaScaleFile scl;
+
+    if (!scl.Open(path))
+      return false;
+
+    char descr[256];
+
+    if (!scl.ReadDescr(descr, sizeof(descr)))
+      return false;
+
+    const int n = scl.ReadNum();
+
+    if (n <= 0)
+      return false;
+
+    std::vector<double> cents;
+
+    for (int i = 0; i < n; i++)
+    {
+      const double ratio = scl.ReadPitch();
+
+      if (ratio <= 0.)
+        return false;
+
+      cents.push_back(1200. * std::log2(ratio));
+    }
+
+    mDescription = descr;
+    return SetScale(cents);
+  }
+
+  /** Load a Scala .kbm file
+   * @return \c false if the file could not be read, in which case the mapping is unchanged */
+  bool LoadKBM(const char* path)
+  {
+    FILE* fp = fopen(path, "rb");
+
+    if (!fp)
+      return false;
+
+    KeyboardMapping mapping;
+    char buf[256];
+    int nMap = -1;
+    int field = 0;
+    bool ok = true;
+
+    while (ok && fgets(buf, sizeof(buf), fp))
+    {
+      const char* p = buf;
+
+      while (*p == ' ' || *p == '\t')
+        p++;
+
+      if (*p == '!' || *p == '\r' || *p == '\n' || *p == '\0')
+        continue;
+
+      switch (field++)
+      {
+        case 0: nMap = atoi(p); ok = nMap >= 0 && nMap <= 1024; break;
+        case 1: mapping.mFirstKey = atoi(p); break;
+        case 2: mapping.mLastKey = atoi(p); break;
+        case 3: mapping.mMiddleKey = atoi(p); break;
+        case 4: mapping.mReferenceKey = atoi(p); break;
+        case 5: mapping.mReferenceFreq = atof(p); ok = mapping.mReferenceFreq > 0.; break;
+        case 6: mapping.mOctaveDegree = atoi(p); break;
+        default:
+          if (static_cast<int>(mapping.mMap.size()) < nMap)
+            mapping.mMap.push_back((*p == 'x' || *p == 'X') ? kUnmapped : atoi(p));
+          break;
+      }
+    }
+
+    fclose(fp);
+
+    if (!ok || field < 7)
+      return false;
+
+    // entries missing from the end of the file are unmapped
+    mapping.mMap.resize(nMap, kUnmapped);
+    mMapping = mapping;
+    return true;
+  }
+
+  /** Set the scale directly
+   * @param cents The degrees after 0, in cents. The last degree is the period, usually 1200 cents
+   * @return \c false if the scale is empty or its period is not positive */
+  bool SetScale(const std::vector<double>& cents)
+  {
+    if (cents.empty() || cents.back() <= 0.)
+      return false;
+
+    mCents = cents;
+    return true;
+  }
+
+  void SetKeyboardMapping(const KeyboardMapping& mapping) { mMapping = mapping; }
+
+  void ResetKeyboardMapping() { mMapping = KeyboardMapping(); }
+
+  const KeyboardMapping& GetKeyboardMapping() const { return mMapping; }
+
+  const char* GetDescription() const { return mDescription.c_str(); }
+
+  /** @return The number of degrees in the scale, including the period */
+  int GetNDegrees() const { return static_cast<int>(mCents.size()); }
+
+  /** @return The pitch of a key in cents relative to 440Hz, or NaN if the key is not mapped */
+  double GetCents(int key) const
+  {
+    if (key < mMapping.mFirstKey || key > mMapping.mLastKey)
+      return std::numeric_limits<double>::quiet_NaN();
+
+    return 1200. * std::log2(mMapping.mReferenceFreq / 440.) + KeyCents(key) - ReferenceCents();
+  }
+
+  /** @return The pitch of a key in octaves relative to 440Hz ("1v / octave"), or NaN if the key is not mapped */
+  float GetPitch(int key) const
+  {
+    return static_cast<float>(GetCents(key) / 1200.);
+  }
+
+  /** Fill a table with this tuning
+   * @param table The table
+   * @param channel The MIDI channel to fill, or -1 for all channels */
+  void Fill(TuningTable& table, int channel = -1) const
+  {
+    float pitches[TuningTable::kNumKeys];
+
+    for (int k = 0; k < TuningTable::kNumKeys; k++)
+      pitches[k] = GetPitch(k);
+
+    for (int c = 0; c < TuningTable::kNumChannels; c++)
+    {
+      if (channel < 0 || channel == c)
+        memcpy(table.mPitches[c], pitches, sizeof(pitches));
+    }
+  }
+
+private:
+  static int FloorDiv(int a, int b)
+  {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+  }
+
+  // cents of a scale degree above degree 0, degrees beyond the scale repeat at the period
+  double DegreeCents(int degree) const
+  {
+    const int n = GetNDegrees();
+    const int periods = FloorDiv(degree, n);
+    const int idx = degree - periods * n;
+    return periods * mCents.back() + (idx ? mCents[idx - 1] : 0.);
+  }
+
+  // cents of a key above the middle key, NaN if the mapping leaves it unmapped
+  double KeyCents(int key) const
+  {
+    const int offset = key - mMapping.mMiddleKey;
+    const int mapSize = static_cast<int>(mMapping.mMap.size());
+
+    if (!mapSize)
+      return DegreeCents(offset);
+
+    const int repeats = FloorDiv(offset, mapSize);
+    const int degree = mMapping.mMap[offset - repeats * mapSize];
+
+    if (degree == kUnmapped)
+      return std::numeric_limits<double>::quiet_NaN();
+
+    const double repeatCents = DegreeCents(mMapping.mOctaveDegree > 0 ? mMapping.mOctaveDegree : GetNDegrees());
+    return repeats * repeatCents + DegreeCents(degree);
+  }
+
+  // the reference key is tuned even if it isn't mapped, in which case it is tuned as if the mapping were linear
+  double ReferenceCents() const
+  {
+    const double cents = KeyCents(mMapping.mReferenceKey);
+    return std::isnan(cents) ? DegreeCents(mMapping.mReferenceKey - mMapping.mMiddleKey) : cents;
+  }
+
+  std::vector<double> mCents;
+  std::string mDescription;
+  KeyboardMapping mMapping;
+};
+
+END_IPLUG_NAMESPACE
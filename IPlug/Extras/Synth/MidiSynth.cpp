@@ -97,6 +97,11 @@ VoiceInputEvent MidiSynth::MidiMessageToEventBasic(const IMidiMsg& msg)
           event.mAction = kNoteOffAction;
           break;
         }
+        case IMidiMsg::kSustainOnOff:
+        {
+          event.mAction = kSustainAction;
+          break;
+        }
         // handle all other controllers
         default:
         {
@@ -167,7 +172,7 @@ VoiceInputEvent MidiSynth::MidiMessageToEventMPE(const IMidiMsg& msg)
     if(IsMasterChannel(event.mAddress.mChannel))
     {
       // store value in master channel
-      *pChannelDestValue = event.mValue;
+      *pChannelDestValue = static_cast<float>(event.mValue);
 
       // no action needed
       event.mAction = kNullAction;
@@ -178,7 +183,7 @@ VoiceInputEvent MidiSynth::MidiMessageToEventMPE(const IMidiMsg& msg)
       event.mValue += masterChannelStoredValue;
 
       // store sum in member channel
-      *pChannelDestValue = event.mValue;
+      *pChannelDestValue = static_cast<float>(event.mValue);
     }
     return event;
   }
@@ -230,6 +235,11 @@ VoiceInputEvent MidiSynth::MidiMessageToEventMPE(const IMidiMsg& msg)
           event.mAction = kNoteOffAction;
           break;
         }
+        case IMidiMsg::kSustainOnOff:
+        {
+          event.mAction = kSustainAction;
+          break;
+        }
 
         default:
           // send all other controllers to matching channels using the generic control action
@@ -394,11 +404,208 @@ void MidiSynth::HandleRPN(IMidiMsg msg)
   }
 }
 
+// MIDI 2.0 channel voice messages are sent to the voices at full resolution. MPE is a MIDI 1.0 convention,
+// so the MPE master channel values are not summed here, MIDI 2.0 senders use per-note messages instead.
+void MidiSynth::HandleUMP(const IMidiUMP& ump)
+{
+  IMidiMsg msg;
+
+  if(ump.GetMIDI1Msg(msg))
+  {
+    if(IsRPNMessage(msg))
+      HandleRPN(msg);
+    else
+      mVoiceAllocator.AddEvent(MidiMessageToEvent(msg));
+    return;
+  }
+
+  if(ump.MessageType() != IMidiUMP::kMIDI2ChannelVoice)
+    return;
+
+  const int channel = ump.Channel();
+  const int key = ump.NoteNumber();
+  ChannelState& state = mChannelStates[channel];
+
+  VoiceInputEvent event{};
+  event.mSampleOffset = ump.mOffset;
+  event.mAddress.mChannel = channel;
+  event.mAddress.mKey = kAllKeys;
+  event.mAddress.mZone = mMPEMode ? MasterZoneFor(channel) : 0;
+
+  switch(ump.StatusMsg())
+  {
+    case IMidiUMP::kNoteOn:
+    {
+      event.mAction = kNoteOnAction;
+      event.mAddress.mKey = key;
+      event.mValue = ump.Velocity() / 65535.;
+      break;
+    }
+    case IMidiUMP::kNoteOff:
+    {
+      event.mAction = kNoteOffAction;
+      event.mAddress.mKey = key;
+      event.mValue = ump.Velocity() / 65535.;
+      break;
+    }
+    case IMidiUMP::kPolyPressure:
+    {
+      event.mAction = kPressureAction;
+      event.mAddress.mKey = key;
+      event.mValue = ump.Unipolar();
+      break;
+    }
+    case IMidiUMP::kChannelPressure:
+    {
+      event.mAction = kPressureAction;
+      event.mValue = ump.Unipolar();
+      break;
+    }
+    case IMidiUMP::kPitchBend:
+    {
+      state.pitchBend = static_cast<float>(ump.Bipolar() * state.pitchBendRange / 12.);
+      SendPitchBendToKeys(event, -1);
+      return;
+    }
+    case IMidiUMP::kPerNotePitchBend:
+    {
+      mPerNotePitchBends[channel][key] = ump.Bipolar() * mPerNotePitchBendRange / 12.;
+      SendPitchBendToKeys(event, key);
+      return;
+    }
+    case IMidiUMP::kPerNoteManagement:
+    {
+      // reset the per-note controllers that we track
+      if((ump.Byte3() & IMidiUMP::kPerNoteReset) && mPerNotePitchBends[channel][key] != 0.)
+      {
+        mPerNotePitchBends[channel][key] = 0.;
+        SendPitchBendToKeys(event, key);
+      }
+      return;
+    }
+    case IMidiUMP::kRegisteredPerNoteController:
+    case IMidiUMP::kAssignablePerNoteController:
+    {
+      const bool registered = ump.StatusMsg() == IMidiUMP::kRegisteredPerNoteController;
+      const int idx = ump.Byte3();
+      event.mAddress.mKey = key;
+      event.mValue = ump.Unipolar();
+
+      if(registered && idx == IMidiMsg::kCutoffFrequency)
+      {
+        event.mAction = kTimbreAction;
+      }
+      else
+      {
+        event.mAction = kControllerAction;
+        event.mControllerNumber = registered ? idx : kAssignablePerNoteControllerOffset + idx;
+      }
+      break;
+    }
+    case IMidiUMP::kControlChange:
+    {
+      event.mControllerNumber = ump.Byte2() & 0x7F;
+      event.mValue = ump.Unipolar();
+
+      switch(event.mControllerNumber)
+      {
+        case IMidiMsg::kCutoffFrequency:
+          event.mAction = kTimbreAction;
+          break;
+        case IMidiMsg::kSustainOnOff:
+          event.mAction = kSustainAction;
+          break;
+        case IMidiMsg::kAllNotesOff:
+          event.mAddress.mFlags = kVoicesAll;
+          event.mAction = kNoteOffAction;
+          break;
+        default:
+          event.mAction = kControllerAction;
+          break;
+      }
+      break;
+    }
+    case IMidiUMP::kRegisteredController:
+    {
+      // the value MSB is in the top 7 bits, as with the data entry MSB of a MIDI 1.0 RPN
+      const int valueMSB = static_cast<int>(ump.Data() >> 25);
+
+      if(ump.Byte2() == 0)
+      {
+        switch(ump.Byte3())
+        {
+          case 0: // RPN 0 : pitch bend range
+            SetChannelPitchBendRange(channel, valueMSB);
+            break;
+          case 6: // RPN 6 : MPE zone configuration
+            if(IsMasterChannel(channel))
+              SetMPEZones(channel, valueMSB);
+            break;
+          case 7: // RPN 7 : per-note pitch bend range
+            mPerNotePitchBendRange = valueMSB;
+            break;
+          default:
+            break;
+        }
+      }
+      return;
+    }
+    case IMidiUMP::kProgramChange:
+    {
+      event.mAction = kProgramChangeAction;
+      event.mControllerNumber = ump.Program();
+      break;
+    }
+    default:
+      return;
+  }
+
+  mVoiceAllocator.AddEvent(event);
+}
+
+// the pitch bend of each voice is the sum of its channel's pitch bend and its per-note pitch bend
+void MidiSynth::SendPitchBendToKeys(VoiceInputEvent event, int key)
+{
+  const int channel = event.mAddress.mChannel;
+  const double channelBend = mChannelStates[channel].pitchBend;
+  event.mAction = kPitchBendAction;
+
+  if(key >= 0)
+  {
+    event.mAddress.mKey = key;
+    event.mValue = channelBend + mPerNotePitchBends[channel][key];
+    mVoiceAllocator.AddEvent(event);
+    return;
+  }
+
+  event.mAddress.mKey = kAllKeys;
+  event.mValue = channelBend;
+  mVoiceAllocator.AddEvent(event);
+
+  // then correct the keys that have their own pitch bend
+  for(int k = 0; k < 128; k++)
+  {
+    if(mPerNotePitchBends[channel][k] != 0.)
+    {
+      event.mAddress.mKey = k;
+      event.mValue = channelBend + mPerNotePitchBends[channel][k];
+      mVoiceAllocator.AddEvent(event);
+    }
+  }
+}
+
 bool MidiSynth::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int nOutputs, int nFrames)
 {
   assert(NVoices());
 
-  if (mVoicesAreActive | !mMidiQueue.Empty())
+  if (mTuning.Consume())
+  {
+    const PendingTuning& tuning = mTuning.GetReadBuffer();
+    mVoiceAllocator.SetTuningTable(tuning.mUseTable ? &tuning.mTable : nullptr);
+    mVoiceAllocator.RetuneVoices(static_cast<int>(tuning.mGlideTime * mSampleRate));
+  }
+
+  if (mVoicesAreActive | !mMidiQueue.Empty() | !mUMPQueue.Empty())
   {
     int blockSize = mBlockSize;
     int samplesRemaining = nFrames;
@@ -409,25 +616,39 @@ bool MidiSynth::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int
       if(samplesRemaining < blockSize)
         blockSize = samplesRemaining;
 
-      while (!mMidiQueue.Empty())
+      while (true)
       {
-        IMidiMsg msg = mMidiQueue.Peek();
+        // we assume the messages in each queue are in chronological order. If we find ones later than the current block we are done.
+        const bool midiDue = !mMidiQueue.Empty() && mMidiQueue.Peek().mOffset < startIndex + blockSize;
+        const bool umpDue = !mUMPQueue.Empty() && mUMPQueue.Peek().mOffset < startIndex + blockSize;
 
-        // we assume the messages are in chronological order. If we find one later than the current block we are done.
-        if (msg.mOffset > startIndex + blockSize) break;
+        if (!midiDue && !umpDue) break;
 
-        if(IsRPNMessage(msg))
+        // merge the two queues by offset
+        if (midiDue && (!umpDue || mMidiQueue.Peek().mOffset <= mUMPQueue.Peek().mOffset))
         {
-          HandleRPN(msg);
+          IMidiMsg msg = mMidiQueue.Peek();
+
+          if(IsRPNMessage(msg))
+          {
+            HandleRPN(msg);
+          }
+          else
+          {
+            // send performance messages to the voice allocator
+            // message offset is relative to the start of this processSamples() block
+            msg.mOffset -= startIndex;
+            mVoiceAllocator.AddEvent(MidiMessageToEvent(msg));
+          }
+          mMidiQueue.Remove();
         }
         else
         {
-          // send performance messages to the voice allocator
-          // message offset is relative to the start of this processSamples() block
-          msg.mOffset -= startIndex;
-          mVoiceAllocator.AddEvent(MidiMessageToEvent(msg));
+          IMidiUMP ump = mUMPQueue.Peek();
+          ump.mOffset -= startIndex;
+          HandleUMP(ump);
+          mUMPQueue.Remove();
         }
-        mMidiQueue.Remove();
       }
 
       mVoiceAllocator.ProcessEvents(blockSize, mSampleTime);
@@ -438,31 +659,36 @@ bool MidiSynth::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int
       mSampleTime += blockSize;
     }
 
-    bool voicesbusy = false;
-    int activeCount = 0;
+    // the busy voices are the ones the allocator is still processing, voices retired by silence culling may report busy
+    mVoicesAreActive = mVoiceAllocator.GetNActiveVoices() > 0;
 
+#if DEBUG_VOICE_COUNT
     for(int v = 0; v < NVoices(); v++)
     {
-      bool busy = GetVoice(v)->GetBusy();
-      voicesbusy |= busy;
-
-      activeCount += (busy==true);
-#if DEBUG_VOICE_COUNT
       if(GetVoice(v)->GetBusy()) printf("X");
       else DBGMSG("_");
     }
     DBGMSG("\n");
-    DBGMSG("Num Voices busy %i\n", activeCount);
-#else
-    }
+    DBGMSG("Num Voices busy %i\n", mVoiceAllocator.GetNActiveVoices());
 #endif
 
-    mVoicesAreActive = voicesbusy;
+    if (mVoiceStatesEnabled)
+    {
+      mVoiceAllocator.GetVoiceStates(mVoiceStates.GetWriteBuffer(), mSampleTime);
+      mVoiceStates.Publish();
+    }
 
     mMidiQueue.Flush(nFrames);
+    mUMPQueue.Flush(nFrames);
+
+    if (mVoiceAllocator.GetNChansPerBus())
+      mVoiceAllocator.FinishOutputBuses(outputs, nOutputs, nFrames);
   }
   else // empty block
   {
+    if (mVoiceAllocator.GetNChansPerBus())
+      mVoiceAllocator.FinishOutputBuses(outputs, nOutputs, nFrames);
+
     return true;
   }
 
@@ -475,6 +701,7 @@ void MidiSynth::SetSampleRateAndBlockSize(double sampleRate, int blockSize)
 
   mSampleRate = sampleRate;
   mMidiQueue.Resize(blockSize);
+  mUMPQueue.Resize(blockSize);
   mVoiceAllocator.SetSampleRateAndBlockSize(sampleRate, blockSize);
 
   for(int v = 0; v < NVoices(); v++)
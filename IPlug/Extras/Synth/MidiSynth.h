@@ -25,21 +25,27 @@
 #include "IPlugMidi.h"
 #include "IPlugLogger.h"
 
+#include "TripleBuffer.h"
+
 #include "SynthVoice.h"
 #include "VoiceAllocator.h"
+#include "MicroTuning.h"
+#include "VoiceState.h"
 
 #define DEBUG_VOICE_COUNT 0
 
 BEGIN_IPLUG_NAMESPACE
 
 /** A monophonic/polyphonic synthesiser base class which can be supplied with a custom voice.
- *  Supports different kinds of after touch, pitch bend, velocity and after touch curves, unison (currently monophonic mode only) */
+ *  Supports different kinds of after touch, pitch bend, velocity and after touch curves, unison stacks (see SetUnison()) */
 class MidiSynth
 {
 public:
   /** This defines the size in samples of a single block of processing that will be done by the synth. */
   static constexpr int kDefaultBlockSize = 32;
   static constexpr int kDefaultPitchBendRange = 12;
+  static constexpr int kDefaultPerNotePitchBendRange = 48;
+  static constexpr int kAssignablePerNoteControllerOffset = 256;
 
 #pragma mark - MidiSynth class
 
@@ -94,13 +100,65 @@ public:
     mVoiceAllocator.mATMode = mode;
   }
 
+  void SetStealPolicy(VoiceAllocator::EStealPolicy policy)
+  {
+    mVoiceAllocator.SetStealPolicy(policy);
+  }
+
+  void SetNotePriority(VoiceAllocator::ENotePriority priority)
+  {
+    mVoiceAllocator.SetNotePriority(priority);
+  }
+
+  void SetLegato(bool legato)
+  {
+    mVoiceAllocator.SetLegato(legato);
+  }
+
+  void SetPortamentoMode(VoiceAllocator::EPortamentoMode mode)
+  {
+    mVoiceAllocator.SetPortamentoMode(mode);
+  }
+
+  /** Play each note with a stack of unison layers, see VoiceAllocator::SetUnison() */
+  void SetUnison(int nLayers, float detuneCents, float panSpread)
+  {
+    mVoiceAllocator.SetUnison(nLayers, detuneCents, panSpread);
+  }
+
   /** Set this function to something other than the default
-   * if you need to implement a tuning table for microtonal support
+   * if you need to implement a tuning table for microtonal support.
+   * The most recent of SetKeyToPitchFn() and SetTuning() wins: this clears any tuning table, at the start of the next ProcessBlock()
    * @param fn A function taking an integer key value and returning a double-precision
    *  pitch value, where 0.5 = 220Hz, 1.0 = 440 Hz, 2.0 = 880 Hz ("1v / octave"). */
   void SetKeyToPitchFn(const std::function<float(int)>& fn)
   {
     mVoiceAllocator.SetKeyToPitchFunction(fn);
+    ClearTuning();
+  }
+
+  /** Set a tuning table, which replaces the key to pitch function. Call from one thread other than the audio thread, e.g. the main thread.
+   * The table is copied, and swapped in without locking at the start of the next ProcessBlock(), so the tuning can be changed while notes play.
+   * See ScalaTuning to make a table from Scala files, and SharedTuning to share a table between instances
+   * @param table The pitches for each channel and key
+   * @param glideTime The time in seconds over which held notes glide to the new tuning, 0 to retune them immediately */
+  void SetTuning(const TuningTable& table, double glideTime = 0.)
+  {
+    PendingTuning& pending = mTuning.GetWriteBuffer();
+    pending.mTable = table;
+    pending.mUseTable = true;
+    pending.mGlideTime = glideTime;
+    mTuning.Publish();
+  }
+
+  /** Remove the tuning table set with SetTuning(), going back to the key to pitch function. Same threading as SetTuning()
+   * @param glideTime The time in seconds over which held notes glide to the new tuning, 0 to retune them immediately */
+  void ClearTuning(double glideTime = 0.)
+  {
+    PendingTuning& pending = mTuning.GetWriteBuffer();
+    pending.mUseTable = false;
+    pending.mGlideTime = glideTime;
+    mTuning.Publish();
   }
 
   void SetNoteOffset(double offset)
@@ -118,6 +176,78 @@ public:
     mVoiceAllocator.SetControlGlideTime(t);
   }
 
+  /** Set the curve of note glides, e.g. kRampSCurve for an S-curve portamento */
+  void SetNoteGlideShape(ERampShape shape)
+  {
+    mVoiceAllocator.SetNoteGlideShape(shape);
+  }
+
+  void SetControlGlideShape(ERampShape shape)
+  {
+    mVoiceAllocator.SetControlGlideShape(shape);
+  }
+
+  /** Route each voice to the output bus it sets with SynthVoice::SetOutputBus(), for multi-output instruments.
+   * When routing is enabled ProcessBlock() writes every output channel, so they don't need to be zeroed first.
+   * See VoiceAllocator::SetOutputBuses()
+   * @param nChansPerBus The number of channels per bus, e.g. 2 for stereo buses, or 0 to render every voice into all outputs */
+  void SetOutputBuses(int nChansPerBus)
+  {
+    mVoiceAllocator.SetOutputBuses(nChansPerBus);
+  }
+
+  /** @return A bit for each output bus that voices rendered into in the last ProcessBlock(), when routing voices to buses */
+  uint64_t GetActiveOutputBuses() const
+  {
+    return mVoiceAllocator.GetActiveOutputBuses();
+  }
+
+  /** Retire released voices early once their output is inaudible, to save the CPU spent on long release tails.
+   * See VoiceAllocator::SetSilenceCulling() */
+  void SetSilenceCulling(VoiceAllocator::ESilenceCulling mode, double thresholdDB = -90., double holdTime = 0.05, double fadeTime = 0.005)
+  {
+    mVoiceAllocator.SetSilenceCulling(mode, thresholdDB, holdTime, fadeTime);
+  }
+
+  /** @return The time released voices spent in their tails and the number of voices culled, since the last ResetCullStats() */
+  const VoiceAllocator::CullStats& GetCullStats() const
+  {
+    return mVoiceAllocator.GetCullStats();
+  }
+
+  void ResetCullStats()
+  {
+    mVoiceAllocator.ResetCullStats();
+  }
+
+  /** Publish a snapshot of the voices' pitch, expression and envelope stage at the end of each ProcessBlock() that processed voices,
+   * e.g. to show MPE expression in an IVVoiceStateControl. The snapshot goes through a triple buffer, so neither side locks or allocates,
+   * and the audio thread only reads the voices it already processed. Read it on one thread, e.g. the main thread:
+   * @code
+   * void MyPlug::OnIdle()
+   * {
+   *   if (mDSP.mSynth.ConsumeVoiceStates())
+   *     SendControlMsgFromDelegate(kCtrlTagVoices, IVVoiceStateControl::kUpdateMessage, sizeof(VoiceStates), &mDSP.mSynth.GetVoiceStates());
+   * }
+   * @endcode */
+  void SetVoiceStatesEnabled(bool enable)
+  {
+    mVoiceStatesEnabled = enable;
+  }
+
+  /** READER: pick up the latest snapshot of the voices' states
+   * @return \c true if GetVoiceStates() now holds a new snapshot */
+  bool ConsumeVoiceStates()
+  {
+    return mVoiceStates.Consume();
+  }
+
+  /** READER: @return The snapshot picked up by the last successful ConsumeVoiceStates() */
+  const VoiceStates& GetVoiceStates() const
+  {
+    return mVoiceStates.GetReadBuffer();
+  }
+
   SynthVoice* GetVoice(int voiceIdx)
   {
     return mVoiceAllocator.GetVoice(voiceIdx);
@@ -145,6 +275,15 @@ public:
     mMidiQueue.Add(msg);
   }
 
+  /** Add a MIDI 2.0 Universal MIDI Packet, which is merged with the MIDI 1.0 messages by sample offset.
+   * MIDI 2.0 channel voice messages keep their 16-bit velocities and 32-bit controller values, and per-note pitch bend and
+   * per-note controllers are sent to the voices playing the note. Registered per-note controller 74 is sent as timbre, other per-note
+   * controllers are sent to SynthVoice::SetControl(), with assignable controllers offset by kAssignablePerNoteControllerOffset */
+  void AddUMPToQueue(const IMidiUMP& ump)
+  {
+    mUMPQueue.Add(ump);
+  }
+
   /** Processes a block of audio samples
    * @param inputs Pointer to input Arrays
    * @param outputs Pointer to output Arrays
@@ -156,6 +295,13 @@ public:
 
 private:
 
+  struct PendingTuning
+  {
+    TuningTable mTable;
+    bool mUseTable = false; // false to go back to the key to pitch function
+    double mGlideTime = 0.;
+  };
+
   // maintain the state for one MIDI channel including RPN receipt state and pitch bend range.
   struct ChannelState
   {
@@ -191,11 +337,14 @@ private:
   VoiceInputEvent MidiMessageToEventMPE(const IMidiMsg& msg);
   VoiceInputEvent MidiMessageToEvent(const IMidiMsg& msg);
   void HandleRPN(IMidiMsg msg);
+  void HandleUMP(const IMidiUMP& ump);
+  void SendPitchBendToKeys(VoiceInputEvent event, int key);
 
   // basic MIDI data
   VoiceAllocator mVoiceAllocator;
   uint16_t mUnisonVoices{1};
   IMidiQueue mMidiQueue;
+  IMidiUMPQueue mUMPQueue;
   float mVelocityLUT[128];
   float mAfterTouchLUT[128];
   ChannelState mChannelStates[16]{};
@@ -204,6 +353,11 @@ private:
   double mSampleRate = DEFAULT_SAMPLE_RATE;
   bool mVoicesAreActive = false;
   int mNonMPEPitchBendRange = kDefaultPitchBendRange;
+  int mPerNotePitchBendRange = kDefaultPerNotePitchBendRange;
+  double mPerNotePitchBends[16][128]{}; // per-note pitch bend of each key, for MIDI 2.0
+  TripleBuffer<PendingTuning> mTuning;
+  TripleBuffer<VoiceStates> mVoiceStates;
+  bool mVoiceStatesEnabled = false;
   
   // the synth will startup in basic MIDI mode. When an MPE Zone setup message is received, MPE mode is entered.
   // To leave MPE mode, use RPNs to set all MPE zone channel counts to 0 as per the MPE spec.
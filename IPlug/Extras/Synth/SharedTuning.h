@@ -0,0 +1,233 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc SharedTuning
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "IPlugPlatform.h"
+#include "MicroTuning.h"
+
+#if defined OS_WIN
+  #include <windows.h>
+#elif defined OS_MAC || defined OS_LINUX
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A TuningTable in shared memory, so that all the instances on a machine that open the same name share a tuning, whether they are
+ * loaded in one process or several. Any instance can Publish() a table, and the others pick it up by calling Poll() on the main thread.
+ * The table is guarded by a sequence number rather than a lock, so a reader never blocks a writer. Not available on iOS or the web.
+ *
+ * The table is meant to have a single writer at a time, typically the instance whose tuning the user has just changed. Concurrent calls to
+ * Publish() are serialised, but a writer is only waited for for kMaxWriteWait: an instance that crashed mid-write would otherwise leave the
+ * table locked forever, so after that its write is abandoned and the table is taken over.
+ * @code
+ * void MyPlug::OnIdle()
+ * {
+ *   TuningTable table;
+ *   if (mSharedTuning.Poll(table))
+ *     mDSP.mSynth.SetTuning(table, 0.05);
+ * }
+ * @endcode */
+class SharedTuning
+{
+public:
+  SharedTuning() = default;
+  SharedTuning(const SharedTuning&) = delete;
+  SharedTuning& operator=(const SharedTuning&) = delete;
+
+  ~SharedTuning()
+  {
+    Close();
+  }
+
+  /** Open the shared table, creating it if no other instance has
+   * @param name Identifies the table, e.g. your company or product name. Keep it short, macOS limits the length
+   * @return \c true on success */
+  bool Open(const char* name)
+  {
+    Close();
+
+#if defined OS_WIN
+    const std::string mappingName = std::string("Local\\iPlug2Tuning_") + name;
+    mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(Shared), mappingName.c_str());
+
+    if (!mMapping)
+      return false;
+
+    mpShared = static_cast<Shared*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Shared)));
+
+    if (!mpShared)
+    {
+      CloseHandle(mMapping);
+      mMapping = nullptr;
+    }
+#elif defined OS_MAC || defined OS_LINUX
+    const std::string shmName = (std::string("/iPlug2Tuning_") + name).substr(0, 30);
+    const int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT, 0666);
+
+    if (fd < 0)
+      return false;
+
+    // a new object is empty, and zero filled when it is sized. macOS doesn't allow resizing it again
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, sizeof(Shared)) != 0) || (st.st_size != 0 && st.st_size < static_cast<off_t>(sizeof(Shared))))
+    {
+      close(fd);
+      return false;
+    }
+
+    void* pMem = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (pMem != MAP_FAILED)
+      mpShared = static_cast<Shared*>(pMem);
+#endif
+
+    mLastSequence = 0;
+    return mpShared != nullptr;
+  }
+
+  void Close()
+  {
+    if (!mpShared)
+      return;
+
+#if defined OS_WIN
+    UnmapViewOfFile(mpShared);
+    CloseHandle(mMapping);
+    mMapping = nullptr;
+#elif defined OS_MAC || defined OS_LINUX
+    munmap(mpShared, sizeof(Shared));
+#endif
+
+    mpShared = nullptr;
+  }
+
+  bool IsOpen() const { return mpShared != nullptr; }
+
+  /** How long Publish() waits for another writer to finish before assuming it has died. Copying a table takes microseconds */
+  static constexpr std::chrono::milliseconds kMaxWriteWait {100};
+
+  /** Write a table for all the instances that have the shared table open, not including this one. See the class description
+   * for what happens with more than one writer */
+  void Publish(const TuningTable& table)
+  {
+    if (!mpShared)
+      return;
+
+    // an odd sequence number means a write is in progress. Claim the next odd number once it is even, or once the same write
+    // has been in progress for kMaxWriteWait
+    uint32_t seq = mpShared->mSequence.load(std::memory_order_relaxed);
+    uint32_t writing = 0;
+    std::chrono::steady_clock::time_point waitStart;
+    uint32_t waitingFor = 0; // never odd, so the first write in progress starts the wait
+
+    while (true)
+    {
+      if (!(seq & 1))
+      {
+        if (mpShared->mSequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+          writing = seq + 1;
+          break;
+        }
+
+        continue;
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+
+      if (seq != waitingFor)
+      {
+        waitingFor = seq;
+        waitStart = now;
+      }
+      else if (now - waitStart >= kMaxWriteWait)
+      {
+        if (mpShared->mSequence.compare_exchange_strong(seq, seq + 2, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+          writing = seq + 2;
+          break;
+        }
+
+        continue;
+      }
+
+      std::this_thread::yield();
+      seq = mpShared->mSequence.load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&mpShared->mTable, &table, sizeof(TuningTable));
+    mpShared->mSequence.store(writing + 1, std::memory_order_release);
+    mLastSequence = writing + 1;
+  }
+
+  /** Get the shared table if another instance has published one since the last call. Call regularly from the main thread
+   * @param table Set to the shared table, if it has changed
+   * @return \c true if the table has changed */
+  bool Poll(TuningTable& table)
+  {
+    if (!mpShared)
+      return false;
+
+    const uint32_t seq = mpShared->mSequence.load(std::memory_order_acquire);
+
+    // nothing published yet, a write in progress, or no change
+    if (seq == 0 || (seq & 1) || seq == mLastSequence)
+      return false;
+
+    memcpy(&mCopy, &mpShared->mTable, sizeof(TuningTable));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // if a writer started while we were copying, try again on the next call
+    if (mpShared->mSequence.load(std::memory_order_relaxed) != seq)
+      return false;
+
+    table = mCopy;
+    mLastSequence = seq;
+    return true;
+  }
+
+private:
+  struct Shared
+  {
+    std::atomic<uint32_t> mSequence; // zero when created, even when the table is complete
+    TuningTable mTable;
+  };
+
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "the sequence number must be lock-free to work across processes");
+
+  Shared* mpShared = nullptr;
+  TuningTable mCopy;
+  uint32_t mLastSequence = 0;
+#if defined OS_WIN
+  HANDLE mMapping = nullptr;
+#endif
+};
+
+END_IPLUG_NAMESPACE
@@ -27,6 +27,7 @@
 
 #include "IPlugQueue.h"
 #include "ControlRamp.h"
+#include "VoiceState.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -49,17 +50,36 @@ using namespace voiceControlNames;
 
 using VoiceInputs = ControlRamp::RampArray<kNumVoiceControlRamps>;
 
+/** One layer of a unison stack, see VoiceAllocator::SetUnison() */
+struct UnisonLayer
+{
+  float mDetune = 0.f; // pitch offset from the voice's pitch, in octaves ("1v / octave")
+  float mPan = 0.f; // [-1, 1]
+  float mGain = 1.f; // scaled so that the whole stack is about as loud as one layer
+};
+
 #pragma mark - Voice class
 
 class SynthVoice
 {
 public:
 
+  /** The maximum number of layers in a unison stack */
+  static constexpr int kMaxUnisonLayers = 16;
+
   virtual ~SynthVoice() {};
 
   /** @return true if voice is generating any audio. */
   virtual bool GetBusy() const = 0;
 
+  /** Implement this to report the current output level of the voice, e.g. its envelope level. This is used by the VoiceAllocator::kStealQuietest steal policy.
+   * @return The level, in any units that are consistent across voices */
+  virtual float GetLevel() const { return 0.f; }
+
+  /** Implement this to report the stage of the voice's main envelope, which is shown by IVVoiceStateControl, e.g. ADSREnvelope::GetStage()
+   * @return The stage, in [-127, 127], or VoiceState::kNoStage */
+  virtual int GetEnvelopeStage() const { return VoiceState::kNoStage; }
+
   /** Trigger is called by the VoiceAllocator when a new voice should start, or if the voice limit has been hit and an existing voice needs to re-trigger. While the VoiceInputs are sufficient to control a voice from the VoiceAllocator, this method can be used to do additional tasks like resetting oscillators.
    * @param level Normalised starting level for this voice, derived from the velocity of the keypress, or in the case of a re-trigger the existing level \todo check
    * @param isRetrigger If this is \c true it means the voice is being re-triggered, and you should accommodate for this in your algorithm */
@@ -68,6 +88,10 @@ public:
   /** As with Trigger, called to do optional tasks when a voice is released. */
   virtual void Release() {};
 
+  /** Called when the VoiceAllocator stops processing a released voice before it has finished, because its output has been inaudible,
+   * see VoiceAllocator::SetSilenceCulling(). Implement this to reset the voice's envelopes, so that GetBusy() returns false. */
+  virtual void Retire() {};
+
   /** Process a block of audio data for the voice
    @param inputs Pointer to input channel arrays. Sometimes synthesisers have audio inputs. Alternatively you can pass in modulation from global LFOs etc here.
    @param outputs Pointer to output channel arrays. You should add to the existing data in these arrays (so that all the voices get summed)
@@ -101,6 +125,21 @@ public:
    */
   virtual void SetControl(int controlNumber, float value) {};
 
+  /** A voice plays a whole unison stack: the VoiceAllocator sets the layers before Trigger() is called, and the voice should render
+   * every layer in ProcessSamplesAccumulating(), e.g. with a UnisonOscillator.
+   * Voices that ignore the layers play a single layer.
+   * @return The number of layers, [1, kMaxUnisonLayers] */
+  int GetNUnisonLayers() const { return mNUnisonLayers; }
+
+  const UnisonLayer& GetUnisonLayer(int layerIdx) const { return mUnisonLayers[layerIdx]; }
+
+  /** Set the output bus this voice renders into, when the VoiceAllocator routes voices to buses (see VoiceAllocator::SetOutputBuses()).
+   * This can be called in Trigger(), e.g. to send each drum sound to its own output.
+   * @param busIdx The bus index. A voice on a bus that doesn't exist renders into bus 0 */
+  void SetOutputBus(int busIdx) { mOutputBus = busIdx; }
+
+  int GetOutputBus() const { return mOutputBus; }
+
 protected:
   VoiceInputs mInputs;
   int64_t mLastTriggeredTime{-1};
@@ -110,6 +149,9 @@ protected:
   uint8_t mKey{0};
   double mBasePitch{0.};
   double mGain{0.}; // used by voice allocator to hard-kill voices.
+  std::array<UnisonLayer, kMaxUnisonLayers> mUnisonLayers{};
+  int mNUnisonLayers{1};
+  int mOutputBus{0};
 
   friend class MidiSynth;
   friend class VoiceAllocator;
@@ -9,6 +9,7 @@
  */
 
 #include "VoiceAllocator.h"
+#include "MicroTuning.h"
 
 #include <algorithm>
 #include <numeric>
@@ -28,8 +29,9 @@ VoiceAllocator::VoiceAllocator()
   // setup default key->pitch fn
   mKeyToPitchFn = [](int k){return (k - 69.f)/12.f;};
 
-  mSustainedNotes.reserve(128);
-  mHeldKeys.reserve(128);
+  mKeyLists.resize(kNumChannels * kNumKeys);
+  mChannelLists.resize(kNumChannels);
+  mFreeList.resize(1);
 }
 
 VoiceAllocator::~VoiceAllocator()
@@ -38,8 +40,6 @@ VoiceAllocator::~VoiceAllocator()
 
 void VoiceAllocator::Clear()
 {
-  mHeldKeys.clear();
-  mSustainedNotes.clear();
   HardKillAllVoices();
 }
 
@@ -53,140 +53,278 @@ void VoiceAllocator::ClearVoiceInputs(SynthVoice* pVoice)
 
 void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
 {
-  if(mVoicePtrs.size() + 1 < UCHAR_MAX)
-  {
-    mVoicePtrs.push_back(pVoice);
-    ClearVoiceInputs(pVoice);
-    pVoice->mKey = -1;
-    pVoice->mZone = zone;
+  const int voiceIdx = static_cast<int>(mVoicePtrs.size());
 
-    // make a glides structures for the control ramps of the new voice
-    mVoiceGlides.emplace_back(ControlRampProcessor::Create(pVoice->mInputs));
-  }
-  else
+  mVoicePtrs.push_back(pVoice);
+  ClearVoiceInputs(pVoice);
+  pVoice->mKey = -1;
+  pVoice->mZone = zone;
+
+  // add the control ramps of the new voice to the glide bank, at voiceIdx * kNumVoiceControlRamps
+  for(int i=0; i<kNumVoiceControlRamps; ++i)
   {
-    throw std::runtime_error{"VoiceAllocator: max voices exceeded!"};
+    mRamps.Add(pVoice->mInputs[i]);
   }
+
+  // grow the indexes, so that nothing needs to be allocated when processing
+  mKeyNodes.emplace_back();
+  mChannelNodes.emplace_back();
+  mFreeNodes.emplace_back();
+  mHeap.push_back(kNoVoice);
+  mHeapPos.push_back(kNoVoice);
+  mStealLevels.push_back(0.f);
+  mCullStates.emplace_back();
+
+  if (zone >= mZoneVoices.size())
+    mZoneVoices.resize(zone + 1);
+
+  mZoneVoices[zone].push_back(voiceIdx);
+
+  ListPushBack(mChannelLists, mChannelNodes, pVoice->mChannel, voiceIdx);
+  ListPushBack(mFreeList, mFreeNodes, 0, voiceIdx);
 }
 
-VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddress addr)
+void VoiceAllocator::ListPushBack(std::vector<VoiceList>& lists, std::vector<VoiceListNode>& nodes, int listIdx, int voiceIdx)
 {
-  const int n = static_cast<int>(mVoicePtrs.size());
-  VoiceBitsArray v;
+  VoiceList& list = lists[listIdx];
+  VoiceListNode& node = nodes[voiceIdx];
 
-  // set all bits to true
-  for(int i=0; i<n; ++i)
-  {
-    v[i] = true;
-  }
+  node.list = listIdx;
+  node.prev = list.tail;
+  node.next = kNoVoice;
 
-  // for each criterion present in address, clear any voice bits not matching
+  if (list.tail != kNoVoice)
+    nodes[list.tail].next = voiceIdx;
+  else
+    list.head = voiceIdx;
 
-  // zone
-  if(addr.mZone != kAllZones)
-  {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mZone == addr.mZone);
-    }
-  }
+  list.tail = voiceIdx;
+}
+
+void VoiceAllocator::ListRemove(std::vector<VoiceList>& lists, std::vector<VoiceListNode>& nodes, int voiceIdx)
+{
+  VoiceListNode& node = nodes[voiceIdx];
+
+  if (node.list == kNoVoice)
+    return;
+
+  VoiceList& list = lists[node.list];
+
+  if (node.prev != kNoVoice)
+    nodes[node.prev].next = node.next;
+  else
+    list.head = node.next;
+
+  if (node.next != kNoVoice)
+    nodes[node.next].prev = node.prev;
+  else
+    list.tail = node.prev;
+
+  node.prev = node.next = node.list = kNoVoice;
+}
+
+bool VoiceAllocator::VoiceMatches(int voiceIdx, const VoiceAddress& addr) const
+{
+  const SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+  if (addr.mZone != kAllZones && pVoice->mZone != addr.mZone)
+    return false;
 
   // setting the flag kVoicesAll returns all voices matching the zone of the address.
-  if(addr.mFlags & kVoicesAll) return v;
+  if (addr.mFlags & kVoicesAll)
+    return true;
+
+  if (addr.mChannel != kAllChannels && pVoice->mChannel != addr.mChannel)
+    return false;
+
+  if (addr.mKey != kAllKeys && pVoice->mKey != addr.mKey)
+    return false;
+
+  if ((addr.mFlags & kVoicesBusy) && !pVoice->GetBusy())
+    return false;
+
+  return true;
+}
+
+void VoiceAllocator::SetVoiceChannelAndKey(int voiceIdx, int channel, int key)
+{
+  SynthVoice* pVoice = mVoicePtrs[voiceIdx];
 
-  // channel
-  if(addr.mChannel != kAllChannels)
+  if (pVoice->mChannel != channel || mChannelNodes[voiceIdx].list == kNoVoice)
   {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mChannel == addr.mChannel);
-    }
+    ListRemove(mChannelLists, mChannelNodes, voiceIdx);
+
+    if (channel >= 0 && channel < kNumChannels)
+      ListPushBack(mChannelLists, mChannelNodes, channel, voiceIdx);
   }
 
-  // Key
-  if(addr.mKey != kAllKeys)
+  pVoice->mChannel = channel;
+  pVoice->mKey = key;
+
+  ListRemove(mKeyLists, mKeyNodes, voiceIdx);
+
+  if (channel >= 0 && channel < kNumChannels && key >= 0 && key < kNumKeys)
+    ListPushBack(mKeyLists, mKeyNodes, channel * kNumKeys + key, voiceIdx);
+}
+
+#pragma mark - steal heap
+
+void VoiceAllocator::SetStealPolicy(EStealPolicy policy)
+{
+  mStealPolicy = policy;
+  HeapRebuild();
+}
+
+bool VoiceAllocator::StealsBefore(int voiceA, int voiceB) const
+{
+  const SynthVoice* pA = mVoicePtrs[voiceA];
+  const SynthVoice* pB = mVoicePtrs[voiceB];
+
+  switch (mStealPolicy)
   {
-    for(int i=0; i<n; ++i)
+    case kStealQuietest:
+      if (mStealLevels[voiceA] != mStealLevels[voiceB])
+        return mStealLevels[voiceA] < mStealLevels[voiceB];
+      break;
+    case kStealReleasedFirst:
     {
-      v[i] = v[i] & (mVoicePtrs[i]->mKey == addr.mKey);
+      // released voices have no key
+      const bool releasedA = pA->mKey == kAllKeys;
+      const bool releasedB = pB->mKey == kAllKeys;
+
+      if (releasedA != releasedB)
+        return releasedA;
+      break;
     }
+    default:
+      break;
   }
 
-  // busy flag
-  if(addr.mFlags & kVoicesBusy)
+  return pA->mLastTriggeredTime < pB->mLastTriggeredTime;
+}
+
+void VoiceAllocator::HeapSwap(int posA, int posB)
+{
+  std::swap(mHeap[posA], mHeap[posB]);
+  mHeapPos[mHeap[posA]] = posA;
+  mHeapPos[mHeap[posB]] = posB;
+}
+
+void VoiceAllocator::HeapSiftUp(int pos)
+{
+  while (pos > 0)
   {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & mVoicePtrs[i]->GetBusy();
-    }
+    const int parent = (pos - 1) / 2;
+
+    if (!StealsBefore(mHeap[pos], mHeap[parent]))
+      break;
+
+    HeapSwap(pos, parent);
+    pos = parent;
   }
+}
 
-  // most recent
-  if(addr.mFlags & kVoicesMostRecent)
+void VoiceAllocator::HeapSiftDown(int pos)
+{
+  while (true)
   {
-    int64_t maxT = -1;
-    int maxIdx = -1;
-    for(int i=0; i<n; ++i)
-    {
-      if(v[i])
-      {
-        int64_t vt = mVoicePtrs[i]->mLastTriggeredTime;
-        if(vt > maxT)
-        {
-          maxT = vt;
-          maxIdx = i;
-        }
-      }
-    }
+    const int left = 2 * pos + 1;
+    const int right = left + 1;
+    int best = pos;
 
-    // set all bits to false
-    //v.reset();
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = 0;
-    }
+    if (left < mHeapSize && StealsBefore(mHeap[left], mHeap[best]))
+      best = left;
 
-    if(maxIdx >= 0)
-    {
-      v[maxIdx] = true;
-    }
+    if (right < mHeapSize && StealsBefore(mHeap[right], mHeap[best]))
+      best = right;
+
+    if (best == pos)
+      break;
+
+    HeapSwap(pos, best);
+    pos = best;
   }
-  return v;
 }
 
-void VoiceAllocator::SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples)
+void VoiceAllocator::HeapInsert(int voiceIdx)
 {
-  // send control change to all matched voices through glide generators
-  for(int i=0; i<mVoicePtrs.size(); ++i)
+  const int pos = mHeapSize++;
+  mHeap[pos] = voiceIdx;
+  mHeapPos[voiceIdx] = pos;
+  HeapSiftUp(pos);
+}
+
+void VoiceAllocator::HeapRemove(int voiceIdx)
+{
+  const int pos = mHeapPos[voiceIdx];
+
+  if (pos == kNoVoice)
+    return;
+
+  const int last = --mHeapSize;
+
+  if (pos != last)
   {
-    if(v[i])
-    {
-      mVoiceGlides[i]->at(ctlIdx).SetTarget(val, 0, glideSamples, mBlockSize);
-    }
+    HeapSwap(pos, last);
+    HeapSiftDown(pos);
+    HeapSiftUp(pos);
   }
+
+  mHeapPos[voiceIdx] = kNoVoice;
 }
 
-void VoiceAllocator::SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, float val)
+void VoiceAllocator::HeapUpdate(int voiceIdx)
 {
-  // send generic control change directly to voice
-  for(int i=0; i<mVoicePtrs.size(); ++i)
+  const int pos = mHeapPos[voiceIdx];
+
+  if (pos != kNoVoice)
   {
-    if(v[i])
-    {
-      mVoicePtrs[i]->SetControl(ctlIdx, val);
-    }
+    HeapSiftUp(pos);
+    HeapSiftDown(mHeapPos[voiceIdx]);
   }
 }
 
-void VoiceAllocator::SendProgramChangeToVoices(VoiceBitsArray v, int pgm)
+void VoiceAllocator::HeapRebuild()
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
+  for (int pos = mHeapSize / 2 - 1; pos >= 0; pos--)
+    HeapSiftDown(pos);
+
+  mHeapNeedsRebuild = false;
+}
+
+void VoiceAllocator::ActivateVoice(int voiceIdx)
+{
+  if (mHeapPos[voiceIdx] != kNoVoice)
   {
-    if(v[i])
-    {
-      mVoicePtrs[i]->SetProgramNumber(pgm);
-    }
+    HeapUpdate(voiceIdx);
+    return;
   }
+
+  ListRemove(mFreeList, mFreeNodes, voiceIdx);
+  HeapInsert(voiceIdx);
+}
+
+void VoiceAllocator::SendControlToVoiceInputs(VoiceAddress addr, int ctlIdx, double val, int glideSamples)
+{
+  // send control change to all matched voices through glide generators
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    mRamps.SetTarget(RampIdx(voiceIdx, ctlIdx), val, 0, glideSamples, mControlGlideShape);
+  });
+}
+
+void VoiceAllocator::SendControlToVoicesDirect(VoiceAddress addr, int ctlIdx, float val)
+{
+  // send generic control change directly to voice
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    mVoicePtrs[voiceIdx]->SetControl(ctlIdx, val);
+  });
+}
+
+void VoiceAllocator::SendProgramChangeToVoices(VoiceAddress addr, int pgm)
+{
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    mVoicePtrs[voiceIdx]->SetProgramNumber(pgm);
+  });
 }
 
 void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
@@ -195,7 +333,6 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
   {
     VoiceInputEvent event;
     mInputQueue.Pop(event);
-    VoiceAllocator::VoiceBitsArray voices = VoicesMatchingAddress(event.mAddress);
 
     switch(event.mAction)
     {
@@ -218,52 +355,38 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
       }
       case kPitchBendAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlPitchBend, event.mValue, mControlGlideSamples);
+        SendControlToVoiceInputs(event.mAddress, kVoiceControlPitchBend, event.mValue, mControlGlideSamples);
         break;
       }
       case kPressureAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlPressure, event.mValue, mControlGlideSamples);
+        SendControlToVoiceInputs(event.mAddress, kVoiceControlPressure, event.mValue, mControlGlideSamples);
         break;
       }
       case kTimbreAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlTimbre, event.mValue, mControlGlideSamples);
+        SendControlToVoiceInputs(event.mAddress, kVoiceControlTimbre, event.mValue, mControlGlideSamples);
         break;
       }
       case kSustainAction:
       {
+        const bool wasDown = mSustainPedalDown;
         mSustainPedalDown = (bool) (event.mValue >= 0.5);
-        if (!mSustainPedalDown) // sustain pedal released
+        if (wasDown && !mSustainPedalDown) // sustain pedal released
         {
-          // if notes are sustaining, check that they're not still held and if not then stop voice
-          if (!mSustainedNotes.empty())
-          {
-            for (auto susNotesItr = mSustainedNotes.begin(); susNotesItr != mSustainedNotes.end();)
-            {
-              uint8_t key = *susNotesItr;
-              bool held = std::find(mHeldKeys.begin(), mHeldKeys.end(), key) != mHeldKeys.end();
-              if (!held)
-              {
-                StopVoices(VoicesMatchingAddress({event.mAddress.mZone, kAllChannels, key, 0}), event.mSampleOffset);
-                susNotesItr = mSustainedNotes.erase(susNotesItr);
-              }
-              else
-                susNotesItr++;
-            }
-          }
+          SustainOff(event);
         }
         break;
       }
       case kControllerAction:
       {
         // called for any continuous controller other than the special #74 specified in MPE
-        SendControlToVoicesDirect(voices, event.mControllerNumber, event.mValue);
+        SendControlToVoicesDirect(event.mAddress, event.mControllerNumber, static_cast<float>(event.mValue));
         break;
       }
       case kProgramChangeAction:
       {
-        SendProgramChangeToVoices(voices, event.mControllerNumber);
+        SendProgramChangeToVoices(event.mAddress, event.mControllerNumber);
         break;
       }
       case kNullAction:
@@ -274,13 +397,126 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
     }
   }
 
-  // update any glides in progress, writing voice control outputs
-  for(auto& glides : mVoiceGlides)
+  // update any glides in progress for all voices in one pass, writing voice control outputs. Ramps that are not changing are not visited
+  mRamps.Process(blockSize);
+}
+
+void VoiceAllocator::SetUnison(int nLayers, float detuneCents, float panSpread)
+{
+  mNUnisonLayers = Clip(nLayers, 1, SynthVoice::kMaxUnisonLayers);
+  const float gain = 1.f / std::sqrt(static_cast<float>(mNUnisonLayers));
+
+  // spread the layers evenly, from the lowest pitch on the left to the highest on the right
+  for(int i = 0; i < SynthVoice::kMaxUnisonLayers; i++)
+  {
+    const float x = (mNUnisonLayers > 1) ? (2.f * i / (mNUnisonLayers - 1) - 1.f) : 0.f;
+    UnisonLayer& layer = mUnisonLayers[i];
+    layer.mDetune = (i < mNUnisonLayers) ? x * detuneCents / 2400.f : 0.f;
+    layer.mPan = (i < mNUnisonLayers) ? x * Clip(panSpread, 0.f, 1.f) : 0.f;
+    layer.mGain = (i < mNUnisonLayers) ? gain : 0.f;
+  }
+}
+
+float VoiceAllocator::KeyToPitch(int channel, int key) const
+{
+  const int offsetKey = key + static_cast<int>(mPitchOffset);
+
+  if(!mpTuningTable)
+    return mKeyToPitchFn(offsetKey);
+
+  if(channel < 0 || channel >= TuningTable::kNumChannels || offsetKey < 0 || offsetKey >= TuningTable::kNumKeys)
+    return std::numeric_limits<float>::quiet_NaN();
+
+  return mpTuningTable->GetPitch(channel, offsetKey);
+}
+
+void VoiceAllocator::RetuneVoices(int glideSamples)
+{
+  for(int i = 0; i < mHeapSize; i++)
   {
-    for(int i=0; i<kNumVoiceControlRamps; ++i)
+    const int voiceIdx = mHeap[i];
+    const SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+    // only voices indexed by a key are playing a held note, released voices have no key
+    if(mKeyNodes[voiceIdx].list == kNoVoice)
+      continue;
+
+    const float pitch = KeyToPitch(pVoice->mChannel, pVoice->mKey);
+
+    if(!std::isnan(pitch))
+      mRamps.SetTarget(RampIdx(voiceIdx, kVoiceControlPitch), pitch, 0, glideSamples, mNoteGlideShape);
+  }
+}
+
+void VoiceAllocator::FinishOutputBuses(sample** outputs, int nOutputs, int nFrames)
+{
+  const int nBuses = mNChansPerBus ? std::min(nOutputs / mNChansPerBus, kMaxOutputBuses) : 0;
+
+  for(int bus = 0; bus < nBuses; bus++)
+  {
+    if(mBusFramesZeroed[bus] < nFrames)
     {
-      glides->at(i).Process(blockSize);
+      for(int c = 0; c < mNChansPerBus; c++)
+        memset(outputs[bus * mNChansPerBus + c] + mBusFramesZeroed[bus], 0, (nFrames - mBusFramesZeroed[bus]) * sizeof(sample));
     }
+
+    mBusFramesZeroed[bus] = 0;
+  }
+
+  // channels left over when nOutputs isn't a multiple of the bus size, or beyond the last bus, never get a voice.
+  // With no bus at all ProcessVoices() renders unrouted, into every output
+  if(nBuses)
+  {
+    for(int c = nBuses * mNChansPerBus; c < nOutputs; c++)
+      memset(outputs[c], 0, nFrames * sizeof(sample));
+  }
+
+  mActiveOutputBuses = mBusesInBlock;
+  mBusesInBlock = 0;
+}
+
+void VoiceAllocator::SetSampleRateAndBlockSize(double sampleRate, int blockSize)
+{
+  mSampleRate = sampleRate;
+  mBlockSize = blockSize;
+  CalcGlideTimesInSamples();
+  CalcCullTimesInSamples();
+}
+
+void VoiceAllocator::SetSilenceCulling(ESilenceCulling mode, double thresholdDB, double holdTime, double fadeTime)
+{
+  mSilenceCulling = mode;
+  mCullThresholdDB = thresholdDB;
+  mCullHoldTime = std::max(holdTime, 0.);
+  mCullFadeTime = std::max(fadeTime, 0.);
+  CalcCullTimesInSamples();
+}
+
+void VoiceAllocator::GetVoiceStates(VoiceStates& states, int64_t sampleTime) const
+{
+  states.mSampleTime = sampleTime;
+  states.mNVoices = std::min(static_cast<int>(mVoicePtrs.size()), VoiceStates::kMaxVoices);
+
+  for(int v = 0; v < states.mNVoices; v++)
+  {
+    const SynthVoice* pVoice = mVoicePtrs[v];
+    VoiceState& state = states.mVoices[v];
+    state.mActive = mHeapPos[v] != kNoVoice;
+    state.mReleased = mKeyNodes[v].list == kNoVoice;
+    state.mChannel = pVoice->mChannel;
+    state.mKey = pVoice->mKey;
+
+    // idle voices keep their last state, but nothing else needs to be read
+    if(!state.mActive)
+      continue;
+
+    state.mPitch = static_cast<float>(pVoice->mInputs[kVoiceControlPitch].endValue);
+    state.mPitchBend = static_cast<float>(pVoice->mInputs[kVoiceControlPitchBend].endValue);
+    state.mPressure = static_cast<float>(pVoice->mInputs[kVoiceControlPressure].endValue);
+    state.mTimbre = static_cast<float>(pVoice->mInputs[kVoiceControlTimbre].endValue);
+    state.mGate = static_cast<float>(pVoice->mInputs[kVoiceControlGate].endValue);
+    state.mLevel = pVoice->GetLevel();
+    state.mStage = static_cast<int8_t>(Clip(pVoice->GetEnvelopeStage(), static_cast<int>(VoiceState::kNoStage), 127));
   }
 }
 
@@ -290,96 +526,114 @@ void VoiceAllocator::CalcGlideTimesInSamples()
   mControlGlideSamples = static_cast<int>(mControlGlideTime * mSampleRate);
 }
 
-int VoiceAllocator::FindFreeVoiceIndex(int startIndex) const
+void VoiceAllocator::CalcCullTimesInSamples()
 {
-  size_t voices = mVoicePtrs.size();
-  for(int i=0; i<voices; ++i)
+  mCullThreshold = static_cast<sample>(DBToAmp(mCullThresholdDB));
+  mCullHoldSamples = static_cast<int>(mCullHoldTime * mSampleRate);
+  mCullFadeSamples = std::max(static_cast<int>(mCullFadeTime * mSampleRate), 1);
+
+  // the scratch buffer holds a whole block, so a voice renders into it at the same index as it would into the outputs
+  if(mSilenceCulling != kSilenceCullingOff && mBlockSize > 0)
   {
-    int j = (startIndex + i)%voices;
-    SynthVoice* pv = mVoicePtrs[j];
-    if(!pv->GetBusy())
-    {
-      return j;
-    }
+    mCullBuffer.resize(kMaxCullChannels * mBlockSize);
+
+    for(int c = 0; c < kMaxCullChannels; c++)
+      mCullPtrs[c] = mCullBuffer.data() + c * mBlockSize;
   }
-  return -1;
 }
 
-int VoiceAllocator::FindVoiceIndexToSteal(int64_t sampleTime) const
+int VoiceAllocator::FindFreeVoiceIndex()
 {
-  size_t voices = mVoicePtrs.size();
-  int64_t earliestTime = sampleTime;
-  int longestPlayingVoiceIdx = 0;
-  for(int i=0; i<voices; ++i)
+  // rotating takes the voice that has been idle longest, otherwise the most recently used one is reused
+  const VoiceList& list = mFreeList[0];
+  return mRotateVoices ? list.head : list.tail;
+}
+
+int VoiceAllocator::FindVoiceIndexToSteal(int channel, int key)
+{
+  if (mStealPolicy == kStealSameNote && channel >= 0 && channel < kNumChannels && key >= 0 && key < kNumKeys)
   {
-    SynthVoice* pv = mVoicePtrs[i];
-    if(pv->mLastTriggeredTime < earliestTime)
-    {
-      earliestTime = pv->mLastTriggeredTime;
-      longestPlayingVoiceIdx = i;
-    }
+    const int sameNoteVoice = mKeyLists[channel * kNumKeys + key].head;
+
+    if (sameNoteVoice != kNoVoice)
+      return sameNoteVoice;
   }
-  return longestPlayingVoiceIdx;
+
+  if (mHeapNeedsRebuild)
+    HeapRebuild();
+
+  return mHeapSize ? mHeap[0] : kNoVoice;
 }
 
 // start a single voice and set its current channel and key.
-void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
+void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig, int glideSamples)
 {
   if(!retrig)
   {
     // add immediate sample-accurate change for trigger
-    mVoiceGlides[voiceIdx]->at(kVoiceControlGate).SetTarget(velocity, sampleOffset, 1, mBlockSize);
+    mRamps.SetTarget(RampIdx(voiceIdx, kVoiceControlGate), velocity, sampleOffset, 1);
   }
 
   // add glide for pitch
-  mVoiceGlides[voiceIdx]->at(kVoiceControlPitch).SetTarget(pitch, sampleOffset, mNoteGlideSamples, mBlockSize);
+  mRamps.SetTarget(RampIdx(voiceIdx, kVoiceControlPitch), pitch, sampleOffset, glideSamples, mNoteGlideShape);
 
   // set things directly in voice
   SynthVoice* pVoice = mVoicePtrs[voiceIdx];
   pVoice->mLastTriggeredTime = sampleTime;
-  pVoice->mChannel = channel;
-  pVoice->mKey = key;
+  SetVoiceChannelAndKey(voiceIdx, channel, key);
   pVoice->mGain = 1.;
+  pVoice->mUnisonLayers = mUnisonLayers;
+  pVoice->mNUnisonLayers = mNUnisonLayers;
+  mCullStates[voiceIdx] = CullState();
+  ActivateVoice(voiceIdx);
 
   // call voice's Trigger method
   pVoice->Trigger(velocity, retrig);
 }
 
-// start all of the voice indexes marked in the VoieBitsArray and set the current channel and key of each.
-void VoiceAllocator::StartVoices(VoiceBitsArray vbits, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
+// start all of the voices matching the address and set the current channel and key of each.
+void VoiceAllocator::StartVoices(VoiceAddress addr, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig, int glideSamples)
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(vbits[i])
-    {
-      StartVoice(i, channel, key, pitch, velocity, sampleOffset, sampleTime, retrig);
-    }
-  }
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    StartVoice(voiceIdx, channel, key, pitch, velocity, sampleOffset, sampleTime, retrig, glideSamples);
+  });
+}
+
+void VoiceAllocator::GlideVoices(VoiceAddress addr, int channel, int key, float pitch, int sampleOffset, int glideSamples)
+{
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    // only voices that are still sounding can continue legato
+    if (mHeapPos[voiceIdx] == kNoVoice)
+      return;
+
+    mRamps.SetTarget(RampIdx(voiceIdx, kVoiceControlPitch), pitch, sampleOffset, glideSamples, mNoteGlideShape);
+    SetVoiceChannelAndKey(voiceIdx, channel, key);
+  });
 }
 
 void VoiceAllocator::StopVoice(int voiceIdx, int sampleOffset)
 {
-  mVoiceGlides[voiceIdx]->at(kVoiceControlGate).SetTarget(0.0, sampleOffset, 1, mBlockSize);
-  mVoicePtrs[voiceIdx]->mKey = -1;
+  mRamps.SetTarget(RampIdx(voiceIdx, kVoiceControlGate), 0.0, sampleOffset, 1);
+  SetVoiceChannelAndKey(voiceIdx, mVoicePtrs[voiceIdx]->mChannel, -1);
   mVoicePtrs[voiceIdx]->Release();
+
+  if (mStealPolicy == kStealReleasedFirst)
+    HeapUpdate(voiceIdx);
 }
 
-// stop all voices marked in the VoiceBitsArray.
-void VoiceAllocator::StopVoices(VoiceBitsArray vbits, int sampleOffset)
+// stop all voices matching the address.
+void VoiceAllocator::StopVoices(VoiceAddress addr, int sampleOffset)
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(vbits[i])
-    {
-      StopVoice(i, sampleOffset);
-    }
-  }
+  ForEachVoiceMatching(addr, [&](int voiceIdx) {
+    StopVoice(voiceIdx, sampleOffset);
+  });
 }
 
 void VoiceAllocator::SoftKillAllVoices()
 {
-  mHeldKeys.clear();
-  mSustainedNotes.clear();
+  mHeldKeys.Clear();
+  mSustainedNotes.Clear();
+  mMonoKey = HeldNoteStack::kNoKey;
   mSustainPedalDown = false;
 
   size_t voices = mVoicePtrs.size();
@@ -398,43 +652,86 @@ void VoiceAllocator::HardKillAllVoices()
   }
 }
 
+int VoiceAllocator::GetMonoKey() const
+{
+  switch(mNotePriority)
+  {
+    case kNotePriorityLow: return mHeldKeys.GetLowest();
+    case kNotePriorityHigh: return mHeldKeys.GetHighest();
+    case kNotePriorityLast:
+    default: return mHeldKeys.GetLast();
+  }
+}
+
+bool VoiceAllocator::PlayMonoKey(uint8_t zone, int channel, int key, float velocity, int sampleOffset, int64_t sampleTime)
+{
+  const VoiceAddress zoneAddr {zone, kAllChannels, kAllKeys, 0};
+  const bool overlapping = mMonoKey != HeldNoteStack::kNoKey;
+  const float pitch = KeyToPitch(channel, key);
+
+  // unmapped keys are silent, the previous key continues
+  if(std::isnan(pitch))
+    return false;
+
+  const int glideSamples = (mPortamentoMode == kPortamentoAlways || overlapping) ? mNoteGlideSamples : 0;
+
+  if(overlapping && mLegato)
+  {
+    GlideVoices(zoneAddr, channel, key, pitch, sampleOffset, glideSamples);
+  }
+  else
+  {
+    // trigger all voices in zone, an overlapping note retriggers the voices that are already sounding
+    StartVoices(zoneAddr, channel, key, pitch, velocity, sampleOffset, sampleTime, overlapping, glideSamples);
+  }
+
+  mMonoKey = key;
+  return true;
+}
+
 void VoiceAllocator::NoteOn(VoiceInputEvent e, int64_t sampleTime)
 {
   int channel = e.mAddress.mChannel;
   int key = e.mAddress.mKey;
   int offset = e.mSampleOffset;
-  float velocity = e.mValue;
-  float pitch = mKeyToPitchFn(key + static_cast<int>(mPitchOffset));
+  float velocity = static_cast<float>(e.mValue);
 
   switch(mPolyMode)
   {
     case kPolyModeMono:
     {
-      // TODO retrig / legato
-      bool retrig = false;
+      // unmapped keys are not held, so that they can't take priority over the keys that sound
+      if(std::isnan(KeyToPitch(channel, key)))
+        break;
 
-      // trigger all voices in zone
-      StartVoices(VoicesMatchingAddress({e.mAddress.mZone, kAllChannels, kAllKeys, 0}), channel, key, pitch, velocity, offset, sampleTime, retrig);
+      mHeldKeys.Push(key, velocity);
 
-      // in mono modes only ever 1 sustained note
-      mSustainedNotes.clear();
+      // a new key only sounds if it has priority over the other held keys
+      if(GetMonoKey() == key)
+      {
+        PlayMonoKey(e.mAddress.mZone, channel, key, velocity, offset, sampleTime);
+      }
       break;
     }
     case kPolyModePoly:
     {
-      int i = FindFreeVoiceIndex(mVoiceRotateIndex);
-      if(i < 0)
+      mHeldKeys.Push(key, velocity);
+      mSustainedNotes.Remove(key);
+
+      const float pitch = KeyToPitch(channel, key);
+      if(std::isnan(pitch))
       {
-        i = FindVoiceIndexToSteal(sampleTime);
+        break;
       }
-      if(mRotateVoices)
+      int i = FindFreeVoiceIndex();
+      if(i < 0)
       {
-        mVoiceRotateIndex = i + 1;
+        i = FindVoiceIndexToSteal(channel, key);
       }
       if(i >= 0)
       {
         bool retrig = false;
-        StartVoice(i, channel, key, pitch, velocity, offset, sampleTime, retrig);
+        StartVoice(i, channel, key, pitch, velocity, offset, sampleTime, retrig, mNoteGlideSamples);
       }
       break;
     }
@@ -442,19 +739,6 @@ void VoiceAllocator::NoteOn(VoiceInputEvent e, int64_t sampleTime)
     default:
       break;
   }
-
-  // add to held keys
-  if(std::find(mHeldKeys.begin(), mHeldKeys.end(), key) == mHeldKeys.end())
-  {
-    mHeldKeys.push_back(key);
-    mMinHeldVelocity = std::min(velocity, mMinHeldVelocity);
-  }
-
-  // add to sustained notes
-  if(std::find(mSustainedNotes.begin(), mSustainedNotes.end(), key) == mSustainedNotes.end())
-  {
-    mSustainedNotes.push_back(key);
-  }
 }
 
 void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
@@ -463,78 +747,209 @@ void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
   int key = e.mAddress.mKey;
   int offset = e.mSampleOffset;
 
-  // remove from held keys
-  mHeldKeys.erase(std::remove(mHeldKeys.begin(), mHeldKeys.end(), key), mHeldKeys.end());
-  if(mHeldKeys.empty())
+  mHeldKeys.Remove(key);
+
+  if(mPolyMode == kPolyModeMono)
   {
-    mMinHeldVelocity = 1.0f;
+    // releasing a key that isn't sounding changes nothing
+    if(key != mMonoKey)
+      return;
+
+    // return to the held key with the highest priority, at the velocity it was played with. It may have become unmapped since it
+    // was pressed if the tuning changed, then it is treated like no key being held
+    const int queuedKey = mHeldKeys.Empty() ? HeldNoteStack::kNoKey : GetMonoKey();
+    const bool playingQueuedKey = queuedKey != HeldNoteStack::kNoKey
+      && PlayMonoKey(e.mAddress.mZone, channel, queuedKey, mHeldKeys.GetVelocity(queuedKey), offset, sampleTime);
+
+    if(!playingQueuedKey && !mSustainPedalDown)
+    {
+      // no held key can sound, so no voices in the zone should be playing.
+      StopVoices({e.mAddress.mZone, kAllChannels, kAllKeys, 0}, offset);
+      mMonoKey = HeldNoteStack::kNoKey;
+    }
+    // otherwise the queued key plays, or the sounding key is sustained until the pedal is released
   }
+  else // poly
+  {
+    if (!mSustainPedalDown)
+    {
+      StopVoices(e.mAddress, e.mSampleOffset);
+    }
+    else
+    {
+      mSustainedNotes.Push(key, 0.f);
+    }
+  }
+}
 
+void VoiceAllocator::SustainOff(VoiceInputEvent e)
+{
   if(mPolyMode == kPolyModeMono)
   {
-    bool doPlayQueuedKey = false;
-    int queuedKey = 0;
+    // if the sounding key isn't held, it was only sustained
+    if(mMonoKey != HeldNoteStack::kNoKey && !mHeldKeys.Contains(mMonoKey))
+    {
+      StopVoices({e.mAddress.mZone, kAllChannels, kAllKeys, 0}, e.mSampleOffset);
+      mMonoKey = HeldNoteStack::kNoKey;
+    }
+  }
+  else
+  {
+    // keys that have been pressed again since they were released are not in the stack
+    mSustainedNotes.ForEach([&](int key) {
+      StopVoices({e.mAddress.mZone, kAllChannels, static_cast<uint8_t>(key), 0}, e.mSampleOffset);
+    });
+  }
+
+  mSustainedNotes.Clear();
+}
+
+void VoiceAllocator::ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
+{
+  const int nBuses = mNChansPerBus ? std::min(nOutputs / mNChansPerBus, kMaxOutputBuses) : 0;
+  const bool canCull = mSilenceCulling != kSilenceCullingOff && startIndex + blockSize <= mBlockSize && !mCullBuffer.empty();
 
-    // if there are still held keys...
-    if(!mHeldKeys.empty())
+  // only the voices in the steal heap can be busy
+  for(int i = 0; i < mHeapSize; i++)
+  {
+    // TODO distribute voices across cores
+    const int voiceIdx = mHeap[i];
+    SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+    if(!pVoice->GetBusy())
+      continue;
+
+    sample** voiceOutputs = outputs;
+    int nVoiceOutputs = nOutputs;
+
+    if(nBuses)
     {
-      queuedKey = mHeldKeys.back();
-      if (queuedKey != mVoicePtrs[0]->mKey)
+      const int bus = (pVoice->mOutputBus >= 0 && pVoice->mOutputBus < nBuses) ? pVoice->mOutputBus : 0;
+      sample** busOutputs = outputs + bus * mNChansPerBus;
+      const int endIndex = startIndex + blockSize;
+
+      // zero the bus up to the end of this chunk, the first time a voice renders into it
+      if(mBusFramesZeroed[bus] < endIndex)
       {
-        doPlayQueuedKey = true;
-        if(mSustainPedalDown)
-        {
-          // in mono modes only ever 1 sustained note
-          mSustainedNotes.clear();
-          mSustainedNotes.push_back(queuedKey);
-        }
+        for(int c = 0; c < mNChansPerBus; c++)
+          memset(busOutputs[c] + mBusFramesZeroed[bus], 0, (endIndex - mBusFramesZeroed[bus]) * sizeof(sample));
+
+        mBusFramesZeroed[bus] = endIndex;
       }
+
+      mBusesInBlock |= uint64_t(1) << bus;
+      voiceOutputs = busOutputs;
+      nVoiceOutputs = mNChansPerBus;
     }
-    else if(mSustainPedalDown)
+
+    // released voices have no key
+    if(canCull && mKeyNodes[voiceIdx].list == kNoVoice && nVoiceOutputs <= kMaxCullChannels)
     {
-      if(!mSustainedNotes.empty())
-      {
-        queuedKey = mSustainedNotes.back();
-        if (queuedKey != mVoicePtrs[0]->mKey)
-        {
-          doPlayQueuedKey = true;
-        }
-      }
+      ProcessReleasedVoice(voiceIdx, inputs, voiceOutputs, nInputs, nVoiceOutputs, startIndex, blockSize);
     }
     else
     {
-      // there are no held keys, so no voices in the zone should be playing.
-      StopVoices(VoicesMatchingAddress({e.mAddress.mZone, kAllChannels, kAllKeys, 0}), offset);
+      mCullStates[voiceIdx] = CullState();
+      pVoice->ProcessSamplesAccumulating(inputs, voiceOutputs, nInputs, nVoiceOutputs, startIndex, blockSize);
     }
+  }
 
-    if(doPlayQueuedKey)
-    {
-      // trigger the queued key for all voices in the zone at the minimum held velocity.
-      // alternatively the release velocity of the note off could be used here.
-      float pitch = mKeyToPitchFn(queuedKey + static_cast<int>(mPitchOffset));
-      bool retrig = false;
+  // retire voices that have finished or been culled, compacting the heap and restoring its order if any were removed
+  int nKept = 0;
 
-      StartVoices(VoicesMatchingAddress({e.mAddress.mZone, kAllChannels, kAllKeys, 0}), channel, queuedKey, pitch, mMinHeldVelocity, offset, sampleTime, retrig);
-    }
-  }
-  else // poly
+  for(int i = 0; i < mHeapSize; i++)
   {
-    if (!mSustainPedalDown)
+    const int voiceIdx = mHeap[i];
+    SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+    if(mCullStates[voiceIdx].mRetired)
+    {
+      mCullStates[voiceIdx] = CullState();
+      mCullStats.mRetiredVoices++;
+      pVoice->Retire();
+    }
+    else if(pVoice->GetBusy())
     {
-      StopVoices(VoicesMatchingAddress(e.mAddress), e.mSampleOffset);
-      mSustainedNotes.erase(std::remove(mSustainedNotes.begin(), mSustainedNotes.end(), key), mSustainedNotes.end());
+      mHeap[nKept] = voiceIdx;
+      mHeapPos[voiceIdx] = nKept++;
+      continue;
     }
+
+    mHeapPos[voiceIdx] = kNoVoice;
+    ListPushBack(mFreeList, mFreeNodes, 0, voiceIdx);
+  }
+
+  if(nKept != mHeapSize)
+  {
+    mHeapSize = nKept;
+    HeapRebuild();
+  }
+
+  if(mStealPolicy == kStealQuietest)
+  {
+    for(int i = 0; i < mHeapSize; i++)
+      mStealLevels[mHeap[i]] = mVoicePtrs[mHeap[i]]->GetLevel();
+
+    mHeapNeedsRebuild = true;
   }
 }
 
-void VoiceAllocator::ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
+void VoiceAllocator::ProcessReleasedVoice(int voiceIdx, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
 {
-  for(auto pVoice : mVoicePtrs)
+  CullState& state = mCullStates[voiceIdx];
+  sample** scratch = mCullPtrs.data();
+  const int endIndex = startIndex + blockSize;
+
+  for(int c = 0; c < nOutputs; c++)
+    memset(scratch[c] + startIndex, 0, blockSize * sizeof(sample));
+
+  mVoicePtrs[voiceIdx]->ProcessSamplesAccumulating(inputs, scratch, nInputs, nOutputs, startIndex, blockSize);
+
+  sample peak = 0.;
+
+  for(int c = 0; c < nOutputs; c++)
   {
-    // TODO distribute voices across cores
-    if(pVoice->GetBusy())
+    for(int s = startIndex; s < endIndex; s++)
+      peak = std::max(peak, std::fabs(scratch[c][s]));
+  }
+
+  mCullStats.mReleasedSamples += blockSize;
+
+  if(peak < mCullThreshold)
+  {
+    state.mQuietSamples += blockSize;
+    mCullStats.mInaudibleSamples += blockSize;
+  }
+  else
+    state.mQuietSamples = 0;
+
+  // once started the fade always finishes, a voice that is loud again after the hold time is cut
+  if(mSilenceCulling == kSilenceCullingRetire && state.mFadePos < 0 && state.mQuietSamples >= mCullHoldSamples)
+    state.mFadePos = 0;
+
+  if(state.mFadePos < 0)
+  {
+    for(int c = 0; c < nOutputs; c++)
     {
-      pVoice->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+      for(int s = startIndex; s < endIndex; s++)
+        outputs[c][s] += scratch[c][s];
     }
+
+    return;
   }
+
+  const sample fadeIncr = static_cast<sample>(1. / mCullFadeSamples);
+  const sample gain0 = 1 - state.mFadePos * fadeIncr;
+
+  for(int c = 0; c < nOutputs; c++)
+  {
+    for(int s = 0; s < blockSize; s++)
+    {
+      const sample gain = std::max(gain0 - (s + 1) * fadeIncr, static_cast<sample>(0.));
+      outputs[c][startIndex + s] += scratch[c][startIndex + s] * gain;
+    }
+  }
+
+  state.mFadePos += blockSize;
+  state.mRetired = state.mFadePos >= mCullFadeSamples;
 }
@@ -19,16 +19,20 @@
 #include <vector>
 #include <stdint.h>
 #include <functional>
-#include <bitset>
+#include <memory>
+#include <climits>
 //#include <iostream>
 
 #include "IPlugLogger.h"
 #include "IPlugQueue.h"
 
 #include "SynthVoice.h"
+#include "HeldNoteStack.h"
 
 BEGIN_IPLUG_NAMESPACE
 
+struct TuningTable;
+
 using namespace voiceControlNames;
 
 struct VoiceAddress
@@ -65,19 +69,23 @@ enum EVoiceAction
  * mAddress specifies which voices should receive the change.
  * mAction is the type of property change.
  * mControllerNumber is the controller number to change if mAction is kController.
- * mValue is the new value associated with the change.
+ * mValue is the new value associated with the change, in double precision so that MIDI 2.0 32-bit controller values are not truncated.
  * mSampleOffset is the number of samples into a processing buffer at which the change should occur.*/
 struct VoiceInputEvent
 {
   VoiceAddress mAddress;
   EVoiceAction mAction;
   int mControllerNumber;
-  float mValue;
+  double mValue;
   int mSampleOffset;
 };
 
 #pragma mark - VoiceAllocator class
 
+/** Allocates SynthVoices to incoming notes and routes controller changes to them.
+ * Voices are indexed by (channel, key), by channel and by zone, so that events only visit the voices they address.
+ * Idle voices are kept in a free list, and busy voices in a heap ordered by the steal policy, so that finding a voice for a
+ * new note is O(1), or O(log N) when a voice must be stolen. Nothing is allocated after the voices have been added. */
 class VoiceAllocator final
 {
 public:
@@ -96,8 +104,55 @@ public:
     kNumPolyModes
   };
 
+  /** Which voice to take for a new note when all voices are busy */
+  enum EStealPolicy
+  {
+    kStealOldest = 0, // the voice that was triggered first
+    kStealQuietest, // the voice with the lowest SynthVoice::GetLevel(), as of the last processed block
+    kStealReleasedFirst, // the oldest released voice, or the oldest voice if none are released
+    kStealSameNote, // a voice already playing the same channel and key, otherwise the oldest voice
+    kNumStealPolicies
+  };
+
+  /** Which held key sounds in mono mode */
+  enum ENotePriority
+  {
+    kNotePriorityLast = 0,
+    kNotePriorityLow,
+    kNotePriorityHigh,
+    kNumNotePriorities
+  };
+
+  /** When the pitch glides to a new note, using the note glide time */
+  enum EPortamentoMode
+  {
+    kPortamentoAlways = 0,
+    kPortamentoLegato, // mono mode only glides between overlapping notes
+    kNumPortamentoModes
+  };
+
+  /** What to do with released voices whose output has become inaudible, see SetSilenceCulling() */
+  enum ESilenceCulling
+  {
+    kSilenceCullingOff = 0,
+    kSilenceCullingMeasure, // measure the released voices' levels and collect CullStats, but let them finish
+    kSilenceCullingRetire, // fade out and retire released voices once they have been inaudible for the hold time
+    kNumSilenceCullingModes
+  };
+
+  /** Statistics collected while silence culling is on, in voice-samples, i.e. one voice rendering one sample frame counts as one */
+  struct CullStats
+  {
+    int64_t mReleasedSamples = 0; // rendered by released voices
+    int64_t mInaudibleSamples = 0; // rendered by released voices while their output was below the threshold
+    int64_t mRetiredVoices = 0; // voices retired before they finished
+  };
+
   static constexpr int kVoiceMostRecent = 1 << 7;
 
+  /** The most output channels a voice can render into and still be culled, see SetSilenceCulling() */
+  static constexpr int kMaxCullChannels = 8;
+
   // one voice worth of ramp generators
   using VoiceControlRamps = ControlRampProcessor::ProcessorArray<kNumVoiceControlRamps>;
 
@@ -109,11 +164,38 @@ public:
 
   void Clear();
 
-  void SetSampleRateAndBlockSize(double sampleRate, int blockSize) { mSampleRate = sampleRate; CalcGlideTimesInSamples(); }
+  void SetSampleRateAndBlockSize(double sampleRate, int blockSize);
   void SetNoteGlideTime(double t) { mNoteGlideTime = t; CalcGlideTimesInSamples(); }
   void SetControlGlideTime(double t) { mControlGlideTime = t; CalcGlideTimesInSamples(); }
 
-  /** Add a synth voice to the allocator. We do not take ownership ot the voice.
+  /** Set the curve of note glides (portamento), e.g. kRampSCurve. Pitch is in octaves, so a linear glide is already exponential in Hz */
+  void SetNoteGlideShape(ERampShape shape) { mNoteGlideShape = shape; }
+
+  /** Set the curve of control glides, such as pitch bend and pressure */
+  void SetControlGlideShape(ERampShape shape) { mControlGlideShape = shape; }
+
+  /** Set the policy for stealing voices when all voices are busy */
+  void SetStealPolicy(EStealPolicy policy);
+
+  EStealPolicy GetStealPolicy() const { return mStealPolicy; }
+
+  void SetNotePriority(ENotePriority priority) { mNotePriority = priority; }
+
+  /** In mono mode, if legato is on a note that overlaps the previous one changes the pitch without retriggering the voices */
+  void SetLegato(bool legato) { mLegato = legato; }
+
+  void SetPortamentoMode(EPortamentoMode mode) { mPortamentoMode = mode; }
+
+  /** Play each note with a stack of unison layers. The stack is one SynthVoice, so it is allocated, glided and stolen as a unit,
+   * and the voice renders all of its layers in one call. The layers are set when a voice is triggered.
+   * @param nLayers The number of layers, [1, SynthVoice::kMaxUnisonLayers]
+   * @param detuneCents The pitch spread between the lowest and highest layers
+   * @param panSpread The pan spread [0, 1], where 1 pans the lowest layer hard left and the highest hard right */
+  void SetUnison(int nLayers, float detuneCents, float panSpread);
+
+  int GetNUnisonLayers() const { return mNUnisonLayers; }
+
+  /** Add a synth voice to the allocator. We do not take ownership ot the voice. This allocates, so add all voices before processing.
    @param pv Pointer to the voice to add.
    @param zone A zone can be specified to make multitimbral synths.*/
   void AddVoice(SynthVoice* pv, uint8_t zone);
@@ -130,66 +212,320 @@ public:
   /** Stop all voices from making sound immdiately. */
   void HardKillAllVoices();
 
+  /** Set the function that maps keys to pitches. It is only used while no tuning table is set, see SetTuningTable() */
   void SetKeyToPitchFunction(const std::function<float(int)>& fn) {mKeyToPitchFn = fn;}
 
+  /** Use a tuning table instead of the key to pitch function, looking up each note's channel and key. The table takes precedence over
+   * the function until it is cleared. Keys that the table leaves unmapped (NaN) don't sound, and in mono mode they are not held.
+   * The table is not copied and must stay valid until it is replaced
+   * @param pTable The table, or nullptr to use the key to pitch function again */
+  void SetTuningTable(const TuningTable* pTable) { mpTuningTable = pTable; }
+
+  /** Send the pitches of the current tuning to the voices that are playing held keys, e.g. after SetTuningTable()
+   * @param glideSamples The number of samples over which the voices glide to their new pitches */
+  void RetuneVoices(int glideSamples);
+
   /** Send the event to the voices matching its address.*/
   void SendEventToVoices(VoiceInputEvent event);
 
+  /** Process the busy voices, and move any that have finished to the free list */
   void ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
 
+  /** Route each voice to the output bus set with SynthVoice::SetOutputBus(). A bus is nChansPerBus consecutive output channels, and
+   * a voice on it is passed a pointer to the bus's first channel and nChansPerBus outputs, so it accumulates straight into the bus.
+   * ProcessVoices() zeroes each part of a bus just before the first voice renders into it, and FinishOutputBuses() zeroes the rest,
+   * so the outputs don't need to be zeroed beforehand and no sample is zeroed twice.
+   * @param nChansPerBus The number of channels per bus, or 0 to render every voice into all of the outputs (the default) */
+  void SetOutputBuses(int nChansPerBus) { mNChansPerBus = std::max(nChansPerBus, 0); }
+
+  int GetNChansPerBus() const { return mNChansPerBus; }
+
+  /** When routing voices to buses, zero the frames of each bus that no voice rendered into, and any outputs that are not part of a bus,
+   * at the end of a block. Does nothing if not even one bus fits in \c nOutputs, since the voices then render into every output
+   * @param outputs The outputs passed to ProcessVoices()
+   * @param nOutputs The number of outputs
+   * @param nFrames The number of frames in the block */
+  void FinishOutputBuses(sample** outputs, int nOutputs, int nFrames);
+
+  /** @return A bit for each output bus that had voices rendered into it in the last block, when routing voices to buses */
+  uint64_t GetActiveOutputBuses() const { return mActiveOutputBuses; }
+
+  /** Track the output level of released voices, and optionally retire them early once they are inaudible, so that long release tails
+   * don't cost CPU after they have decayed below the threshold. Voices playing held or sustained keys are never culled.
+   * A released voice renders into a scratch buffer, so its peak level can be measured, which is then added to the outputs.
+   * Once its peak has been below the threshold for the hold time it is faded out over the fade time, SynthVoice::Retire() is called,
+   * and it is returned to the free list. Voices rendering into more than kMaxCullChannels outputs are not culled.
+   * This allocates the scratch buffer, so call it before processing, e.g. in the constructor
+   * @param mode The culling mode
+   * @param thresholdDB The peak level below which a voice is inaudible. This is per voice, so allow for many quiet voices summing
+   * @param holdTime The time in seconds for which a voice must be inaudible before it is faded out. Make it longer than any gaps in the voices' tails
+   * @param fadeTime The time in seconds over which a voice is faded out before it is retired */
+  void SetSilenceCulling(ESilenceCulling mode, double thresholdDB = -90., double holdTime = 0.05, double fadeTime = 0.005);
+
+  ESilenceCulling GetSilenceCulling() const { return mSilenceCulling; }
+
+  const CullStats& GetCullStats() const { return mCullStats; }
+
+  /** Fill a snapshot of the voices' states, reading their control ramps and levels. Call on the audio thread after ProcessVoices().
+   * This visits every voice up to VoiceStates::kMaxVoices and doesn't allocate
+   * @param states The snapshot to fill
+   * @param sampleTime The sample time at the end of the block */
+  void GetVoiceStates(VoiceStates& states, int64_t sampleTime) const;
+
+  void ResetCullStats() { mCullStats = CullStats(); }
+
   size_t GetNVoices() const {return mVoicePtrs.size();}
   SynthVoice* GetVoice(int voiceIndex) const {return mVoicePtrs[voiceIndex];}
   void SetPitchOffset(float offset) { mPitchOffset = offset; }
 
+  /** @return The number of voices that are busy, i.e. not in the free list */
+  int GetNActiveVoices() const { return mHeapSize; }
+
 private:
-  using VoiceBitsArray = std::bitset<UCHAR_MAX>;
+  static constexpr int kNoVoice = -1;
+  static constexpr int kNumChannels = 16;
+  static constexpr int kNumKeys = 128;
 
-  VoiceBitsArray VoicesMatchingAddress(VoiceAddress va);
+  // intrusive doubly linked lists of voice indices, so voices can be moved between indexes in O(1) without allocating
+  struct VoiceList
+  {
+    int head = kNoVoice;
+    int tail = kNoVoice;
+  };
 
-  void SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples);
-  void SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, float val);
-  void SendProgramChangeToVoices(VoiceBitsArray v, int pgm);
+  struct VoiceListNode
+  {
+    int prev = kNoVoice;
+    int next = kNoVoice;
+    int list = kNoVoice; // the index of the list this voice is in
+  };
+
+  static void ListPushBack(std::vector<VoiceList>& lists, std::vector<VoiceListNode>& nodes, int listIdx, int voiceIdx);
+  static void ListRemove(std::vector<VoiceList>& lists, std::vector<VoiceListNode>& nodes, int voiceIdx);
+
+  /** Call func(voiceIdx) for each voice matching the address. func may move the voice it is called with between indexes */
+  template <typename F>
+  void ForEachVoiceMatching(VoiceAddress addr, F func);
+
+  template <typename F>
+  void ForEachVoiceInIndex(const VoiceAddress& addr, F func);
 
-  void StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
-  void StartVoices(VoiceBitsArray voices, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
+  bool VoiceMatches(int voiceIdx, const VoiceAddress& addr) const;
+
+  void SendControlToVoiceInputs(VoiceAddress addr, int ctlIdx, double val, int glideSamples);
+  void SendControlToVoicesDirect(VoiceAddress addr, int ctlIdx, float val);
+  void SendProgramChangeToVoices(VoiceAddress addr, int pgm);
+
+  void StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig, int glideSamples);
+  void StartVoices(VoiceAddress addr, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig, int glideSamples);
+
+  /** Change the key and pitch of the voices matching the address without retriggering them, for legato */
+  void GlideVoices(VoiceAddress addr, int channel, int key, float pitch, int sampleOffset, int glideSamples);
 
   void StopVoice(int voiceIdx, int sampleOffset);
-  void StopVoices(VoiceBitsArray voices, int sampleOffset);
+  void StopVoices(VoiceAddress addr, int sampleOffset);
+
+  /** Update the channel and key indexes when a voice's channel or key changes */
+  void SetVoiceChannelAndKey(int voiceIdx, int channel, int key);
 
   void CalcGlideTimesInSamples();
+
+  static int RampIdx(int voiceIdx, int ctlIdx) { return voiceIdx * kNumVoiceControlRamps + ctlIdx; }
+  void CalcCullTimesInSamples();
+
+  /** Render a released voice into the scratch buffer, measuring its level and fading it out if it has been inaudible for long enough */
+  void ProcessReleasedVoice(int voiceIdx, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
+
+  /** @return The pitch of a key from the tuning table if there is one, otherwise the key to pitch function. NaN if unmapped */
+  float KeyToPitch(int channel, int key) const;
+
   void ClearVoiceInputs(SynthVoice* pVoice);
-  int FindFreeVoiceIndex(int startIndex) const;
-  int FindVoiceIndexToSteal(int64_t sampleTime) const;
+  int FindFreeVoiceIndex();
+  int FindVoiceIndexToSteal(int channel, int key);
+
+  // steal heap: all busy voices, ordered so that the voice to steal is at the top
+  bool StealsBefore(int voiceA, int voiceB) const;
+  void HeapInsert(int voiceIdx);
+  void HeapRemove(int voiceIdx);
+  void HeapUpdate(int voiceIdx);
+  void HeapSiftUp(int pos);
+  void HeapSiftDown(int pos);
+  void HeapSwap(int posA, int posB);
+  void HeapRebuild();
+
+  /** Mark a voice as busy, moving it from the free list to the steal heap */
+  void ActivateVoice(int voiceIdx);
 
   void NoteOn(VoiceInputEvent e, int64_t sampleTime);
   void NoteOff(VoiceInputEvent e, int64_t sampleTime);
+  void SustainOff(VoiceInputEvent e);
+
+  /** @return The held key that should sound in mono mode, according to the note priority */
+  int GetMonoKey() const;
+
+  /** Play a key on all voices in a zone in mono mode, gliding or retriggering if a note is already sounding
+   * @return \c false if the key is unmapped, in which case nothing changes */
+  bool PlayMonoKey(uint8_t zone, int channel, int key, float velocity, int sampleOffset, int64_t sampleTime);
 
   IPlugQueue<VoiceInputEvent> mInputQueue{1024};
 
   std::vector<SynthVoice*> mVoicePtrs;
-  std::vector<std::unique_ptr<VoiceControlRamps>> mVoiceGlides;
-  std::vector<int> mHeldKeys; // The currently physically held keys on the keyboard
-  std::vector<int> mSustainedNotes; // Any notes that are sustained, including those that are physically held
+  ControlRampBank mRamps; // the control ramps of every voice, voiceIdx * kNumVoiceControlRamps + control
+  HeldNoteStack mHeldKeys; // The currently physically held keys on the keyboard
+  HeldNoteStack mSustainedNotes; // Keys released while the sustain pedal is down, in poly mode
+  int mMonoKey = HeldNoteStack::kNoKey; // The key sounding in mono mode, held or sustained, or kNoKey once released
+
+  // voice indexes
+  std::vector<VoiceList> mKeyLists; // voices playing each (channel, key)
+  std::vector<VoiceListNode> mKeyNodes;
+  std::vector<VoiceList> mChannelLists; // voices last started on each channel
+  std::vector<VoiceListNode> mChannelNodes;
+  std::vector<VoiceList> mFreeList; // a single list of idle voices, in the order they became idle
+  std::vector<VoiceListNode> mFreeNodes;
+  std::vector<std::vector<int>> mZoneVoices; // voices in each zone
+  std::vector<int> mHeap; // busy voices
+  std::vector<int> mHeapPos; // position of each voice in mHeap, or kNoVoice
+  std::vector<float> mStealLevels; // levels for kStealQuietest, sampled after each block
+  int mHeapSize = 0;
+  bool mHeapNeedsRebuild = false;
+  EStealPolicy mStealPolicy = kStealOldest;
 
   std::function<float(int)> mKeyToPitchFn;
+  const TuningTable* mpTuningTable = nullptr;
   double mPitchOffset{0.};
 
   double mNoteGlideTime{0.};
   double mControlGlideTime{0.01};
   int mNoteGlideSamples{0}; // glide for note-to-note portamento
   int mControlGlideSamples{0}; // glide for controls including pitch bend
+  ERampShape mNoteGlideShape{kRampLinear};
+  ERampShape mControlGlideShape{kRampLinear};
   double mSampleRate;
-  int mBlockSize;
+  int mBlockSize{0};
 
   bool mRotateVoices{true};
-  int mVoiceRotateIndex{0};
   bool mSustainPedalDown{false};
   float mModWheel{0.f};
-  float mMinHeldVelocity{1.f};
+  ENotePriority mNotePriority{kNotePriorityLast};
+  EPortamentoMode mPortamentoMode{kPortamentoAlways};
+  bool mLegato{false};
+  std::array<UnisonLayer, SynthVoice::kMaxUnisonLayers> mUnisonLayers{};
+  int mNUnisonLayers{1};
+
+  // output bus routing
+  static constexpr int kMaxOutputBuses = 64;
+  int mNChansPerBus{0};
+  std::array<int, kMaxOutputBuses> mBusFramesZeroed{}; // each bus is zeroed up to this frame in the current block
+  uint64_t mBusesInBlock{0};
+  uint64_t mActiveOutputBuses{0};
+
+  // silence culling of released voices
+  struct CullState
+  {
+    int mQuietSamples = 0; // how long the voice has been below the threshold
+    int mFadePos = -1; // the position in the fade out, or -1 if not fading
+    bool mRetired = false;
+  };
+
+  ESilenceCulling mSilenceCulling{kSilenceCullingOff};
+  double mCullThresholdDB{-90.};
+  double mCullHoldTime{0.05};
+  double mCullFadeTime{0.005};
+  sample mCullThreshold{0.};
+  int mCullHoldSamples{0};
+  int mCullFadeSamples{1};
+  std::vector<CullState> mCullStates;
+  std::vector<sample> mCullBuffer; // kMaxCullChannels * mBlockSize
+  std::array<sample*, kMaxCullChannels> mCullPtrs{};
+  CullStats mCullStats;
 
 public:
   EPolyMode mPolyMode {kPolyModePoly};
   EATMode mATMode {kATModeChannel};
 };
 
+template <typename F>
+void VoiceAllocator::ForEachVoiceMatching(VoiceAddress addr, F func)
+{
+  if (addr.mFlags & kVoicesMostRecent)
+  {
+    // find the most recently triggered voice, then call func for it alone
+    int64_t maxT = -1;
+    int maxIdx = kNoVoice;
+
+    ForEachVoiceInIndex(addr, [&](int voiceIdx) {
+      const int64_t t = mVoicePtrs[voiceIdx]->mLastTriggeredTime;
+
+      if (t > maxT)
+      {
+        maxT = t;
+        maxIdx = voiceIdx;
+      }
+    });
+
+    if (maxIdx != kNoVoice)
+      func(maxIdx);
+  }
+  else
+    ForEachVoiceInIndex(addr, func);
+}
+
+template <typename F>
+void VoiceAllocator::ForEachVoiceInIndex(const VoiceAddress& addr, F func)
+{
+  const bool allInZone = addr.mFlags & kVoicesAll;
+  const bool byKey = !allInZone && addr.mKey < kNumKeys;
+  const bool byChannel = !allInZone && addr.mChannel < kNumChannels;
+
+  // visit the smallest index that covers the address, fetching the next voice before calling func in case it moves the voice
+  auto visitList = [&](const std::vector<VoiceList>& lists, const std::vector<VoiceListNode>& nodes, int listIdx) {
+    int v = lists[listIdx].head;
+
+    while (v != kNoVoice)
+    {
+      const int next = nodes[v].next;
+
+      if (VoiceMatches(v, addr))
+        func(v);
+
+      v = next;
+    }
+  };
+
+  if (byKey && byChannel)
+  {
+    visitList(mKeyLists, mKeyNodes, addr.mChannel * kNumKeys + addr.mKey);
+  }
+  else if (byKey)
+  {
+    for (int c = 0; c < kNumChannels; c++)
+      visitList(mKeyLists, mKeyNodes, c * kNumKeys + addr.mKey);
+  }
+  else if (byChannel)
+  {
+    visitList(mChannelLists, mChannelNodes, addr.mChannel);
+  }
+  else if (addr.mZone != kAllZones)
+  {
+    if (addr.mZone < mZoneVoices.size())
+    {
+      for (auto v : mZoneVoices[addr.mZone])
+      {
+        if (VoiceMatches(v, addr))
+          func(v);
+      }
+    }
+  }
+  else
+  {
+    const int n = static_cast<int>(mVoicePtrs.size());
+
+    for (int v = 0; v < n; v++)
+    {
+      if (VoiceMatches(v, addr))
+        func(v);
+    }
+  }
+}
+
 END_IPLUG_NAMESPACE
@@ -0,0 +1,53 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc VoiceStates
+ */
+
+#include <stdint.h>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The state of one voice at the end of a block, for display */
+struct VoiceState
+{
+  static constexpr int kNoStage = -128;
+
+  float mPitch = 0.f; // the note's pitch in octaves relative to 440Hz ("1v / octave"), not including pitch bend
+  float mPitchBend = 0.f; // in octaves
+  float mPressure = 0.f; // [0, 1]
+  float mTimbre = 0.f; // [0, 1]
+  float mGate = 0.f; // the velocity, 0 once released
+  float mLevel = 0.f; // from SynthVoice::GetLevel()
+  uint8_t mChannel = 0;
+  uint8_t mKey = 0; // the key playing the voice, only valid while it is not released
+  int8_t mStage = kNoStage; // from SynthVoice::GetEnvelopeStage()
+  bool mActive = false; // the voice is being processed
+  bool mReleased = false; // the voice is playing its release, its key is no longer held or sustained
+};
+
+/** A snapshot of every voice, written at the end of each block by MidiSynth when enabled with MidiSynth::SetVoiceStatesEnabled().
+ * It is plain data with a fixed size, so it can be passed through a TripleBuffer or sent to a control as a message. */
+struct VoiceStates
+{
+  static constexpr int kMaxVoices = 128;
+
+  int64_t mSampleTime = 0; // the synth's sample time at the end of the block
+  int mNVoices = 0;
+  VoiceState mVoices[kMaxVoices];
+};
+
+END_IPLUG_NAMESPACE
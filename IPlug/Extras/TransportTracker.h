@@ -0,0 +1,341 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc TransportTracker
+ */
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "IPlugPlatform.h"
+#include "IPlugStructs.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Turns the once-per-block ITimeInfo supplied by the host into sample accurate musical positions.
+ * It keeps track of the previous blocks in order to:
+ * - interpolate tempo ramps across a block, extrapolating the tempo change of the previous block
+ * - wrap the position at the end of the loop (cycle) within a block
+ * - detect transport starts, stops and position jumps (relocation by the user, or the host correcting a wrongly predicted ramp)
+ *
+ * Call Reset() from OnReset() and ProcessBlock() at the start of ProcessBlock() with GetTimeInfo(). The per sample quarter note positions
+ * can then be passed to tempo synced DSP, and GridEventIterator enumerates beats, bars or any other grid division within the block
+ * without allocating. */
+class TransportTracker
+{
+public:
+  /** A position on a grid, reported by GridEventIterator */
+  struct GridEvent
+  {
+    int sampleOffset; // offset of the event within the block
+    long long gridIdx; // the number of grid divisions since PPQ 0
+    double ppqPos; // the interpolated PPQ position at sampleOffset, just after the grid line
+    bool isBarStart; // the grid line is also the start of a bar
+    bool isBeatStart; // the grid line is also the start of a beat (in units of the time signature denominator)
+  };
+
+  /** Enumerates the crossings of a grid in the current block, in sample order. Does not allocate.
+   * @code
+   * TransportTracker::GridEventIterator itr(mTransport, 0.25); // 16ths
+   * TransportTracker::GridEvent e;
+   * while (itr.Next(e))
+   *   TriggerStep(e.gridIdx, e.sampleOffset);
+   * @endcode */
+  class GridEventIterator
+  {
+  public:
+    /** @param transport The transport, after ProcessBlock() has been called for this block
+     * @param gridQN The grid division in quarter notes, e.g. 1. for quarter notes, 0.25 for 16ths, 1./3. for 8th triplets */
+    GridEventIterator(const TransportTracker& transport, double gridQN)
+    : mTransport(transport)
+    , mGridQN(gridQN)
+    {
+      assert(gridQN > 0.);
+      mSegmentEnd = mTransport.GetSegmentEnd(0);
+      mPrevPPQ = mTransport.GetPPQBeforeSegment(0);
+    }
+
+    /** @param event Filled with the next grid event
+     * @return \c true if there was another event in the block */
+    bool Next(GridEvent& event)
+    {
+      const int nFrames = mTransport.mNFrames;
+
+      if (!mTransport.IsRunning())
+        return false;
+
+      const double* pPPQ = mTransport.mPPQ.Get();
+
+      while (mPos < nFrames)
+      {
+        // the first grid line after the previous position
+        const long long idx = static_cast<long long>(std::floor(mPrevPPQ / mGridQN + kGridTolerance)) + 1;
+        const double gridPPQ = (idx - kGridTolerance) * mGridQN;
+
+        // the position is monotonic within a segment so we can binary search
+        const double* pFound = std::lower_bound(pPPQ + mPos, pPPQ + mSegmentEnd, gridPPQ);
+        const int s = static_cast<int>(pFound - pPPQ);
+
+        if (s < mSegmentEnd)
+        {
+          mPos = s + 1;
+          mPrevPPQ = pPPQ[s];
+          event.sampleOffset = s;
+          event.gridIdx = idx;
+          event.ppqPos = pPPQ[s];
+          event.isBarStart = mTransport.IsOnGrid(idx * mGridQN, mTransport.GetPPQPerBar(), mTransport.mLastBar);
+          event.isBeatStart = mTransport.IsOnGrid(idx * mGridQN, mTransport.GetPPQPerBeat(), mTransport.mLastBar);
+          return true;
+        }
+
+        // continue in the next segment, after a loop wrap
+        mPos = mSegmentEnd;
+
+        if (mPos < nFrames)
+        {
+          mSegmentIdx++;
+          mSegmentEnd = mTransport.GetSegmentEnd(mSegmentIdx);
+          mPrevPPQ = mTransport.GetPPQBeforeSegment(mSegmentIdx);
+        }
+      }
+
+      return false;
+    }
+
+  private:
+    static constexpr double kGridTolerance = 1e-9; // in grid units, to absorb rounding of host positions that are exactly on a line
+
+    const TransportTracker& mTransport;
+    const double mGridQN;
+    double mPrevPPQ;
+    int mPos = 0;
+    int mSegmentIdx = 0;
+    int mSegmentEnd;
+  };
+
+  /** A loop wrap within the block */
+  struct LoopWrap
+  {
+    int sampleOffset; // the first sample after the wrap
+  };
+
+  static constexpr int kMaxLoopWrapsPerBlock = 8;
+
+  /** The value ITimeInfo holds for a position the host didn't supply */
+  static constexpr double kUnknownPosition = -1.;
+
+  /** Call from OnReset()
+   * @param sampleRate The sample rate
+   * @param maxBlockSize The largest block that will be processed, to allocate the position buffer up front */
+  void Reset(double sampleRate, int maxBlockSize)
+  {
+    mSampleRate = sampleRate;
+    mPPQ.Resize(std::max(maxBlockSize, 1));
+    mNFrames = 0;
+    mHasPrevBlock = false;
+    mRunning = mWasRunning = false;
+  }
+
+  /** If enabled (default), a tempo change between blocks is assumed to be part of a ramp, and continued over the next block.
+   * Disable if the host only makes stepped tempo changes */
+  void SetExtrapolateTempoRamps(bool extrapolate) { mExtrapolateTempo = extrapolate; }
+
+  /** Calculate the sample accurate positions for a block. Call once per block, before querying
+   * @param timeInfo The host's time info at the start of the block
+   * @param nFrames The number of frames in the block */
+  void ProcessBlock(const ITimeInfo& timeInfo, int nFrames)
+  {
+    mPrevLastPPQ = mNFrames ? mPPQ.Get()[mNFrames - 1] : 0.;
+
+    if (mPPQ.GetSize() < nFrames)
+      mPPQ.Resize(nFrames); // Reset() was not called with the correct block size: allocates!
+
+    mWasRunning = mRunning;
+    mRunning = timeInfo.mTransportIsRunning;
+    mNumerator = std::max(timeInfo.mNumerator, 1);
+    mDenominator = std::max(timeInfo.mDenominator, 1);
+    mLastBar = timeInfo.mLastBar != kUnknownPosition ? timeInfo.mLastBar : 0.;
+    mLoopEnabled = timeInfo.mTransportLoopEnabled && timeInfo.mCycleEnd > timeInfo.mCycleStart;
+    mCycleStart = timeInfo.mCycleStart;
+    mCycleEnd = timeInfo.mCycleEnd;
+
+    const double tempo = timeInfo.mTempo > 0. ? timeInfo.mTempo : DEFAULT_TEMPO;
+    // negative positions are real (count-in, pre-roll). Without a position, carry on from the previous block
+    double startPPQ = timeInfo.mPPQPos;
+
+    if (startPPQ == kUnknownPosition)
+      startPPQ = mHasPrevBlock ? mPredictedPPQ : 0.;
+
+    // compare with where the previous block predicted we would be
+    bool wrappedAtStart = false;
+
+    if (mLoopEnabled && mPredictedPPQ >= mCycleEnd - kJumpToleranceQN && std::abs(startPPQ - mCycleStart) < std::abs(startPPQ - mPredictedPPQ))
+    {
+      // the host wrapped the loop between blocks
+      mPredictedPPQ -= mCycleEnd - mCycleStart;
+      wrappedAtStart = true;
+    }
+
+    mTempoChanged = mHasPrevBlock && tempo != mTempoAtBlockStart;
+    mJumped = mHasPrevBlock && mRunning && mWasRunning && std::abs(startPPQ - mPredictedPPQ) > kJumpToleranceQN;
+    mContinuous = mHasPrevBlock && mRunning && mWasRunning && !mJumped && !wrappedAtStart;
+
+    double tempoIncr = 0.; // per sample
+
+    if (mExtrapolateTempo && mTempoChanged && !mJumped && mPrevNFrames > 0)
+      tempoIncr = (tempo - mTempoAtBlockStart) / mPrevNFrames;
+
+    mTempoAtBlockStart = tempo;
+    mTempoAtBlockEnd = std::max(tempo + tempoIncr * nFrames, 1.);
+
+    // integrate the (possibly ramping) tempo into PPQ
+    const double qnPerSamplePerBPM = 1. / (60. * mSampleRate);
+    double* pPPQ = mPPQ.Get();
+    double ppq = startPPQ;
+    double bpm = tempo;
+    mNLoopWraps = 0;
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      if (mRunning && mLoopEnabled && ppq >= mCycleEnd && ppq - mCycleEnd < mCycleEnd - mCycleStart)
+      {
+        ppq -= mCycleEnd - mCycleStart;
+
+        if (mNLoopWraps < kMaxLoopWrapsPerBlock)
+          mLoopWraps[mNLoopWraps++].sampleOffset = s;
+      }
+
+      pPPQ[s] = ppq;
+
+      if (mRunning)
+      {
+        ppq += bpm * qnPerSamplePerBPM;
+        bpm = std::max(bpm + tempoIncr, 1.);
+      }
+    }
+
+    mPredictedPPQ = ppq;
+    mNFrames = nFrames;
+    mPrevNFrames = nFrames;
+    mHasPrevBlock = true;
+  }
+
+  /** @return The PPQ (quarter note) positions for each sample of the current block */
+  const double* GetPPQBuffer() const { return mPPQ.Get(); }
+
+  double GetPPQ(int sampleOffset) const { return mPPQ.Get()[sampleOffset]; }
+
+  /** @return The fractional bar number at a sample, counted from PPQ 0 assuming the current time signature */
+  double GetBarPos(int sampleOffset) const { return GetPPQ(sampleOffset) / GetPPQPerBar(); }
+
+  /** @return The position within the bar at a sample, 0-1 */
+  double GetPhaseInBar(int sampleOffset) const
+  {
+    const double pos = (GetPPQ(sampleOffset) - mLastBar) / GetPPQPerBar();
+    return pos - std::floor(pos);
+  }
+
+  /** @return The tempo at a sample, which ramps if a tempo change is being extrapolated */
+  double GetTempo(int sampleOffset) const
+  {
+    return mNFrames ? mTempoAtBlockStart + (mTempoAtBlockEnd - mTempoAtBlockStart) * sampleOffset / mNFrames : mTempoAtBlockStart;
+  }
+
+  double GetPPQPerBar() const { return mNumerator * GetPPQPerBeat(); }
+
+  double GetPPQPerBeat() const { return 4. / mDenominator; }
+
+  int GetNFrames() const { return mNFrames; }
+
+  bool IsRunning() const { return mRunning; }
+
+  /** @return \c true if the transport started at the start of this block */
+  bool StartedThisBlock() const { return mRunning && !mWasRunning; }
+
+  /** @return \c true if the transport stopped at the start of this block */
+  bool StoppedThisBlock() const { return !mRunning && mWasRunning; }
+
+  /** @return \c true if the host position did not follow on from the previous block, excluding loop wraps at the start of the block */
+  bool JumpedThisBlock() const { return mJumped; }
+
+  /** @return \c true if the tempo differs from the previous block */
+  bool TempoChangedThisBlock() const { return mTempoChanged; }
+
+  /** @return \c true if a sync'ed process should reset its phase, i.e. the transport has just started or jumped */
+  bool NeedsResync() const { return StartedThisBlock() || mJumped; }
+
+  int GetNLoopWraps() const { return mNLoopWraps; }
+
+  const LoopWrap& GetLoopWrap(int idx) const { return mLoopWraps[idx]; }
+
+private:
+  static constexpr double kJumpToleranceQN = 1e-3; // larger than host rounding, smaller than any plausible tempo ramp error
+
+  static bool IsOnGrid(double ppq, double grid, double offset)
+  {
+    const double pos = (ppq - offset) / grid;
+    return std::abs(pos - std::round(pos)) < 1e-6;
+  }
+
+  /** @return The end (exclusive) of the monotonic range of samples between loop wraps */
+  int GetSegmentEnd(int segment) const
+  {
+    return segment < mNLoopWraps ? mLoopWraps[segment].sampleOffset : mNFrames;
+  }
+
+  /** @return The position before the first sample of a segment, i.e. the last sample of the previous block if the transport is continuous.
+   * At a discontinuity (start, jump or loop wrap) it is one sample's distance earlier, so that a grid line exactly on the first sample is reported */
+  double GetPPQBeforeSegment(int segment) const
+  {
+    if (!mNFrames)
+      return 0.;
+
+    const int start = segment > 0 ? mLoopWraps[segment - 1].sampleOffset : 0;
+    const double ppq = mPPQ.Get()[start];
+    const double incr = mTempoAtBlockStart / (60. * mSampleRate);
+
+    if (segment == 0 && mContinuous)
+      return mPrevLastPPQ;
+
+    return ppq - incr;
+  }
+
+  WDL_TypedBuf<double> mPPQ;
+  LoopWrap mLoopWraps[kMaxLoopWrapsPerBlock];
+  double mSampleRate = 44100.;
+  double mTempoAtBlockStart = DEFAULT_TEMPO;
+  double mTempoAtBlockEnd = DEFAULT_TEMPO;
+  double mPredictedPPQ = 0.;
+  double mPrevLastPPQ = 0.;
+  double mLastBar = 0.;
+  double mCycleStart = 0.;
+  double mCycleEnd = 0.;
+  int mNumerator = 4;
+  int mDenominator = 4;
+  int mNFrames = 0;
+  int mPrevNFrames = 0;
+  int mNLoopWraps = 0;
+  bool mRunning = false;
+  bool mWasRunning = false;
+  bool mJumped = false;
+  bool mTempoChanged = false;
+  bool mLoopEnabled = false;
+  bool mHasPrevBlock = false;
+  bool mContinuous = false;
+  bool mExtrapolateTempo = true;
+};
+
+END_IPLUG_NAMESPACE
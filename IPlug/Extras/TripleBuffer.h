@@ -0,0 +1,72 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc TripleBuffer
+ */
+
+#include <atomic>
+#include <cstdint>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A lock-free triple buffer for handing a large value from one writer thread to one reader thread, e.g. a table computed on the
+ * main thread and used on the audio thread. The writer fills GetWriteBuffer() and calls Publish(), the reader calls Consume() and then
+ * uses GetReadBuffer(). Neither side ever waits or allocates, and the reader always sees the most recently published complete value.
+ * If the writer publishes several times before the reader consumes, the intermediate values are skipped. */
+template <class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  /** WRITER: @return The buffer to fill before calling Publish(). It holds an older value, not necessarily the last one written */
+  T& GetWriteBuffer() { return mBuffers[mWriteIdx]; }
+
+  /** WRITER: make the write buffer available to the reader */
+  void Publish()
+  {
+    const uint8_t prev = mMiddle.exchange(static_cast<uint8_t>(mWriteIdx | kDirty), std::memory_order_acq_rel);
+    mWriteIdx = prev & kIdxMask;
+  }
+
+  /** READER: pick up the most recently published value, if there is a new one
+   * @return \c true if GetReadBuffer() now holds a new value */
+  bool Consume()
+  {
+    if (!(mMiddle.load(std::memory_order_relaxed) & kDirty))
+      return false;
+
+    const uint8_t prev = mMiddle.exchange(static_cast<uint8_t>(mReadIdx), std::memory_order_acq_rel);
+    mReadIdx = prev & kIdxMask;
+    return true;
+  }
+
+  /** READER: @return The value picked up by the last successful Consume() */
+  const T& GetReadBuffer() const { return mBuffers[mReadIdx]; }
+
+private:
+  static constexpr uint8_t kDirty = 4;
+  static constexpr uint8_t kIdxMask = 3;
+
+  T mBuffers[3] {};
+  int mWriteIdx = 0;
+  int mReadIdx = 1;
+  std::atomic<uint8_t> mMiddle {2};
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,424 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Multi-channel waveshaper with first and second order antiderivative antialiasing (ADAA).
+ * Based on:
+ * - Parker, Zavalishin, Le Bivic, "Reducing the Aliasing of Nonlinear Waveshaping Using Continuous-Time Convolution" (DAFx 2016)
+ * - Bilbao, Esqueda, Parker, Välimäki, "Antiderivative Antialiasing for Memoryless Nonlinearities" (IEEE SPL 2017)
+ */
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <initializer_list>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Shapes for Waveshaper provide the curve F0 and its first and second antiderivatives F1 and F2, in double precision */
+
+/** tanh, with F1 = log(cosh(x)) and F2 from the dilogarithm */
+struct TanhShape
+{
+  double F0(double x) const { return std::tanh(x); }
+
+  double F1(double x) const
+  {
+    const double a = std::fabs(x);
+    return a + std::log1p(std::exp(-2. * a)) - kLn2;
+  }
+
+  /** x^2/2 - x ln2 + Li2(-e^-2x)/2 + pi^2/24 for x >= 0, odd. With u = log(1 + z), Li2(-z) = -B(u) - u^2/2, where
+   * B(u) is the Bernoulli series of Li2(1 - e^-u), converging quickly for u <= ln2 */
+  double F2(double x) const
+  {
+    const double a = std::fabs(x);
+    const double u = std::log1p(std::exp(-2. * a));
+    const double u2 = u * u;
+    const double b = u * (1. + u * (-0.25 + u * (0.027777777777777776 + u2 * (-2.777777777777778e-4 + u2 * (4.72411186696901e-6
+                   + u2 * (-9.185773074661964e-8 + u2 * (1.8978869988971e-9 + u2 * (-4.0647616451442256e-11
+                   + u2 * (8.921691020456452e-13 + u2 * -1.9939295860721074e-14)))))))));
+    const double li2 = -b - 0.5 * u2;
+    const double f = 0.5 * a * a - a * kLn2 + 0.5 * li2 + kPi2Over24;
+    return x < 0. ? -f : f;
+  }
+
+private:
+  static constexpr double kLn2 = 0.69314718055994530942;
+  static constexpr double kPi2Over24 = 0.41123351671205660911;
+};
+
+/** A polynomial on [-limit, limit], continued flat beyond it. Hard clipping is the polynomial x */
+struct PolynomialShape
+{
+  static constexpr int kMaxCoeffs = 8;
+
+  /** @param coeffs c0, c1, c2 ... for f(x) = c0 + c1 x + c2 x^2 ..., up to kMaxCoeffs
+   * @param limit Inputs beyond +-limit give f(+-limit) */
+  PolynomialShape(std::initializer_list<double> coeffs = {0., 1.5, 0., -0.5}, double limit = 1.)
+  : mLimit(limit)
+  {
+    assert(coeffs.size() > 0 && coeffs.size() <= kMaxCoeffs && limit > 0.);
+    mNCoeffs = static_cast<int>(std::min<size_t>(coeffs.size(), kMaxCoeffs));
+    std::fill(mC.begin(), mC.end(), 0.);
+    std::copy(coeffs.begin(), coeffs.begin() + mNCoeffs, mC.begin());
+
+    for (auto k = 0; k < mNCoeffs; k++)
+    {
+      mC1[k + 1] = mC[k] / (k + 1);
+      mC2[k + 2] = mC[k] / ((k + 1) * (k + 2));
+    }
+
+    for (auto s = 0; s < 2; s++)
+    {
+      const double edge = s ? mLimit : -mLimit;
+      mEdge[s][0] = Horner(mC.data(), mNCoeffs, edge);
+      mEdge[s][1] = Horner(mC1.data(), mNCoeffs + 1, edge);
+      mEdge[s][2] = Horner(mC2.data(), mNCoeffs + 2, edge);
+    }
+  }
+
+  /** Cubic soft clipper 1.5x - 0.5x^3, reaching +-1 with zero slope at +-1 */
+  static PolynomialShape SoftClip() { return PolynomialShape({0., 1.5, 0., -0.5}, 1.); }
+
+  /** Hard clipper at +-threshold */
+  static PolynomialShape HardClip(double threshold = 1.) { return PolynomialShape({0., 1.}, threshold); }
+
+  double F0(double x) const
+  {
+    const double c = std::min(std::max(x, -mLimit), mLimit);
+    return Horner(mC.data(), mNCoeffs, c);
+  }
+
+  double F1(double x) const
+  {
+    if (x > mLimit) return mEdge[1][1] + mEdge[1][0] * (x - mLimit);
+    if (x < -mLimit) return mEdge[0][1] + mEdge[0][0] * (x + mLimit);
+    return Horner(mC1.data(), mNCoeffs + 1, x);
+  }
+
+  double F2(double x) const
+  {
+    if (x > mLimit) { const double d = x - mLimit; return mEdge[1][2] + d * (mEdge[1][1] + 0.5 * d * mEdge[1][0]); }
+    if (x < -mLimit) { const double d = x + mLimit; return mEdge[0][2] + d * (mEdge[0][1] + 0.5 * d * mEdge[0][0]); }
+    return Horner(mC2.data(), mNCoeffs + 2, x);
+  }
+
+private:
+  static double Horner(const double* pC, int n, double x)
+  {
+    double y = 0.;
+    for (auto k = n - 1; k >= 0; k--)
+      y = y * x + pC[k];
+    return y;
+  }
+
+  std::array<double, kMaxCoeffs> mC;
+  std::array<double, kMaxCoeffs + 1> mC1 {};
+  std::array<double, kMaxCoeffs + 2> mC2 {};
+  double mEdge[2][3]; // f, F1, F2 at -limit and +limit
+  double mLimit;
+  int mNCoeffs;
+};
+
+/** A curve from equally spaced samples over [xMin, xMax], linearly interpolated and continued flat beyond the ends.
+ * F1 and F2 are the exact antiderivatives of the interpolated curve, accumulated from xMin when the table is built */
+struct TableShape
+{
+  /** @param pValues f(x) at size equally spaced points from xMin to xMax, size >= 2 */
+  TableShape(const double* pValues, int size, double xMin, double xMax)
+  {
+    assert(size >= 2 && xMax > xMin);
+    mF0.assign(pValues, pValues + size);
+    Init(xMin, xMax);
+  }
+
+  /** Sample a function into a table */
+  template <typename FuncType>
+  static TableShape FromFunction(FuncType func, int size, double xMin, double xMax)
+  {
+    std::vector<double> values(size);
+    for (auto i = 0; i < size; i++)
+      values[i] = func(xMin + (xMax - xMin) * i / (size - 1));
+    return TableShape(values.data(), size, xMin, xMax);
+  }
+
+  double F0(double x) const
+  {
+    int i; double u;
+    if (!Locate(x, i, u))
+      return x < mXMin ? mF0.front() : mF0.back();
+    return mF0[i] + mSlope[i] * u;
+  }
+
+  double F1(double x) const
+  {
+    int i; double u;
+    if (!Locate(x, i, u))
+      return x < mXMin ? mF0.front() * (x - mXMin) : mF1.back() + mF0.back() * (x - mXMax);
+    return mF1[i] + u * (mF0[i] + 0.5 * u * mSlope[i]);
+  }
+
+  double F2(double x) const
+  {
+    int i; double u;
+    if (!Locate(x, i, u))
+    {
+      if (x < mXMin)
+      {
+        const double d = x - mXMin;
+        return 0.5 * d * d * mF0.front();
+      }
+      const double d = x - mXMax;
+      return mF2.back() + d * (mF1.back() + 0.5 * d * mF0.back());
+    }
+    return mF2[i] + u * (mF1[i] + u * (0.5 * mF0[i] + u * mSlope[i] * (1. / 6.)));
+  }
+
+private:
+  void Init(double xMin, double xMax)
+  {
+    const int n = static_cast<int>(mF0.size());
+    mXMin = xMin;
+    mXMax = xMax;
+    mStep = (xMax - xMin) / (n - 1);
+    mSlope.resize(n);
+    mF1.resize(n);
+    mF2.resize(n);
+    mF1[0] = mF2[0] = 0.;
+
+    for (auto i = 0; i < n - 1; i++)
+    {
+      const double h = mStep;
+      mSlope[i] = (mF0[i + 1] - mF0[i]) / h;
+      mF1[i + 1] = mF1[i] + h * (mF0[i] + 0.5 * h * mSlope[i]);
+      mF2[i + 1] = mF2[i] + h * (mF1[i] + h * (0.5 * mF0[i] + h * mSlope[i] * (1. / 6.)));
+    }
+
+    mSlope[n - 1] = 0.;
+  }
+
+  /** @return false outside [xMin, xMax), otherwise the segment and the offset into it */
+  bool Locate(double x, int& i, double& u) const
+  {
+    if (!(x >= mXMin && x < mXMax))
+      return false;
+
+    i = std::min(static_cast<int>((x - mXMin) / mStep), static_cast<int>(mF0.size()) - 2);
+    u = x - (mXMin + i * mStep);
+    return true;
+  }
+
+  std::vector<double> mF0, mSlope, mF1, mF2;
+  double mXMin = -1., mXMax = 1., mStep = 1.;
+};
+
+/** Multi-channel memoryless waveshaper y = gain * f(drive * x), with optional ADAA.
+ * First order ADAA delays the signal by half a sample and second order by one sample, and both attenuate
+ * the top octave a little, so that ADAA at 2x oversampling gives aliasing comparable to naive shaping at much higher factors.
+ * ProcessBlock() has the OverSampler block function signature:
+ * @code
+ * mOverSampler.ProcessBlock(inputs, outputs, nFrames, 2, 2, [&](sample** in, sample** out, int n) { mShaper.ProcessBlock(in, out, n); });
+ * @endcode
+ * Each block is processed in chunks, with one pass per stage (drive, antiderivatives, differences) over a whole chunk, so
+ * that the loops vectorise for arithmetic shapes. The rare ill-conditioned samples fall back to evaluating the curve at the midpoint. */
+template <typename T = double, typename Shape = TanhShape>
+class Waveshaper
+{
+public:
+  enum EADAA
+  {
+    kNaive = 0,
+    kADAA1,
+    kADAA2,
+    kNumADAAOrders
+  };
+
+  Waveshaper(int nChans = 1, EADAA order = kADAA1, const Shape& shape = Shape())
+  : mShape(shape)
+  , mOrder(order)
+  , mChannels(nChans)
+  {
+    Reset();
+  }
+
+  /** Clears the history. Call this after changing the shape */
+  void Reset()
+  {
+    for (auto& c : mChannels)
+    {
+      c.x1 = c.x2 = 0.;
+      c.Fx1 = c.Fx2 = mOrder == kADAA2 ? mShape.F2(0.) : mShape.F1(0.);
+      c.D1 = mShape.F1(0.);
+    }
+  }
+
+  void SetOrder(EADAA order)
+  {
+    if (order != mOrder)
+    {
+      mOrder = order;
+      Reset();
+    }
+  }
+
+  EADAA GetOrder() const { return mOrder; }
+
+  /** @return The group delay the ADAA order adds, in samples at the rate ProcessBlock() runs at */
+  double GetDelaySamples() const { return 0.5 * static_cast<int>(mOrder); }
+
+  /** Input gain applied before the curve */
+  void SetDrive(double drive) { mDrive = drive; }
+
+  /** Output gain applied after the curve */
+  void SetGain(double gain) { mGain = gain; }
+
+  Shape& GetShape() { return mShape; }
+  const Shape& GetShape() const { return mShape; }
+
+  int NChannels() const { return static_cast<int>(mChannels.size()); }
+
+  /** Process planar blocks. inputs and outputs may be the same buffers
+   * @param nChans The number of channels to process, -1 for all the channels the waveshaper was constructed with */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nChans = -1)
+  {
+    if (nChans < 0)
+      nChans = NChannels();
+
+    assert(nChans <= NChannels());
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      for (auto start = 0; start < nFrames; start += kChunkSize)
+      {
+        const int n = std::min(kChunkSize, nFrames - start);
+
+        switch (mOrder)
+        {
+          case kNaive: ProcessNaive(inputs[c] + start, outputs[c] + start, n); break;
+          case kADAA1: ProcessADAA1(mChannels[c], inputs[c] + start, outputs[c] + start, n); break;
+          case kADAA2: ProcessADAA2(mChannels[c], inputs[c] + start, outputs[c] + start, n); break;
+          default: break;
+        }
+      }
+    }
+  }
+
+private:
+  static constexpr int kChunkSize = 64;
+  // below these input differences the divided differences are ill-conditioned
+  static constexpr double kEps1 = 1e-5;
+  static constexpr double kEps2 = 1e-4;
+
+  struct ChannelState
+  {
+    double x1, x2; // previous driven inputs
+    double Fx1, Fx2; // the antiderivative at x1 and x2 (F1 for first order, F2 for second order)
+    double D1;     // second order: the divided difference of x1 and x2
+  };
+
+  void ProcessNaive(const T* pIn, T* pOut, int n) const
+  {
+    for (auto i = 0; i < n; i++)
+      pOut[i] = static_cast<T>(mGain * mShape.F0(mDrive * static_cast<double>(pIn[i])));
+  }
+
+  void ProcessADAA1(ChannelState& state, const T* pIn, T* pOut, int n) const
+  {
+    // index 0 holds the previous sample
+    double x[kChunkSize + 1], F[kChunkSize + 1];
+    x[0] = state.x1;
+    F[0] = state.Fx1;
+
+    for (auto i = 0; i < n; i++)
+      x[i + 1] = mDrive * static_cast<double>(pIn[i]);
+
+    for (auto i = 1; i <= n; i++)
+      F[i] = mShape.F1(x[i]);
+
+    for (auto i = 1; i <= n; i++)
+    {
+      const double dx = x[i] - x[i - 1];
+      const double y = std::fabs(dx) > kEps1 ? (F[i] - F[i - 1]) / dx : mShape.F0(0.5 * (x[i] + x[i - 1]));
+      pOut[i - 1] = static_cast<T>(mGain * y);
+    }
+
+    state.x1 = x[n];
+    state.Fx1 = F[n];
+  }
+
+  void ProcessADAA2(ChannelState& state, const T* pIn, T* pOut, int n) const
+  {
+    // indices 0 and 1 hold the previous two samples
+    double x[kChunkSize + 2], F[kChunkSize + 2], D[kChunkSize + 2];
+    x[0] = state.x2;
+    x[1] = state.x1;
+    F[0] = state.Fx2;
+    F[1] = state.Fx1;
+    D[1] = state.D1;
+
+    for (auto i = 0; i < n; i++)
+      x[i + 2] = mDrive * static_cast<double>(pIn[i]);
+
+    for (auto i = 2; i < n + 2; i++)
+      F[i] = mShape.F2(x[i]);
+
+    // D[i] = (F2(x[i]) - F2(x[i-1])) / (x[i] - x[i-1]), which tends to F1 at the midpoint
+    for (auto i = 2; i < n + 2; i++)
+    {
+      const double dx = x[i] - x[i - 1];
+      D[i] = std::fabs(dx) > kEps2 ? (F[i] - F[i - 1]) / dx : mShape.F1(0.5 * (x[i] + x[i - 1]));
+    }
+
+    for (auto i = 2; i < n + 2; i++)
+    {
+      const double dx2 = x[i] - x[i - 2];
+      double y;
+
+      if (std::fabs(dx2) > kEps2)
+        y = 2. * (D[i] - D[i - 1]) / dx2;
+      else
+      {
+        // x[i] ~ x[i-2]: expand around their mean
+        const double xBar = 0.5 * (x[i] + x[i - 2]);
+        const double delta = xBar - x[i - 1];
+
+        if (std::fabs(delta) > kEps2)
+          y = 2. / delta * (mShape.F1(xBar) + (F[i - 1] - mShape.F2(xBar)) / delta);
+        else
+          y = mShape.F0(0.5 * (xBar + x[i - 1]));
+      }
+
+      pOut[i - 2] = static_cast<T>(mGain * y);
+    }
+
+    state.x2 = x[n];
+    state.x1 = x[n + 1];
+    state.Fx2 = F[n];
+    state.Fx1 = F[n + 1];
+    state.D1 = D[n + 1];
+  }
+
+  Shape mShape;
+  EADAA mOrder;
+  double mDrive = 1.;
+  double mGain = 1.;
+  std::vector<ChannelState> mChannels;
+};
+
+END_IPLUG_NAMESPACE
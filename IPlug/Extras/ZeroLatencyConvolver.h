@@ -0,0 +1,298 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ZeroLatencyConvolver
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "MatrixConvolver.h"
+
+#if !defined(IPLUG_CONVOLVER_NO_SIMD) && defined(__AVX2__)
+  #define IPLUG_CONVOLVER_AVX2
+  #include <immintrin.h>
+#elif !defined(IPLUG_CONVOLVER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define IPLUG_CONVOLVER_SSE2
+  #include <emmintrin.h>
+#elif !defined(IPLUG_CONVOLVER_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+  #define IPLUG_CONVOLVER_NEON
+  #include <arm_neon.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Zero latency convolution of nIns inputs with an nIns x nOuts matrix of impulse responses, for tracking and live monitoring.
+ *
+ * The first \c headLength samples of each impulse are convolved in the time domain by a direct form FIR, vectorised with AVX2, SSE2 or
+ * NEON (define IPLUG_CONVOLVER_NO_SIMD for scalar code). The rest goes to a MatrixConvolver with a block size of \c headLength, whose
+ * one block of latency lines its output up with the end of the head, so the sum is the full convolution with no delay.
+ *
+ * The head costs \c headLength multiply-adds per sample per route, the tail gets cheaper as its blocks grow, so the best head length
+ * depends on the impulse length and the SIMD width. 64-256 is usually a good balance.
+ *
+ * SetImpulses() allocates, ProcessBlock() is realtime safe and takes any number of frames. Uses WDL_real_fft(), so WDL/fft.c must be
+ * compiled into the project. */
+class ZeroLatencyConvolver
+{
+public:
+  ZeroLatencyConvolver() = default;
+  ZeroLatencyConvolver(const ZeroLatencyConvolver&) = delete;
+  ZeroLatencyConvolver& operator=(const ZeroLatencyConvolver&) = delete;
+
+  /** Set the routing matrix. Call off the audio thread
+   * @param nIns Number of inputs
+   * @param nOuts Number of outputs
+   * @param pImpulses nIns * nOuts pointers, the impulse from input \c i to output \c o at [i * nOuts + o]. nullptr means no route
+   * @param length Length of each impulse (in samples)
+   * @param headLength Number of samples convolved in the time domain, a power of two of at least 16
+   * @return \c false if the arguments are invalid */
+  bool SetImpulses(int nIns, int nOuts, const WDL_FFT_REAL* const* pImpulses, int length, int headLength = 128)
+  {
+    if (nIns < 1 || nOuts < 1 || length < 0 || headLength < 16 || (headLength & (headLength - 1)))
+      return false;
+
+    mNIns = nIns;
+    mNOuts = nOuts;
+    mHeadLength = headLength;
+    mNTaps = std::max(std::min(length, headLength), 1);
+    mHasTail = length > headLength;
+
+    if (mHasTail && !mTail.SetImpulses(nIns, nOuts, pImpulses, length, headLength, headLength))
+      return false;
+
+    // reversed, so that the FIR walks taps and input forwards together
+    mHead.assign(static_cast<size_t>(nIns) * nOuts * mNTaps, 0.);
+    mHeadActive.assign(static_cast<size_t>(nIns) * nOuts, 0);
+
+    for (int i = 0; i < nIns; i++)
+    {
+      for (int o = 0; o < nOuts; o++)
+      {
+        const WDL_FFT_REAL* pIR = pImpulses ? pImpulses[i * nOuts + o] : nullptr;
+
+        if (!pIR)
+          continue;
+
+        const int route = i * nOuts + o;
+        WDL_FFT_REAL* pHead = &mHead[static_cast<size_t>(route) * mNTaps];
+
+        for (int k = 0; k < std::min(length, mNTaps); k++)
+        {
+          pHead[mNTaps - 1 - k] = pIR[k];
+          mHeadActive[route] |= pIR[k] != 0.;
+        }
+      }
+    }
+
+    mHistory.assign(static_cast<size_t>(nIns) * headLength * 2, 0.);
+    mTailIn.resize(nIns);
+    mTailOut.resize(nOuts);
+    Reset();
+    return true;
+  }
+
+  /** Clear all history, e.g. from OnReset() */
+  void Reset()
+  {
+    std::fill(mHistory.begin(), mHistory.end(), 0.);
+    mTail.Reset();
+  }
+
+  /** Convolve \c nFrames of NIns() inputs into NOuts() outputs, with no delay. In-place processing is supported */
+  void ProcessBlock(WDL_FFT_REAL** inputs, WDL_FFT_REAL** outputs, int nFrames)
+  {
+    if (!mHeadLength)
+      return;
+
+    const int N = mHeadLength;
+    int done = 0;
+
+    while (done < nFrames)
+    {
+      const int n = std::min(nFrames - done, N);
+
+      // the history holds the previous N inputs followed by this chunk. It also feeds the tail, so in-place processing is safe
+      for (int i = 0; i < mNIns; i++)
+      {
+        WDL_FFT_REAL* pHistory = &mHistory[static_cast<size_t>(i) * N * 2];
+        memcpy(pHistory + N, inputs[i] + done, n * sizeof(WDL_FFT_REAL));
+        mTailIn[i] = pHistory + N;
+      }
+
+      for (int o = 0; o < mNOuts; o++)
+        mTailOut[o] = outputs[o] + done;
+
+      if (mHasTail)
+        mTail.ProcessBlock(mTailIn.data(), mTailOut.data(), n);
+      else
+      {
+        for (int o = 0; o < mNOuts; o++)
+          std::fill(mTailOut[o], mTailOut[o] + n, 0.);
+      }
+
+      for (int o = 0; o < mNOuts; o++)
+      {
+        for (int i = 0; i < mNIns; i++)
+        {
+          const int route = i * mNOuts + o;
+
+          if (!mHeadActive[route])
+            continue;
+
+          // output t needs inputs t - mNTaps + 1 ... t, which start at N - mNTaps + 1 + t in the history
+          const WDL_FFT_REAL* pX = &mHistory[static_cast<size_t>(i) * N * 2 + N - mNTaps + 1];
+          FIRAccumulate(mTailOut[o], pX, &mHead[static_cast<size_t>(route) * mNTaps], mNTaps, n);
+        }
+      }
+
+      for (int i = 0; i < mNIns; i++)
+      {
+        WDL_FFT_REAL* pHistory = &mHistory[static_cast<size_t>(i) * N * 2];
+        memmove(pHistory, pHistory + n, N * sizeof(WDL_FFT_REAL));
+      }
+
+      done += n;
+    }
+  }
+
+  int GetLatency() const { return 0; }
+  int GetHeadLength() const { return mHeadLength; }
+  int NIns() const { return mNIns; }
+  int NOuts() const { return mNOuts; }
+
+private:
+#pragma mark - SIMD
+#if defined IPLUG_CONVOLVER_AVX2
+  static inline int Lanes(const double*) { return 4; }
+  static inline __m256d Load(const double* p) { return _mm256_loadu_pd(p); }
+  static inline void Store(double* p, __m256d a) { _mm256_storeu_pd(p, a); }
+  static inline __m256d Splat(double x) { return _mm256_set1_pd(x); }
+  static inline int Lanes(const float*) { return 8; }
+  static inline __m256 Load(const float* p) { return _mm256_loadu_ps(p); }
+  static inline void Store(float* p, __m256 a) { _mm256_storeu_ps(p, a); }
+  static inline __m256 Splat(float x) { return _mm256_set1_ps(x); }
+#if defined(__FMA__) || defined(_MSC_VER) // MSVC's /arch:AVX2 implies FMA3
+  static inline __m256d MulAdd(__m256d acc, __m256d a, __m256d b) { return _mm256_fmadd_pd(a, b, acc); }
+  static inline __m256 MulAdd(__m256 acc, __m256 a, __m256 b) { return _mm256_fmadd_ps(a, b, acc); }
+#else
+  static inline __m256d MulAdd(__m256d acc, __m256d a, __m256d b) { return _mm256_add_pd(acc, _mm256_mul_pd(a, b)); }
+  static inline __m256 MulAdd(__m256 acc, __m256 a, __m256 b) { return _mm256_add_ps(acc, _mm256_mul_ps(a, b)); }
+#endif
+#elif defined IPLUG_CONVOLVER_SSE2
+  static inline int Lanes(const double*) { return 2; }
+  static inline __m128d Load(const double* p) { return _mm_loadu_pd(p); }
+  static inline void Store(double* p, __m128d a) { _mm_storeu_pd(p, a); }
+  static inline __m128d Splat(double x) { return _mm_set1_pd(x); }
+  static inline __m128d MulAdd(__m128d acc, __m128d a, __m128d b) { return _mm_add_pd(acc, _mm_mul_pd(a, b)); }
+  static inline int Lanes(const float*) { return 4; }
+  static inline __m128 Load(const float* p) { return _mm_loadu_ps(p); }
+  static inline void Store(float* p, __m128 a) { _mm_storeu_ps(p, a); }
+  static inline __m128 Splat(float x) { return _mm_set1_ps(x); }
+  static inline __m128 MulAdd(__m128 acc, __m128 a, __m128 b) { return _mm_add_ps(acc, _mm_mul_ps(a, b)); }
+#elif defined IPLUG_CONVOLVER_NEON
+  static inline int Lanes(const float*) { return 4; }
+  static inline float32x4_t Load(const float* p) { return vld1q_f32(p); }
+  static inline void Store(float* p, float32x4_t a) { vst1q_f32(p, a); }
+  static inline float32x4_t Splat(float x) { return vdupq_n_f32(x); }
+  static inline float32x4_t MulAdd(float32x4_t acc, float32x4_t a, float32x4_t b) { return vmlaq_f32(acc, a, b); }
+#if defined(__aarch64__) || defined(_M_ARM64)
+  static inline int Lanes(const double*) { return 2; }
+  static inline float64x2_t Load(const double* p) { return vld1q_f64(p); }
+  static inline void Store(double* p, float64x2_t a) { vst1q_f64(p, a); }
+  static inline float64x2_t Splat(double x) { return vdupq_n_f64(x); }
+  static inline float64x2_t MulAdd(float64x2_t acc, float64x2_t a, float64x2_t b) { return vfmaq_f64(acc, a, b); }
+#else
+  static inline int Lanes(const double*) { return 1; }
+  static inline double Load(const double* p) { return *p; }
+  static inline void Store(double* p, double a) { *p = a; }
+  static inline double Splat(double x) { return x; }
+  static inline double MulAdd(double acc, double a, double b) { return acc + a * b; }
+#endif
+#else
+  template <typename T> static inline int Lanes(const T*) { return 1; }
+  template <typename T> static inline T Load(const T* p) { return *p; }
+  template <typename T> static inline void Store(T* p, T a) { *p = a; }
+  template <typename T> static inline T Splat(T x) { return x; }
+  template <typename T> static inline T MulAdd(T acc, T a, T b) { return acc + a * b; }
+#endif
+
+#pragma mark -
+  /** pOut[t] += sum over k of pH[k] * pX[t + k]. Four vectors of outputs stay in registers while the taps stream past */
+  template <typename T>
+  static void FIRAccumulate(T* __restrict pOut, const T* __restrict pX, const T* __restrict pH, int nTaps, int nFrames)
+  {
+    const int L = Lanes(pOut);
+    int t = 0;
+
+    for (; t + 4 * L <= nFrames; t += 4 * L)
+    {
+      auto a0 = Load(pOut + t);
+      auto a1 = Load(pOut + t + L);
+      auto a2 = Load(pOut + t + 2 * L);
+      auto a3 = Load(pOut + t + 3 * L);
+
+      for (int k = 0; k < nTaps; k++)
+      {
+        const auto h = Splat(pH[k]);
+        const T* pXk = pX + t + k;
+        a0 = MulAdd(a0, h, Load(pXk));
+        a1 = MulAdd(a1, h, Load(pXk + L));
+        a2 = MulAdd(a2, h, Load(pXk + 2 * L));
+        a3 = MulAdd(a3, h, Load(pXk + 3 * L));
+      }
+
+      Store(pOut + t, a0);
+      Store(pOut + t + L, a1);
+      Store(pOut + t + 2 * L, a2);
+      Store(pOut + t + 3 * L, a3);
+    }
+
+    for (; t + L <= nFrames; t += L)
+    {
+      auto a = Load(pOut + t);
+
+      for (int k = 0; k < nTaps; k++)
+        a = MulAdd(a, Splat(pH[k]), Load(pX + t + k));
+
+      Store(pOut + t, a);
+    }
+
+    for (; t < nFrames; t++)
+    {
+      T acc = pOut[t];
+
+      for (int k = 0; k < nTaps; k++)
+        acc += pH[k] * pX[t + k];
+
+      pOut[t] = acc;
+    }
+  }
+
+  int mNIns = 0;
+  int mNOuts = 0;
+  int mHeadLength = 0;
+  int mNTaps = 0;
+  bool mHasTail = false;
+
+  MatrixConvolver mTail;
+  std::vector<WDL_FFT_REAL> mHead; // [in][out][tap], reversed
+  std::vector<char> mHeadActive;
+  std::vector<WDL_FFT_REAL> mHistory; // [in][2 * head], the previous head length of input followed by the current chunk
+  std::vector<WDL_FFT_REAL*> mTailIn, mTailOut;
+};
+
+END_IPLUG_NAMESPACE
@@ -594,6 +594,603 @@ struct ISysEx
 
 };
 
+/** Encapsulates a MIDI 2.0 Universal MIDI Packet (UMP) of 32, 64, 96 or 128 bits, with a sample offset like IMidiMsg.
+ * Helpers are provided for MIDI 1.0 and MIDI 2.0 channel voice messages, other packets are passed through as raw words.
+ * MIDI 2.0 channel voice messages carry 16-bit velocities and 32-bit controller values, and add per-note controllers,
+ * per-note pitch bend and registered/assignable controllers (RPN/NRPN) as single messages.
+ * @ingroup IPlugStructs */
+struct IMidiUMP
+{
+  int mOffset;
+  uint32_t mWords[4];
+
+  /** Constants for the message type, the top 4 bits of the first word */
+  enum EMessageType
+  {
+    kUtility = 0x0,
+    kSystem = 0x1,
+    kMIDI1ChannelVoice = 0x2,
+    kData64 = 0x3,
+    kMIDI2ChannelVoice = 0x4,
+    kData128 = 0x5,
+    kFlexData = 0xD,
+    kStream = 0xF
+  };
+
+  /** Constants for the status nibble of a MIDI 2.0 channel voice message */
+  enum EStatusMsg
+  {
+    kRegisteredPerNoteController = 0x0,
+    kAssignablePerNoteController = 0x1,
+    kRegisteredController = 0x2,
+    kAssignableController = 0x3,
+    kRelativeRegisteredController = 0x4,
+    kRelativeAssignableController = 0x5,
+    kPerNotePitchBend = 0x6,
+    kNoteOff = 0x8,
+    kNoteOn = 0x9,
+    kPolyPressure = 0xA,
+    kControlChange = 0xB,
+    kProgramChange = 0xC,
+    kChannelPressure = 0xD,
+    kPitchBend = 0xE,
+    kPerNoteManagement = 0xF
+  };
+
+  /** Constants for the attribute type of MIDI 2.0 note on/off messages */
+  enum ENoteAttribute
+  {
+    kNoAttribute = 0,
+    kManufacturerAttribute,
+    kProfileAttribute,
+    kPitch79Attribute // attribute data is the note's pitch in semitones, as 7.9 fixed point
+  };
+
+  /** Flags for per-note management messages */
+  static constexpr uint8_t kPerNoteReset = 0x1;
+  static constexpr uint8_t kPerNoteDetach = 0x2;
+
+  /** Create a UMP
+   * @param offset The sample offset in the block
+   * @param word0 The first 32-bit word, which sets the message type and so the number of words used */
+  IMidiUMP(int offset = 0, uint32_t word0 = 0, uint32_t word1 = 0, uint32_t word2 = 0, uint32_t word3 = 0)
+  : mOffset(offset)
+  , mWords{word0, word1, word2, word3}
+  {}
+
+  /** Wrap a MIDI 1.0 channel voice message in a 32-bit UMP of type kMIDI1ChannelVoice, without translating it
+   * @param msg The message, which keeps its sample offset
+   * @param group The UMP group [0, 15] */
+  void MakeMIDI1Msg(const IMidiMsg& msg, int group = 0)
+  {
+    Clear();
+    mWords[0] = (kMIDI1ChannelVoice << 28) | ((group & 0xF) << 24) | (msg.mStatus << 16) | ((msg.mData1 & 0x7F) << 8) | (msg.mData2 & 0x7F);
+    mOffset = msg.mOffset;
+  }
+
+  /** Make a MIDI 2.0 channel voice message. The other Make methods are helpers for this
+   * @param status The status nibble
+   * @param channel MIDI channel [0, 15]
+   * @param byte2 The note number, controller index or bank, depending on the status
+   * @param byte3 The attribute type, controller index or flags, depending on the status
+   * @param data The second word, i.e. the 32-bit value
+   * @param offset Sample offset in block
+   * @param group The UMP group [0, 15] */
+  void MakeChannelVoiceMsg(EStatusMsg status, int channel, int byte2, int byte3, uint32_t data, int offset, int group = 0)
+  {
+    Clear();
+    mWords[0] = (kMIDI2ChannelVoice << 28) | ((group & 0xF) << 24) | ((status & 0xF) << 20) | ((channel & 0xF) << 16) | ((byte2 & 0xFF) << 8) | (byte3 & 0xFF);
+    mWords[1] = data;
+    mOffset = offset;
+  }
+
+  /** Make a MIDI 2.0 Note On message
+   * @param noteNumber Note number
+   * @param velocity 16-bit velocity. Unlike MIDI 1.0, a velocity of 0 is not a note off
+   * @param offset Sample offset in block
+   * @param channel MIDI channel [0, 15]
+   * @param attribute The attribute type
+   * @param attributeData The attribute data */
+  void MakeNoteOnMsg(int noteNumber, uint16_t velocity, int offset, int channel = 0, ENoteAttribute attribute = kNoAttribute, uint16_t attributeData = 0)
+  {
+    MakeChannelVoiceMsg(kNoteOn, channel, noteNumber & 0x7F, attribute, (uint32_t(velocity) << 16) | attributeData, offset);
+  }
+
+  /** Make a MIDI 2.0 Note Off message
+   * @param noteNumber Note number
+   * @param velocity 16-bit release velocity
+   * @param offset Sample offset in block
+   * @param channel MIDI channel [0, 15] */
+  void MakeNoteOffMsg(int noteNumber, uint16_t velocity, int offset, int channel = 0)
+  {
+    MakeChannelVoiceMsg(kNoteOff, channel, noteNumber & 0x7F, kNoAttribute, uint32_t(velocity) << 16, offset);
+  }
+
+  /** Make a MIDI 2.0 Control Change message
+   * @param idx Controller index [0, 127]
+   * @param value Range [0, 1], converts to 32 bits
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakeControlChangeMsg(int idx, double value, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kControlChange, channel, idx & 0x7F, 0, UnipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Pitch Bend message
+   * @param value Range [-1, 1], converts to 32 bits where 0x80000000 = no pitch change
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakePitchBendMsg(double value, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kPitchBend, channel, 0, 0, BipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Per-Note Pitch Bend message, which is added to the channel pitch bend for one note
+   * @param noteNumber Note number
+   * @param value Range [-1, 1], converts to 32 bits where 0x80000000 = no pitch change
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakePerNotePitchBendMsg(int noteNumber, double value, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kPerNotePitchBend, channel, noteNumber & 0x7F, 0, BipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Per-Note Controller message
+   * @param noteNumber Note number
+   * @param idx Controller index [0, 255]
+   * @param value Range [0, 1], converts to 32 bits
+   * @param registered \c true for a registered per-note controller, \c false for an assignable one
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakePerNoteControllerMsg(int noteNumber, int idx, double value, bool registered, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(registered ? kRegisteredPerNoteController : kAssignablePerNoteController, channel, noteNumber & 0x7F, idx, UnipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Registered (RPN) or Assignable (NRPN) Controller message
+   * @param bank The bank, i.e. the parameter number MSB [0, 127]
+   * @param idx The index, i.e. the parameter number LSB [0, 127]
+   * @param data The 32-bit value
+   * @param registered \c true for a registered controller (RPN), \c false for an assignable one (NRPN)
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakeControllerMsg(int bank, int idx, uint32_t data, bool registered, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(registered ? kRegisteredController : kAssignableController, channel, bank & 0x7F, idx & 0x7F, data, offset);
+  }
+
+  /** Make a MIDI 2.0 Program Change message
+   * @param program Program index [0, 127]
+   * @param bank The 14-bit bank, or -1 to not select a bank
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakeProgramChangeMsg(int program, int bank = -1, int channel = 0, int offset = 0)
+  {
+    const bool bankValid = bank >= 0;
+    const uint32_t data = (uint32_t(program & 0x7F) << 24) | (bankValid ? (((bank >> 7) & 0x7F) << 8) | (bank & 0x7F) : 0);
+    MakeChannelVoiceMsg(kProgramChange, channel, 0, bankValid ? 1 : 0, data, offset);
+  }
+
+  /** Make a MIDI 2.0 Channel Pressure message
+   * @param value Range [0, 1], converts to 32 bits
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakeChannelPressureMsg(double value, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kChannelPressure, channel, 0, 0, UnipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Poly Pressure message
+   * @param noteNumber Note number
+   * @param value Range [0, 1], converts to 32 bits
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakePolyPressureMsg(int noteNumber, double value, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kPolyPressure, channel, noteNumber & 0x7F, 0, UnipolarToData(value), offset);
+  }
+
+  /** Make a MIDI 2.0 Per-Note Management message
+   * @param noteNumber Note number
+   * @param flags kPerNoteReset and/or kPerNoteDetach
+   * @param channel MIDI channel [0, 15]
+   * @param offset Sample offset in block */
+  void MakePerNoteManagementMsg(int noteNumber, uint8_t flags, int channel = 0, int offset = 0)
+  {
+    MakeChannelVoiceMsg(kPerNoteManagement, channel, noteNumber & 0x7F, flags & 0x3, 0, offset);
+  }
+
+  /** @return The message type */
+  EMessageType MessageType() const { return (EMessageType) (mWords[0] >> 28); }
+
+  /** @return The number of 32-bit words in the packet, [1, 4], which is set by the message type */
+  int NumWords() const
+  {
+    static const int nWords[16] = {1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4};
+    return nWords[mWords[0] >> 28];
+  }
+
+  /** @return The UMP group [0, 15] */
+  int Group() const { return (mWords[0] >> 24) & 0xF; }
+
+  /** @return The status nibble of a channel voice message. For kMIDI1ChannelVoice messages this is an IMidiMsg::EStatusMsg */
+  EStatusMsg StatusMsg() const { return (EStatusMsg) ((mWords[0] >> 20) & 0xF); }
+
+  /** @return [0, 15] for midi channels 1 ... 16 */
+  int Channel() const { return (mWords[0] >> 16) & 0xF; }
+
+  /** @return The third byte of the first word: the note number, controller index or bank depending on the status */
+  int Byte2() const { return (mWords[0] >> 8) & 0xFF; }
+
+  /** @return The fourth byte of the first word: the attribute type, controller index or flags depending on the status */
+  int Byte3() const { return mWords[0] & 0xFF; }
+
+  /** @return The note number of a note or per-note message */
+  int NoteNumber() const { return Byte2() & 0x7F; }
+
+  /** @return The 32-bit value of a MIDI 2.0 channel voice message */
+  uint32_t Data() const { return mWords[1]; }
+
+  /** @return The 16-bit velocity of a MIDI 2.0 note message */
+  uint16_t Velocity() const { return mWords[1] >> 16; }
+
+  ENoteAttribute Attribute() const { return (ENoteAttribute) Byte3(); }
+
+  uint16_t AttributeData() const { return mWords[1] & 0xFFFF; }
+
+  /** @return The 32-bit value mapped to [0, 1] */
+  double Unipolar() const { return DataToUnipolar(Data()); }
+
+  /** @return The 32-bit value mapped to [-1, 1], where 0x80000000 is 0 */
+  double Bipolar() const { return DataToBipolar(Data()); }
+
+  /** @return The program index of a MIDI 2.0 Program Change message */
+  int Program() const { return (mWords[1] >> 24) & 0x7F; }
+
+  /** @return The 14-bit bank of a MIDI 2.0 Program Change message, or -1 if no bank is selected */
+  int ProgramBank() const { return (Byte3() & 1) ? (((mWords[1] >> 8) & 0x7F) << 7) | (mWords[1] & 0x7F) : -1; }
+
+  /** Get the MIDI 1.0 message wrapped in a kMIDI1ChannelVoice UMP
+   * @return \c false if this is not a kMIDI1ChannelVoice UMP */
+  bool GetMIDI1Msg(IMidiMsg& msg) const
+  {
+    if (MessageType() != kMIDI1ChannelVoice)
+      return false;
+
+    msg = IMidiMsg(mOffset, (mWords[0] >> 16) & 0xFF, (mWords[0] >> 8) & 0x7F, mWords[0] & 0x7F);
+    return true;
+  }
+
+  static uint32_t UnipolarToData(double value)
+  {
+    return static_cast<uint32_t>(std::min(std::max(value, 0.0), 1.0) * 4294967295.0 + 0.5);
+  }
+
+  static uint32_t BipolarToData(double value)
+  {
+    return static_cast<uint32_t>(std::min(std::max(value * 2147483648.0 + 2147483648.0, 0.0), 4294967295.0) + 0.5);
+  }
+
+  static double DataToUnipolar(uint32_t data) { return static_cast<double>(data) / 4294967295.0; }
+
+  static double DataToBipolar(uint32_t data) { return (static_cast<double>(data) - 2147483648.0) / 2147483648.0; }
+
+  /** Scale a value to more bits, using the MIDI 2.0 min-center-max algorithm, so that the minimum, center and maximum values
+   * map onto the minimum, center and maximum of the destination, and values above the center are spread evenly up to the maximum
+   * @param value The source value
+   * @param srcBits The number of bits of the source value [2, 31]
+   * @param dstBits The number of bits of the result [srcBits, 32]
+   * @return The scaled value */
+  static uint32_t ScaleUp(uint32_t value, int srcBits, int dstBits)
+  {
+    const int scaleBits = dstBits - srcBits;
+    const uint32_t shifted = value << scaleBits;
+    const uint32_t srcCenter = 1u << (srcBits - 1);
+
+    if (value <= srcCenter)
+      return shifted;
+
+    // repeat the bits below the sign bit to fill the new low bits
+    const int repeatBits = srcBits - 1;
+    uint32_t repeatValue = value & ((1u << repeatBits) - 1);
+    repeatValue = scaleBits > repeatBits ? repeatValue << (scaleBits - repeatBits) : repeatValue >> (repeatBits - scaleBits);
+
+    uint32_t result = shifted;
+
+    while (repeatValue)
+    {
+      result |= repeatValue;
+      repeatValue >>= repeatBits;
+    }
+
+    return result;
+  }
+
+  /** Scale a value to fewer bits, the inverse of ScaleUp() */
+  static uint32_t ScaleDown(uint32_t value, int srcBits, int dstBits)
+  {
+    return value >> (srcBits - dstBits);
+  }
+
+  /** Clear the message */
+  void Clear()
+  {
+    mOffset = 0;
+    mWords[0] = mWords[1] = mWords[2] = mWords[3] = 0;
+  }
+
+  /** Log a message (TRACER BUILDS) */
+  void LogMsg()
+  {
+    Trace(TRACELOC, "ump:(%08X %08X %08X %08X)", mWords[0], mWords[1], mWords[2], mWords[3]);
+  }
+
+  /** Print a message (DEBUG BUILDS) */
+  void PrintMsg() const
+  {
+    DBGMSG("ump: offset %i, (%08X %08X %08X %08X)\n", mOffset, mWords[0], mWords[1], mWords[2], mWords[3]);
+  }
+};
+
+/** Translates between MIDI 1.0 messages and MIDI 2.0 channel voice UMPs, following the default translation of the UMP specification.
+ * MIDI 1.0 to UMP keeps per-channel state to assemble 14-bit controllers (CC 0-31 with their LSBs CC 32-63),
+ * RPN/NRPN data entry into single Registered/Assignable Controller messages, and bank select into Program Change.
+ * UMP to MIDI 1.0 expands those messages into CC sequences. Per-note controllers, per-note pitch bend and per-note management
+ * have no MIDI 1.0 equivalent and are dropped. State is kept per channel, not per group.
+ * Nothing is allocated, so this can be used on the audio thread.
+ * @ingroup IPlugUtilities */
+class IMidiUMPTranslator
+{
+public:
+  /** The maximum number of MIDI 1.0 messages that one UMP can translate to */
+  static constexpr int kMaxMIDI1Msgs = 4;
+
+  IMidiUMPTranslator() { Reset(); }
+
+  void Reset()
+  {
+    for (auto& state : mChannels)
+      state = ChannelState();
+  }
+
+  /** Translate a MIDI 1.0 message to a MIDI 2.0 channel voice UMP
+   * @param msg The message
+   * @param ump Set to the translated message, with the same sample offset
+   * @param group The UMP group [0, 15]
+   * @return \c false if there is nothing to send yet, e.g. for RPN parameter number and bank select messages */
+  bool ToUMP(const IMidiMsg& msg, IMidiUMP& ump, int group = 0)
+  {
+    const int channel = msg.Channel();
+    ChannelState& state = mChannels[channel];
+
+    auto make = [&](IMidiUMP::EStatusMsg status, int byte2, int byte3, uint32_t data) {
+      ump.MakeChannelVoiceMsg(status, channel, byte2, byte3, data, msg.mOffset, group);
+      return true;
+    };
+
+    switch (msg.StatusMsg())
+    {
+      case IMidiMsg::kNoteOn:
+        // a velocity of 0 is a note off in MIDI 1.0, with the release velocity of 64 that it implies
+        if (msg.mData2 == 0)
+          return make(IMidiUMP::kNoteOff, msg.mData1, 0, IMidiUMP::ScaleUp(64, 7, 16) << 16);
+        return make(IMidiUMP::kNoteOn, msg.mData1, 0, IMidiUMP::ScaleUp(msg.mData2, 7, 16) << 16);
+      case IMidiMsg::kNoteOff:
+        return make(IMidiUMP::kNoteOff, msg.mData1, 0, IMidiUMP::ScaleUp(msg.mData2, 7, 16) << 16);
+      case IMidiMsg::kPolyAftertouch:
+        return make(IMidiUMP::kPolyPressure, msg.mData1, 0, IMidiUMP::ScaleUp(msg.mData2, 7, 32));
+      case IMidiMsg::kChannelAftertouch:
+        return make(IMidiUMP::kChannelPressure, 0, 0, IMidiUMP::ScaleUp(msg.mData1, 7, 32));
+      case IMidiMsg::kPitchWheel:
+        return make(IMidiUMP::kPitchBend, 0, 0, IMidiUMP::ScaleUp((msg.mData2 << 7) | msg.mData1, 14, 32));
+      case IMidiMsg::kProgramChange:
+      {
+        const bool bankValid = state.bankMSB != kNotSet;
+        const uint32_t data = (uint32_t(msg.mData1) << 24) | (bankValid ? (state.bankMSB << 8) | (state.bankLSB == kNotSet ? 0 : state.bankLSB) : 0);
+        return make(IMidiUMP::kProgramChange, 0, bankValid ? 1 : 0, data);
+      }
+      case IMidiMsg::kControlChange:
+        return ControlChangeToUMP(msg, state, make);
+      default:
+        return false;
+    }
+  }
+
+  /** Translate a UMP to MIDI 1.0 messages
+   * @param ump The message, either a MIDI 1.0 or MIDI 2.0 channel voice UMP. Other message types are ignored
+   * @param pMsgs Array of at least kMaxMIDI1Msgs messages, set to the translated messages with the same sample offset
+   * @return The number of messages */
+  int FromUMP(const IMidiUMP& ump, IMidiMsg* pMsgs)
+  {
+    if (ump.GetMIDI1Msg(pMsgs[0]))
+      return 1;
+
+    if (ump.MessageType() != IMidiUMP::kMIDI2ChannelVoice)
+      return 0;
+
+    const int channel = ump.Channel();
+    const int offset = ump.mOffset;
+    int n = 0;
+
+    auto add = [&](IMidiMsg::EStatusMsg status, int data1, int data2) {
+      pMsgs[n++] = IMidiMsg(offset, static_cast<uint8_t>((status << 4) | channel), static_cast<uint8_t>(data1 & 0x7F), static_cast<uint8_t>(data2 & 0x7F));
+    };
+
+    auto addCC = [&](int idx, int value) {
+      add(IMidiMsg::kControlChange, idx, value);
+    };
+
+    switch (ump.StatusMsg())
+    {
+      case IMidiUMP::kNoteOn:
+      {
+        // velocity 0 is valid in MIDI 2.0 but would be a note off in MIDI 1.0
+        const int velocity = static_cast<int>(IMidiUMP::ScaleDown(ump.Velocity(), 16, 7));
+        add(IMidiMsg::kNoteOn, ump.NoteNumber(), velocity ? velocity : 1);
+        break;
+      }
+      case IMidiUMP::kNoteOff:
+        add(IMidiMsg::kNoteOff, ump.NoteNumber(), IMidiUMP::ScaleDown(ump.Velocity(), 16, 7));
+        break;
+      case IMidiUMP::kPolyPressure:
+        add(IMidiMsg::kPolyAftertouch, ump.NoteNumber(), IMidiUMP::ScaleDown(ump.Data(), 32, 7));
+        break;
+      case IMidiUMP::kChannelPressure:
+        add(IMidiMsg::kChannelAftertouch, IMidiUMP::ScaleDown(ump.Data(), 32, 7), 0);
+        break;
+      case IMidiUMP::kPitchBend:
+      {
+        const uint32_t value = IMidiUMP::ScaleDown(ump.Data(), 32, 14);
+        add(IMidiMsg::kPitchWheel, value & 0x7F, value >> 7);
+        break;
+      }
+      case IMidiUMP::kControlChange:
+      {
+        const int idx = ump.Byte2() & 0x7F;
+
+        if (idx < 32 && m14BitCCs)
+        {
+          const uint32_t value = IMidiUMP::ScaleDown(ump.Data(), 32, 14);
+          addCC(idx, value >> 7);
+          addCC(idx + 32, value & 0x7F);
+        }
+        else
+          addCC(idx, IMidiUMP::ScaleDown(ump.Data(), 32, 7));
+        break;
+      }
+      case IMidiUMP::kRegisteredController:
+      case IMidiUMP::kAssignableController:
+      {
+        const bool registered = ump.StatusMsg() == IMidiUMP::kRegisteredController;
+        const uint32_t value = IMidiUMP::ScaleDown(ump.Data(), 32, 14);
+        addCC(registered ? kRPNMSB : kNRPNMSB, ump.Byte2());
+        addCC(registered ? kRPNLSB : kNRPNLSB, ump.Byte3());
+        addCC(kDataEntryMSB, value >> 7);
+        addCC(kDataEntryLSB, value & 0x7F);
+        break;
+      }
+      case IMidiUMP::kProgramChange:
+      {
+        const int bank = ump.ProgramBank();
+
+        if (bank >= 0)
+        {
+          addCC(kBankSelectMSB, bank >> 7);
+          addCC(kBankSelectLSB, bank & 0x7F);
+        }
+
+        add(IMidiMsg::kProgramChange, ump.Program(), 0);
+        break;
+      }
+      default:
+        break;
+    }
+
+    return n;
+  }
+
+  /** Set whether CC 0-31 and their LSBs CC 32-63 are treated as 14-bit controllers. On by default */
+  void Set14BitCCs(bool enable) { m14BitCCs = enable; }
+
+private:
+  static constexpr uint8_t kNotSet = 0xFF;
+
+  // MIDI 1.0 controllers used for banks and RPN/NRPN
+  static constexpr int kBankSelectMSB = 0;
+  static constexpr int kDataEntryMSB = 6;
+  static constexpr int kBankSelectLSB = 32;
+  static constexpr int kDataEntryLSB = 38;
+  static constexpr int kDataIncrement = 96;
+  static constexpr int kDataDecrement = 97;
+  static constexpr int kNRPNLSB = 98;
+  static constexpr int kNRPNMSB = 99;
+  static constexpr int kRPNLSB = 100;
+  static constexpr int kRPNMSB = 101;
+
+  struct ChannelState
+  {
+    uint8_t paramMSB = kNotSet; // the selected RPN/NRPN
+    uint8_t paramLSB = kNotSet;
+    bool registered = true; // whether the selected parameter is an RPN or NRPN
+    uint8_t dataMSB = 0;
+    uint8_t bankMSB = kNotSet;
+    uint8_t bankLSB = kNotSet;
+    uint8_t ccMSB[32] = {}; // the last MSB of each 14-bit controller
+  };
+
+  template <typename F>
+  bool ControlChangeToUMP(const IMidiMsg& msg, ChannelState& state, F make)
+  {
+    const int idx = msg.mData1 & 0x7F;
+    const int value = msg.mData2 & 0x7F;
+
+    switch (idx)
+    {
+      case kBankSelectMSB:
+        state.bankMSB = value;
+        return false;
+      case kBankSelectLSB:
+        state.bankLSB = value;
+        return false;
+      case kRPNMSB:
+      case kNRPNMSB:
+        state.paramMSB = value;
+        state.registered = idx == kRPNMSB;
+        return false;
+      case kRPNLSB:
+      case kNRPNLSB:
+        state.paramLSB = value;
+        state.registered = idx == kRPNLSB;
+        return false;
+      case kDataEntryMSB:
+      case kDataEntryLSB:
+      {
+        // RPN 127/127 is the null parameter, which deselects any parameter
+        if (state.paramMSB == kNotSet || state.paramLSB == kNotSet || (state.paramMSB == 0x7F && state.paramLSB == 0x7F))
+          return false;
+
+        // the MSB is sent on its own first, the LSB refines it
+        uint32_t value14;
+
+        if (idx == kDataEntryMSB)
+        {
+          state.dataMSB = value;
+          value14 = value << 7;
+        }
+        else
+          value14 = (state.dataMSB << 7) | value;
+
+        return make(state.registered ? IMidiUMP::kRegisteredController : IMidiUMP::kAssignableController, state.paramMSB, state.paramLSB, IMidiUMP::ScaleUp(value14, 14, 32));
+      }
+      case kDataIncrement:
+      case kDataDecrement:
+      {
+        if (state.paramMSB == kNotSet || state.paramLSB == kNotSet || (state.paramMSB == 0x7F && state.paramLSB == 0x7F))
+          return false;
+
+        const int32_t delta = idx == kDataIncrement ? 1 : -1;
+        return make(state.registered ? IMidiUMP::kRelativeRegisteredController : IMidiUMP::kRelativeAssignableController, state.paramMSB, state.paramLSB, static_cast<uint32_t>(delta));
+      }
+      default:
+        break;
+    }
+
+    if (m14BitCCs && idx < 32)
+    {
+      state.ccMSB[idx] = value;
+      return make(IMidiUMP::kControlChange, idx, 0, IMidiUMP::ScaleUp(value << 7, 14, 32));
+    }
+
+    if (m14BitCCs && idx >= 32 && idx < 64)
+      return make(IMidiUMP::kControlChange, idx - 32, 0, IMidiUMP::ScaleUp((state.ccMSB[idx - 32] << 7) | value, 14, 32));
+
+    return make(IMidiUMP::kControlChange, idx, 0, IMidiUMP::ScaleUp(value, 7, 32));
+  }
+
+  ChannelState mChannels[16];
+  bool m14BitCCs = true;
+};
+
 /*
 
 IMidiQueue
@@ -672,25 +1269,26 @@ void MyPlug::ProcessBlock(double** inputs, double** outputs, int nFrames)
   #define DEFAULT_BLOCK_SIZE 512
 #endif
 
-/** A class to help with queuing timestamped MIDI messages
+/** A class to help with queuing timestamped MIDI messages, of any type with an mOffset member
   * @ingroup IPlugUtilities */
-class IMidiQueue
+template <class T>
+class IMidiQueueBase
 {
 public:
-  IMidiQueue(int size = DEFAULT_BLOCK_SIZE)
+  IMidiQueueBase(int size = DEFAULT_BLOCK_SIZE)
   : mBuf(NULL), mSize(0), mGrow(Granulize(size)), mFront(0), mBack(0)
   {
     Expand();
   }
   
-  ~IMidiQueue()
+  ~IMidiQueueBase()
   {
     free(mBuf);
   }
 
   // Adds a MIDI message at the back of the queue. If the queue is full,
   // it will automatically expand itself.
-  void Add(const IMidiMsg& msg)
+  void Add(const T& msg)
   {
     if (mBack >= mSize)
     {
@@ -706,7 +1304,7 @@ public:
       int i = mBack - 2;
       while (i >= mFront && msg.mOffset < mBuf[i].mOffset) --i;
       i++;
-      memmove(&mBuf[i + 1], &mBuf[i], (mBack - i) * sizeof(IMidiMsg));
+      memmove(&mBuf[i + 1], &mBuf[i], (mBack - i) * sizeof(T));
       mBuf[i] = msg;
     }
     else
@@ -731,7 +1329,7 @@ public:
 
   // Returns the "next" MIDI message (all the way in the front of the
   // queue), but does *not* remove it from the queue.
-  inline IMidiMsg& Peek() const { return mBuf[mFront]; }
+  inline T& Peek() const { return mBuf[mFront]; }
 
   // Moves back MIDI messages all the way to the front of the queue, thus
   // freeing up space at the back, and updates the sample offset of the
@@ -757,10 +1355,10 @@ public:
     if (size < mBack) size = Granulize(mBack);
     if (size == mSize) return mSize;
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
+    void* buf = realloc(mBuf, size * sizeof(T));
     if (!buf) return mSize;
 
-    mBuf = (IMidiMsg*)buf;
+    mBuf = (T*)buf;
     mSize = size;
     return size;
   }
@@ -772,10 +1370,10 @@ protected:
     if (!mGrow) return false;
     int size = (mSize / mGrow + 1) * mGrow;
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
+    void* buf = realloc(mBuf, size * sizeof(T));
     if (!buf) return false;
 
-    mBuf = (IMidiMsg*)buf;
+    mBuf = (T*)buf;
     mSize = size;
     return true;
   }
@@ -784,23 +1382,26 @@ protected:
   inline void Compact()
   {
     mBack -= mFront;
-    if (mBack > 0) memmove(&mBuf[0], &mBuf[mFront], mBack * sizeof(IMidiMsg));
+    if (mBack > 0) memmove(&mBuf[0], &mBuf[mFront], mBack * sizeof(T));
     mFront = 0;
   }
 
   // Rounds the MIDI queue size up to the next 4 kB memory page size.
   inline int Granulize(int size) const
   {
-    int bytes = size * sizeof(IMidiMsg);
+    int bytes = size * sizeof(T);
     int rest = bytes % 4096;
-    if (rest) size = (bytes - rest + 4096) / sizeof(IMidiMsg);
+    if (rest) size = (bytes - rest + 4096) / sizeof(T);
     return size;
   }
 
-  IMidiMsg* mBuf;
+  T* mBuf;
 
   int mSize, mGrow;
   int mFront, mBack;
 };
 
+using IMidiQueue = IMidiQueueBase<IMidiMsg>;
+using IMidiUMPQueue = IMidiQueueBase<IMidiUMP>;
+
 END_IPLUG_NAMESPACE
@@ -483,6 +483,8 @@ void IPlugProcessor::AttachBuffers(ERoute direction, int idx, int n, PLUG_SAMPLE
 
 void IPlugProcessor::PassThroughBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
+  mOutputIsSilent = false;
+
   if (mLatency && mLatencyDelay)
     mLatencyDelay->ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
   else
@@ -509,9 +511,55 @@ void IPlugProcessor::PassThroughBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 
 void IPlugProcessor::ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
+  mOutputIsSilent = mSilenceDetection && CanSkipBlock(nFrames);
+
+  if (mOutputIsSilent)
+  {
+    sample** ppOutputs = mScratchData[ERoute::kOutput].Get();
+
+    for (int i = 0; i < MaxNChannels(ERoute::kOutput); i++)
+      memset(ppOutputs[i], 0, nFrames * sizeof(sample));
+
+    return;
+  }
+
   ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
 }
 
+bool IPlugProcessor::CanSkipBlock(int nFrames)
+{
+  sample** ppInputs = mScratchData[ERoute::kInput].Get();
+
+  for (int i = 0; i < MaxNChannels(ERoute::kInput); i++)
+  {
+    if (IsChannelConnected(ERoute::kInput, i) && !IsSilent(ppInputs[i], nFrames, mSilenceThreshold))
+    {
+      mSilentFrames = 0;
+      return false;
+    }
+  }
+
+  if (mTailSize < 0)
+    return false;
+
+  // keep processing until the tail of the last input that wasn't silent has been output
+  if (mSilentFrames < static_cast<int64_t>(mTailSize) + mLatency)
+  {
+    mSilentFrames += nFrames;
+    return false;
+  }
+
+  return !IsProducingAudio();
+}
+
+void IPlugProcessor::SetSilenceDetection(bool enable, double thresholdDB)
+{
+  mSilenceDetection = enable;
+  mSilenceThreshold = static_cast<sample>(DBToAmp(thresholdDB));
+  mSilentFrames = 0;
+  mOutputIsSilent = false;
+}
+
 void IPlugProcessor::ProcessBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 {
   ProcessBuffers((PLUG_SAMPLE_DST) 0, nFrames);
@@ -80,6 +80,14 @@ public:
    * @param active \c true if the host has activated the plug-in */
   virtual void OnActivate(bool active) { TRACE }
 
+  /** Override this method if silence detection is enabled and your plug-in can make sound while its inputs are silent, e.g. an instrument,
+   * or an effect with an oscillator. It is only called once the inputs have been silent for longer than the tail size and latency, and
+   * ProcessBlock() is only skipped if it returns \c false. It is called after any MIDI for the block has been passed to ProcessMidiMsg(),
+   * so an instrument can check its queued notes as well as its active voices.
+   * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD
+   * @return \c true if the plug-in is producing sound of its own */
+  virtual bool IsProducingAudio() { return false; }
+
 #pragma mark - Methods you can call - some of which have custom implementations in the API classes, some implemented in IPlugProcessor.cpp
 
   /** Send a single MIDI message // TODO: info about what thread should this be called on or not called on!
@@ -115,6 +123,9 @@ public:
   /** @return \c true if the plugin is currently rendering off-line */
   bool GetRenderingOffline() const { return mRenderingOffline; };
 
+  /** @return \c true if silence detection skipped ProcessBlock() for the last block, and the outputs were zeroed */
+  bool GetOutputIsSilent() const { return mOutputIsSilent; }
+
 #pragma mark -
   /** @return The number of samples elapsed since start of project timeline. */
   double GetSamplePos() const { return mTimeInfo.mSamplePos; }
@@ -235,11 +246,22 @@ public:
   virtual void SetLatency(int latency);
 
   /** Call this method if you need to update the tail size at runtime, for example if the decay time of your reverb effect changes
-   * Some apis have special interpretations of certain numbers. For VST3 set to 0xffffffff for infinite tail, or 0 for none (default)
+   * Some apis have special interpretations of certain numbers. A negative value (e.g. 0xffffffff) means an infinite tail, which VST3 reports as kInfiniteTail, 0 means none (default)
    * For VST2 setting to 1 means no tail
    * @param tailSize the new tailsize in samples*/
   void SetTailSize(int tailSize) { mTailSize = tailSize; }
 
+  /** Call this method (e.g. in your plug-in's constructor) to stop calling ProcessBlock() when there is nothing to process.
+   * Once all the connected inputs have been silent for longer than the tail size plus latency, and IsProducingAudio() returns \c false,
+   * the outputs are zeroed instead, and hosts that support it are told that the outputs are silent. Processing starts again as soon as an
+   * input isn't silent. A negative tail size (e.g. 0xffffffff for an infinite VST3 tail) disables sleeping.
+   * @param enable \c true to enable silence detection
+   * @param thresholdDB The level at and below which input samples count as silence */
+  void SetSilenceDetection(bool enable, double thresholdDB = -120.);
+
+  /** @return \c true if silence detection is enabled */
+  bool GetSilenceDetection() const { return mSilenceDetection; }
+
   /** A static method to parse the config.h channel I/O string.
    * @param IOStr Space separated cstring list of I/O configurations for this plug-in in the format ninchans-noutchans.
    * A hypen character \c(-) deliminates input-output. Supports multiple buses, which are indicated using a period \c(.) character.
@@ -267,12 +289,16 @@ protected:
   void ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames);
   void ProcessBuffersAccumulating(int nFrames); // only for VST2 deprecated method single precision
   void ZeroScratchBuffers();
+  /** @return \c true if ProcessBlock() can be skipped for this block, see SetSilenceDetection() */
+  bool CanSkipBlock(int nFrames);
   void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
   void SetBlockSize(int blockSize);
   void SetBypassed(bool bypassed) { mBypassed = bypassed; }
   void SetTimeInfo(const ITimeInfo& timeInfo) { mTimeInfo = timeInfo; }
   void SetRenderingOffline(bool renderingOffline) { mRenderingOffline = renderingOffline; }
   const WDL_String& GetChannelLabel(ERoute direction, int idx) { return mChannelData[direction].Get(idx)->mLabel; }
+  /** @return The buffer that stands in for channel \c idx while it is unconnected, sized by SetBlockSize(). Used by the APP wrapper to prefault it */
+  WDL_TypedBuf<PLUG_SAMPLE_DST>& GetScratchBuf(ERoute direction, int idx) { return mChannelData[direction].Get(idx)->mScratchBuf; }
 
 private:
   /** See EIPlugPluginTypes */
@@ -295,6 +321,14 @@ private:
   bool mBypassed = false;
   /** \c true if the plug-in is rendering off-line*/
   bool mRenderingOffline = false;
+  /** \c true if ProcessBlock() should be skipped when the inputs and tail are silent */
+  bool mSilenceDetection = false;
+  /** \c true if the last block was skipped and its outputs zeroed */
+  bool mOutputIsSilent = false;
+  /** The level at and below which input samples count as silence */
+  sample mSilenceThreshold = 0.;
+  /** The number of samples since the inputs were last not silent */
+  int64_t mSilentFrames = 0;
   /** A list of IOConfig structures populated by ParseChannelIOStr in the IPlugProcessor constructor */
   WDL_PtrList<IOConfig> mIOConfigs;
   /* Manages pointers to the actual data for each channel */
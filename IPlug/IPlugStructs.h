@@ -236,7 +236,22 @@ public:
     }
     return n;
   }
-  
+
+  /** Pre-allocates storage so that the chunk can grow to \c nBytes without reallocating, e.g. before serializing a large state.
+   * The size of the chunk is unchanged
+   * @param nBytes The expected final size of the chunk (in bytes)
+   * @return \c true if the storage could be allocated */
+  inline bool Reserve(int nBytes)
+  {
+    const int n = mBytes.GetSize();
+    if (nBytes <= n)
+      return true;
+
+    const bool ok = mBytes.ResizeOK(nBytes, false) != nullptr;
+    mBytes.Resize(n, false);
+    return ok;
+  }
+
   /** Gets a ptr to the chunk data
    * @return uint8_t* Ptr to the chunk data */
   inline uint8_t* GetData()
@@ -386,6 +401,139 @@ private:
   int mPos;
 };
 
+/** Streaming writer for multi-megabyte states. Data is appended into fixed-size segments, so unlike IByteChunk::PutBytes() nothing
+ * already written is ever reallocated or copied while writing. The result can be streamed segment by segment with ForEachSegment()
+ * or flattened into an IByteChunk with a single allocation with CopyTo() */
+class ISegmentedByteWriter
+{
+public:
+  /** @param segmentSize The size of each segment (in bytes) */
+  ISegmentedByteWriter(int segmentSize = 1 << 20)
+  : mSegmentSize(std::max(segmentSize, 64))
+  {
+  }
+
+  ISegmentedByteWriter(const ISegmentedByteWriter&) = delete;
+  ISegmentedByteWriter& operator=(const ISegmentedByteWriter&) = delete;
+
+  ~ISegmentedByteWriter()
+  {
+    mSegments.Empty(true);
+  }
+
+  /** Copies data onto the end of the writer, adding segments as needed
+   * @param pSrc Pointer to the data to copy
+   * @param nBytesToCopy Number of bytes to copy
+   * @return int The total size written so far, or -1 if a segment could not be allocated */
+  int PutBytes(const void* pSrc, int nBytesToCopy)
+  {
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pSrc);
+
+    while (nBytesToCopy > 0)
+    {
+      WDL_TypedBuf<uint8_t>* pSegment = mSegments.Get(mSegments.GetSize() - 1);
+
+      if (!pSegment || pSegment->GetSize() == mSegmentSize)
+      {
+        pSegment = new WDL_TypedBuf<uint8_t>;
+
+        if (!pSegment->ResizeOK(mSegmentSize, false))
+        {
+          delete pSegment;
+          return -1;
+        }
+
+        pSegment->Resize(0, false);
+        mSegments.Add(pSegment);
+      }
+
+      const int used = pSegment->GetSize();
+      const int n = std::min(nBytesToCopy, mSegmentSize - used);
+      pSegment->Resize(used + n, false);
+      memcpy(pSegment->Get() + used, pBytes, n);
+      pBytes += n;
+      nBytesToCopy -= n;
+      mSize += n;
+    }
+
+    return mSize;
+  }
+
+  /** Copies arbitary typed data onto the end of the writer
+   * @tparam T The type of data to be stored
+   * @param pVal Ptr to the data to be stored
+   * @return int The total size written so far */
+  template <class T>
+  int Put(const T* pVal)
+  {
+    return PutBytes(pVal, sizeof(T));
+  }
+
+  /** Put a string, in the same format as IByteChunk::PutStr()
+   * @param str CString to insert
+   * @return int The total size written so far */
+  int PutStr(const char* str)
+  {
+    int slen = (int) strlen(str);
+    Put(&slen);
+    return PutBytes(str, slen);
+  }
+
+  /** Put the contents of an IByteChunk
+   * @param pRHS Ptr to the IByteChunk to copy in
+   * @return int The total size written so far */
+  int PutChunk(const IByteChunk* pRHS)
+  {
+    return PutBytes(pRHS->GetData(), pRHS->Size());
+  }
+
+  /** @return The total size written (in bytes) */
+  int Size() const { return mSize; }
+
+  /** Frees all segments */
+  void Clear()
+  {
+    mSegments.Empty(true);
+    mSize = 0;
+  }
+
+  /** Calls \c func(const uint8_t* pData, int size) for each segment in order, e.g. to write them to a host stream.
+   * @param func Returns \c false to stop early
+   * @return \c true if every segment was visited */
+  template <class F>
+  bool ForEachSegment(F func) const
+  {
+    for (int i = 0; i < mSegments.GetSize(); i++)
+    {
+      const WDL_TypedBuf<uint8_t>* pSegment = mSegments.Get(i);
+
+      if (!func(static_cast<const uint8_t*>(pSegment->Get()), pSegment->GetSize()))
+        return false;
+    }
+
+    return true;
+  }
+
+  /** Appends everything written to \c chunk, growing it only once
+   * @param chunk The destination chunk
+   * @return \c true if the chunk could be allocated */
+  bool CopyTo(IByteChunk& chunk) const
+  {
+    if (!chunk.Reserve(chunk.Size() + mSize))
+      return false;
+
+    return ForEachSegment([&chunk](const uint8_t* pData, int size) {
+      chunk.PutBytes(pData, size);
+      return true;
+    });
+  }
+
+private:
+  int mSegmentSize;
+  int mSize = 0;
+  WDL_PtrList<WDL_TypedBuf<uint8_t>> mSegments;
+};
+
 /** Helper struct to set compile time options to an API class constructor  */
 struct Config
 {
@@ -105,6 +105,32 @@ static inline double AmpToDB(double amp)
   return AMP_DB * std::log(std::fabs(amp));
 }
 
+/** Check if a buffer is silent, stopping at the first block of samples that isn't. The inner loop has no branches,
+ * so the compiler vectorises it into SIMD compares
+ * @param pBuffer The samples
+ * @param nFrames The number of samples
+ * @param threshold The largest absolute value that counts as silence
+ * @return \c true if no sample's absolute value is above the threshold */
+template <typename T>
+inline bool IsSilent(const T* pBuffer, int nFrames, T threshold)
+{
+  constexpr int kChunkSize = 64;
+
+  for (int start = 0; start < nFrames; start += kChunkSize)
+  {
+    const int end = std::min(start + kChunkSize, nFrames);
+    int loud = 0;
+
+    for (int i = start; i < end; i++)
+      loud |= std::abs(pBuffer[i]) > threshold;
+
+    if (loud)
+      return false;
+  }
+
+  return true;
+}
+
 /** Helper function to unpack the version number parts as individual integers
  * @param versionInteger The version number packed into an integer
  * @param maj The major version
@@ -53,18 +53,23 @@ struct IPlugVST3State
     
     IByteChunk chunk;
     
-    const int bytesPerBlock = 128;
-    char buffer[bytesPerBlock];
+    // read straight into the chunk, large states can be many MB
+    const int bytesPerBlock = 65536;
     
     while(true)
     {
+      const int pos = chunk.Size();
+      chunk.Resize(pos + bytesPerBlock);
+      
       Steinberg::int32 bytesRead = 0;
-      auto status = pState->read(buffer, (Steinberg::int32) bytesPerBlock, &bytesRead);
+      auto status = pState->read(chunk.GetData() + pos, (Steinberg::int32) bytesPerBlock, &bytesRead);
       
-      if (bytesRead <= 0 || (status != Steinberg::kResultTrue && pPlug->GetHost() != kHostWaveLab))
-        break;
+      const bool readOK = bytesRead > 0 && (status == Steinberg::kResultTrue || pPlug->GetHost() == kHostWaveLab);
       
-      chunk.PutBytes(buffer, bytesRead);
+      chunk.Resize(pos + (readOK ? bytesRead : 0));
+      
+      if (!readOK)
+        break;
     }
     int pos = pPlug->UnserializeState(chunk,0);
     
@@ -418,6 +418,17 @@ void IPlugVST3ProcessorBase::ProcessAudio(ProcessData& data, ProcessSetup& setup
       mPlug.mParams_mutex.Leave();
 #endif
     }
+
+    if (GetSilenceDetection())
+    {
+      // tell the host which output channels are silent, so that it can skip processing them downstream
+      for (int outBus = 0; outBus < data.numOutputs; outBus++)
+      {
+        const int32 nChans = data.outputs[outBus].numChannels;
+        const uint64 allChans = nChans >= 64 ? ~uint64(0) : (uint64(1) << nChans) - 1;
+        data.outputs[outBus].silenceFlags = GetOutputIsSilent() ? allChans : 0;
+      }
+    }
   }
 }
 
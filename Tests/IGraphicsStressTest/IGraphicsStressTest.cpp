@@ -2,6 +2,9 @@
 #include "IPlug_include_in_plug_src.h"
 
 #include "IControls.h"
+#include "IGraphicsProfiler.h"
+
+#include <cstdio>
 
 IGraphicsStressTest::IGraphicsStressTest(const InstanceInfo& info)
 : Plugin(info, MakeConfig(kNumParams, 1))
@@ -33,6 +36,7 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     pGraphics->GetBackgroundControl()->SetTargetAndDrawRECTs(bounds);
 
     pGraphics->GetControl(1)->SetTargetAndDrawRECTs(visualsArea);
+    pGraphics->GetControlWithTag(kCtrlTagMultiSlider)->SetTargetAndDrawRECTs(visualsArea);
     pGraphics->GetControlWithTag(kCtrlTagNumThings)->SetTargetAndDrawRECTs(labelsArea.GetGridCell(0, 1, 2));
     pGraphics->GetControlWithTag(kCtrlTagTestNum)->SetTargetAndDrawRECTs(labelsArea.GetGridCell(1, 1, 2));
     
@@ -44,7 +48,7 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
   
   pGraphics->AttachCornerResizer(EUIResizerMode::Size, true);
   
-  enum class EFunc {Next, Prev, More, Less, Set};
+  enum class EFunc {Next, Prev, More, Less, Set, Profile};
   
   auto DoFunc = [&](EFunc func, int thing = 0){
     switch (func) {
@@ -53,28 +57,63 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
       case EFunc::More: this->mNumberOfThings++; break;
       case EFunc::Less: this->mNumberOfThings--; break;
       case EFunc::Set: this->mKindOfThing = thing; break;
+      case EFunc::Profile:
+        GetUI()->EnableProfiler(true);
+        GetUI()->GetProfiler()->Reset();
+        this->mProfileRunFrame = 0;
+        this->mKindOfThing = 1;
+        break;
       default:
         break;
     }
     
-    GetUI()->GetControlWithTag(kCtrlTagNumThings)->As<ITextControl>()->SetStrFmt(64, "Number of things = %i", mNumberOfThings);
+    // tests 13 and 14 draw a multislider with kNumMultiSliderTracks tracks, with and without batched drawing
+    auto* pMultiSlider = GetUI()->GetControlWithTag(kCtrlTagMultiSlider)->As<IVMultiSliderControl<kNumMultiSliderTracks>>();
+    const bool multiSliderTest = this->mKindOfThing == 13 || this->mKindOfThing == 14;
+    pMultiSlider->Hide(!multiSliderTest);
+    pMultiSlider->SetDrawBatched(this->mKindOfThing == 14);
+    
+    GetUI()->GetControlWithTag(kCtrlTagNumThings)->As<ITextControl>()->SetStrFmt(64, "Number of things = %i", multiSliderTest ? kNumMultiSliderTracks : mNumberOfThings);
     GetUI()->GetControlWithTag(kCtrlTagTestNum)->As<ITextControl>()->SetStrFmt(64, "Test %i/%i", this->mKindOfThing, 32);
     GetUI()->SetAllControlsDirty();
   };
   
-  pGraphics->SetKeyHandlerFunc([DoFunc](const IKeyPress& key, bool isUp)
+  pGraphics->SetKeyHandlerFunc([DoFunc, pGraphics](const IKeyPress& key, bool isUp)
   {
     if(!isUp) {
       switch (key.VK) {
         case kVK_UP: DoFunc(EFunc::More); return true;
         case kVK_DOWN: DoFunc(EFunc::Less); return true;
         case kVK_TAB: key.S ? DoFunc(EFunc::Prev) : DoFunc(EFunc::Next); return true;
+        case kVK_P: pGraphics->ShowProfilerDisplay(!pGraphics->ShowingProfilerDisplay()); return true;
+        case kVK_R: DoFunc(EFunc::Profile); return true;
         default: return false;
       }
     }
     return false;
   });
   
+  // when running all the tests with the profiler, report the p50/p99 costs of each test after kProfileFramesPerTest frames
+  pGraphics->SetDisplayTickFunc([&, DoFunc]() {
+    if(this->mProfileRunFrame < 0 || ++this->mProfileRunFrame < kProfileFramesPerTest)
+      return;
+    
+    WDL_String report;
+    GetUI()->GetProfiler()->GetReport(report);
+    // stdout rather than DBGMSG, so that release builds print the report too
+    printf("IGraphicsStressTest: test %i, %i things\n%s\n", this->mKindOfThing, this->mNumberOfThings, report.Get());
+    fflush(stdout);
+    GetUI()->GetProfiler()->Reset();
+    
+    if(this->mKindOfThing < kNumTests - 1)
+    {
+      this->mProfileRunFrame = 0;
+      DoFunc(EFunc::Next);
+    }
+    else
+      this->mProfileRunFrame = -1;
+  });
+  
   pGraphics->EnableMouseOver(false);
   pGraphics->LoadFont("Roboto-Regular", ROBOTO_FN);
   pGraphics->AttachPanelBackground(COLOR_GRAY);
@@ -132,6 +171,17 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     
   }, 10000, false, false));
   
+  pGraphics->AttachControl(new IVMultiSliderControl<kNumMultiSliderTracks>(visualsArea, "", DEFAULT_STYLE.WithDrawShadows(false)), kCtrlTagMultiSlider);
+  pGraphics->GetControlWithTag(kCtrlTagMultiSlider)->As<IVMultiSliderControl<kNumMultiSliderTracks>>()->SetTrackPadding(0.f);
+  
+  for (int i=0; i<kNumMultiSliderTracks; i++)
+  {
+    pGraphics->GetControlWithTag(kCtrlTagMultiSlider)->SetValue(0.5 + 0.4 * std::sin(i * 0.01) * std::cos(i * 0.0013), i);
+  }
+  
+  pGraphics->GetControlWithTag(kCtrlTagMultiSlider)->SetAnimation([](IControl* pCaller) { pCaller->SetDirty(false); }); // redraw every frame
+  pGraphics->GetControlWithTag(kCtrlTagMultiSlider)->Hide(true);
+  
   pGraphics->AttachControl(new ITextControl(labelsArea.GetGridCell(0, 1, 2), "", IText(20)), kCtrlTagNumThings);
   pGraphics->AttachControl(new ITextControl(labelsArea.GetGridCell(1, 1, 2), "", IText(20)), kCtrlTagTestNum);
   
@@ -144,7 +194,7 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
       switch (button){
         case 0:
         {
-          static IPopupMenu menu {"Test", {"Start", "DrawRect", "FillRect", "DrawRoundRect", "FillRoundRect", "DrawEllipse", "FillEllipse", "DrawArc", "FillArc", "DrawLine", "DrawDottedLine", "DrawFittedBitmap", "DrawSVG"},
+          static IPopupMenu menu {"Test", {"Start", "DrawRect", "FillRect", "DrawRoundRect", "FillRoundRect", "DrawEllipse", "FillEllipse", "DrawArc", "FillArc", "DrawLine", "DrawDottedLine", "DrawFittedBitmap", "DrawSVG", "IVMultiSlider", "IVMultiSlider (batched)"},
             [DoFunc](IPopupMenu* pMenu) {
               DoFunc(EFunc::Set, pMenu->GetChosenItemIdx());
             }};
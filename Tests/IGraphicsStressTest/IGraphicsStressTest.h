@@ -17,9 +17,14 @@ enum EControlTags
   kCtrlTagButton3,
   kCtrlTagButton4,
   kCtrlTagButton5,
-  kCtrlTagButton6
+  kCtrlTagButton6,
+  kCtrlTagMultiSlider
 };
 
+constexpr int kNumMultiSliderTracks = 4096;
+constexpr int kNumTests = 15;
+constexpr int kProfileFramesPerTest = 120;
+
 using namespace iplug;
 using namespace igraphics;
 
@@ -33,5 +38,6 @@ public:
 public:
   int mNumberOfThings = 16;
   int mKindOfThing = 0;
+  int mProfileRunFrame = -1; // >= 0 while running all the tests with the profiler
 #endif
 };
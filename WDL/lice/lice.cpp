@@ -18,6 +18,7 @@
 
 #include "lice_combine.h"
 #include "lice_extended.h"
+#include "lice_simd.h"
 
 #ifndef _WIN32
 #include "../swell/swell.h"
@@ -1068,6 +1069,20 @@ static void LICE_BlitInt(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int ds
   else 
   {
     int ia=(int)(alpha*256.0);
+
+    // the row kernels read a group of source pixels before writing, so leave overlapping self-blits to the scalar code
+    _LICE_SIMD_RowFunc rowfunc = src != dest ? _LICE_SIMD_GetBlitFunc(mode,ia) : NULL;
+    if (rowfunc)
+    {
+      while (i-->0)
+      {
+        rowfunc((LICE_pixel *)pdest,(const LICE_pixel *)psrc,cpsize,ia);
+        pdest+=dest_span;
+        psrc += src_span;
+      }
+      return;
+    }
+
     #ifdef LICE_FAVOR_SIZE
         LICE_COMBINEFUNC blitfunc=NULL;      
         #define __LICE__ACTION(comb) blitfunc=comb::doPix;
@@ -1467,6 +1482,12 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
     }
     else
     {
+      if ((mode&(LICE_BLIT_FILTER_MASK|LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))==(LICE_BLIT_FILTER_BILINEAR|LICE_BLIT_MODE_COPY) && ia==256 &&
+          src != dest && _LICE_SIMD_ScaleBlitBilinear(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span))
+      {
+        return;
+      }
+
       #ifdef LICE_FAVOR_SIZE
         LICE_COMBINEFUNC blitfunc=NULL;      
         #define __LICE__ACTION(comb) blitfunc=comb::doPix;
@@ -421,6 +421,10 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty,
 
 void LICE_HalveBlitAA(LICE_IBitmap *dest, LICE_IBitmap *src); // AA's src down to dest. uses the minimum size of both (use with LICE_SubBitmap to do sections)
 
+// LICE_Blit() copy/add/multiply and bilinear LICE_ScaledBlit() copy use SSE4.1/AVX2/NEON kernels when available (see lice_simd.h)
+// level: -1=best available, 0=scalar code only, 1=SSE4.1, 2=AVX2, 3=NEON. returns the level in use
+int LICE_SetSIMDLevel(int level);
+
 // if cliptosourcerect is false, then areas outside the source rect can get in (otherwise they are not drawn)
 void LICE_RotatedBlit(LICE_IBitmap *dest, LICE_IBitmap *src, 
                       int dstx, int dsty, int dstw, int dsth, 
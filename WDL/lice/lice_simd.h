@@ -0,0 +1,551 @@
+/*
+  Cockos WDL - LICE - Lightweight Image Compositing Engine
+  Copyright (C) 2007 and later, Cockos Incorporated
+  File: lice_simd.h (SIMD blit kernels, included by lice.cpp)
+  See lice.h for license and other information
+
+  SSE4.1/AVX2 (selected at runtime) and NEON versions of the common LICE_Blit() modes
+  (copy with constant alpha, copy with source alpha, add and multiply, with or without source alpha)
+  and of bilinear LICE_ScaledBlit() with copy at alpha 1.0.
+
+  The results are identical to the scalar combiners in lice_combine.h, which remain the reference:
+  LICE_SetSIMDLevel(0) disables these kernels. Define LICE_NO_SIMD to leave them out.
+*/
+
+#ifndef _LICE_SIMD_H_
+#define _LICE_SIMD_H_
+
+#if !defined(LICE_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+  #define LICE_SIMD_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif !defined(LICE_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+  #define LICE_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define LICE_SIMD_TARGET(x) __attribute__((target(x)))
+#else
+  #define LICE_SIMD_TARGET(x)
+#endif
+
+enum
+{
+  _LICE_SIMD_OP_COPY=0, // constant alpha 1..255
+  _LICE_SIMD_OP_COPY_SRCALPHA,
+  _LICE_SIMD_OP_ADD,
+  _LICE_SIMD_OP_ADD_SRCALPHA,
+  _LICE_SIMD_OP_MUL,
+  _LICE_SIMD_OP_MUL_SRCALPHA,
+  _LICE_SIMD_NUM_OPS
+};
+
+typedef void (*_LICE_SIMD_RowFunc)(LICE_pixel *dest, const LICE_pixel *src, int n, int ia);
+typedef void (*_LICE_SIMD_BilinearRowFunc)(LICE_pixel *dest, const LICE_pixel_chan *inptr, int src_span, int n, int curx, int idx, unsigned int clipright, unsigned int yfrac);
+
+static int _LICE_simd_level=-1;
+static _LICE_SIMD_RowFunc _LICE_simd_rowfuncs[_LICE_SIMD_NUM_OPS];
+static _LICE_SIMD_BilinearRowFunc _LICE_simd_bilinearfunc;
+
+// exact versions of the per channel arithmetic in lice_combine.h, on 16 bit lanes (4 lanes per pixel):
+// copy:  s + (d-s)*sc/256, truncated towards zero as C division is: sign(d-s) * ((|d-s|*sc)>>8), |d-s|*sc < 65536
+// add:   d + (s*u)>>8
+// mul:   (d*(65536-u*(256-s)))>>16, which is (d*(da+s*u))>>16 with da=(256-u)*256. Only u==0 needs 17 bits, callers mask it
+
+#ifdef LICE_SIMD_X86
+
+#define _LICE_SIMD_SHUF_A(p) (char)((p)*8+LICE_PIXEL_A*2),(char)((p)*8+LICE_PIXEL_A*2+1)
+#define _LICE_SIMD_SHUF_A4(p) _LICE_SIMD_SHUF_A(p),_LICE_SIMD_SHUF_A(p),_LICE_SIMD_SHUF_A(p),_LICE_SIMD_SHUF_A(p)
+#define _LICE_SIMD_MASK_A(c) (short)((c)==LICE_PIXEL_A ? -1 : 0)
+#define _LICE_SIMD_MASK_A4 _LICE_SIMD_MASK_A(0),_LICE_SIMD_MASK_A(1),_LICE_SIMD_MASK_A(2),_LICE_SIMD_MASK_A(3)
+
+LICE_SIMD_TARGET("sse4.1") static inline __m128i _LICE_SSE_Combine(int op, __m128i d, __m128i s, __m128i ia, bool ia256)
+{
+  const __m128i shufA = _mm_setr_epi8(_LICE_SIMD_SHUF_A4(0),_LICE_SIMD_SHUF_A4(1));
+  const __m128i maskA = _mm_setr_epi16(_LICE_SIMD_MASK_A4,_LICE_SIMD_MASK_A4);
+  const __m128i c255 = _mm_set1_epi16(255), c256 = _mm_set1_epi16(256), zero = _mm_setzero_si128();
+
+  switch (op)
+  {
+    case _LICE_SIMD_OP_COPY:
+    {
+      const __m128i diff = _mm_sub_epi16(d,s);
+      const __m128i q = _mm_srli_epi16(_mm_mullo_epi16(_mm_abs_epi16(diff),_mm_sub_epi16(c256,ia)),8);
+      return _mm_add_epi16(s,_mm_sign_epi16(q,diff));
+    }
+    case _LICE_SIMD_OP_COPY_SRCALPHA:
+    {
+      const __m128i a = _mm_shuffle_epi8(s,shufA);
+      __m128i sc, u;
+      if (ia256) { sc = _mm_sub_epi16(c255,a); u = a; }
+      else { u = _mm_srli_epi16(_mm_mullo_epi16(ia,_mm_add_epi16(a,_mm_set1_epi16(1))),8); sc = _mm_sub_epi16(c256,u); }
+      const __m128i diff = _mm_sub_epi16(d,s);
+      const __m128i q = _mm_srli_epi16(_mm_mullo_epi16(_mm_abs_epi16(diff),sc),8);
+      __m128i r = _mm_blendv_epi8(_mm_add_epi16(s,_mm_sign_epi16(q,diff)),_mm_min_epi16(c255,_mm_add_epi16(u,d)),maskA);
+      return _mm_blendv_epi8(r,d,_mm_cmpeq_epi16(a,zero));
+    }
+    case _LICE_SIMD_OP_ADD:
+      return _mm_min_epi16(c255,_mm_add_epi16(d,_mm_srli_epi16(_mm_mullo_epi16(s,ia),8)));
+    case _LICE_SIMD_OP_ADD_SRCALPHA:
+    {
+      const __m128i a = _mm_shuffle_epi8(s,shufA);
+      const __m128i a1 = _mm_add_epi16(a,_mm_set1_epi16(1));
+      const __m128i u = ia256 ? a1 : _mm_srli_epi16(_mm_mullo_epi16(ia,a1),8);
+      const __m128i r = _mm_min_epi16(c255,_mm_add_epi16(d,_mm_srli_epi16(_mm_mullo_epi16(s,u),8)));
+      return _mm_blendv_epi8(r,d,_mm_cmpeq_epi16(a,zero));
+    }
+    case _LICE_SIMD_OP_MUL:
+      return _mm_mulhi_epu16(d,_mm_sub_epi16(zero,_mm_mullo_epi16(ia,_mm_sub_epi16(c256,s))));
+    case _LICE_SIMD_OP_MUL_SRCALPHA:
+    {
+      const __m128i a = _mm_shuffle_epi8(s,shufA);
+      const __m128i a1 = _mm_add_epi16(a,_mm_set1_epi16(1));
+      const __m128i u = ia256 ? a1 : _mm_srli_epi16(_mm_mullo_epi16(ia,a1),8);
+      const __m128i r = _mm_mulhi_epu16(d,_mm_sub_epi16(zero,_mm_mullo_epi16(u,_mm_sub_epi16(c256,s))));
+      return _mm_blendv_epi8(r,d,_mm_or_si128(_mm_cmpeq_epi16(a,zero),_mm_cmpeq_epi16(u,zero)));
+    }
+  }
+  return d;
+}
+
+template<int OP> LICE_SIMD_TARGET("sse4.1") static void _LICE_SSE_Row(LICE_pixel *dest, const LICE_pixel *src, int n, int ia)
+{
+  const __m128i via = _mm_set1_epi16((short)ia), zero = _mm_setzero_si128();
+  const bool ia256 = ia >= 256;
+  while (n > 0)
+  {
+    LICE_pixel dtmp[4], stmp[4];
+    LICE_pixel *pd = dest;
+    const LICE_pixel *ps = src;
+    if (n < 4)
+    {
+      memcpy(dtmp,dest,n*sizeof(LICE_pixel));
+      memcpy(stmp,src,n*sizeof(LICE_pixel));
+      pd = dtmp;
+      ps = stmp;
+    }
+    const __m128i d = _mm_loadu_si128((const __m128i *)pd), s = _mm_loadu_si128((const __m128i *)ps);
+    const __m128i lo = _LICE_SSE_Combine(OP,_mm_cvtepu8_epi16(d),_mm_cvtepu8_epi16(s),via,ia256);
+    const __m128i hi = _LICE_SSE_Combine(OP,_mm_unpackhi_epi8(d,zero),_mm_unpackhi_epi8(s,zero),via,ia256);
+    _mm_storeu_si128((__m128i *)pd,_mm_packus_epi16(lo,hi));
+    if (n < 4)
+    {
+      memcpy(dest,dtmp,n*sizeof(LICE_pixel));
+      return;
+    }
+    dest += 4;
+    src += 4;
+    n -= 4;
+  }
+}
+
+LICE_SIMD_TARGET("avx2") static inline __m256i _LICE_AVX2_Combine(int op, __m256i d, __m256i s, __m256i ia, bool ia256)
+{
+  const __m256i shufA = _mm256_setr_epi8(_LICE_SIMD_SHUF_A4(0),_LICE_SIMD_SHUF_A4(1),_LICE_SIMD_SHUF_A4(0),_LICE_SIMD_SHUF_A4(1));
+  const __m256i maskA = _mm256_setr_epi16(_LICE_SIMD_MASK_A4,_LICE_SIMD_MASK_A4,_LICE_SIMD_MASK_A4,_LICE_SIMD_MASK_A4);
+  const __m256i c255 = _mm256_set1_epi16(255), c256 = _mm256_set1_epi16(256), zero = _mm256_setzero_si256();
+
+  switch (op)
+  {
+    case _LICE_SIMD_OP_COPY:
+    {
+      const __m256i diff = _mm256_sub_epi16(d,s);
+      const __m256i q = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_abs_epi16(diff),_mm256_sub_epi16(c256,ia)),8);
+      return _mm256_add_epi16(s,_mm256_sign_epi16(q,diff));
+    }
+    case _LICE_SIMD_OP_COPY_SRCALPHA:
+    {
+      const __m256i a = _mm256_shuffle_epi8(s,shufA);
+      __m256i sc, u;
+      if (ia256) { sc = _mm256_sub_epi16(c255,a); u = a; }
+      else { u = _mm256_srli_epi16(_mm256_mullo_epi16(ia,_mm256_add_epi16(a,_mm256_set1_epi16(1))),8); sc = _mm256_sub_epi16(c256,u); }
+      const __m256i diff = _mm256_sub_epi16(d,s);
+      const __m256i q = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_abs_epi16(diff),sc),8);
+      __m256i r = _mm256_blendv_epi8(_mm256_add_epi16(s,_mm256_sign_epi16(q,diff)),_mm256_min_epi16(c255,_mm256_add_epi16(u,d)),maskA);
+      return _mm256_blendv_epi8(r,d,_mm256_cmpeq_epi16(a,zero));
+    }
+    case _LICE_SIMD_OP_ADD:
+      return _mm256_min_epi16(c255,_mm256_add_epi16(d,_mm256_srli_epi16(_mm256_mullo_epi16(s,ia),8)));
+    case _LICE_SIMD_OP_ADD_SRCALPHA:
+    {
+      const __m256i a = _mm256_shuffle_epi8(s,shufA);
+      const __m256i a1 = _mm256_add_epi16(a,_mm256_set1_epi16(1));
+      const __m256i u = ia256 ? a1 : _mm256_srli_epi16(_mm256_mullo_epi16(ia,a1),8);
+      const __m256i r = _mm256_min_epi16(c255,_mm256_add_epi16(d,_mm256_srli_epi16(_mm256_mullo_epi16(s,u),8)));
+      return _mm256_blendv_epi8(r,d,_mm256_cmpeq_epi16(a,zero));
+    }
+    case _LICE_SIMD_OP_MUL:
+      return _mm256_mulhi_epu16(d,_mm256_sub_epi16(zero,_mm256_mullo_epi16(ia,_mm256_sub_epi16(c256,s))));
+    case _LICE_SIMD_OP_MUL_SRCALPHA:
+    {
+      const __m256i a = _mm256_shuffle_epi8(s,shufA);
+      const __m256i a1 = _mm256_add_epi16(a,_mm256_set1_epi16(1));
+      const __m256i u = ia256 ? a1 : _mm256_srli_epi16(_mm256_mullo_epi16(ia,a1),8);
+      const __m256i r = _mm256_mulhi_epu16(d,_mm256_sub_epi16(zero,_mm256_mullo_epi16(u,_mm256_sub_epi16(c256,s))));
+      return _mm256_blendv_epi8(r,d,_mm256_or_si256(_mm256_cmpeq_epi16(a,zero),_mm256_cmpeq_epi16(u,zero)));
+    }
+  }
+  return d;
+}
+
+template<int OP> LICE_SIMD_TARGET("avx2") static void _LICE_AVX2_Row(LICE_pixel *dest, const LICE_pixel *src, int n, int ia)
+{
+  const __m256i via = _mm256_set1_epi16((short)ia);
+  const bool ia256 = ia >= 256;
+  while (n > 0)
+  {
+    LICE_pixel dtmp[8], stmp[8];
+    LICE_pixel *pd = dest;
+    const LICE_pixel *ps = src;
+    if (n < 8)
+    {
+      memcpy(dtmp,dest,n*sizeof(LICE_pixel));
+      memcpy(stmp,src,n*sizeof(LICE_pixel));
+      pd = dtmp;
+      ps = stmp;
+    }
+    const __m128i d0 = _mm_loadu_si128((const __m128i *)pd), d1 = _mm_loadu_si128((const __m128i *)pd + 1);
+    const __m128i s0 = _mm_loadu_si128((const __m128i *)ps), s1 = _mm_loadu_si128((const __m128i *)ps + 1);
+    const __m256i lo = _LICE_AVX2_Combine(OP,_mm256_cvtepu8_epi16(d0),_mm256_cvtepu8_epi16(s0),via,ia256);
+    const __m256i hi = _LICE_AVX2_Combine(OP,_mm256_cvtepu8_epi16(d1),_mm256_cvtepu8_epi16(s1),via,ia256);
+    // packus works within 128 bit lanes, restore the pixel order
+    _mm256_storeu_si256((__m256i *)pd,_mm256_permute4x64_epi64(_mm256_packus_epi16(lo,hi),0xd8));
+    if (n < 8)
+    {
+      memcpy(dest,dtmp,n*sizeof(LICE_pixel));
+      return;
+    }
+    dest += 8;
+    src += 8;
+    n -= 8;
+  }
+}
+
+// one pixel per iteration: the 16.16 weights need 32 bit products to match __LICE_BilinearFilterI exactly
+LICE_SIMD_TARGET("sse4.1") static void _LICE_SSE_BilinearRow(LICE_pixel *dest, const LICE_pixel_chan *inptr, int src_span, int n, int curx, int idx, unsigned int clipright, unsigned int yfrac)
+{
+  while (n-- > 0)
+  {
+    const unsigned int offs = (unsigned int)curx >> 16;
+    const LICE_pixel_chan *pin = inptr + offs*sizeof(LICE_pixel);
+    if (offs < clipright-1)
+    {
+      const unsigned int xfrac = curx&0xffff;
+      const unsigned int f4=(xfrac*yfrac)>>16;
+      const unsigned int f3=yfrac-f4;
+      const unsigned int f2=xfrac-f4;
+      const unsigned int f1=65536-yfrac-xfrac+f4;
+      const __m128i top = _mm_loadl_epi64((const __m128i *)pin), bot = _mm_loadl_epi64((const __m128i *)(pin+src_span));
+      __m128i sum = _mm_mullo_epi32(_mm_cvtepu8_epi32(top),_mm_set1_epi32((int)f1));
+      sum = _mm_add_epi32(sum,_mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(top,4)),_mm_set1_epi32((int)f2)));
+      sum = _mm_add_epi32(sum,_mm_mullo_epi32(_mm_cvtepu8_epi32(bot),_mm_set1_epi32((int)f3)));
+      sum = _mm_add_epi32(sum,_mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(bot,4)),_mm_set1_epi32((int)f4)));
+      const __m128i v = _mm_srli_epi32(sum,16);
+      *dest = (LICE_pixel)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(v,v),v));
+    }
+    else if (offs == clipright-1)
+    {
+      __LICE_LinearFilterIPixOut((LICE_pixel_chan *)dest,pin,pin+src_span,yfrac);
+    }
+    dest++;
+    curx += idx;
+  }
+}
+
+LICE_SIMD_TARGET("avx2") static void _LICE_AVX2_BilinearRow(LICE_pixel *dest, const LICE_pixel_chan *inptr, int src_span, int n, int curx, int idx, unsigned int clipright, unsigned int yfrac)
+{
+  while (n-- > 0)
+  {
+    const unsigned int offs = (unsigned int)curx >> 16;
+    const LICE_pixel_chan *pin = inptr + offs*sizeof(LICE_pixel);
+    if (offs < clipright-1)
+    {
+      const unsigned int xfrac = curx&0xffff;
+      const unsigned int f4=(xfrac*yfrac)>>16;
+      const unsigned int f3=yfrac-f4;
+      const unsigned int f2=xfrac-f4;
+      const unsigned int f1=65536-yfrac-xfrac+f4;
+      // both pixels of a row in one register, [f1 x4, f2 x4] and [f3 x4, f4 x4]
+      const __m256i top = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)pin));
+      const __m256i bot = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pin+src_span)));
+      const __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(top,_mm256_setr_epi32(f1,f1,f1,f1,f2,f2,f2,f2)),
+                                           _mm256_mullo_epi32(bot,_mm256_setr_epi32(f3,f3,f3,f3,f4,f4,f4,f4)));
+      const __m128i v = _mm_srli_epi32(_mm_add_epi32(_mm256_castsi256_si128(sum),_mm256_extracti128_si256(sum,1)),16);
+      *dest = (LICE_pixel)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(v,v),v));
+    }
+    else if (offs == clipright-1)
+    {
+      __LICE_LinearFilterIPixOut((LICE_pixel_chan *)dest,pin,pin+src_span,yfrac);
+    }
+    dest++;
+    curx += idx;
+  }
+}
+
+static int _LICE_SIMD_Detect()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info,0);
+  if (info[0] < 1) return 0;
+  __cpuid(info,1);
+  const bool sse41 = (info[2] & (1<<19)) != 0;
+  const bool osxsave = (info[2] & (1<<27)) != 0, avx = (info[2] & (1<<28)) != 0;
+  bool avx2 = false;
+  if (sse41 && osxsave && avx && (_xgetbv(0) & 6) == 6 && info[0] >= 7)
+  {
+    __cpuidex(info,7,0);
+    avx2 = (info[1] & (1<<5)) != 0;
+  }
+  return avx2 ? 2 : sse41 ? 1 : 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse4.1") ? 1 : 0;
+#endif
+}
+
+#define _LICE_SIMD_SETROWFUNCS(impl) \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY] = impl<_LICE_SIMD_OP_COPY>; \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY_SRCALPHA] = impl<_LICE_SIMD_OP_COPY_SRCALPHA>; \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD] = impl<_LICE_SIMD_OP_ADD>; \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD_SRCALPHA] = impl<_LICE_SIMD_OP_ADD_SRCALPHA>; \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL] = impl<_LICE_SIMD_OP_MUL>; \
+  _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL_SRCALPHA] = impl<_LICE_SIMD_OP_MUL_SRCALPHA>;
+
+static void _LICE_SIMD_Select(int level)
+{
+  if (level == 2) { _LICE_SIMD_SETROWFUNCS(_LICE_AVX2_Row) _LICE_simd_bilinearfunc = _LICE_AVX2_BilinearRow; }
+  else if (level == 1) { _LICE_SIMD_SETROWFUNCS(_LICE_SSE_Row) _LICE_simd_bilinearfunc = _LICE_SSE_BilinearRow; }
+}
+
+#undef _LICE_SIMD_SETROWFUNCS
+#undef _LICE_SIMD_SHUF_A
+#undef _LICE_SIMD_SHUF_A4
+#undef _LICE_SIMD_MASK_A
+#undef _LICE_SIMD_MASK_A4
+
+#elif defined(LICE_SIMD_NEON)
+
+static inline uint16x8_t _LICE_NEON_Neg(uint16x8_t x) { return vsubq_u16(vdupq_n_u16(0),x); }
+static inline int16x8_t _LICE_NEON_SignedQ(int16x8_t q, int16x8_t diff) { return vbslq_s16(vcltq_s16(diff,vdupq_n_s16(0)),vnegq_s16(q),q); }
+
+template<int OP> static inline uint16x8_t _LICE_NEON_Combine(uint16x8_t d, uint16x8_t s, uint16x8_t ia, bool ia256)
+{
+  static const uint16_t maskA_tab[8] = {
+    LICE_PIXEL_A==0 ? 0xffff : 0, LICE_PIXEL_A==1 ? 0xffff : 0, LICE_PIXEL_A==2 ? 0xffff : 0, LICE_PIXEL_A==3 ? 0xffff : 0,
+    LICE_PIXEL_A==0 ? 0xffff : 0, LICE_PIXEL_A==1 ? 0xffff : 0, LICE_PIXEL_A==2 ? 0xffff : 0, LICE_PIXEL_A==3 ? 0xffff : 0 };
+  const uint16x8_t c255 = vdupq_n_u16(255), c256 = vdupq_n_u16(256);
+
+  if (OP == _LICE_SIMD_OP_ADD)
+    return vminq_u16(c255,vaddq_u16(d,vshrq_n_u16(vmulq_u16(s,ia),8)));
+  if (OP == _LICE_SIMD_OP_MUL)
+  {
+    const uint16x8_t m = _LICE_NEON_Neg(vmulq_u16(ia,vsubq_u16(c256,s)));
+    return vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(d),vget_low_u16(m)),16),vshrn_n_u32(vmull_u16(vget_high_u16(d),vget_high_u16(m)),16));
+  }
+  if (OP == _LICE_SIMD_OP_COPY)
+  {
+    const int16x8_t diff = vreinterpretq_s16_u16(vsubq_u16(d,s));
+    const int16x8_t q = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vreinterpretq_u16_s16(vabsq_s16(diff)),vsubq_u16(c256,ia)),8));
+    return vreinterpretq_u16_s16(vaddq_s16(vreinterpretq_s16_u16(s),_LICE_NEON_SignedQ(q,diff)));
+  }
+
+  // source alpha modes: broadcast each pixel's alpha to its 4 lanes
+  const uint16x4_t alo = vdup_lane_u16(vget_low_u16(s),LICE_PIXEL_A), ahi = vdup_lane_u16(vget_high_u16(s),LICE_PIXEL_A);
+  const uint16x8_t a = vcombine_u16(alo,ahi), a1 = vaddq_u16(a,vdupq_n_u16(1));
+  const uint16x8_t az = vceqq_u16(a,vdupq_n_u16(0));
+  uint16x8_t r;
+
+  if (OP == _LICE_SIMD_OP_COPY_SRCALPHA)
+  {
+    uint16x8_t sc, u;
+    if (ia256) { sc = vsubq_u16(c255,a); u = a; }
+    else { u = vshrq_n_u16(vmulq_u16(ia,a1),8); sc = vsubq_u16(c256,u); }
+    const int16x8_t diff = vreinterpretq_s16_u16(vsubq_u16(d,s));
+    const int16x8_t q = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vreinterpretq_u16_s16(vabsq_s16(diff)),sc),8));
+    const uint16x8_t col = vreinterpretq_u16_s16(vaddq_s16(vreinterpretq_s16_u16(s),_LICE_NEON_SignedQ(q,diff)));
+    r = vbslq_u16(vld1q_u16(maskA_tab),vminq_u16(c255,vaddq_u16(u,d)),col);
+  }
+  else
+  {
+    const uint16x8_t u = ia256 ? a1 : vshrq_n_u16(vmulq_u16(ia,a1),8);
+    if (OP == _LICE_SIMD_OP_ADD_SRCALPHA)
+      r = vminq_u16(c255,vaddq_u16(d,vshrq_n_u16(vmulq_u16(s,u),8)));
+    else
+    {
+      const uint16x8_t m = _LICE_NEON_Neg(vmulq_u16(u,vsubq_u16(c256,s)));
+      r = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(d),vget_low_u16(m)),16),vshrn_n_u32(vmull_u16(vget_high_u16(d),vget_high_u16(m)),16));
+      return vbslq_u16(vorrq_u16(az,vceqq_u16(u,vdupq_n_u16(0))),d,r);
+    }
+  }
+  return vbslq_u16(az,d,r);
+}
+
+template<int OP> static void _LICE_NEON_Row(LICE_pixel *dest, const LICE_pixel *src, int n, int ia)
+{
+  const uint16x8_t via = vdupq_n_u16((uint16_t)ia);
+  const bool ia256 = ia >= 256;
+  while (n > 0)
+  {
+    LICE_pixel dtmp[4], stmp[4];
+    LICE_pixel *pd = dest;
+    const LICE_pixel *ps = src;
+    if (n < 4)
+    {
+      memcpy(dtmp,dest,n*sizeof(LICE_pixel));
+      memcpy(stmp,src,n*sizeof(LICE_pixel));
+      pd = dtmp;
+      ps = stmp;
+    }
+    const uint8x16_t d = vld1q_u8((const uint8_t *)pd), s = vld1q_u8((const uint8_t *)ps);
+    const uint16x8_t lo = _LICE_NEON_Combine<OP>(vmovl_u8(vget_low_u8(d)),vmovl_u8(vget_low_u8(s)),via,ia256);
+    const uint16x8_t hi = _LICE_NEON_Combine<OP>(vmovl_u8(vget_high_u8(d)),vmovl_u8(vget_high_u8(s)),via,ia256);
+    vst1q_u8((uint8_t *)pd,vcombine_u8(vqmovn_u16(lo),vqmovn_u16(hi)));
+    if (n < 4)
+    {
+      memcpy(dest,dtmp,n*sizeof(LICE_pixel));
+      return;
+    }
+    dest += 4;
+    src += 4;
+    n -= 4;
+  }
+}
+
+static void _LICE_NEON_BilinearRow(LICE_pixel *dest, const LICE_pixel_chan *inptr, int src_span, int n, int curx, int idx, unsigned int clipright, unsigned int yfrac)
+{
+  while (n-- > 0)
+  {
+    const unsigned int offs = (unsigned int)curx >> 16;
+    const LICE_pixel_chan *pin = inptr + offs*sizeof(LICE_pixel);
+    if (offs < clipright-1)
+    {
+      const unsigned int xfrac = curx&0xffff;
+      const unsigned int f4=(xfrac*yfrac)>>16;
+      const unsigned int f3=yfrac-f4;
+      const unsigned int f2=xfrac-f4;
+      const unsigned int f1=65536-yfrac-xfrac+f4;
+      const uint16x8_t top = vmovl_u8(vld1_u8(pin)), bot = vmovl_u8(vld1_u8(pin+src_span));
+      uint32x4_t sum = vmulq_n_u32(vmovl_u16(vget_low_u16(top)),f1);
+      sum = vmlaq_n_u32(sum,vmovl_u16(vget_high_u16(top)),f2);
+      sum = vmlaq_n_u32(sum,vmovl_u16(vget_low_u16(bot)),f3);
+      sum = vmlaq_n_u32(sum,vmovl_u16(vget_high_u16(bot)),f4);
+      const uint16x4_t v = vshrn_n_u32(sum,16);
+      vst1_lane_u32((uint32_t *)dest,vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(v,v))),0);
+    }
+    else if (offs == clipright-1)
+    {
+      __LICE_LinearFilterIPixOut((LICE_pixel_chan *)dest,pin,pin+src_span,yfrac);
+    }
+    dest++;
+    curx += idx;
+  }
+}
+
+static int _LICE_SIMD_Detect() { return 3; }
+
+static void _LICE_SIMD_Select(int level)
+{
+  if (level == 3)
+  {
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY] = _LICE_NEON_Row<_LICE_SIMD_OP_COPY>;
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY_SRCALPHA] = _LICE_NEON_Row<_LICE_SIMD_OP_COPY_SRCALPHA>;
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD] = _LICE_NEON_Row<_LICE_SIMD_OP_ADD>;
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD_SRCALPHA] = _LICE_NEON_Row<_LICE_SIMD_OP_ADD_SRCALPHA>;
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL] = _LICE_NEON_Row<_LICE_SIMD_OP_MUL>;
+    _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL_SRCALPHA] = _LICE_NEON_Row<_LICE_SIMD_OP_MUL_SRCALPHA>;
+    _LICE_simd_bilinearfunc = _LICE_NEON_BilinearRow;
+  }
+}
+
+#else
+
+static int _LICE_SIMD_Detect() { return 0; }
+static void _LICE_SIMD_Select(int level) { }
+
+#endif
+
+int LICE_SetSIMDLevel(int level)
+{
+  const int avail = _LICE_SIMD_Detect();
+  if (level < 0 || level > avail) level = avail;
+  // there is no SSE4.1-only NEON, etc: any other nonzero request means the best available
+  if (level && avail == 3) level = 3;
+
+  memset(_LICE_simd_rowfuncs,0,sizeof(_LICE_simd_rowfuncs));
+  _LICE_simd_bilinearfunc = NULL;
+  _LICE_SIMD_Select(level);
+  return _LICE_simd_level = level;
+}
+
+static inline void _LICE_SIMD_Init()
+{
+  if (_LICE_simd_level < 0) LICE_SetSIMDLevel(-1);
+}
+
+// returns the row function for a LICE_Blit() mode/alpha, or NULL if the scalar code should be used
+static _LICE_SIMD_RowFunc _LICE_SIMD_GetBlitFunc(int mode, int ia)
+{
+  _LICE_SIMD_Init();
+  if (ia <= 0 || ia > 256) return NULL;
+
+  switch (mode&(LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))
+  {
+    case LICE_BLIT_MODE_COPY: return ia < 256 ? _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY] : NULL;
+    case LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA: return _LICE_simd_rowfuncs[_LICE_SIMD_OP_COPY_SRCALPHA];
+#ifndef LICE_DISABLE_BLEND_ADD
+    case LICE_BLIT_MODE_ADD: return _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD];
+    case LICE_BLIT_MODE_ADD|LICE_BLIT_USE_ALPHA: return _LICE_simd_rowfuncs[_LICE_SIMD_OP_ADD_SRCALPHA];
+#endif
+#ifndef LICE_DISABLE_BLEND_MUL
+    case LICE_BLIT_MODE_MUL: return _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL];
+    case LICE_BLIT_MODE_MUL|LICE_BLIT_USE_ALPHA: return _LICE_simd_rowfuncs[_LICE_SIMD_OP_MUL_SRCALPHA];
+#endif
+  }
+  return NULL;
+}
+
+// LICE_ScaledBlit() with LICE_BLIT_FILTER_BILINEAR|LICE_BLIT_MODE_COPY at alpha 1.0, same arguments as _LICE_Template_Blit2::scaleBlit()
+// returns false if the scalar code should be used
+static bool _LICE_SIMD_ScaleBlitBilinear(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h,
+                                         int icurx, int icury, int idx, int idy, unsigned int clipright, unsigned int clipbottom,
+                                         int src_span, int dest_span)
+{
+  _LICE_SIMD_Init();
+  if (!_LICE_simd_bilinearfunc) return false;
+
+  while (h--)
+  {
+    const unsigned int cury = icury >> 16;
+    const LICE_pixel_chan *inptr=src + cury * src_span;
+    if (cury < clipbottom-1)
+    {
+      _LICE_simd_bilinearfunc((LICE_pixel *)dest,inptr,src_span,w,icurx,idx,clipright,icury&65535);
+    }
+    else if (cury == clipbottom-1)
+    {
+      int curx=icurx;
+      LICE_pixel *pout=(LICE_pixel *)dest;
+      int n=w;
+      while (n--)
+      {
+        const unsigned int offs=curx >> 16;
+        const LICE_pixel_chan *pin = inptr + offs*sizeof(LICE_pixel);
+        if (offs<clipright-1)
+          __LICE_LinearFilterIPixOut((LICE_pixel_chan *)pout,pin,pin+sizeof(LICE_pixel)/sizeof(LICE_pixel_chan),curx&0xffff);
+        else if (offs==clipright-1)
+          *pout = *(const LICE_pixel *)pin;
+        pout++;
+        curx+=idx;
+      }
+    }
+    dest+=dest_span;
+    icury+=idy;
+  }
+  return true;
+}
+
+#endif // _LICE_SIMD_H_